@@ -0,0 +1,49 @@
+#ifndef BENCH_HARNESS_H
+#define BENCH_HARNESS_H
+
+#include <string>
+#include <vector>
+#include <functional>
+
+// Self-registering benchmarks for make bench, laid out like the tests. A
+// benchmark builds its input, times the variants it compares with
+// fastestMs and prints a line per variant with report. Each runs in a
+// fresh directory of its own; a benchmark that throws is reported as
+// failed and the rest still run.
+struct Benchmark {
+    std::string name;
+    std::function<void()> run;
+};
+
+class BenchRegistry {
+public:
+    static std::vector<Benchmark>& all();
+    static bool add(const std::string& name, const std::function<void()>& run);
+};
+
+namespace bench {
+
+// Repetitions fastestMs takes the best of, unless a benchmark asks for
+// its own number
+const int RUNS = 5;
+
+// Milliseconds of the fastest of runs calls of work; the best run is the
+// one least disturbed by the rest of the machine
+double fastestMs(const std::function<void()>& work, int runs = RUNS);
+
+// One result line: what ran, how long it took and the items per second
+// that makes
+void report(const std::string& label, double ms, double items, const char* unit);
+
+// Folds a result into a checksum printed at the end, so the optimizer
+// cannot drop the work that produced it
+void consume(size_t value);
+
+}
+
+#define BENCHMARK(name) \
+    static void name(); \
+    static const bool name##Registered = BenchRegistry::add(#name, name); \
+    static void name()
+
+#endif
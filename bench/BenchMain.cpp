@@ -0,0 +1,125 @@
+#include "BenchHarness.h"
+#include "TaskScheduler.h"
+#include "Crc32c.h"
+#include "Validation.h"
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <exception>
+#include <sys/stat.h>
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <unistd.h>
+#endif
+
+namespace {
+
+size_t checksum = 0;
+
+bool makeDirectory(const std::string& path) {
+#ifdef _WIN32
+    return _mkdir(path.c_str()) == 0;
+#else
+    return mkdir(path.c_str(), 0755) == 0;
+#endif
+}
+
+bool changeDirectory(const std::string& path) {
+#ifdef _WIN32
+    return _chdir(path.c_str()) == 0;
+#else
+    return chdir(path.c_str()) == 0;
+#endif
+}
+
+bool selected(const std::string& name, int argc, char* argv[]) {
+    if (argc < 2) {
+        return true;
+    }
+    for (int i = 1; i < argc; ++i) {
+        if (name == argv[i]) {
+            return true;
+        }
+    }
+    return false;
+}
+
+}
+
+std::vector<Benchmark>& BenchRegistry::all() {
+    static std::vector<Benchmark> benchmarks;
+    return benchmarks;
+}
+
+bool BenchRegistry::add(const std::string& name, const std::function<void()>& run) {
+    Benchmark benchmark;
+    benchmark.name = name;
+    benchmark.run = run;
+    all().push_back(benchmark);
+    return true;
+}
+
+double bench::fastestMs(const std::function<void()>& work, int runs) {
+    typedef std::chrono::steady_clock Clock;
+    double best = 0;
+    for (int run = 0; run < runs; ++run) {
+        Clock::time_point start = Clock::now();
+        work();
+        double ms = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+        if (run == 0 || ms < best) {
+            best = ms;
+        }
+    }
+    return best;
+}
+
+void bench::report(const std::string& label, double ms, double items, const char* unit) {
+    std::cout << "  " << std::left << std::setw(36) << label << std::right << std::fixed
+              << std::setprecision(2) << std::setw(10) << ms << " ms" << std::setprecision(0)
+              << std::setw(14) << (ms > 0 ? items / ms * 1000.0 : 0.0) << " " << unit << "/s" << std::endl;
+}
+
+void bench::consume(size_t value) {
+    checksum = checksum * 31 + value;
+}
+
+// Runs every benchmark, or the ones named on the command line, from the
+// current directory; make bench starts it in an emptied bench-data
+// directory of the release build
+int main(int argc, char* argv[]) {
+    std::cout << "Workers: " << TaskScheduler::instance().getWorkerCount()
+              << "  Validation: " << Validation::kernelName()
+              << "  CRC-32C: " << Crc32c::kernelName() << std::endl;
+
+    size_t failed = 0;
+    const std::vector<Benchmark>& benchmarks = BenchRegistry::all();
+    for (size_t i = 0; i < benchmarks.size(); ++i) {
+        if (!selected(benchmarks[i].name, argc, argv)) {
+            continue;
+        }
+        std::cout << "\n" << benchmarks[i].name << std::endl;
+
+        std::string error;
+        if (!makeDirectory(benchmarks[i].name) || !changeDirectory(benchmarks[i].name)) {
+            error = "cannot create the directory " + benchmarks[i].name + " (left over from an earlier run?)";
+        } else {
+            try {
+                benchmarks[i].run();
+            } catch (const std::exception& e) {
+                error = e.what();
+            }
+            if (!changeDirectory("..")) {
+                std::cerr << "[FATAL ERROR] cannot leave the directory " << benchmarks[i].name << std::endl;
+                return 2;
+            }
+        }
+        if (!error.empty()) {
+            std::cout << "[FAILED] " << benchmarks[i].name << ": " << error << std::endl;
+            ++failed;
+        }
+    }
+
+    std::cout << "\nChecksum: " << checksum << std::endl;
+    return failed == 0 ? 0 : 1;
+}
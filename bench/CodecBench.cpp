@@ -0,0 +1,194 @@
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include "BenchHarness.h"
+#include "ModelReflection.h"
+
+namespace {
+
+const size_t SUPPLIERS = 20000;
+const int MATERIALS_PER_SUPPLIER = 10;
+
+std::vector<Supplier> randomSuppliers(std::mt19937& random) {
+    const char* types[] = { "Lens", "Blank", "Contact lens", "Filter" };
+    const char* names[] = { "CR39", "Polycarbonate", "Trivex", "Crown glass 1.523" };
+    std::vector<Supplier> suppliers;
+    suppliers.reserve(SUPPLIERS);
+    for (size_t i = 0; i < SUPPLIERS; ++i) {
+        Supplier supplier(std::to_string(100000000 + i), "Optika " + std::to_string(i) + " OOD",
+                          "Sofia, bul. Vitosha " + std::to_string(random() % 200),
+                          "+359 88 " + std::to_string(1000000 + random() % 9000000));
+        for (int m = 0; m < MATERIALS_PER_SUPPLIER; ++m) {
+            supplier.addMaterial(OpticalMaterial(types[random() % 4], 1.0 + random() % 8 * 0.25,
+                                                 -6.0 + random() % 49 * 0.25, names[random() % 4],
+                                                 (100 + random() % 50000) / 100.0));
+        }
+        suppliers.push_back(supplier);
+    }
+    return suppliers;
+}
+
+// The hand-written stream code the codecs replaced, kept as the baseline:
+// operator<< and >> per field, getline for text, ignore after numbers
+void streamWrite(std::ostream& os, const Supplier& supplier) {
+    const CowVector<OpticalMaterial>& materials = supplier.getMaterials();
+    os << supplier.getBulstat() << "\n"
+       << supplier.getName() << "\n"
+       << supplier.getLocation() << "\n"
+       << supplier.getPhoneNumber() << "\n"
+       << materials.size() + 1 << "\n"
+       << supplier.getCatalogVersion() << "\n"
+       << materials.size() << "\n";
+    for (size_t i = 0; i < materials.size(); ++i) {
+        const OpticalMaterial& material = materials[i];
+        os << material.getId() << "\n"
+           << material.getVersion() << "\n"
+           << material.getType() << "\n"
+           << material.getThickness() << "\n"
+           << material.getDiopter() << "\n"
+           << material.getMaterialName() << "\n"
+           << material.getPrice() << "\n";
+    }
+    os << 0 << "\n";
+}
+
+Supplier streamRead(std::istream& is) {
+    std::string bulstat, name, location, phone;
+    std::getline(is, bulstat);
+    std::getline(is, name);
+    std::getline(is, location);
+    std::getline(is, phone);
+    Supplier supplier(bulstat, name, location, phone);
+
+    unsigned int nextMaterialId, catalogVersion;
+    size_t materialCount;
+    is >> nextMaterialId >> catalogVersion >> materialCount;
+    is.ignore();
+    for (size_t i = 0; i < materialCount; ++i) {
+        unsigned int id, version;
+        std::string type, materialName;
+        double thickness, diopter, price;
+        is >> id >> version;
+        is.ignore();
+        std::getline(is, type);
+        is >> thickness >> diopter;
+        is.ignore();
+        std::getline(is, materialName);
+        is >> price;
+        is.ignore();
+        OpticalMaterial material(type, thickness, diopter, materialName, price);
+        material.setId(id);
+        material.setVersion(version);
+        supplier.addMaterial(material);
+    }
+
+    size_t stockCount;
+    is >> stockCount;
+    is.ignore();
+    for (size_t i = 0; i < stockCount; ++i) {
+        unsigned int materialId;
+        int onHand;
+        is >> materialId >> onHand;
+        is.ignore();
+        supplier.setStock(materialId, onHand);
+    }
+    return supplier;
+}
+
+std::string textOf(const std::vector<Supplier>& suppliers) {
+    std::string text;
+    TextWriter writer(text);
+    for (size_t i = 0; i < suppliers.size(); ++i) {
+        writer.write(suppliers[i]);
+    }
+    return text;
+}
+
+void checkSameText(const std::string& expected, const std::vector<Supplier>& suppliers, const char* reader) {
+    if (textOf(suppliers) != expected) {
+        throw std::runtime_error(std::string(reader) + " read back different suppliers");
+    }
+}
+
+}
+
+// 20k suppliers with ten materials each written and read back by the
+// hand-written stream code and by the text and binary codecs, plus the
+// report codec; both text writers must produce the same bytes
+BENCHMARK(codecsVsStreams) {
+    std::mt19937 random(34);
+    std::vector<Supplier> suppliers = randomSuppliers(random);
+    const double items = static_cast<double>(SUPPLIERS);
+
+    std::string streamText;
+    double ms = bench::fastestMs([&]() {
+        std::ostringstream os;
+        for (size_t i = 0; i < suppliers.size(); ++i) {
+            streamWrite(os, suppliers[i]);
+        }
+        streamText = os.str();
+    });
+    bench::report("write, iostream", ms, items, "suppliers");
+
+    std::string text;
+    ms = bench::fastestMs([&]() { text = textOf(suppliers); });
+    bench::report("write, text codec", ms, items, "suppliers");
+    if (text != streamText) {
+        throw std::runtime_error("The text codec and the stream code wrote different files");
+    }
+
+    std::string binary;
+    ms = bench::fastestMs([&]() {
+        binary.clear();
+        BinaryWriter writer(binary);
+        for (size_t i = 0; i < suppliers.size(); ++i) {
+            writer.write(suppliers[i]);
+        }
+    });
+    bench::report("write, binary codec", ms, items, "suppliers");
+
+    std::string report;
+    ms = bench::fastestMs([&]() {
+        report.clear();
+        ReportWriter writer(report);
+        for (size_t i = 0; i < suppliers.size(); ++i) {
+            writer.write(suppliers[i]);
+        }
+    });
+    bench::report("write, report codec", ms, items, "suppliers");
+    bench::consume(report.size());
+
+    std::vector<Supplier> loaded;
+    ms = bench::fastestMs([&]() {
+        loaded.clear();
+        std::istringstream is(text);
+        for (size_t i = 0; i < SUPPLIERS; ++i) {
+            loaded.push_back(streamRead(is));
+        }
+    });
+    bench::report("read, iostream", ms, items, "suppliers");
+    checkSameText(text, loaded, "The stream code");
+
+    ms = bench::fastestMs([&]() {
+        loaded.clear();
+        BufferLines lines(text);
+        TextReader<BufferLines> reader(lines, DATA_FORMAT_VERSION);
+        for (size_t i = 0; i < SUPPLIERS; ++i) {
+            loaded.push_back(Supplier());
+            reader.read(loaded.back());
+        }
+    });
+    bench::report("read, text codec", ms, items, "suppliers");
+    checkSameText(text, loaded, "The text codec");
+
+    ms = bench::fastestMs([&]() {
+        loaded.clear();
+        BinaryReader reader(binary.data(), binary.data() + binary.size());
+        for (size_t i = 0; i < SUPPLIERS; ++i) {
+            loaded.push_back(Supplier());
+            reader.read(loaded.back());
+        }
+    });
+    bench::report("read, binary codec", ms, items, "suppliers");
+    checkSameText(text, loaded, "The binary codec");
+}
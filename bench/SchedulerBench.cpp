@@ -0,0 +1,115 @@
+#include <stdexcept>
+#include "BenchHarness.h"
+#include "TaskScheduler.h"
+#include "Crc32c.h"
+#include "DataStore.h"
+
+namespace {
+
+// A few microseconds of arithmetic the optimizer cannot fold away
+uint64_t spin(uint64_t seed, size_t rounds) {
+    for (size_t i = 0; i < rounds; ++i) {
+        seed = seed * 6364136223846793005ull + 1442695040888963407ull;
+    }
+    return seed;
+}
+
+// 1000 suppliers with 100 orders each, for the render case
+void fillOrders(DataStore& store) {
+    for (size_t i = 0; i < 1000; ++i) {
+        Supplier supplier(std::to_string(100000000 + i), "Optika " + std::to_string(i), "Sofia",
+                          "+359 88 " + std::to_string(1000000 + i));
+        supplier.addMaterial(OpticalMaterial("Lens", 1.5, -2.0, "CR39", 40.0));
+        supplier.addMaterial(OpticalMaterial("Blank", 2.0, 0.0, "Trivex", 30.0));
+        store.addSupplier(supplier);
+    }
+    std::vector<Order> orders;
+    for (size_t i = 0; i < 100000; ++i) {
+        int supplier = static_cast<int>(i % 1000);
+        Order order(store.getSupplier(supplier));
+        order.addItem(store.resolveMaterial(supplier, 0), 1 + static_cast<int>(i % 7));
+        order.addItem(store.resolveMaterial(supplier, 1), 1 + static_cast<int>(i % 5));
+        order.setIdempotencyKey("bench-" + std::to_string(i));
+        orders.push_back(order);
+    }
+    store.addOrders(orders);
+}
+
+}
+
+// The scheduler at the worker count OPTICAL_THREADS sets (make
+// bench-scaling runs it at 1 to 64): 200k tasks too small to be worth
+// one, a 20M-element reduce, checksums of 64 MB in 256 KiB blocks, a
+// graph of 64 chains of 4 dependent tasks, and rendering 100k orders
+BENCHMARK(schedulerScaling) {
+    TaskScheduler& scheduler = TaskScheduler::instance();
+
+    const size_t TINY_TASKS = 200000;
+    std::vector<uint64_t> tiny(TINY_TASKS);
+    double ms = bench::fastestMs([&]() {
+        scheduler.forEach(TINY_TASKS, [&](size_t i) { tiny[i] = spin(i, 4); });
+    });
+    bench::report("200k tiny tasks", ms, TINY_TASKS, "tasks");
+    bench::consume(static_cast<size_t>(tiny[TINY_TASKS - 1]));
+
+    const size_t REDUCED = 20000000;
+    uint64_t sum = 0;
+    ms = bench::fastestMs([&]() {
+        sum = scheduler.parallelReduce(0, REDUCED, 65536, uint64_t(0),
+            [](size_t first, size_t last) {
+                uint64_t partial = 0;
+                for (size_t i = first; i < last; ++i) {
+                    partial += i * i;
+                }
+                return partial;
+            },
+            [](uint64_t a, uint64_t b) { return a + b; });
+    });
+    bench::report("reduce 20M", ms, REDUCED, "elements");
+    // Addition wraps the same way in any order, so every worker count
+    // must match the serial sum
+    uint64_t serial = 0;
+    for (size_t i = 0; i < REDUCED; ++i) {
+        serial += i * i;
+    }
+    if (sum != serial) {
+        throw std::runtime_error("parallelReduce gave a wrong sum");
+    }
+
+    const size_t CRC_BYTES = 64u << 20;
+    std::string data(CRC_BYTES, '\0');
+    for (size_t i = 0; i < CRC_BYTES; i += 8) {
+        data[i] = static_cast<char>(spin(i, 1));
+    }
+    ms = bench::fastestMs([&]() {
+        bench::consume(Crc32c::blocks(data.data(), data.size(), 256u << 10).back());
+    });
+    bench::report("crc 64 MB", ms, CRC_BYTES >> 20, "MB");
+
+    const size_t CHAINS = 64, CHAIN_LENGTH = 4;
+    std::vector<uint64_t> links(CHAINS * CHAIN_LENGTH);
+    ms = bench::fastestMs([&]() {
+        TaskGraph graph;
+        for (size_t chain = 0; chain < CHAINS; ++chain) {
+            TaskGraph::TaskId previous = 0;
+            for (size_t step = 0; step < CHAIN_LENGTH; ++step) {
+                size_t slot = chain * CHAIN_LENGTH + step;
+                TaskGraph::TaskId id = graph.add([&links, slot, step]() {
+                    links[slot] = spin(step ? links[slot - 1] : slot, 200000);
+                });
+                if (step > 0) {
+                    graph.precede(previous, id);
+                }
+                previous = id;
+            }
+        }
+        graph.run(scheduler);
+    }, 3);
+    bench::report("graph 64x4", ms, CHAINS * CHAIN_LENGTH, "tasks");
+    bench::consume(static_cast<size_t>(links.back()));
+
+    DataStore store(4);
+    fillOrders(store);
+    ms = bench::fastestMs([&]() { bench::consume(store.renderOrders().size()); }, 3);
+    bench::report("render 100k orders", ms, store.getOrderCount(), "orders");
+}
@@ -0,0 +1,99 @@
+#include <thread>
+#include <chrono>
+#include <stdexcept>
+#include "BenchHarness.h"
+#include "DataStore.h"
+
+namespace {
+
+const size_t SUPPLIERS = 1000;
+const size_t ORDERS = 200000;
+const int STOCK = 200;
+
+void fillSuppliers(DataStore& store, bool trackStock) {
+    for (size_t i = 0; i < SUPPLIERS; ++i) {
+        Supplier supplier(std::to_string(100000000 + i), "Optika " + std::to_string(i), "Sofia",
+                          "+359 88 " + std::to_string(1000000 + i));
+        supplier.addMaterial(OpticalMaterial("Lens", 1.5, -2.0, "CR39", 40.0));
+        supplier.addMaterial(OpticalMaterial("Lens", 1.6, -1.0, "Trivex", 55.0));
+        supplier.addMaterial(OpticalMaterial("Blank", 2.0, 0.0, "Polycarbonate", 30.0));
+        store.addSupplier(supplier);
+        for (int m = 0; trackStock && m < 3; ++m) {
+            store.setStock(static_cast<int>(i), supplier.getMaterial(m).getId(), STOCK);
+        }
+    }
+}
+
+// Single-line orders spread over every supplier's materials; keys keep
+// orders with equal lines apart
+std::vector<Order> singleLineOrders(const DataStore& store) {
+    std::vector<Order> orders;
+    orders.reserve(ORDERS);
+    for (size_t i = 0; i < ORDERS; ++i) {
+        int supplier = static_cast<int>(i % SUPPLIERS);
+        Order order(store.getSupplier(supplier));
+        order.addItem(store.resolveMaterial(supplier, static_cast<int>(i / SUPPLIERS % 3)), 1);
+        order.setIdempotencyKey("bench-" + std::to_string(i));
+        orders.push_back(order);
+    }
+    return orders;
+}
+
+// Milliseconds for threadCount threads to place the orders, each taking
+// every threadCount-th one with DataStore::addOrder
+double placeOrders(size_t shardCount, int threadCount, bool trackStock) {
+    DataStore store(shardCount);
+    fillSuppliers(store, trackStock);
+    std::vector<Order> orders = singleLineOrders(store);
+
+    typedef std::chrono::steady_clock Clock;
+    Clock::time_point start = Clock::now();
+    std::vector<std::thread> threads;
+    for (int t = 0; t < threadCount; ++t) {
+        threads.push_back(std::thread([&, t]() {
+            for (size_t i = t; i < orders.size(); i += threadCount) {
+                store.addOrder(orders[i]);
+            }
+        }));
+    }
+    for (size_t t = 0; t < threads.size(); ++t) {
+        threads[t].join();
+    }
+    double ms = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+    if (store.getOrderCount() != static_cast<int>(ORDERS)) {
+        throw std::runtime_error("Not every order was placed");
+    }
+    return ms;
+}
+
+// fastestMs would time building the store too; only placing is timed
+double fastestPlacement(size_t shardCount, int threadCount, bool trackStock) {
+    double best = 0;
+    for (int run = 0; run < 3; ++run) {
+        double ms = placeOrders(shardCount, threadCount, trackStock);
+        best = run == 0 || ms < best ? ms : best;
+    }
+    return best;
+}
+
+std::string label(size_t shardCount, int threadCount) {
+    return std::to_string(shardCount) + (shardCount == 1 ? " shard, " : " shards, ") +
+           std::to_string(threadCount) + (threadCount == 1 ? " thread" : " threads");
+}
+
+}
+
+// 200k single-line orders placed from 1 or 8 threads into stores of 1 or
+// 8 shards, 1000 suppliers with three materials at 200 units each; the
+// first line is the same work with no stock tracked
+BENCHMARK(orderContention) {
+    bench::report(label(1, 1) + ", untracked", fastestPlacement(1, 1, false), ORDERS, "orders");
+    const size_t shardCounts[] = { 1, 8 };
+    const int threadCounts[] = { 1, 8 };
+    for (size_t s = 0; s < 2; ++s) {
+        for (size_t t = 0; t < 2; ++t) {
+            bench::report(label(shardCounts[s], threadCounts[t]), fastestPlacement(shardCounts[s], threadCounts[t], true),
+                          ORDERS, "orders");
+        }
+    }
+}
@@ -0,0 +1,78 @@
+#include <random>
+#include "BenchHarness.h"
+#include "Validation.h"
+
+namespace {
+
+// Values shaped like supplier records: mostly valid, some mistyped
+std::vector<std::string> bulstats(std::mt19937& random, size_t count) {
+    std::vector<std::string> values(count);
+    for (size_t i = 0; i < count; ++i) {
+        size_t length = random() % 4 ? 9 : 13;
+        for (size_t c = 0; c < length; ++c) {
+            values[i] += static_cast<char>('0' + random() % 10);
+        }
+        if (random() % 20 == 0) {
+            values[i][random() % length] = 'O';
+        }
+    }
+    return values;
+}
+
+std::vector<std::string> phoneNumbers(std::mt19937& random, size_t count) {
+    const char* formats[] = { "+359 88 ### ####", "(02) ###-####", "08########", "+1.###.###.####" };
+    std::vector<std::string> values(count);
+    for (size_t i = 0; i < count; ++i) {
+        values[i] = formats[random() % 4];
+        for (size_t c = 0; c < values[i].size(); ++c) {
+            if (values[i][c] == '#') {
+                values[i][c] = static_cast<char>('0' + random() % 10);
+            }
+        }
+        if (random() % 20 == 0) {
+            values[i][random() % values[i].size()] = 'x';
+        }
+    }
+    return values;
+}
+
+size_t errorCount(const std::vector<const char*>& errors) {
+    size_t count = 0;
+    for (size_t i = 0; i < errors.size(); ++i) {
+        count += errors[i] != 0;
+    }
+    return count;
+}
+
+}
+
+// The one-at-a-time checks against the batch checks with each kernel
+// this CPU runs, on the same 200k BULSTATs and phone numbers
+BENCHMARK(validationScalarVsBatch) {
+    const size_t COUNT = 200000;
+    std::mt19937 random(30);
+    std::vector<std::string> bulstatValues = bulstats(random, COUNT);
+    std::vector<std::string> phoneValues = phoneNumbers(random, COUNT);
+
+    double ms = bench::fastestMs([&]() {
+        size_t errors = 0;
+        for (size_t i = 0; i < COUNT; ++i) {
+            errors += Validation::checkBulstat(bulstatValues[i]) != 0;
+            errors += Validation::checkPhoneNumber(phoneValues[i]) != 0;
+        }
+        bench::consume(errors);
+    });
+    bench::report("one at a time", ms, 2.0 * COUNT, "values");
+
+    const ValidationKernel kernels[] = { VALIDATION_SCALAR, VALIDATION_SSE42, VALIDATION_AVX2 };
+    for (size_t k = 0; k < sizeof(kernels) / sizeof(kernels[0]); ++k) {
+        if (!Validation::hasKernel(kernels[k])) {
+            continue;
+        }
+        ms = bench::fastestMs([&]() {
+            bench::consume(errorCount(Validation::checkBulstats(bulstatValues, kernels[k])));
+            bench::consume(errorCount(Validation::checkPhoneNumbers(phoneValues, kernels[k])));
+        });
+        bench::report(std::string("batch, ") + Validation::kernelName(kernels[k]), ms, 2.0 * COUNT, "values");
+    }
+}
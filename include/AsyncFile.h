@@ -0,0 +1,103 @@
+#ifndef ASYNC_FILE_H
+#define ASYNC_FILE_H
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <cstddef>
+
+// Build with -DOPTICAL_IO_URING=1 (make IO_URING=1, the default on Linux)
+// to issue chunk reads and writes through io_uring. Without it, or when
+// the kernel refuses io_uring, a worker thread does blocking I/O instead.
+#ifndef OPTICAL_IO_URING
+#define OPTICAL_IO_URING 0
+#endif
+
+class IoEngine;
+
+// Reads a whole file on a worker thread, CHUNK_SIZE bytes at a time with
+// QUEUE_DEPTH chunks in flight, into one contiguous buffer. Callers parse
+// the prefix that has arrived while the rest is still being read.
+class AsyncFileReader {
+private:
+    std::string path;
+    std::string buffer;
+    size_t available;
+    bool stopping;
+    std::string error;
+    std::unique_ptr<IoEngine> engine;
+    std::mutex mutex;
+    std::condition_variable progress;
+    std::thread worker;
+
+    void run();
+
+public:
+    static const size_t CHUNK_SIZE = 1 << 20;
+    static const size_t QUEUE_DEPTH = 2;
+
+    explicit AsyncFileReader(const std::string& path);
+    ~AsyncFileReader();
+
+    const char* data() const;
+    size_t size() const;
+    // Blocks until the first min(bytes, size()) bytes are in data();
+    // throws if reading failed
+    size_t waitFor(size_t bytes);
+};
+
+// Writes a file on a worker thread while the caller produces the next
+// chunk. At most QUEUE_DEPTH chunks are pending at once, so memory stays
+// bounded however large the file is.
+class AsyncFileWriter {
+private:
+    struct Job {
+        std::string bytes;
+        size_t offset;
+        // Submitted only once every earlier job is complete, and before
+        // any later one, since io_uring does not order requests
+        bool barrier;
+    };
+
+    std::string path;
+    std::deque<Job> pending;
+    std::vector<std::string> spare;
+    size_t outstanding;
+    size_t endOffset;
+    bool closing;
+    std::string error;
+    std::unique_ptr<IoEngine> engine;
+    std::mutex mutex;
+    std::condition_variable workAvailable;
+    std::condition_variable spaceAvailable;
+    std::thread worker;
+
+    void queue(Job& job);
+    void run();
+
+public:
+    static const size_t QUEUE_DEPTH = 2;
+
+    // Creates or truncates path
+    explicit AsyncFileWriter(const std::string& path);
+    ~AsyncFileWriter();
+
+    // Queues chunk at the end of the file and leaves an empty recycled
+    // buffer in its place
+    void append(std::string& chunk);
+    // Overwrites bytes already appended, e.g. to fill in a length field;
+    // the write waits for the appends before it to land
+    void writeAt(size_t offset, const std::string& bytes);
+    size_t size() const;
+    // Waits until every queued write is done; throws if any failed
+    void finish();
+};
+
+// "io_uring" when chunk I/O goes through io_uring, otherwise "threads"
+const char* asyncFileBackend();
+
+#endif
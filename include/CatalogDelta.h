@@ -0,0 +1,60 @@
+#ifndef CATALOG_DELTA_H
+#define CATALOG_DELTA_H
+
+#include <string>
+#include <vector>
+#include <iostream>
+#include "OpticalMaterial.h"
+
+// One row of a price-list change, keyed by the supplier's material id
+struct MaterialChange {
+    enum Kind { ADD_MATERIAL, UPDATE_PRICE, REMOVE_MATERIAL };
+
+    Kind kind;
+    unsigned int materialId;    // 0 on ADD_MATERIAL assigns the next free id
+    double price;               // UPDATE_PRICE only
+    OpticalMaterial material;   // ADD_MATERIAL only
+
+    MaterialChange() : kind(UPDATE_PRICE), materialId(0), price(0.0) {}
+};
+
+// Changes to one supplier's materials on top of catalog version baseVersion
+struct CatalogDelta {
+    std::string supplierBulstat;
+    unsigned int baseVersion;
+    std::vector<MaterialChange> changes;
+
+    CatalogDelta() : baseVersion(0) {}
+};
+
+// Append-only journal of applied deltas (catalog.log). A full save makes
+// it redundant; on load, records newer than suppliers.dat are replayed.
+// Each record is framed as "J <length> <crc32c>" so a torn or corrupted
+// tail is detected and cut off instead of being half-applied.
+class CatalogChangeLog {
+private:
+    std::string path;
+
+    static void appendRecord(std::string& out, const CatalogDelta& delta);
+
+public:
+    explicit CatalogChangeLog(const std::string& path = "catalog.log");
+
+    void append(const CatalogDelta& delta) const;
+    // Returns the records up to the first damaged one, e.g. one cut short
+    // by a crash, and rewrites the journal without the damaged tail
+    std::vector<CatalogDelta> recover() const;
+    void truncate() const;
+
+    static void writeDelta(std::ostream& os, const CatalogDelta& delta);
+    static bool readDelta(std::istream& is, int formatVersion, CatalogDelta& delta);
+
+    // Price-list update file, one change per line:
+    //   bulstat,price,materialId,newPrice
+    //   bulstat,remove,materialId
+    //   bulstat,add,type,thickness,diopter,materialName,price
+    // Rows are grouped into one delta per supplier, in file order.
+    static std::vector<CatalogDelta> parseCsv(std::istream& is, std::vector<std::string>& errors);
+};
+
+#endif
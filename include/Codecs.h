@@ -0,0 +1,398 @@
+#ifndef CODECS_H
+#define CODECS_H
+
+#include <string>
+#include <memory>
+#include <cstring>
+#include <cstdint>
+#include <iostream>
+#include <stdexcept>
+#include "Reflect.h"
+#include "DataFormat.h"
+
+class OpticalMaterial;
+class MaterialCatalog;
+
+// Non-template helpers shared by the codecs (Codecs.cpp)
+namespace codec {
+
+void appendUnsigned(std::string& out, unsigned long long value);
+void appendSigned(std::string& out, long long value);
+// The shortest of 15 or 17 significant digits that reads back exactly
+void appendDouble(std::string& out, double value);
+
+unsigned long long parseUnsigned(const char* begin, const char* end);
+long long parseSigned(const char* begin, const char* end);
+double parseDouble(const char* begin, const char* end);
+
+std::shared_ptr<const OpticalMaterial> resolve(const MaterialCatalog* catalog, const std::string& owner,
+                                               unsigned int id, unsigned int version);
+
+// State every writer shares; writers never resolve catalog references
+class WriterBase {
+public:
+    static const bool LOADING = false;
+
+    int version() const { return DATA_FORMAT_VERSION; }
+    void setCatalogOwner(const std::string&) {}
+    std::shared_ptr<const OpticalMaterial> resolve(unsigned int, unsigned int) const {
+        return std::shared_ptr<const OpticalMaterial>();
+    }
+};
+
+// State every reader shares: the layout version being read and the
+// catalog that order lines point into
+class ReaderBase {
+private:
+    int formatVersion;
+    const MaterialCatalog* catalog;
+    std::string catalogOwner;
+
+public:
+    static const bool LOADING = true;
+
+    ReaderBase(int formatVersion, const MaterialCatalog* catalog)
+        : formatVersion(formatVersion), catalog(catalog) {}
+
+    int version() const { return formatVersion; }
+    void setCatalogOwner(const std::string& bulstat) { catalogOwner = bulstat; }
+    std::shared_ptr<const OpticalMaterial> resolve(unsigned int id, unsigned int version) const {
+        return codec::resolve(catalog, catalogOwner, id, version);
+    }
+};
+
+}
+
+// Takes the text a TextWriter has produced so far once it grows past
+// threshold(), so a large file is written out while it is serialized
+class TextSink {
+public:
+    virtual ~TextSink() {}
+    virtual size_t threshold() const = 0;
+    // Consumes a prefix of text and leaves the rest in place
+    virtual void drain(std::string& text) = 0;
+};
+
+// Line-per-field text, the layout of suppliers.dat and orders.dat
+class TextWriter : public codec::WriterBase {
+private:
+    std::string& out;
+    TextSink* sink;
+    size_t drainAt;
+
+public:
+    explicit TextWriter(std::string& out, TextSink* sink = 0)
+        : out(out), sink(sink), drainAt(sink ? sink->threshold() : 0) {}
+
+    void field(const char*, const std::string& value) { out += value; out += '\n'; }
+    void field(const char*, unsigned int value) { codec::appendUnsigned(out, value); out += '\n'; }
+    void field(const char*, int value) { codec::appendSigned(out, value); out += '\n'; }
+    void field(const char*, double value) { codec::appendDouble(out, value); out += '\n'; }
+
+    template <typename T>
+    void object(const char*, T& value) {
+        Reflect<T>::visit(value, *this);
+    }
+
+    template <typename Sequence>
+    void sequence(const char*, Sequence& items) {
+        typedef typename Sequence::value_type Element;
+        codec::appendUnsigned(out, items.size());
+        out += '\n';
+        for (const auto& item : items) {
+            Reflect<Element>::visit(const_cast<Element&>(item), *this);
+            if (sink && out.size() >= drainAt) {
+                sink->drain(out);
+            }
+        }
+    }
+
+    template <typename T>
+    void write(const T& value) {
+        Reflect<T>::visit(const_cast<T&>(value), *this);
+    }
+};
+
+// Lines of an in-memory buffer; the buffer must outlive the reader and be
+// NUL-terminated, as std::string data is
+class BufferLines {
+private:
+    const char* position;
+    const char* end;
+
+public:
+    BufferLines(const char* begin, const char* end) : position(begin), end(end) {}
+    explicit BufferLines(const std::string& text)
+        : position(text.c_str()), end(text.c_str() + text.size()) {}
+
+    bool next(const char*& lineBegin, const char*& lineEnd) {
+        if (position >= end) {
+            return false;
+        }
+        const char* newline = static_cast<const char*>(std::memchr(position, '\n', end - position));
+        lineBegin = position;
+        lineEnd = newline ? newline : end;
+        position = newline ? newline + 1 : end;
+        return true;
+    }
+
+    const char* remaining() const { return position; }
+};
+
+// Lines pulled from a stream one at a time, for callers that hold an istream
+class StreamLines {
+private:
+    std::istream& is;
+    std::string line;
+
+public:
+    explicit StreamLines(std::istream& is) : is(is) {}
+
+    bool next(const char*& lineBegin, const char*& lineEnd) {
+        if (!std::getline(is, line)) {
+            return false;
+        }
+        lineBegin = line.c_str();
+        lineEnd = lineBegin + line.size();
+        return true;
+    }
+};
+
+template <typename Source>
+class TextReader : public codec::ReaderBase {
+private:
+    Source& source;
+    const char* lineBegin;
+    const char* lineEnd;
+
+    void nextLine() {
+        if (!source.next(lineBegin, lineEnd)) {
+            throw std::runtime_error("Unexpected end of data");
+        }
+    }
+
+public:
+    TextReader(Source& source, int formatVersion, const MaterialCatalog* catalog = 0)
+        : codec::ReaderBase(formatVersion, catalog), source(source), lineBegin(0), lineEnd(0) {}
+
+    void field(const char*, std::string& value) { nextLine(); value.assign(lineBegin, lineEnd); }
+    void field(const char*, unsigned int& value) {
+        nextLine();
+        value = static_cast<unsigned int>(codec::parseUnsigned(lineBegin, lineEnd));
+    }
+    void field(const char*, int& value) {
+        nextLine();
+        value = static_cast<int>(codec::parseSigned(lineBegin, lineEnd));
+    }
+    void field(const char*, double& value) { nextLine(); value = codec::parseDouble(lineBegin, lineEnd); }
+
+    size_t count() {
+        nextLine();
+        return static_cast<size_t>(codec::parseUnsigned(lineBegin, lineEnd));
+    }
+
+    template <typename T>
+    void object(const char*, T& value) {
+        Reflect<T>::visit(value, *this);
+    }
+
+    template <typename Sequence>
+    void sequence(const char*, Sequence& items) {
+        typedef typename Sequence::value_type Element;
+        size_t itemCount = count();
+        items.clear();
+        for (size_t i = 0; i < itemCount; ++i) {
+            Element item;
+            Reflect<Element>::visit(item, *this);
+            items.push_back(item);
+        }
+    }
+
+    template <typename T>
+    void read(T& value) {
+        Reflect<T>::visit(value, *this);
+    }
+};
+
+// Compact little-endian binary: fixed-width numbers, length-prefixed strings
+class BinaryWriter : public codec::WriterBase {
+private:
+    std::string& out;
+
+    void putU32(uint32_t value) {
+        char bytes[4] = { static_cast<char>(value), static_cast<char>(value >> 8),
+                          static_cast<char>(value >> 16), static_cast<char>(value >> 24) };
+        out.append(bytes, 4);
+    }
+
+    void putU64(uint64_t value) {
+        putU32(static_cast<uint32_t>(value));
+        putU32(static_cast<uint32_t>(value >> 32));
+    }
+
+public:
+    explicit BinaryWriter(std::string& out) : out(out) {}
+
+    void field(const char*, const std::string& value) {
+        putU32(static_cast<uint32_t>(value.size()));
+        out.append(value);
+    }
+    void field(const char*, unsigned int value) { putU32(value); }
+    void field(const char*, int value) { putU32(static_cast<uint32_t>(value)); }
+    void field(const char*, double value) {
+        uint64_t bits;
+        std::memcpy(&bits, &value, sizeof(bits));
+        putU64(bits);
+    }
+
+    template <typename T>
+    void object(const char*, T& value) {
+        Reflect<T>::visit(value, *this);
+    }
+
+    template <typename Sequence>
+    void sequence(const char*, Sequence& items) {
+        typedef typename Sequence::value_type Element;
+        putU32(static_cast<uint32_t>(items.size()));
+        for (const auto& item : items) {
+            Reflect<Element>::visit(const_cast<Element&>(item), *this);
+        }
+    }
+
+    template <typename T>
+    void write(const T& value) {
+        Reflect<T>::visit(const_cast<T&>(value), *this);
+    }
+};
+
+class BinaryReader : public codec::ReaderBase {
+private:
+    const unsigned char* position;
+    const unsigned char* end;
+
+    void require(size_t bytes) const {
+        if (static_cast<size_t>(end - position) < bytes) {
+            throw std::runtime_error("Truncated binary record");
+        }
+    }
+
+    uint32_t getU32() {
+        require(4);
+        uint32_t value = static_cast<uint32_t>(position[0]) |
+                         static_cast<uint32_t>(position[1]) << 8 |
+                         static_cast<uint32_t>(position[2]) << 16 |
+                         static_cast<uint32_t>(position[3]) << 24;
+        position += 4;
+        return value;
+    }
+
+    uint64_t getU64() {
+        uint64_t low = getU32();
+        return low | static_cast<uint64_t>(getU32()) << 32;
+    }
+
+public:
+    BinaryReader(const char* begin, const char* end, const MaterialCatalog* catalog = 0)
+        : codec::ReaderBase(DATA_FORMAT_VERSION, catalog),
+          position(reinterpret_cast<const unsigned char*>(begin)),
+          end(reinterpret_cast<const unsigned char*>(end)) {}
+
+    void field(const char*, std::string& value) {
+        uint32_t length = getU32();
+        require(length);
+        value.assign(reinterpret_cast<const char*>(position), length);
+        position += length;
+    }
+    void field(const char*, unsigned int& value) { value = getU32(); }
+    void field(const char*, int& value) { value = static_cast<int>(getU32()); }
+    void field(const char*, double& value) {
+        uint64_t bits = getU64();
+        std::memcpy(&value, &bits, sizeof(value));
+    }
+
+    template <typename T>
+    void object(const char*, T& value) {
+        Reflect<T>::visit(value, *this);
+    }
+
+    template <typename Sequence>
+    void sequence(const char*, Sequence& items) {
+        typedef typename Sequence::value_type Element;
+        uint32_t itemCount = getU32();
+        items.clear();
+        for (uint32_t i = 0; i < itemCount; ++i) {
+            Element item;
+            Reflect<Element>::visit(item, *this);
+            items.push_back(item);
+        }
+    }
+
+    template <typename T>
+    void read(T& value) {
+        Reflect<T>::visit(value, *this);
+    }
+
+    bool atEnd() const { return position == end; }
+};
+
+// Indented "Label: value" listing of every field, for dumps and debugging
+class ReportWriter : public codec::WriterBase {
+private:
+    std::string& out;
+    int depth;
+
+    void label(const char* name) {
+        out.append(static_cast<size_t>(depth) * 2, ' ');
+        out += name;
+        out += ": ";
+    }
+
+public:
+    explicit ReportWriter(std::string& out) : out(out), depth(0) {}
+
+    void field(const char* name, const std::string& value) { label(name); out += value; out += '\n'; }
+    void field(const char* name, unsigned int value) {
+        label(name);
+        codec::appendUnsigned(out, value);
+        out += '\n';
+    }
+    void field(const char* name, int value) { label(name); codec::appendSigned(out, value); out += '\n'; }
+    void field(const char* name, double value) { label(name); codec::appendDouble(out, value); out += '\n'; }
+
+    template <typename T>
+    void object(const char* name, T& value) {
+        out.append(static_cast<size_t>(depth) * 2, ' ');
+        out += name;
+        out += '\n';
+        ++depth;
+        Reflect<T>::visit(value, *this);
+        --depth;
+    }
+
+    template <typename Sequence>
+    void sequence(const char* name, Sequence& items) {
+        typedef typename Sequence::value_type Element;
+        label(name);
+        codec::appendUnsigned(out, items.size());
+        out += '\n';
+        ++depth;
+        size_t number = 0;
+        for (const auto& item : items) {
+            out.append(static_cast<size_t>(depth) * 2, ' ');
+            out += '[';
+            codec::appendUnsigned(out, ++number);
+            out += "]\n";
+            ++depth;
+            Reflect<Element>::visit(const_cast<Element&>(item), *this);
+            --depth;
+        }
+        --depth;
+    }
+
+    template <typename T>
+    void write(const T& value) {
+        Reflect<T>::visit(const_cast<T&>(value), *this);
+    }
+};
+
+#endif
@@ -0,0 +1,175 @@
+#ifndef COMPACT_TEXT_H
+#define COMPACT_TEXT_H
+
+#include <string>
+#include <cstddef>
+#include <cstdint>
+#include "MemoryUsage.h"
+
+// Small stand-ins for std::string and double in records that exist by
+// the hundred thousand. Each converts at its owner's getters and setters
+// (str()/value() and assign()), so the files and the public interfaces
+// still see plain strings and doubles.
+
+// Process-wide table of interned strings. Each distinct text is stored
+// once and named by a 32-bit id; entries are never freed, so references
+// from get() stay valid for the life of the process. Meant for values
+// that repeat across many records, not for unique ones.
+class StringPool {
+public:
+    typedef uint32_t Id;
+
+    static const size_t MAX_SIZE = 1 << 24;
+
+    // Id of text, adding it on first use; throws std::length_error once
+    // MAX_SIZE strings are pooled. The empty string is id 0.
+    static Id intern(const std::string& text);
+    static const std::string& get(Id id);
+    static size_t size();
+    static MemoryFootprint memoryUsage();
+};
+
+// A repeated string (a material type or name, a supplier's location)
+// kept as its StringPool id
+class PooledString {
+private:
+    StringPool::Id id;
+
+public:
+    PooledString() : id(0) {}
+    explicit PooledString(const std::string& text) : id(StringPool::intern(text)) {}
+
+    const std::string& str() const { return StringPool::get(id); }
+    void assign(const std::string& text) { id = StringPool::intern(text); }
+};
+
+// Text made of digits and phone punctuation (a BULSTAT, a phone number),
+// four bits per character over "0123456789+-() .". The last byte holds
+// the length, so Words 64-bit words fit Words * 16 - 2 characters. Longer
+// text or text with other characters (possible only in unvalidated data)
+// is pooled instead.
+template <size_t Words>
+class PackedDigits {
+private:
+    static const size_t CAPACITY = Words * 16 - 2;
+    static const unsigned POOLED = 0xFF;
+
+    uint64_t words[Words];
+
+    static int codeOf(char c) {
+        if (c >= '0' && c <= '9') {
+            return c - '0';
+        }
+        switch (c) {
+            case '+': return 10;
+            case '-': return 11;
+            case '(': return 12;
+            case ')': return 13;
+            case ' ': return 14;
+            case '.': return 15;
+            default: return -1;
+        }
+    }
+
+    unsigned length() const {
+        return static_cast<unsigned>(words[Words - 1] >> 56);
+    }
+
+public:
+    PackedDigits() {
+        for (size_t w = 0; w < Words; ++w) {
+            words[w] = 0;
+        }
+    }
+    explicit PackedDigits(const std::string& text) {
+        assign(text);
+    }
+
+    std::string str() const {
+        static const char SYMBOLS[] = "0123456789+-() .";
+        if (length() == POOLED) {
+            return StringPool::get(static_cast<StringPool::Id>(words[0]));
+        }
+        std::string text(length(), '0');
+        for (size_t i = 0; i < text.size(); ++i) {
+            text[i] = SYMBOLS[(words[i / 16] >> (i % 16 * 4)) & 0xF];
+        }
+        return text;
+    }
+
+    void assign(const std::string& text) {
+        uint64_t packed[Words] = {};
+        bool fits = text.size() <= CAPACITY;
+        for (size_t i = 0; fits && i < text.size(); ++i) {
+            int code = codeOf(text[i]);
+            fits = code >= 0;
+            packed[i / 16] |= static_cast<uint64_t>(code < 0 ? 0 : code) << (i % 16 * 4);
+        }
+        if (!fits) {
+            for (size_t w = 0; w < Words; ++w) {
+                packed[w] = 0;
+            }
+            packed[0] = StringPool::intern(text);
+        }
+        packed[Words - 1] |= static_cast<uint64_t>(fits ? text.size() : POOLED) << 56;
+        for (size_t w = 0; w < Words; ++w) {
+            words[w] = packed[w];
+        }
+    }
+};
+
+// Unique text with small-string storage in 16 bytes instead of
+// std::string's 32: up to 15 characters inline, longer text in a heap
+// block of exactly its size
+class CompactString {
+private:
+    static const size_t INLINE_CAPACITY = 15;
+    static const unsigned char ON_HEAP = 0xFF;
+
+    // Inline: the characters, length in the last byte. On the heap: the
+    // pointer, the 32-bit length, ON_HEAP in the last byte.
+    char bytes[16];
+
+    bool onHeap() const { return static_cast<unsigned char>(bytes[15]) == ON_HEAP; }
+    const char* heapData() const;
+    uint32_t heapLength() const;
+    void release();
+    // Moves other's text here and leaves other empty
+    void takeFrom(CompactString& other);
+    void copyFrom(const char* data, size_t length);
+
+public:
+    CompactString();
+    explicit CompactString(const std::string& text);
+    CompactString(const CompactString& other);
+    CompactString& operator=(const CompactString& other);
+    ~CompactString();
+
+    std::string str() const;
+    void assign(const std::string& text);
+    // Heap bytes beyond the object; 0 while inline
+    size_t heapBytes() const;
+};
+
+// A decimal kept as a 32-bit count of ten-thousandths. Values with up to
+// four decimals come back as exactly the double they were given (1.1
+// stays 1.1, where a float would give 1.10000002); others are rounded to
+// the nearest ten-thousandth.
+class FixedDecimal {
+private:
+    int32_t units;
+
+public:
+    static const double SCALE;
+    // Largest magnitude that fits
+    static const double LIMIT;
+
+    FixedDecimal() : units(0) {}
+    explicit FixedDecimal(double value) : units(0) { assign(value); }
+
+    double value() const { return units / SCALE; }
+    // Throws std::out_of_range beyond LIMIT (or for NaN)
+    void assign(double value);
+};
+
+#endif
@@ -0,0 +1,159 @@
+#ifndef COW_VECTOR_H
+#define COW_VECTOR_H
+
+#include <vector>
+#include <memory>
+#include <stdexcept>
+#include <cstddef>
+#include <iterator>
+#include "MemoryUsage.h"
+
+// Persistent vector built from fixed-size chunks shared between copies.
+// Copying a CowVector is O(1); a mutation clones only the chunk spine and
+// the chunk it touches when they are still shared with another copy, so a
+// snapshot stays frozen while the original keeps changing.
+template <typename T>
+class CowVector {
+private:
+    static const size_t CHUNK_SIZE = 32;
+
+    typedef std::vector<T> Chunk;
+    typedef std::vector<std::shared_ptr<Chunk> > Spine;
+
+    std::shared_ptr<Spine> spine;
+    size_t count;
+
+    void detachSpine() {
+        if (!spine) {
+            spine = std::make_shared<Spine>();
+        } else if (spine.use_count() != 1) {
+            spine = std::make_shared<Spine>(*spine);
+        }
+    }
+
+    Chunk& detachChunk(size_t chunkIndex) {
+        std::shared_ptr<Chunk>& chunk = (*spine)[chunkIndex];
+        if (chunk.use_count() != 1) {
+            chunk = std::make_shared<Chunk>(*chunk);
+        }
+        return *chunk;
+    }
+
+    void checkIndex(size_t index) const {
+        if (index >= count) {
+            throw std::out_of_range("CowVector index out of range");
+        }
+    }
+
+public:
+    typedef T value_type;
+
+    class const_iterator {
+    private:
+        const CowVector* owner;
+        size_t index;
+
+    public:
+        typedef std::forward_iterator_tag iterator_category;
+        typedef T value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef const T* pointer;
+        typedef const T& reference;
+
+        const_iterator(const CowVector* owner, size_t index) : owner(owner), index(index) {}
+
+        reference operator*() const { return (*owner)[index]; }
+        pointer operator->() const { return &(*owner)[index]; }
+        const_iterator& operator++() { ++index; return *this; }
+        const_iterator operator++(int) { const_iterator tmp(*this); ++index; return tmp; }
+        bool operator==(const const_iterator& other) const { return index == other.index; }
+        bool operator!=(const const_iterator& other) const { return index != other.index; }
+    };
+
+    CowVector() : count(0) {}
+
+    size_t size() const { return count; }
+    bool empty() const { return count == 0; }
+
+    const T& operator[](size_t index) const {
+        return (*(*spine)[index / CHUNK_SIZE])[index % CHUNK_SIZE];
+    }
+
+    const T& at(size_t index) const {
+        checkIndex(index);
+        return (*this)[index];
+    }
+
+    const T& back() const {
+        checkIndex(count - 1);
+        return (*this)[count - 1];
+    }
+
+    // Mutable access detaches the touched chunk from any snapshot first.
+    T& mutableAt(size_t index) {
+        checkIndex(index);
+        detachSpine();
+        return detachChunk(index / CHUNK_SIZE)[index % CHUNK_SIZE];
+    }
+
+    void set(size_t index, const T& value) {
+        mutableAt(index) = value;
+    }
+
+    void push_back(const T& value) {
+        detachSpine();
+        if (count % CHUNK_SIZE == 0) {
+            std::shared_ptr<Chunk> chunk = std::make_shared<Chunk>();
+            // The first chunk grows as needed, so the many short vectors
+            // (a supplier's materials) do not each hold a full chunk
+            if (count != 0) {
+                chunk->reserve(CHUNK_SIZE);
+            }
+            spine->push_back(chunk);
+        }
+        detachChunk(spine->size() - 1).push_back(value);
+        ++count;
+    }
+
+    void pop_back() {
+        checkIndex(count - 1);
+        detachSpine();
+        Chunk& last = detachChunk(spine->size() - 1);
+        last.pop_back();
+        if (last.empty()) {
+            spine->pop_back();
+        }
+        --count;
+    }
+
+    void erase(size_t index) {
+        checkIndex(index);
+        for (size_t i = index; i + 1 < count; ++i) {
+            set(i, (*this)[i + 1]);
+        }
+        pop_back();
+    }
+
+    void clear() {
+        spine.reset();
+        count = 0;
+    }
+
+    // Heap bytes of the spine and chunks, not counting what the elements
+    // own themselves. Chunks shared with a snapshot count in both.
+    size_t memoryBytes() const {
+        if (!spine) {
+            return 0;
+        }
+        size_t bytes = memory::sharedBytes(sizeof(Spine)) + memory::vectorBytes(*spine);
+        for (size_t i = 0; i < spine->size(); ++i) {
+            bytes += memory::sharedBytes(sizeof(Chunk)) + memory::vectorBytes(*(*spine)[i]);
+        }
+        return bytes;
+    }
+
+    const_iterator begin() const { return const_iterator(this, 0); }
+    const_iterator end() const { return const_iterator(this, count); }
+};
+
+#endif
@@ -0,0 +1,24 @@
+#ifndef CRC32C_H
+#define CRC32C_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// CRC-32C (Castagnoli), the checksum behind the persisted data files.
+// Uses the SSE4.2 crc32 instruction when the CPU has it, checked once at
+// runtime, and a slicing-by-8 table otherwise; both give identical values.
+class Crc32c {
+public:
+    static uint32_t compute(const void* data, size_t length);
+    // Continues a checksum over the next bytes of the same stream
+    static uint32_t extend(uint32_t crc, const void* data, size_t length);
+
+    // Checksums of consecutive blockSize slices (the last may be shorter),
+    // computed in parallel on the shared TaskScheduler
+    static std::vector<uint32_t> blocks(const char* data, size_t length, size_t blockSize);
+
+    static const char* kernelName();
+};
+
+#endif
@@ -0,0 +1,113 @@
+#ifndef DATA_FILE_H
+#define DATA_FILE_H
+
+#include <string>
+#include <vector>
+#include <stdexcept>
+#include <cstddef>
+#include <cstdint>
+#include "AsyncFile.h"
+#include "Codecs.h"
+
+// A data file failed verification: truncated, checksum mismatch or
+// unparseable. Loading falls back to the previous save when it sees one.
+class DataIntegrityError : public std::runtime_error {
+public:
+    explicit DataIntegrityError(const std::string& message) : std::runtime_error(message) {}
+};
+
+// Checksummed, atomically replaced data files. From format 4 on a file is
+//
+//   OPTICAL-DATA <version>
+//   #PAYLOAD <bytes> <blockSize>
+//   <payload>
+//   <CRC-32C of each payload block, 8 hex digits per line>
+//   #END
+//
+// The payload stays plain text and contiguous, so it is parsed in place
+// as its blocks arrive from disk, each one verified before it is parsed.
+// <bytes> is zero-padded to a fixed width so a writer can stream the
+// payload and fill it in at the end. Older files have no checksums and
+// are read as they are.
+class DataFile {
+public:
+    static const size_t BLOCK_SIZE = 1 << 20;
+
+    static bool exists(const std::string& path);
+    static std::string backupPath(const std::string& path);
+
+    // Replaces path via a temporary file and rename, keeping the file it
+    // replaces as path.bak when keepBackup is set
+    static void writeAtomically(const std::string& path, const std::string& bytes, bool keepBackup);
+    // The rename half of writeAtomically, for a temporary already written.
+    // The temporary is flushed to disk before the rename and the directory
+    // after it, so a power loss leaves either the old file or the new one.
+    static void replace(const std::string& temporary, const std::string& path, bool keepBackup);
+    static std::string readAll(const std::string& path);
+};
+
+// Streams a data file to path.tmp while it is serialized: each whole
+// payload block is checksummed and queued on an AsyncFileWriter as soon
+// as the TextWriter has produced it. commit() adds the checksums and
+// moves the file into place, keeping the previous save as path.bak;
+// a writer destroyed without commit() removes its temporary.
+class DataFileWriter : public TextSink {
+private:
+    std::string path;
+    std::string temporary;
+    AsyncFileWriter file;
+    std::string chunk;
+    std::vector<uint32_t> checksums;
+    size_t payloadBytes;
+    size_t sizeField;
+    bool committed;
+
+    void emit(std::string& text, size_t length);
+
+public:
+    explicit DataFileWriter(const std::string& path);
+    ~DataFileWriter();
+
+    size_t threshold() const;
+    void drain(std::string& text);
+    // Writes the rest of text as the last block and replaces path
+    void commit(std::string& text);
+    // After commit(): the stamp a DataFileReader of this file will report
+    uint64_t generationStamp() const;
+};
+
+// Line source for TextReader over a data file that is still being read:
+// lines are handed out only from blocks whose checksum has been verified,
+// so a damaged file throws DataIntegrityError before anything from the
+// bad block is parsed.
+class DataFileReader {
+private:
+    std::string path;
+    AsyncFileReader file;
+    int formatVersion;
+    size_t payloadBegin;
+    size_t payloadEnd;
+    size_t blockSize;
+    std::vector<uint32_t> checksums;
+    size_t position;
+    size_t verified;
+
+    void readFrame();
+    void readChecksums();
+    void verify(size_t begin, size_t end);
+
+public:
+    explicit DataFileReader(const std::string& path);
+
+    int getFormatVersion() const;
+    // Identifies this exact payload by its length and block checksums, as
+    // soon as the file is open; files derived from it record the stamp to
+    // recognise it later. Zero for files older than format 4, which have
+    // no checksums.
+    uint64_t generationStamp() const;
+    bool next(const char*& lineBegin, const char*& lineEnd);
+    // Verifies the blocks the parser did not reach
+    void finish();
+};
+
+#endif
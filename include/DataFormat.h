@@ -0,0 +1,17 @@
+#ifndef DATA_FORMAT_H
+#define DATA_FORMAT_H
+
+#include <iostream>
+
+// Version 1 is the original headerless text format. Version 2 adds stable
+// material ids/versions and reference-based order lines. Version 3 adds
+// the per-supplier catalog version used by the catalog change log.
+// Version 4 frames the payload with block checksums (see DataFile.h).
+// Version 5 adds the order idempotency key. Version 6 adds supplier stock
+// levels and the order status.
+const int DATA_FORMAT_VERSION = 6;
+
+void writeFormatHeader(std::ostream& os);
+int readFormatHeader(std::istream& is);
+
+#endif
@@ -0,0 +1,35 @@
+#ifndef DATA_PERSISTENCE_H
+#define DATA_PERSISTENCE_H
+
+#include <string>
+#include <vector>
+#include <memory>
+#include "DataStore.h"
+
+// Full saves and loads of a data store's files in the current directory.
+// Every shard writes or reads its own files as tasks on the shared
+// TaskScheduler.
+class DataPersistence {
+private:
+    // Validates the suppliers read per shard and adds those that are
+    // valid and unique, moving them out of shardSuppliers. Shards whose
+    // records all stay where they were adopt their prebuilt indexes.
+    static void registerLoadedSuppliers(DataStore& loaded, std::vector<std::vector<Supplier> >& shardSuppliers,
+                                        std::vector<std::shared_ptr<ShardIndexes> >& prebuilt);
+
+public:
+    // name itself, or the copy of its previous save (name.bak)
+    static std::string filePath(const std::string& name, bool fromBackup);
+    // Writes every shard's catalog, suppliers, orders, order totals and
+    // the indexes over its suppliers (see IndexFile), and records the shard
+    // count. Each file replaces its predecessor atomically; the predecessor
+    // is kept as <file>.bak
+    static void saveSnapshot(const DataSnapshot& snapshot);
+    // Loads the files (or their backups) into loaded, which must be empty
+    // and have the shard count they were written with. Invalid and
+    // duplicate records are skipped with a warning. Returns true when any
+    // shard had an orders file; throws when a file is damaged.
+    static bool readFiles(DataStore& loaded, bool fromBackup);
+};
+
+#endif
@@ -0,0 +1,188 @@
+#ifndef DATA_SHARD_H
+#define DATA_SHARD_H
+
+#include <string>
+#include <vector>
+#include <mutex>
+#include <memory>
+#include "CowVector.h"
+#include "Supplier.h"
+#include "Order.h"
+#include "OrderArchive.h"
+#include "MaterialCatalog.h"
+#include "SupplierIndex.h"
+#include "OrderIndex.h"
+#include "MaterialIndex.h"
+#include "CatalogDelta.h"
+#include "OrderAggregates.h"
+#include "IndexFile.h"
+#include "StockCounters.h"
+
+// Files owned by one shard. A single-shard store keeps the original names
+// (suppliers.dat, orders.dat, ...); shard k of several adds "-s<k>".
+struct ShardFiles {
+    std::string catalog;
+    std::string suppliers;
+    std::string orders;
+    std::string changeLog;
+    std::string archive;    // base name of the manifest and month segments
+    std::string aggregates;
+    std::string index;      // prebuilt indexes, see IndexFile
+
+    static ShardFiles forShard(size_t shard, size_t shardCount);
+    // The files a full save rewrites
+    std::vector<std::string> dataFiles() const;
+};
+
+struct ShardSnapshot {
+    CowVector<Supplier> suppliers;
+    CowVector<int> supplierIds;
+    CowVector<Order> orders;
+    CowVector<CatalogEntry> catalog;
+    // The shard's lookups over these suppliers, which a save writes
+    // beside them (see IndexFile)
+    std::shared_ptr<const ShardIndexes> indexes;
+    // Null when the files held none (written before aggregates were kept)
+    std::shared_ptr<const OrderAggregates> aggregates;
+};
+
+// One partition of the data store: the suppliers whose BULSTAT hashes to
+// it, their orders, material versions, archive and change log. Writers,
+// snapshots and readers take the shard's own lock, so work on different
+// shards never contends. Readers only copy what they need under it (the
+// CowVectors and the shared indexes copy in O(1)) and search the copy
+// after unlocking, while writers replace the members. Suppliers are
+// addressed by their position within the shard; supplierIds maps a
+// position back to the store-wide supplier number.
+class DataShard {
+private:
+    ShardFiles files;
+    CowVector<Supplier> suppliers;
+    CowVector<int> supplierIds;
+    CowVector<Order> orders;
+    OrderArchive archive;
+    MaterialCatalog catalog;
+    // Supplier and material lookups, shared with snapshots (a save writes
+    // them out) and copied before a change while shared
+    std::shared_ptr<ShardIndexes> indexes;
+    OrderIndex orderIndex;
+    CatalogChangeLog changeLog;
+    // Shared with snapshots and readers and copied before a change while
+    // shared, so a reader's copy never moves. Null until rebuilt when the
+    // loaded files held none.
+    std::shared_ptr<OrderAggregates> aggregates;
+    // Units free to reserve, taken before the lock (see addOrder); the
+    // suppliers' own levels are the committed ones snapshots save
+    StockCounters stockCounters;
+    mutable std::mutex mutex;
+
+    void rebuildIndex();
+    ShardIndexes& writableIndexesLocked();
+    // The current indexes, which a writer copies before changing them
+    // while a reader holds them
+    std::shared_ptr<const ShardIndexes> currentIndexes() const;
+    void rebuildOrderIndex();
+    // reservation is null for loaded orders, whose stock was taken before
+    bool addOrderLocked(const Order& order, StockCounters::Reservation* reservation);
+    // Applies a reservation to the supplier's committed levels, taking it
+    // again first if the counters were reset since it was made
+    void commitStockLocked(const Order& order, StockCounters::Reservation& reservation);
+    // Counters at the committed levels of every supplier
+    void resetStockCountersLocked();
+    // Position of the stored order with order's id and content whose
+    // cancelled flag is as given, searching newest first; -1 if none
+    long findStoredLocked(const Order& order, bool cancelled) const;
+    void releaseStockLocked(const Order& order);
+    // Adds (sign 1) or subtracts (sign -1) order in the aggregates
+    void aggregateLocked(const Order& order, int sign);
+    void validatePosition(int position) const;
+    CatalogDelta applyDeltaLocked(int position, const std::vector<MaterialChange>& changes);
+
+public:
+    explicit DataShard(const ShardFiles& files);
+
+    const ShardFiles& getFiles() const;
+
+    size_t getSupplierCount() const;
+    size_t getOrderCount() const;
+    // A copy, so it stays valid while writers change the shard
+    Supplier getSupplier(int position) const;
+    int getSupplierId(int position) const;
+    // A frozen copy of the current orders
+    CowVector<Order> getOrders() const;
+
+    int findByBulstat(const std::string& bulstat) const;
+    int findByPhone(const std::string& phoneNumber) const;
+    // Matches carry positions within this shard
+    std::vector<SupplierMatch> search(const std::string& query, size_t limit) const;
+    // Matches carry positions within this shard
+    std::vector<MaterialMatch> nearestMaterials(const MaterialQuery& query) const;
+
+    void addSupplier(const Supplier& supplier, int supplierId);
+    // Suppliers read back from disk, into an empty shard, taking ids from
+    // firstSupplierId on. The shard adopts prebuilt when it indexes exactly
+    // these suppliers and indexes them itself otherwise; prebuilt may be
+    // null.
+    void addLoadedSuppliers(const std::vector<Supplier>& loadedSuppliers, int firstSupplierId,
+                            const std::shared_ptr<ShardIndexes>& prebuilt);
+    // Undoes addSupplier for the supplier added last. Its catalog versions
+    // stay, as versions always do.
+    void removeLastSupplier();
+    // Orders that duplicate one already in the shard (see OrderIndex) are
+    // skipped: addOrder returns false, addOrders the number added. A new
+    // order takes its units from the stock counters before it takes the
+    // shard lock, so threads ordering from one shard only queue for the
+    // insertion itself, and an order short on stock never takes the lock;
+    // addOrder throws InsufficientStockError when they are short,
+    // addOrders skips the order and appends the reason to stockErrors.
+    // The orders that were added are appended to added.
+    bool addOrder(const Order& order);
+    size_t addOrders(const std::vector<Order>& newOrders, std::vector<std::string>* stockErrors = 0,
+                     std::vector<Order>* added = 0);
+    // Orders read back from disk; their stock was taken when they were placed
+    size_t addLoadedOrders(const std::vector<Order>& loadedOrders);
+    // Orders of the supplier with this id, cancelled ones included
+    std::vector<Order> findOrders(const std::string& bulstat, const std::string& orderId) const;
+    // Marks the stored order with the same id and content cancelled and
+    // returns its units to stock
+    void cancelOrder(const Order& order);
+    // Undo counterparts: removeOrder drops a stored order and returns its
+    // units to stock, reinstateOrder takes a cancelled order's units again
+    // (or throws InsufficientStockError). Both look from the newest order
+    // back, so undoing a recent edit is O(1).
+    void removeOrder(const Order& order);
+    void reinstateOrder(const Order& order);
+    void setStock(int position, unsigned int materialId, int onHand);
+    void clear();
+
+    const MaterialCatalog& getCatalog() const;
+    MaterialCatalog& getCatalog();
+    // Looks a version up in the catalog under the lock, as delta writers
+    // register versions in it
+    std::shared_ptr<const OpticalMaterial> resolveVersion(const std::string& bulstat,
+                                                          unsigned int id, unsigned int version) const;
+    CatalogDelta applyCatalogDelta(int position, const std::vector<MaterialChange>& changes);
+    size_t replayChangeLog();
+    void truncateChangeLog() const;
+
+    const OrderArchive& getArchive() const;
+    void loadArchiveManifest();
+    void archiveColdOrders();
+
+    // Frozen view of the running order totals; empty while they are
+    // still to be rebuilt
+    std::shared_ptr<const OrderAggregates> getAggregates() const;
+    void loadAggregates(DataFileReader& file);
+    // Marks the aggregates missing, for data files that did not have them
+    void forgetAggregates();
+    // Recounts missing aggregates from the archived and current orders;
+    // returns false when they were already there
+    bool rebuildAggregates();
+
+    MemoryUsage memoryUsage() const;
+
+    ShardSnapshot snapshot() const;
+    void restore(const ShardSnapshot& snapshot);
+};
+
+#endif
@@ -0,0 +1,165 @@
+#ifndef DATA_STORE_H
+#define DATA_STORE_H
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <functional>
+#include "CowVector.h"
+#include "DataShard.h"
+
+// Where a supplier lives: its shard and its position within that shard
+struct SupplierLocation {
+    unsigned int shard;
+    unsigned int position;
+};
+
+// Frozen view of the whole dataset. Taking one is O(1) per shard and it
+// never changes afterwards, so it can be saved or queried from another
+// thread.
+struct DataSnapshot {
+    std::vector<ShardSnapshot> shards;
+    CowVector<SupplierLocation> directory;
+
+    size_t supplierCount() const;
+    size_t orderCount() const;
+};
+
+// Suppliers and their orders, partitioned into shards by a hash of the
+// supplier's BULSTAT. Each shard has its own files, indexes and lock, so
+// writes to different shards do not contend. Suppliers keep a store-wide
+// number in insertion order; queries that span all shards run a task per
+// shard on the shared TaskScheduler.
+class DataStore {
+private:
+    std::vector<std::unique_ptr<DataShard> > shards;
+    CowVector<SupplierLocation> directory;
+    // Held while a supplier is added: uniqueness spans every shard
+    std::mutex directoryMutex;
+
+    const SupplierLocation& locate(int supplierIndex) const;
+    DataShard& shardOf(const std::string& bulstat);
+    const DataShard& shardOf(const std::string& bulstat) const;
+
+public:
+    static const size_t DEFAULT_SHARD_COUNT = 4;
+    static const size_t MAX_SHARD_COUNT = 64;
+
+    // Shard count of the data directory: the one recorded in shards.idx,
+    // 1 for files written before sharding, otherwise OPTICAL_SHARDS or
+    // DEFAULT_SHARD_COUNT for a new directory
+    static size_t configuredShardCount();
+    static void recordShardCount(size_t shardCount);
+    // Stable across platforms (FNV-1a), since it decides file placement
+    static size_t shardIndexOf(const std::string& bulstat, size_t shardCount);
+    // Runs task(shard) for every shard on the shared TaskScheduler;
+    // rethrows the first failure
+    static void forEachShard(size_t shardCount, const std::function<void(size_t)>& task);
+
+    explicit DataStore(size_t shardCount = configuredShardCount());
+
+    size_t getShardCount() const;
+    DataShard& getShard(size_t shard);
+    const DataShard& getShard(size_t shard) const;
+
+    int getSupplierCount() const;
+    int getOrderCount() const;
+    Supplier getSupplier(int index) const;
+
+    // Store-wide supplier number, or -1
+    int findSupplier(const std::string& bulstat) const;
+    bool bulstatExists(const std::string& bulstat) const;
+    bool phoneNumberExists(const std::string& phoneNumber) const;
+    // Searches every shard in parallel; matches carry store-wide numbers
+    std::vector<SupplierMatch> searchSuppliers(const std::string& query, size_t limit) const;
+    // Asks each shard in turn (a lookup is too short to be worth a thread);
+    // matches carry store-wide supplier numbers
+    std::vector<MaterialMatch> nearestMaterials(const MaterialQuery& query) const;
+
+    void addSupplier(const Supplier& supplier);
+    // addSupplier in bulk for a load into an empty store. shardSuppliers[k]
+    // holds shard k's suppliers, already free of duplicates; they take ids
+    // shard by shard in that order. prebuilt[k] (may be null) are indexes
+    // read for shard k, see DataShard::addLoadedSuppliers.
+    void addLoadedSuppliers(const std::vector<std::vector<Supplier> >& shardSuppliers,
+                            const std::vector<std::shared_ptr<ShardIndexes> >& prebuilt);
+    // Undoes addSupplier; throws std::logic_error unless the supplier with
+    // this BULSTAT is the one added last
+    void removeLastSupplier(const std::string& bulstat);
+    void addMaterial(int supplierIndex, const OpticalMaterial& material);
+    // False when the order duplicates a stored one (same idempotency key
+    // for the supplier, or same supplier, date and lines). Takes the
+    // ordered units from the supplier's stock, or throws
+    // InsufficientStockError and adds nothing.
+    bool addOrder(const Order& order);
+    // Groups the orders by shard and inserts the groups in parallel,
+    // skipping duplicates and orders short on stock (reasons go to
+    // stockErrors); returns the number added and appends those orders to
+    // added
+    size_t addOrders(const std::vector<Order>& newOrders, std::vector<std::string>* stockErrors = 0,
+                     std::vector<Order>* added = 0);
+    std::vector<Order> findOrders(const std::string& bulstat, const std::string& orderId) const;
+    void cancelOrder(const Order& order);
+    // See DataShard::removeOrder and DataShard::reinstateOrder
+    void removeOrder(const Order& order);
+    void reinstateOrder(const Order& order);
+    void setStock(int supplierIndex, unsigned int materialId, int onHand);
+    void clear();
+
+    // Applies one supplier's material changes, catalogs the new versions
+    // and appends the delta to the shard's change log
+    CatalogDelta applyCatalogDelta(int supplierIndex, const std::vector<MaterialChange>& changes);
+    // Re-applies logged deltas that are newer than the loaded suppliers;
+    // returns how many were applied
+    size_t replayChangeLogs();
+    void truncateChangeLogs() const;
+    // Immutable catalog version of a supplier's current material
+    std::shared_ptr<const OpticalMaterial> resolveMaterial(int supplierIndex, int materialIndex) const;
+    std::shared_ptr<const OpticalMaterial> resolveVersion(const std::string& bulstat,
+                                                          unsigned int id, unsigned int version) const;
+
+    // Hot orders of every shard, rendered in parallel and merged by date
+    std::vector<std::string> renderOrders() const;
+
+    // Archive segments of all shards, merged per month
+    std::vector<ArchiveSegment> getArchiveSegments() const;
+    size_t getArchivedOrderCount() const;
+    std::vector<Order> loadArchivedOrders(const std::string& period) const;
+    void loadArchiveManifests();
+    // Moves orders from past months out of memory into sealed segments
+    void archiveColdOrders();
+
+    // Every shard measured in parallel, plus the store-wide directory
+    MemoryUsage memoryUsage() const;
+
+    // Answers from the shards' running order totals (see OrderAggregates):
+    // a supplier's figures come from its shard, the rest add up one entry
+    // per shard, so none of them reads an order. Cancelled orders do not
+    // count; archived ones do.
+    AggregateTotals orderTotals() const;
+    AggregateTotals supplierSpend(const std::string& bulstat) const;
+    // Months fromPeriod to toPeriod (YYYY-MM), both included
+    AggregateTotals supplierSpend(const std::string& bulstat,
+                                  const std::string& fromPeriod, const std::string& toPeriod) const;
+    MaterialDemand materialDemand(const std::string& type, const std::string& materialName) const;
+    // Days fromDay to toDay (YYYY-MM-DD), both included
+    AggregateTotals totalsBetween(const std::string& fromDay, const std::string& toDay) const;
+    // Highest spend or quantity first, at most limit entries
+    std::vector<SupplierSpend> topSuppliers(size_t limit) const;
+    std::vector<MaterialDemand> topMaterials(size_t limit) const;
+    // The latest days with orders, newest first
+    std::vector<DayRow> recentDays(size_t limit) const;
+    // Recounts the totals of shards whose files had none; returns how many
+    // shards it recounted
+    size_t rebuildMissingAggregates();
+
+    DataSnapshot snapshot() const;
+    void restore(const DataSnapshot& snapshot);
+    // Exchanges the whole contents, indexes included, with a store of the
+    // same shard count: a store loaded on the side takes over without being
+    // copied or indexed again. Neither store may be in use meanwhile.
+    void swap(DataStore& other);
+};
+
+#endif
@@ -0,0 +1,38 @@
+#ifndef INDEX_FILE_H
+#define INDEX_FILE_H
+
+#include <string>
+#include <cstdint>
+#include "CowVector.h"
+#include "Supplier.h"
+#include "SupplierIndex.h"
+#include "MaterialIndex.h"
+
+// The lookup indexes a shard keeps over its suppliers
+struct ShardIndexes {
+    SupplierIndex supplierIndex;
+    MaterialIndex materialIndex;
+
+    // Indexes suppliers by position, as the shard does one at a time
+    void build(const CowVector<Supplier>& suppliers);
+};
+
+// Prebuilt indexes saved beside a shard's suppliers file, so a load can
+// adopt them instead of indexing every supplier again:
+//
+//   OIDX1
+//   <generation stamp of the suppliers file> <CRC-32C of the body>
+//   <SupplierIndex::save, then MaterialIndex::save>
+//
+// The file is only a cache. One written for another save of the suppliers
+// (a different stamp), missing or damaged is ignored, and the load indexes
+// the suppliers itself; the next save writes a fresh one.
+class IndexFile {
+public:
+    static void write(const std::string& path, uint64_t suppliersStamp, const ShardIndexes& indexes);
+    // True, with indexes filled in, when path holds the indexes of the
+    // suppliers file with this stamp
+    static bool read(const std::string& path, uint64_t suppliersStamp, ShardIndexes& indexes);
+};
+
+#endif
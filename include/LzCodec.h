@@ -0,0 +1,15 @@
+#ifndef LZ_CODEC_H
+#define LZ_CODEC_H
+
+#include <string>
+
+// Small LZ77 block compressor in the spirit of LZ4: greedy hash-chain-free
+// matching, token bytes with 4-bit literal/match lengths and 16-bit offsets.
+// Output starts with the uncompressed size so decompression is one pass.
+class LzCodec {
+public:
+    static std::string compress(const std::string& input);
+    static std::string decompress(const std::string& input);
+};
+
+#endif
@@ -0,0 +1,51 @@
+#ifndef MATERIAL_CATALOG_H
+#define MATERIAL_CATALOG_H
+
+#include <string>
+#include <memory>
+#include <unordered_map>
+#include <iostream>
+#include "CowVector.h"
+#include "OpticalMaterial.h"
+#include "MemoryUsage.h"
+
+class TextSink;
+class DataFileReader;
+
+struct CatalogEntry {
+    std::string supplierBulstat;
+    std::shared_ptr<const OpticalMaterial> material;
+};
+
+// Every material version ever offered, keyed by (supplier BULSTAT,
+// material id, version). Versions are immutable and never removed, so
+// order lines can reference them instead of carrying their own copy.
+class MaterialCatalog {
+private:
+    CowVector<CatalogEntry> entries;
+    std::unordered_map<std::string, size_t> index;
+
+    static std::string makeKey(const std::string& bulstat, unsigned int id, unsigned int version);
+
+public:
+    MaterialCatalog();
+
+    std::shared_ptr<const OpticalMaterial> registerVersion(const std::string& bulstat,
+                                                           const OpticalMaterial& material);
+    std::shared_ptr<const OpticalMaterial> resolve(const std::string& bulstat,
+                                                   unsigned int id, unsigned int version) const;
+    bool contains(const std::string& bulstat, unsigned int id, unsigned int version) const;
+
+    const CowVector<CatalogEntry>& getEntries() const;
+    size_t size() const;
+    // Adds the versions, their materials and the key index to usage.catalog
+    void addMemoryUsage(MemoryUsage& usage) const;
+    void restore(const CowVector<CatalogEntry>& snapshot);
+    void clear();
+
+    static void saveEntries(std::string& out, const CowVector<CatalogEntry>& entries, TextSink* sink = 0);
+    // The catalog is always a file of its own
+    void load(DataFileReader& file);
+};
+
+#endif
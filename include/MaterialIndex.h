@@ -0,0 +1,114 @@
+#ifndef MATERIAL_INDEX_H
+#define MATERIAL_INDEX_H
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <cstdint>
+#include "OpticalMaterial.h"
+
+class BinaryWriter;
+class BinaryReader;
+
+// A k-nearest-neighbour question: materials closest to a prescription,
+// optionally near a price and limited to one type and/or material name
+// (both matched case-insensitively; empty means any).
+struct MaterialQuery {
+    double diopter;
+    double thickness;
+    double price;
+    bool usePrice;
+    std::string type;
+    std::string materialName;
+    size_t limit;
+
+    MaterialQuery() : diopter(0.0), thickness(0.0), price(0.0), usePrice(false), limit(10) {}
+};
+
+struct MaterialMatch {
+    int supplierIndex;
+    unsigned int materialId;
+    unsigned int version;
+    double distance;
+};
+
+// Uniform grid over (diopter, thickness), one grid per material type, for
+// nearest-prescription lookups. Distances are measured in steps: a quarter
+// diopter, half a millimetre and (when the query has a price) 5 BGN each
+// count as 1, and a grid cell is one step on each side. A query scans
+// rings of cells around the prescription and stops once no unvisited cell
+// can beat the k-th best match, so it touches a handful of cells however
+// many materials are indexed. Materials are added and removed one by one
+// as suppliers change.
+class MaterialIndex {
+public:
+    static const double DIOPTER_STEP;
+    static const double THICKNESS_STEP;
+    static const double PRICE_STEP;
+
+private:
+    // Coordinates live in the cells themselves so a query reads each
+    // cell as one contiguous run instead of chasing entry numbers
+    struct Point {
+        double diopter;
+        double thickness;
+        double price;
+        uint32_t entry;
+        uint32_t nameId;
+    };
+
+    struct Entry {
+        uint32_t supplierIndex;
+        uint32_t materialId;
+        uint32_t version;
+        uint32_t typeId;
+        uint32_t cellSlot;      // position in its cell's list
+        uint64_t cell;
+    };
+
+    struct Grid {
+        std::unordered_map<uint64_t, std::vector<Point> > cells;
+        int minX, maxX, minY, maxY;
+    };
+
+    std::vector<Entry> entries;
+    std::vector<uint32_t> freeEntries;
+    // (supplier, material id) -> entry
+    std::unordered_map<uint64_t, uint32_t> byMaterial;
+    std::vector<Grid> grids;    // by type id
+    std::unordered_map<std::string, uint32_t> typeIds;
+    std::unordered_map<std::string, uint32_t> nameIds;
+    size_t liveCount;
+
+    static std::string normalize(const std::string& text);
+    static uint64_t materialKey(int supplierIndex, unsigned int materialId);
+    static int cellCoordinate(double value, double step);
+    static uint64_t cellKey(int x, int y);
+    static uint32_t intern(std::unordered_map<std::string, uint32_t>& ids, const std::string& text);
+
+    void searchGrid(const Grid& grid, const MaterialQuery& query, long nameId,
+                    std::vector<MaterialMatch>& best) const;
+
+public:
+    MaterialIndex();
+
+    // Replaces the entry of the same supplier and material id, if any
+    void add(int supplierIndex, const OpticalMaterial& material);
+    void remove(int supplierIndex, unsigned int materialId);
+    void clear();
+    size_t size() const;
+    // Heap bytes of the lookup structures
+    size_t memoryBytes() const;
+
+    // The grids as they are, for the prebuilt index file; load() replaces
+    // the contents and throws when the input is cut short
+    void save(BinaryWriter& writer) const;
+    void load(BinaryReader& reader);
+
+    // Up to query.limit matches, nearest first; ties by supplier and id
+    std::vector<MaterialMatch> nearest(const MaterialQuery& query) const;
+
+    static bool closer(const MaterialMatch& a, const MaterialMatch& b);
+};
+
+#endif
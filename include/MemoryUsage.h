@@ -0,0 +1,73 @@
+#ifndef MEMORY_USAGE_H
+#define MEMORY_USAGE_H
+
+#include <string>
+#include <vector>
+#include <cstddef>
+
+// Bytes held by one kind of record: the records, the heap blocks they own
+// and their share of the containers holding them.
+struct MemoryFootprint {
+    size_t count;
+    size_t bytes;
+
+    MemoryFootprint() : count(0), bytes(0) {}
+
+    double bytesPerRecord() const;
+    MemoryFootprint& operator+=(const MemoryFootprint& other);
+};
+
+// Estimated memory of a data store by record type. Heap blocks are
+// counted as the allocator rounds them (see memory::allocationBytes), so
+// the totals track the resident size rather than sizeof alone.
+struct MemoryUsage {
+    MemoryFootprint suppliers;
+    // Current materials of the suppliers, with the id -> position lookup
+    MemoryFootprint materials;
+    // Material versions kept for order lines, with their lookup
+    MemoryFootprint catalog;
+    // Orders in memory and their lines (archived months are on disk)
+    MemoryFootprint orders;
+    // Search, duplicate and nearest-material indexes; count is entries
+    MemoryFootprint indexes;
+    // Shared StringPool text; count is distinct strings
+    MemoryFootprint strings;
+
+    size_t totalBytes() const;
+    MemoryUsage& operator+=(const MemoryUsage& other);
+    // One line per record type with count, bytes and bytes per record
+    std::string report() const;
+};
+
+namespace memory {
+
+// Bytes a heap allocation of requested bytes takes with a glibc-style
+// allocator: an 8-byte header, 16-byte granules and 32 bytes at least
+size_t allocationBytes(size_t requested);
+// Heap bytes of a string; 0 while it fits the inline buffer
+size_t stringBytes(const std::string& text);
+// A make_shared block: the object plus a two-counter control block
+size_t sharedBytes(size_t objectSize);
+
+template <typename T>
+size_t vectorBytes(const std::vector<T>& items) {
+    return items.capacity() == 0 ? 0 : allocationBytes(items.capacity() * sizeof(T));
+}
+
+// Node-based hash map or set: a node per element (next pointer, cached
+// hash, value) plus the bucket array
+template <typename HashMap>
+size_t hashMapBytes(const HashMap& map) {
+    return map.size() * allocationBytes(2 * sizeof(void*) + sizeof(typename HashMap::value_type)) +
+           allocationBytes(map.bucket_count() * sizeof(void*));
+}
+
+// Red-black tree map or set: three links and a colour per node
+template <typename TreeMap>
+size_t treeMapBytes(const TreeMap& map) {
+    return map.size() * allocationBytes(4 * sizeof(void*) + sizeof(typename TreeMap::value_type));
+}
+
+}
+
+#endif
@@ -0,0 +1,79 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <string>
+#include <cstdint>
+#include <chrono>
+
+// Compile with -DOPTICAL_METRICS=0 (make METRICS=0) to remove all
+// instrumentation; otherwise it is compiled in and switched on at runtime.
+#ifndef OPTICAL_METRICS
+#define OPTICAL_METRICS 1
+#endif
+
+enum MetricId {
+    METRIC_LOAD_DATA,
+    METRIC_SAVE_DATA,
+    METRIC_ORDER_ADD_ITEM,
+    METRIC_ORDER_CALCULATE_TOTAL,
+    METRIC_SUPPLIER_LOOKUP_BULSTAT,
+    METRIC_SUPPLIER_LOOKUP_PHONE,
+    METRIC_SUPPLIER_SEARCH,
+    METRIC_RENDER_ORDER,
+    METRIC_RENDER_MATERIALS,
+    METRIC_RENDER_CACHE_HIT,
+    METRIC_RENDER_CACHE_MISS,
+    METRIC_COUNT
+};
+
+// Log-linear latency histogram in the style of HdrHistogram: 16 linear
+// sub-buckets per power of two, so any recorded value is reported within
+// about 6% of its true value.
+class LatencyHistogram {
+public:
+    static const int BUCKET_COUNT = 1024;
+
+    static int bucketOf(uint64_t value);
+    static uint64_t bucketLowerBound(int bucket);
+};
+
+// Per-thread counters and histograms. Recording touches only the calling
+// thread's slot, so hot paths never contend; reports merge all threads.
+class Metrics {
+public:
+    static bool isEnabled();
+    static void setEnabled(bool enabled);
+    // Enables metrics when the OPTICAL_METRICS environment variable is set
+    static void configureFromEnvironment();
+
+    static const char* nameOf(MetricId id);
+    static void recordLatency(MetricId id, uint64_t nanoseconds);
+    static void increment(MetricId id, uint64_t amount = 1);
+
+    static std::string reportText();
+    static std::string reportJson();
+    static void reset();
+};
+
+class ScopedMetricTimer {
+private:
+    MetricId id;
+    bool active;
+    std::chrono::steady_clock::time_point start;
+
+public:
+    explicit ScopedMetricTimer(MetricId id);
+    ~ScopedMetricTimer();
+};
+
+#if OPTICAL_METRICS
+#define METRIC_CONCAT_INNER(a, b) a##b
+#define METRIC_CONCAT(a, b) METRIC_CONCAT_INNER(a, b)
+#define METRIC_TIMER(id) ScopedMetricTimer METRIC_CONCAT(metricTimer, __LINE__)(id)
+#define METRIC_INCREMENT(id) Metrics::increment(id)
+#else
+#define METRIC_TIMER(id) ((void)0)
+#define METRIC_INCREMENT(id) ((void)0)
+#endif
+
+#endif
@@ -0,0 +1,233 @@
+#ifndef MODEL_REFLECTION_H
+#define MODEL_REFLECTION_H
+
+#include <string>
+#include <stdexcept>
+#include "Codecs.h"
+#include "OpticalMaterial.h"
+#include "Supplier.h"
+#include "Order.h"
+#include "MaterialCatalog.h"
+#include "CompactText.h"
+#include "OrderAggregates.h"
+
+namespace reflect {
+
+// Compact members (see CompactText.h) go through the codecs as the plain
+// strings and doubles they stand for, so the file formats do not change
+template <typename Visitor, typename Text>
+void textField(Visitor& visitor, const char* label, Text& member) {
+    std::string text = Visitor::LOADING ? std::string() : member.str();
+    visitor.field(label, text);
+    if (Visitor::LOADING) {
+        member.assign(text);
+    }
+}
+
+template <typename Visitor>
+void decimalField(Visitor& visitor, const char* label, FixedDecimal& member) {
+    double value = member.value();
+    visitor.field(label, value);
+    if (Visitor::LOADING) {
+        member.assign(value);
+    }
+}
+
+// The codecs have no 64-bit field, so running totals go as decimal text
+template <typename Visitor>
+void wideField(Visitor& visitor, const char* label, long long& member) {
+    std::string text = Visitor::LOADING ? std::string() : std::to_string(member);
+    visitor.field(label, text);
+    if (Visitor::LOADING) {
+        member = codec::parseSigned(text.data(), text.data() + text.size());
+    }
+}
+
+}
+
+template <>
+struct Reflect<OpticalMaterial> {
+    template <typename Visitor>
+    static void visit(OpticalMaterial& material, Visitor& visitor) {
+        if (visitor.version() >= 2) {
+            visitor.field("Id", material.id);
+            visitor.field("Version", material.version);
+        } else if (Visitor::LOADING) {
+            material.id = 0;
+            material.version = 0;
+        }
+        reflect::textField(visitor, "Type", material.type);
+        reflect::decimalField(visitor, "Thickness", material.thickness);
+        reflect::decimalField(visitor, "Diopter", material.diopter);
+        reflect::textField(visitor, "Material", material.materialName);
+        visitor.field("Price", material.price);
+    }
+};
+
+template <>
+struct Reflect<CatalogEntry> {
+    template <typename Visitor>
+    static void visit(CatalogEntry& entry, Visitor& visitor) {
+        visitor.field("Supplier BULSTAT", entry.supplierBulstat);
+        if (Visitor::LOADING) {
+            OpticalMaterial material;
+            visitor.object("Material", material);
+            entry.material = std::make_shared<const OpticalMaterial>(material);
+        } else {
+            visitor.object("Material", const_cast<OpticalMaterial&>(*entry.material));
+        }
+    }
+};
+
+template <>
+struct Reflect<StockLevel> {
+    template <typename Visitor>
+    static void visit(StockLevel& level, Visitor& visitor) {
+        visitor.field("Material id", level.materialId);
+        visitor.field("On hand", level.onHand);
+    }
+};
+
+template <>
+struct Reflect<Supplier> {
+    template <typename Visitor>
+    static void visit(Supplier& supplier, Visitor& visitor) {
+        reflect::textField(visitor, "Bulstat", supplier.bulstat);
+        reflect::textField(visitor, "Name", supplier.name);
+        reflect::textField(visitor, "Location", supplier.location);
+        reflect::textField(visitor, "Phone", supplier.phoneNumber);
+        if (visitor.version() >= 2) {
+            visitor.field("Next material id", supplier.nextMaterialId);
+        } else if (Visitor::LOADING) {
+            supplier.nextMaterialId = 1;
+        }
+        if (visitor.version() >= 3) {
+            visitor.field("Catalog version", supplier.catalogVersion);
+        } else if (Visitor::LOADING) {
+            supplier.catalogVersion = 0;
+        }
+        visitor.sequence("Materials", supplier.materials);
+        if (Visitor::LOADING) {
+            supplier.numberLoadedMaterials();
+        }
+        if (visitor.version() >= 6) {
+            visitor.sequence("Stock", supplier.stock);
+            if (Visitor::LOADING) {
+                supplier.normalizeLoadedStock();
+            }
+        } else if (Visitor::LOADING) {
+            supplier.stock.clear();
+        }
+    }
+};
+
+template <>
+struct Reflect<OrderItem> {
+    template <typename Visitor>
+    static void visit(OrderItem& item, Visitor& visitor) {
+        if (visitor.version() < 2) {
+            // Legacy lines carry a full copy of the material
+            OpticalMaterial material;
+            visitor.object("Material", material);
+            visitor.field("Quantity", item.quantity);
+            item.material = std::make_shared<const OpticalMaterial>(material);
+            item.unitPrice = material.getPrice();
+            return;
+        }
+
+        unsigned int id = item.material ? item.material->getId() : 0;
+        unsigned int version = item.material ? item.material->getVersion() : 0;
+        visitor.field("Material id", id);
+        visitor.field("Material version", version);
+        visitor.field("Unit price", item.unitPrice);
+        visitor.field("Quantity", item.quantity);
+
+        if (id != 0) {
+            if (Visitor::LOADING) {
+                item.material = visitor.resolve(id, version);
+            }
+        } else if (Visitor::LOADING) {
+            OpticalMaterial material;
+            visitor.object("Material", material);
+            item.material = std::make_shared<const OpticalMaterial>(material);
+        } else {
+            // Lines without a catalog reference carry the material inline
+            visitor.object("Material", const_cast<OpticalMaterial&>(*item.material));
+        }
+    }
+};
+
+template <>
+struct Reflect<Order> {
+    template <typename Visitor>
+    static void visit(Order& order, Visitor& visitor) {
+        visitor.field("Order ID", order.orderId);
+        visitor.field("Supplier", order.supplierName);
+        visitor.field("Supplier BULSTAT", order.supplierBulstat);
+        visitor.field("Date", order.orderDate);
+        visitor.field("Total", order.totalPrice);
+        if (visitor.version() >= 5) {
+            visitor.field("Idempotency key", order.idempotencyKey);
+        } else if (Visitor::LOADING) {
+            order.idempotencyKey.clear();
+        }
+        if (visitor.version() >= 6) {
+            std::string status = order.cancelled ? "Cancelled" : "Placed";
+            visitor.field("Status", status);
+            if (Visitor::LOADING) {
+                if (status != "Placed" && status != "Cancelled") {
+                    throw std::runtime_error("Unknown order status: " + status);
+                }
+                order.cancelled = status == "Cancelled";
+            }
+        } else if (Visitor::LOADING) {
+            order.cancelled = false;
+        }
+        visitor.setCatalogOwner(order.supplierBulstat);
+        visitor.sequence("Items", order.items);
+        if (Visitor::LOADING) {
+            order.touch();
+        }
+    }
+};
+
+template <>
+struct Reflect<AggregateTotals> {
+    template <typename Visitor>
+    static void visit(AggregateTotals& totals, Visitor& visitor) {
+        reflect::wideField(visitor, "Orders", totals.orderCount);
+        reflect::wideField(visitor, "Amount", totals.amountUnits);
+    }
+};
+
+template <>
+struct Reflect<SupplierPeriodRow> {
+    template <typename Visitor>
+    static void visit(SupplierPeriodRow& row, Visitor& visitor) {
+        visitor.field("Supplier BULSTAT", row.bulstat);
+        visitor.field("Period", row.period);
+        visitor.object("Totals", row.totals);
+    }
+};
+
+template <>
+struct Reflect<MaterialDemand> {
+    template <typename Visitor>
+    static void visit(MaterialDemand& demand, Visitor& visitor) {
+        visitor.field("Type", demand.type);
+        visitor.field("Material", demand.materialName);
+        reflect::wideField(visitor, "Quantity", demand.quantity);
+        reflect::wideField(visitor, "Amount", demand.amountUnits);
+    }
+};
+
+template <>
+struct Reflect<DayRow> {
+    template <typename Visitor>
+    static void visit(DayRow& row, Visitor& visitor) {
+        visitor.field("Day", row.day);
+        visitor.object("Totals", row.totals);
+    }
+};
+
+#endif
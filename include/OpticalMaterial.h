@@ -3,18 +3,28 @@
 
 #include <string>
 #include <iostream>
+#include "DataFormat.h"
+#include "CompactText.h"
+#include "Reflect.h"
 
 class OpticalMaterial {
 private:
-    std::string type;
-    double thickness;
-    double diopter;
-    std::string materialName;
+    // Stable per-supplier id and immutable version; 0 means not cataloged
+    unsigned int id;
+    unsigned int version;
+    // Types and names repeat across a catalog, so they are pooled
+    PooledString type;
+    PooledString materialName;
+    FixedDecimal thickness;
+    FixedDecimal diopter;
     double price;
 
     void validateThickness(double t) const;
+    void validateDiopter(double d) const;
     void validatePrice(double p) const;
 
+    friend struct Reflect<OpticalMaterial>;
+
 public:
     OpticalMaterial();
     
@@ -23,14 +33,22 @@ public:
     
     OpticalMaterial(const OpticalMaterial& other);
     
+    OpticalMaterial& operator=(const OpticalMaterial& other);
+    
     ~OpticalMaterial();
 
-    std::string getType() const;
+    unsigned int getId() const;
+    unsigned int getVersion() const;
+    const std::string& getType() const;
     double getThickness() const;
     double getDiopter() const;
-    std::string getMaterialName() const;
+    const std::string& getMaterialName() const;
     double getPrice() const;
+    // Heap bytes owned beyond sizeof(OpticalMaterial)
+    size_t heapBytes() const;
 
+    void setId(unsigned int id);
+    void setVersion(unsigned int version);
     void setType(const std::string& type);
     void setThickness(double thickness);
     void setDiopter(double diopter);
@@ -41,7 +59,7 @@ public:
     friend std::istream& operator>>(std::istream& is, OpticalMaterial& material);
     
     void saveToFile(std::ostream& os) const;
-    void loadFromFile(std::istream& is);
+    void loadFromFile(std::istream& is, int formatVersion = DATA_FORMAT_VERSION);
 };
 
 #endif
@@ -4,15 +4,24 @@
 #include <string>
 #include <vector>
 #include <iostream>
+#include <memory>
+#include <utility>
+#include <cstdint>
 #include "OpticalMaterial.h"
 #include "Supplier.h"
+#include "MaterialCatalog.h"
+#include "Reflect.h"
 
+// An order line points at an immutable catalog version of the material
+// and keeps its own snapshot of the unit price.
 struct OrderItem {
-    OpticalMaterial material;
+    std::shared_ptr<const OpticalMaterial> material;
+    double unitPrice;
     int quantity;
     
-    OrderItem(const OpticalMaterial& mat, int qty) 
-        : material(mat), quantity(qty) {}
+    OrderItem() : unitPrice(0.0), quantity(0) {}
+    OrderItem(const std::shared_ptr<const OpticalMaterial>& mat, int qty) 
+        : material(mat), unitPrice(mat->getPrice()), quantity(qty) {}
 };
 
 class Order {
@@ -23,11 +32,22 @@ private:
     std::vector<OrderItem> items;
     double totalPrice;
     std::string orderDate;
+    // Set by the sender so a replayed order is recognized; may be empty
+    std::string idempotencyKey;
+    // Cancelled orders stay on record but hold no stock
+    bool cancelled;
+    // Fresh stamp on every change; keys the cached rendering
+    unsigned long long revision;
 
     void calculateTotalPrice();
+    void touch();
+    std::string renderOrder() const;
     void validateQuantity(int quantity) const;
     std::string generateOrderId() const;
     std::string getCurrentDate() const;
+    std::string contentKey() const;
+
+    friend struct Reflect<Order>;
 
 public:
     Order();
@@ -36,6 +56,8 @@ public:
     
     Order(const Order& other);
     
+    Order& operator=(const Order& other);
+    
     ~Order();
 
     std::string getOrderId() const;
@@ -44,17 +66,39 @@ public:
     double getTotalPrice() const;
     std::string getOrderDate() const;
     int getItemCount() const;
+    const std::vector<OrderItem>& getItems() const;
+    // Heap bytes owned beyond sizeof(Order); the materials its lines point
+    // at belong to the catalog
+    size_t heapBytes() const;
+    std::string getIdempotencyKey() const;
+    void setIdempotencyKey(const std::string& key);
+    // Hash of the supplier, date and lines, independent of the order id
+    // and of the line order; sameContent() confirms a match
+    uint64_t contentHash() const;
+    bool sameContent(const Order& other) const;
+    bool isCancelled() const;
+    void cancel();
+    // Undoes cancel()
+    void reinstate();
+    // (material id, quantity) of every cataloged line, for stock keeping
+    std::vector<std::pair<unsigned int, int> > stockLines() const;
 
+    void addItem(const std::shared_ptr<const OpticalMaterial>& material, int quantity);
     void addItem(const OpticalMaterial& material, int quantity);
+    // Adds many lines with one merge pass and a single total recalculation
+    void addItems(const std::vector<std::pair<std::shared_ptr<const OpticalMaterial>, int> >& lines);
     void removeItem(int index);
     void clearOrder();
     bool isEmpty() const;
     void displayOrder() const;
+    // Formatted order details, served from the render cache when unchanged
+    std::string render() const;
 
     friend std::ostream& operator<<(std::ostream& os, const Order& order);
     
     void saveToFile(std::ostream& os) const;
-    void loadFromFile(std::istream& is);
+    void loadFromFile(std::istream& is, const MaterialCatalog& catalog,
+                      int formatVersion = DATA_FORMAT_VERSION);
 };
 
 #endif
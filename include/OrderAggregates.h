@@ -0,0 +1,109 @@
+#ifndef ORDER_AGGREGATES_H
+#define ORDER_AGGREGATES_H
+
+#include <string>
+#include <vector>
+#include <map>
+#include <unordered_map>
+#include <utility>
+#include "Order.h"
+
+class TextSink;
+class DataFileReader;
+
+// Count and value of the orders behind one aggregate. Amounts are kept
+// in ten-thousandths of a BGN, so adding an order and later subtracting
+// it returns exactly to the previous figure.
+struct AggregateTotals {
+    long long orderCount;
+    long long amountUnits;
+
+    AggregateTotals() : orderCount(0), amountUnits(0) {}
+
+    double amount() const;
+    AggregateTotals& operator+=(const AggregateTotals& other);
+};
+
+struct SupplierSpend {
+    std::string bulstat;
+    AggregateTotals totals;
+};
+
+// Units ordered of one kind of material, over all its suppliers and
+// versions
+struct MaterialDemand {
+    std::string type;
+    std::string materialName;
+    long long quantity;
+    long long amountUnits;
+
+    MaterialDemand() : quantity(0), amountUnits(0) {}
+
+    double amount() const;
+};
+
+// Rows of the aggregates file
+struct SupplierPeriodRow {
+    std::string bulstat;
+    std::string period;     // YYYY-MM
+    AggregateTotals totals;
+};
+
+struct DayRow {
+    std::string day;        // YYYY-MM-DD
+    AggregateTotals totals;
+};
+
+// Running totals over every order of a shard, archived months included:
+// spend per supplier (overall and per month), quantity per material type
+// and name, and totals per day. Cancelled orders do not count; the shard
+// adds an order when it is placed or reinstated and subtracts it when it
+// is cancelled or removed, so no question needs a pass over the orders.
+class OrderAggregates {
+private:
+    struct SupplierTotals {
+        AggregateTotals overall;
+        std::map<std::string, AggregateTotals> byPeriod;
+    };
+
+    AggregateTotals overall;
+    std::unordered_map<std::string, SupplierTotals> bySupplier;
+    std::unordered_map<std::string, MaterialDemand> byMaterial;
+    std::map<std::string, AggregateTotals> byDay;
+
+    static std::string materialKey(const std::string& type, const std::string& materialName);
+    // sign is +1 to add the order, -1 to subtract it
+    void apply(const Order& order, int sign);
+
+public:
+    static long long toUnits(double amount);
+    static std::string dayOf(const std::string& orderDate);
+
+    void add(const Order& order);
+    void subtract(const Order& order);
+    void clear();
+
+    const AggregateTotals& getOverall() const;
+    AggregateTotals supplierTotals(const std::string& bulstat) const;
+    // Months fromPeriod to toPeriod (YYYY-MM), both included
+    AggregateTotals supplierTotals(const std::string& bulstat,
+                                   const std::string& fromPeriod, const std::string& toPeriod) const;
+    MaterialDemand materialDemand(const std::string& type, const std::string& materialName) const;
+    // Days fromDay to toDay (YYYY-MM-DD), both included
+    AggregateTotals totalsBetween(const std::string& fromDay, const std::string& toDay) const;
+
+    std::vector<SupplierSpend> allSupplierSpend() const;
+    std::vector<MaterialDemand> allMaterialDemand() const;
+    // The latest days with orders, newest first
+    std::vector<DayRow> recentDays(size_t limit) const;
+
+    // Number of stored aggregates
+    size_t size() const;
+    // Heap bytes of the tables
+    size_t memoryBytes() const;
+
+    void save(std::string& out, TextSink* sink = 0) const;
+    void load(DataFileReader& file);
+};
+
+#endif
@@ -0,0 +1,72 @@
+#ifndef ORDER_ARCHIVE_H
+#define ORDER_ARCHIVE_H
+
+#include <string>
+#include <vector>
+#include <unordered_set>
+#include <cstdint>
+#include "CowVector.h"
+#include "Order.h"
+#include "MaterialCatalog.h"
+
+struct ArchiveSegment {
+    std::string period;
+    size_t orderCount;
+    size_t rawBytes;
+    size_t storedBytes;
+};
+
+// Orders from past months are moved out of orders.dat into one
+// compressed, read-only segment per month ("YYYY-MM"). Only the manifest
+// is read at startup; segments are decompressed when a query needs them.
+//
+// Beside each segment a small keys file (orders-YYYY-MM.keys) lists the
+// content hash and scoped idempotency key of every sealed order, so an
+// order replayed after its month was sealed is still recognized. The
+// keys are read with the manifest; a keys file that is missing or does
+// not match its segment is rebuilt from the segment.
+class OrderArchive {
+private:
+    std::string baseName;
+    std::vector<ArchiveSegment> segments;
+    std::unordered_set<std::string> sealedKeys;
+    std::unordered_set<uint64_t> sealedHashes;
+
+    std::string manifestPath() const;
+    std::string segmentPath(const std::string& period) const;
+    std::string keysPath(const std::string& period) const;
+    void saveManifest() const;
+    void writeSegment(const std::string& period, const std::vector<Order>& orders);
+    void writeKeys(const std::string& period, const std::vector<Order>& orders);
+    // False when the keys file is missing, damaged or for another version
+    // of the segment
+    bool readKeys(const ArchiveSegment& segment);
+    void addKeys(const Order& order);
+    ArchiveSegment* findSegment(const std::string& period);
+    const ArchiveSegment* findSegment(const std::string& period) const;
+
+public:
+    explicit OrderArchive(const std::string& baseName = "orders");
+
+    static std::string periodOf(const std::string& orderDate);
+    static std::string currentPeriod();
+
+    // catalog resolves the orders of segments whose keys are rebuilt
+    void loadManifest(const MaterialCatalog& catalog);
+    const std::vector<ArchiveSegment>& getSegments() const;
+    size_t getArchivedOrderCount() const;
+    // Heap bytes of the sealed keys and hashes
+    size_t memoryBytes() const;
+
+    // Whether a sealed order has order's scoped idempotency key, or the
+    // same content (confirmed against its month's segment) with the rules
+    // OrderIndex::findDuplicate applies to current orders
+    bool holdsDuplicate(const Order& order, uint64_t contentHash, const MaterialCatalog& catalog) const;
+
+    // Seals every order older than the current period into its segment and
+    // returns the orders that stay hot.
+    CowVector<Order> sealColdOrders(const CowVector<Order>& orders, const MaterialCatalog& catalog);
+    std::vector<Order> loadSegment(const std::string& period, const MaterialCatalog& catalog) const;
+};
+
+#endif
@@ -0,0 +1,42 @@
+#ifndef ORDER_BATCH_H
+#define ORDER_BATCH_H
+
+#include <string>
+#include <vector>
+#include <iostream>
+#include "Order.h"
+#include "DataStore.h"
+
+struct OrderBatchLine {
+    size_t lineNumber;
+    std::string orderRef;
+    std::string supplierBulstat;
+    unsigned int materialId;
+    int quantity;
+};
+
+struct OrderBatchResult {
+    std::vector<Order> orders;
+    std::vector<std::string> errors;
+    size_t acceptedLines;
+    size_t rejectedOrders;
+};
+
+// Builds many orders at once from (order ref, supplier BULSTAT, material
+// id, quantity) lines. Lines are grouped per order ref, every supplier and
+// material is resolved once for the whole batch, and orders are priced in
+// parallel. An order with any bad line is rejected as a whole. The order
+// ref becomes the order's idempotency key, so importing the same batch
+// again adds nothing.
+class OrderBatch {
+public:
+    static const int MAX_LINE_QUANTITY = 10000;
+
+    // CSV: orderRef,bulstat,materialId,quantity; '#' comments and a
+    // leading header row are skipped
+    static std::vector<OrderBatchLine> parseCsv(std::istream& is, std::vector<std::string>& errors);
+
+    static OrderBatchResult build(const DataStore& store, const std::vector<OrderBatchLine>& lines);
+};
+
+#endif
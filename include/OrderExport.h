@@ -0,0 +1,86 @@
+#ifndef ORDER_EXPORT_H
+#define ORDER_EXPORT_H
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include "Order.h"
+#include "AsyncFile.h"
+#include "DataStore.h"
+
+enum ExportFormat {
+    EXPORT_CSV,
+    EXPORT_NDJSON,
+    EXPORT_COLUMNAR
+};
+
+// Orders dated from..to, both inclusive. The bounds are compared with the
+// start of the order date, so "2024-03" covers all of March; empty means
+// unbounded.
+struct ExportFilter {
+    std::string from;
+    std::string to;
+
+    bool matches(const std::string& orderDate) const;
+    // False when no date of the "YYYY-MM" period can match
+    bool coversPeriod(const std::string& period) const;
+};
+
+struct ExportSummary {
+    size_t orders;
+    size_t lines;
+    size_t bytes;
+};
+
+// Streams orders to a file for spreadsheets and finance tools. CSV and the
+// columnar format have a row per order line carrying its order's fields
+// (an order without lines gets one row with line 0); newline-delimited
+// JSON has an object per order with its lines nested.
+//
+// The columnar file is "OCOL" and a version, then the schema (for every
+// column its type: 0 string, 1 int64, 2 double, and its name), then row
+// groups of up to a chunk of orders: "RGRP", the row count, and every
+// column as its byte length followed by its values (strings as a 32-bit
+// length and bytes). A footer lists the row group offsets and the row
+// count; the file ends with the footer's offset and "OCOL". All integers
+// and doubles are little-endian.
+//
+// Orders are formatted a chunk per TaskScheduler task and written in
+// order while the next chunks are formatted, so memory use depends on
+// the batch size, not on the number of orders.
+class OrderExporter {
+private:
+    ExportFormat format;
+    AsyncFileWriter file;
+    std::vector<uint64_t> rowGroupOffsets;
+    size_t orderCount;
+    size_t lineCount;
+    size_t rowCount;
+    size_t chunkBytes;
+    bool finished;
+
+    void writeHeader();
+    void writeFooter();
+    void formatChunk(const std::vector<const Order*>& orders, size_t first, size_t last,
+                     std::string& text, size_t& lines, size_t& rows) const;
+
+public:
+    static const size_t ORDERS_PER_CHUNK = 1024;
+    static const size_t CHUNKS_PER_BATCH = 16;
+    static const uint32_t COLUMNAR_VERSION = 1;
+
+    // Creates or truncates path
+    OrderExporter(const std::string& path, ExportFormat format);
+
+    // Appends orders in the given sequence
+    void write(const std::vector<const Order*>& orders);
+    // Writes the trailer and waits for the file; throws if writing failed
+    ExportSummary finish();
+
+    // Archived months oldest first, one month in memory at a time, then
+    // the orders still in memory, all in date order
+    static ExportSummary exportOrders(const DataStore& store, const std::string& path,
+                                      ExportFormat format, const ExportFilter& filter);
+};
+
+#endif
@@ -0,0 +1,40 @@
+#ifndef ORDER_INDEX_H
+#define ORDER_INDEX_H
+
+#include <string>
+#include <unordered_map>
+#include <cstdint>
+#include "CowVector.h"
+#include "Order.h"
+
+// Duplicate detection over a list of orders. Each order is indexed by its
+// 64-bit content hash (supplier, date and canonical lines) and,
+// when it has one, by its idempotency key, which is scoped to the order's
+// supplier. Hash hits are confirmed against the stored order, so a
+// collision never rejects a distinct order.
+class OrderIndex {
+private:
+    std::unordered_multimap<uint64_t, size_t> byContent;
+    std::unordered_map<std::string, size_t> byKey;
+
+public:
+    // The order's idempotency key prefixed with its supplier, or empty
+    static std::string scopedKey(const Order& order);
+
+    // contentHash is order.contentHash(), passed in so callers compute it once
+    void add(size_t position, const Order& order, uint64_t contentHash);
+    // Drops the entries add() made for the order at position
+    void remove(size_t position, const Order& order, uint64_t contentHash);
+    void clear();
+    size_t size() const;
+    // Heap bytes of the lookup structures
+    size_t memoryBytes() const;
+
+    // Position of an indexed order that order duplicates, or -1: same
+    // idempotency key, or same content as an order that is not cancelled
+    // unless both orders carry keys
+    long findDuplicate(const Order& order, uint64_t contentHash,
+                       const CowVector<Order>& orders) const;
+};
+
+#endif
@@ -0,0 +1,69 @@
+#ifndef PRICE_MATRIX_H
+#define PRICE_MATRIX_H
+
+#include <string>
+#include "DataStore.h"
+
+enum MatrixLayout {
+    // A row per material and a price column per supplier
+    MATRIX_WIDE,
+    // A row per supplier offer, carrying its material's statistics
+    MATRIX_LONG
+};
+
+struct PriceMatrixSummary {
+    size_t rows;
+    // Rows offered by two suppliers or more
+    size_t comparableRows;
+    size_t suppliers;
+    size_t offers;
+    size_t outliers;
+    size_t bytes;
+    // Sorted runs written to disk because the offers outgrew the budget
+    size_t spilledRuns;
+};
+
+// Current prices of every material across all suppliers, as CSV. A row
+// is a material kind: type and name (trimmed, runs of whitespace made one
+// space, ASCII letters lowercased) with thickness and diopter, so "Lens"
+// at 1.5 mm from one supplier and "lens " at 1.50 mm from another meet
+// on the same row. Rows are sorted by that key; suppliers are columns in
+// store-wide order, named by BULSTAT. A supplier listing a kind twice
+// counts once, at its lower price.
+//
+// Each row has the number of suppliers, the minimum, median and maximum
+// price, and the suppliers whose price lies beyond 1.5 interquartile
+// ranges of the quartiles (low or high); a row needs MIN_OUTLIER_OFFERS
+// prices before any is called an outlier.
+//
+// The work runs on the TaskScheduler: pieces of suppliers build their
+// own tables of names, which are merged into one sorted table, then read
+// their materials into compact offers (about 32 bytes each) and sort
+// them in parallel. Half of memoryBudget holds offers; once the next
+// piece would not fit, the held ones are merged into one sorted run and
+// written to a temporary file next to path (path.run0, path.run1, ...).
+// The runs are merged k ways, each spilled one through a share of the
+// other half of the budget, and the files are removed when the export
+// ends, failed or not. Rows are formatted a chunk per task as the merge
+// produces them and written in order while the next chunks are
+// formatted, so neither the matrix nor, past the budget, the offers are
+// ever held whole. The names of the materials and suppliers are always
+// kept in memory; one piece larger than half the budget is held anyway.
+class PriceMatrix {
+public:
+    static const size_t MIN_OUTLIER_OFFERS = 4;
+    static const size_t SUPPLIERS_PER_PIECE = 64;
+    static const size_t ROWS_PER_CHUNK = 256;
+    static const size_t CHUNKS_PER_BATCH = 16;
+    static const size_t MEMORY_BUDGET = 256u << 20;
+
+    // Type and material name as they are compared
+    static std::string canonicalText(const std::string& text);
+
+    // Creates or truncates path; throws if writing fails. memoryBudget is
+    // in bytes.
+    static PriceMatrixSummary exportMatrix(const DataStore& store, const std::string& path,
+                                           MatrixLayout layout, size_t memoryBudget = MEMORY_BUDGET);
+};
+
+#endif
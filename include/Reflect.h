@@ -0,0 +1,18 @@
+#ifndef REFLECT_H
+#define REFLECT_H
+
+// Field table of a model class, specialised in ModelReflection.h:
+//
+//   template <typename Visitor>
+//   static void visit(T& object, Visitor& visitor);
+//
+// visit() walks the fields in file order by calling visitor.field(label,
+// member), visitor.object(label, member) and visitor.sequence(label,
+// member). Every codec in Codecs.h is a visitor, so one table gives the
+// text, binary and report formats. Writers are handed a const_cast object
+// and only read from it; code that should run on load only is guarded by
+// Visitor::LOADING, and older layouts by visitor.version().
+template <typename T>
+struct Reflect;
+
+#endif
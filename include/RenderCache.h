@@ -0,0 +1,51 @@
+#ifndef RENDER_CACHE_H
+#define RENDER_CACHE_H
+
+#include <string>
+#include <list>
+#include <unordered_map>
+#include <mutex>
+#include <cstddef>
+
+// Bounded LRU of rendered console views. Entries are keyed by view and by
+// the revision stamp of the entity they show; every mutation gives the
+// entity a fresh stamp, so an outdated view can never be returned and just
+// ages out of the cache.
+class RenderCache {
+public:
+    enum View {
+        VIEW_SUPPLIER_MATERIALS,
+        VIEW_ORDER_DETAILS
+    };
+
+    static const size_t DEFAULT_CAPACITY_BYTES = 8 * 1024 * 1024;
+
+    // Process-wide, never reused; 0 is never handed out
+    static unsigned long long nextRevision();
+    static RenderCache& shared();
+
+    explicit RenderCache(size_t capacityBytes = DEFAULT_CAPACITY_BYTES);
+
+    bool find(View view, unsigned long long revision, std::string& text);
+    void store(View view, unsigned long long revision, const std::string& text);
+    void clear();
+
+    size_t size() const;
+    size_t sizeInBytes() const;
+
+private:
+    struct Entry {
+        unsigned long long key;
+        std::string text;
+    };
+
+    size_t capacityBytes;
+    size_t usedBytes;
+    std::list<Entry> entries;   // most recently used first
+    std::unordered_map<unsigned long long, std::list<Entry>::iterator> positions;
+    mutable std::mutex mutex;
+
+    static unsigned long long makeKey(View view, unsigned long long revision);
+};
+
+#endif
@@ -0,0 +1,69 @@
+#ifndef STOCK_COUNTERS_H
+#define STOCK_COUNTERS_H
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <unordered_map>
+#include "Supplier.h"
+
+// Units still free to reserve, one atomic counter per tracked material,
+// so placing an order takes its stock without the shard lock. A supplier's
+// counters start at its levels on hand and stay below them by the units
+// of orders reserved but not yet stored.
+//
+// reserve() and release() may run on any thread at any time. The other
+// changes are serialized by the owning shard's lock; each swaps in fresh
+// counters for one supplier at its committed levels, and a reservation
+// made on counters that were swapped out since is no longer current and
+// must be taken again (DataShard does that under its lock).
+class StockCounters {
+public:
+    typedef std::vector<std::pair<unsigned int, int> > Lines;
+
+private:
+    // One supplier's tracked materials, sorted by id; only the counts change
+    struct SupplierStock {
+        std::vector<unsigned int> materialIds;
+        std::unique_ptr<std::atomic<int>[]> available;
+    };
+    typedef std::unordered_map<std::string, std::shared_ptr<SupplierStock> > Bucket;
+
+    // Suppliers are spread over buckets so adding one copies a small map;
+    // each bucket is read with std::atomic_load and replaced whole
+    static const size_t BUCKET_COUNT = 256;
+    std::shared_ptr<const Bucket> buckets[BUCKET_COUNT];
+
+    size_t bucketOf(const std::string& bulstat) const;
+    std::shared_ptr<SupplierStock> find(const std::string& bulstat) const;
+    void publish(const std::string& bulstat, const std::shared_ptr<SupplierStock>& stock);
+
+public:
+    // Units taken from one supplier's counters: its counted lines, merged
+    // per material, and the counters they came from
+    struct Reservation {
+        std::shared_ptr<SupplierStock> stock;
+        Lines lines;
+    };
+
+    StockCounters();
+
+    // Takes every counted line or none: lines of a material add up, each
+    // material is taken with compare-and-swap, and when one falls short
+    // the ones already taken are given back and InsufficientStockError is
+    // thrown. Materials without a counter are not counted.
+    Reservation reserve(const std::string& bulstat, const Lines& lines) const;
+    // Gives a reservation's units back to the counters it came from
+    static void cancel(const Reservation& reservation);
+    bool isCurrent(const std::string& bulstat, const Reservation& reservation) const;
+    // Returns units of a stored order whose committed levels went up
+    void release(const std::string& bulstat, const Lines& lines) const;
+
+    // Counters at the supplier's levels on hand, none when it tracks no stock
+    void reset(const Supplier& supplier);
+    void remove(const std::string& bulstat);
+    void clear();
+};
+
+#endif
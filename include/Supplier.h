@@ -4,20 +4,71 @@
 #include <string>
 #include <vector>
 #include <iostream>
+#include <cstdint>
+#include <utility>
+#include <stdexcept>
 #include "OpticalMaterial.h"
+#include "CowVector.h"
+#include "CompactText.h"
+#include "MemoryUsage.h"
+#include "CatalogDelta.h"
+#include "Reflect.h"
+
+// Units on hand of one material. Materials without an entry are not
+// counted, so orders for them are never refused.
+struct StockLevel {
+    unsigned int materialId;
+    int onHand;
+
+    StockLevel() : materialId(0), onHand(0) {}
+    StockLevel(unsigned int materialId, int onHand) : materialId(materialId), onHand(onHand) {}
+};
+
+// An order asked for more units than a supplier has on hand
+class InsufficientStockError : public std::runtime_error {
+public:
+    explicit InsufficientStockError(const std::string& message) : std::runtime_error(message) {}
+};
 
 class Supplier {
 private:
-    std::string bulstat;
-    std::string name;
-    std::string location;
-    std::string phoneNumber;
-    std::vector<OpticalMaterial> materials;
+    // 9 or 13 digits, a BULSTAT fits one packed word
+    PackedDigits<1> bulstat;
+    CompactString name;
+    // Suppliers share a few cities
+    PooledString location;
+    PackedDigits<2> phoneNumber;
+    CowVector<OpticalMaterial> materials;
+    unsigned int nextMaterialId;
+    // Bumped once per applied catalog delta
+    unsigned int catalogVersion;
+    // Indexed by material id (ids are handed out in sequence): position in
+    // materials plus one, 0 for an id that is not in use
+    std::vector<uint32_t> materialPositions;
+    // Sorted by material id
+    std::vector<StockLevel> stock;
+    // Fresh stamp on every change; keys the cached material listing
+    unsigned long long revision;
 
+    void rebuildMaterialPositions();
+    void setMaterialPosition(unsigned int materialId, size_t position);
+    // Gives legacy materials their ids once a record has been read
+    void numberLoadedMaterials();
+    void removeMaterialAt(size_t position);
+    std::vector<StockLevel>::iterator findStock(unsigned int materialId);
+    std::vector<StockLevel>::const_iterator findStock(unsigned int materialId) const;
+    // Sorts loaded stock entries and drops those of unknown materials
+    void normalizeLoadedStock();
+    void touch();
+    std::string renderMaterials() const;
     void validateBulstat(const std::string& bulstat) const;
     void validatePhoneNumber(const std::string& phone) const;
 
+    friend struct Reflect<Supplier>;
+
 public:
+    static const int UNTRACKED_STOCK = -1;
+
     Supplier();
     
     Supplier(const std::string& bulstat, const std::string& name, 
@@ -25,30 +76,53 @@ public:
     
     Supplier(const Supplier& other);
     
+    Supplier& operator=(const Supplier& other);
+    
     ~Supplier();
 
     std::string getBulstat() const;
     std::string getName() const;
     std::string getLocation() const;
     std::string getPhoneNumber() const;
-    const std::vector<OpticalMaterial>& getMaterials() const;
+    const CowVector<OpticalMaterial>& getMaterials() const;
+    unsigned int getCatalogVersion() const;
+    // Position of the material with this id, or -1
+    int findMaterial(unsigned int materialId) const;
 
     void setBulstat(const std::string& bulstat);
     void setName(const std::string& name);
     void setLocation(const std::string& location);
     void setPhoneNumber(const std::string& phoneNumber);
     
+    // Assigns the next stable material id when the material has none
     void addMaterial(const OpticalMaterial& material);
     void removeMaterial(int index);
+    // Applies all changes or none, in O(changes). Returns the delta as
+    // applied: ids of added materials filled in, baseVersion set.
+    CatalogDelta applyDelta(const std::vector<MaterialChange>& changes);
     void displayMaterials() const;
     int getMaterialCount() const;
     OpticalMaterial getMaterial(int index) const;
+    // Adds the supplier's own heap to usage.suppliers and its materials to
+    // usage.materials; sizeof(Supplier) is counted by its container
+    void addMemoryUsage(MemoryUsage& usage) const;
+
+    // Units on hand, or UNTRACKED_STOCK when the material is not counted
+    int getStock(unsigned int materialId) const;
+    bool tracksStock() const;
+    // onHand == UNTRACKED_STOCK stops counting the material
+    void setStock(unsigned int materialId, int onHand);
+    // Takes the quantity of every (material id, quantity) line, or throws
+    // InsufficientStockError and takes nothing
+    void reserveStock(const std::vector<std::pair<unsigned int, int> >& lines);
+    // Puts units back for the materials that are still counted
+    void releaseStock(const std::vector<std::pair<unsigned int, int> >& lines);
 
     friend std::ostream& operator<<(std::ostream& os, const Supplier& supplier);
     friend std::istream& operator>>(std::istream& is, Supplier& supplier);
     
     void saveToFile(std::ostream& os) const;
-    void loadFromFile(std::istream& is);
+    void loadFromFile(std::istream& is, int formatVersion = DATA_FORMAT_VERSION);
 };
 
 #endif
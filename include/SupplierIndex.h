@@ -0,0 +1,77 @@
+#ifndef SUPPLIER_INDEX_H
+#define SUPPLIER_INDEX_H
+
+#include <string>
+#include <vector>
+#include <map>
+#include <unordered_map>
+#include <cstdint>
+#include "Supplier.h"
+
+class BinaryWriter;
+class BinaryReader;
+
+struct SupplierMatch {
+    int supplierIndex;
+    double score;
+};
+
+// Lookup structures over the supplier list: exact BULSTAT/phone maps for
+// duplicate checks, an ordered token dictionary for prefix search and a
+// trigram index over the distinct tokens for typo-tolerant search.
+class SupplierIndex {
+private:
+    enum Field { NAME_FIELD = 0, LOCATION_FIELD = 1 };
+
+    struct Posting {
+        int supplierIndex;
+        unsigned char field;
+    };
+
+    std::unordered_map<std::string, int> byBulstat;
+    std::unordered_map<std::string, int> byPhone;
+    std::map<std::string, int> tokenIds;
+    std::vector<std::string> tokenText;
+    std::vector<std::vector<Posting> > postings;
+    std::unordered_map<uint32_t, std::vector<int> > trigrams;
+    size_t supplierCount;
+
+    static std::vector<std::string> tokenize(const std::string& text);
+    static std::vector<uint32_t> trigramsOf(const std::string& token);
+    static int boundedDistance(const std::string& a, const std::string& b, int limit);
+
+    void addToken(const std::string& token, int supplierIndex, Field field);
+    // Writes the best score per supplier into termScores (dense, indexed by
+    // supplier) and lists every supplier it touched.
+    void matchTerm(const std::string& term, std::vector<double>& termScores,
+                   std::vector<int>& touched) const;
+    void scoreToken(int tokenId, double base, std::vector<double>& termScores,
+                    std::vector<int>& touched) const;
+
+public:
+    SupplierIndex();
+
+    void add(int supplierIndex, const Supplier& supplier);
+    // Undoes add() for the supplier added last. Its tokens stay in the
+    // dictionary with no postings, so the trigram lists need no update.
+    void removeLast(const Supplier& supplier);
+    void clear();
+    size_t size() const;
+    // Heap bytes of the lookup structures
+    size_t memoryBytes() const;
+
+    // The structures as they are, for the prebuilt index file; load()
+    // replaces the contents and throws when the input is cut short
+    void save(BinaryWriter& writer) const;
+    void load(BinaryReader& reader);
+
+    int findByBulstat(const std::string& bulstat) const;
+    int findByPhone(const std::string& phoneNumber) const;
+
+    // Ranked matches for every query word (prefix or close spelling) in
+    // the supplier's name or location; an empty query returns the first
+    // suppliers in insertion order.
+    std::vector<SupplierMatch> search(const std::string& query, size_t limit) const;
+};
+
+#endif
@@ -0,0 +1,158 @@
+#ifndef TASK_SCHEDULER_H
+#define TASK_SCHEDULER_H
+
+#include <vector>
+#include <deque>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+#include <exception>
+#include <utility>
+#include <cstddef>
+
+class TaskGroup;
+
+// Work-stealing thread pool shared by everything that runs in parallel.
+// Every pool thread owns a deque: it pushes and pops its own tasks at the
+// back, and idle threads steal from the front of the others'. Tasks
+// submitted from outside the pool go to a shared deque. A thread waiting
+// for its tasks runs queued tasks meanwhile, so tasks may start and wait
+// for tasks of their own without tying up the pool. Never wait while
+// holding a lock that a queued task might take.
+class TaskScheduler {
+private:
+    struct Job {
+        std::function<void()> run;
+        TaskGroup* group;
+    };
+
+    struct Queue {
+        std::mutex mutex;
+        std::deque<Job> jobs;
+    };
+
+    // queues[0] is shared by outside threads, queues[i] belongs to pool thread i
+    std::vector<std::unique_ptr<Queue> > queues;
+    std::vector<std::thread> threads;
+    std::atomic<size_t> queued;
+    // Idle pool threads sleep on wake and threads waiting for a group on
+    // finished, so a finished group does not stir the whole pool
+    std::atomic<size_t> idleWorkers;
+    std::atomic<size_t> idleWaiters;
+    std::mutex sleepMutex;
+    std::condition_variable wake;
+    std::condition_variable finished;
+    bool stopping;
+
+    size_t ownQueue() const;
+    void submit(const std::function<void()>& task, TaskGroup* group);
+    bool takeJob(Job& job);
+    bool runOne();
+    void waitForGroup(TaskGroup& group);
+    void groupFinished();
+    void workerLoop(size_t index);
+
+    friend class TaskGroup;
+
+public:
+    typedef std::pair<size_t, size_t> Range;
+
+    static const size_t MAX_WORKER_COUNT = 256;
+    // parallelFor splits a range into at most this many pieces per worker,
+    // so a slow piece can be balanced by stealing the others
+    static const size_t PIECES_PER_WORKER = 4;
+
+    // OPTICAL_THREADS when it is set to 1..MAX_WORKER_COUNT, otherwise
+    // the number of cores
+    static size_t configuredWorkerCount();
+    // Process-wide scheduler, created on first use
+    static TaskScheduler& instance();
+
+    // workerCount threads take part, the waiting caller being one of
+    // them: 1 runs everything on the caller
+    explicit TaskScheduler(size_t workerCount = configuredWorkerCount());
+    ~TaskScheduler();
+
+    size_t getWorkerCount() const;
+
+    // Runs task(i) for every i below count; rethrows the first failure
+    void forEach(size_t count, const std::function<void(size_t)>& task);
+    // Calls body(first, last) on pieces of [begin, end) no smaller than
+    // grain (except the last); rethrows the first failure
+    void parallelFor(size_t begin, size_t end, size_t grain,
+                     const std::function<void(size_t, size_t)>& body);
+    // The pieces parallelFor would use, in order
+    std::vector<Range> split(size_t begin, size_t end, size_t grain) const;
+
+    // map(first, last) gives each piece's value; the values are folded
+    // with combine in piece order, so the result does not depend on
+    // timing as long as combine is associative
+    template <typename T, typename Map, typename Combine>
+    T parallelReduce(size_t begin, size_t end, size_t grain, const T& identity,
+                     Map map, Combine combine) {
+        std::vector<Range> pieces = split(begin, end, grain);
+        std::vector<T> partial(pieces.size(), identity);
+        forEach(pieces.size(), [&](size_t piece) {
+            partial[piece] = map(pieces[piece].first, pieces[piece].second);
+        });
+        T result = identity;
+        for (size_t i = 0; i < partial.size(); ++i) {
+            result = combine(result, partial[i]);
+        }
+        return result;
+    }
+};
+
+// Tasks that are waited for together. wait() runs queued tasks until all
+// of the group's have finished, then rethrows the first failure; the
+// destructor waits too but swallows failures.
+class TaskGroup {
+private:
+    TaskScheduler& scheduler;
+    std::atomic<size_t> pending;
+    std::mutex failureMutex;
+    std::exception_ptr failure;
+
+    void waitIdle();
+    void finish(std::exception_ptr error);
+
+    friend class TaskScheduler;
+
+public:
+    explicit TaskGroup(TaskScheduler& scheduler = TaskScheduler::instance());
+    ~TaskGroup();
+
+    void run(const std::function<void()>& task);
+    void wait();
+    bool failed();
+};
+
+// Tasks with ordering constraints. A task starts once every task it was
+// declared to follow has finished; independent tasks run in parallel.
+// When a task fails, the tasks after it are skipped and run() rethrows.
+class TaskGraph {
+private:
+    struct Node {
+        std::function<void()> task;
+        std::vector<size_t> successors;
+        size_t predecessors;
+    };
+
+    std::vector<Node> nodes;
+
+public:
+    typedef size_t TaskId;
+
+    TaskId add(const std::function<void()>& task);
+    // after starts only once before has finished
+    void precede(TaskId before, TaskId after);
+    size_t size() const;
+
+    // Throws std::logic_error if the constraints form a cycle
+    void run(TaskScheduler& scheduler = TaskScheduler::instance());
+};
+
+#endif
@@ -0,0 +1,128 @@
+#ifndef TRANSACTION_H
+#define TRANSACTION_H
+
+#include <string>
+#include <vector>
+#include <deque>
+#include "DataStore.h"
+
+// One step of a transaction. Each kind has an opposite kind (a catalog
+// delta is undone by another delta), so undoing an edit is applying
+// edits. Suppliers are named by BULSTAT, which outlives store-wide
+// numbers across undo.
+struct StoreEdit {
+    enum Kind {
+        ADD_SUPPLIER, REMOVE_SUPPLIER,
+        ADD_ORDER, REMOVE_ORDER,
+        CANCEL_ORDER, REINSTATE_ORDER,
+        SET_STOCK, CATALOG_DELTA
+    };
+
+    Kind kind;
+    Supplier supplier;                      // *_SUPPLIER
+    Order order;                            // *_ORDER
+    std::string supplierBulstat;            // SET_STOCK, CATALOG_DELTA
+    unsigned int materialId;                // SET_STOCK
+    int onHand;                             // SET_STOCK
+    std::vector<MaterialChange> changes;    // CATALOG_DELTA
+
+    StoreEdit() : kind(ADD_ORDER), materialId(0), onHand(0) {}
+};
+
+// The edits of one transaction as applied, and the edits that undo them
+// in the order they are to be applied from the back
+struct EditBatch {
+    std::string description;
+    std::vector<StoreEdit> edits;
+    std::vector<StoreEdit> inverses;
+};
+
+// A group of store changes that stands or falls together. Each operation
+// is applied at once and logged with its inverse; rollback() applies the
+// inverses newest first, so aborting costs as much as the edits made,
+// not a reload. A transaction that is neither committed nor rolled back
+// rolls back when it goes out of scope, e.g. while an exception unwinds.
+//
+// Catalog changes are undone by compensating deltas (a removal for an
+// addition, the old price for a price change) that go through the change
+// log like any other, so the log still replays to the current state.
+// Catalog versions are never taken back.
+class Transaction {
+private:
+    DataStore& store;
+    EditBatch batch;
+    bool open;
+
+    void checkOpen() const;
+    // Keeps edit and what undoes it; inverse is in the order to apply it
+    void record(const StoreEdit& edit, const std::vector<StoreEdit>& inverse);
+    void perform(const StoreEdit& edit);
+    void performAddSupplier(const Supplier& supplier);
+    void performRemoveSupplier(const std::string& bulstat);
+    bool performAddOrder(const Order& order);
+    void performRemoveOrder(const Order& order);
+    void performCancelOrder(const Order& order);
+    void performReinstateOrder(const Order& order);
+    void performSetStock(const std::string& bulstat, unsigned int materialId, int onHand);
+    CatalogDelta performCatalogDelta(const std::string& bulstat, const std::vector<MaterialChange>& changes);
+
+public:
+    Transaction(DataStore& store, const std::string& description);
+    ~Transaction();
+
+    void addSupplier(const Supplier& supplier);
+    void addMaterial(int supplierIndex, const OpticalMaterial& material);
+    // See DataStore::addOrder and DataStore::addOrders
+    bool addOrder(const Order& order);
+    size_t addOrders(const std::vector<Order>& newOrders, std::vector<std::string>* stockErrors = 0);
+    void cancelOrder(const Order& order);
+    void setStock(int supplierIndex, unsigned int materialId, int onHand);
+    CatalogDelta applyCatalogDelta(int supplierIndex, const std::vector<MaterialChange>& changes);
+    // Any logged edit, e.g. one replayed by EditHistory
+    void apply(const StoreEdit& edit);
+
+    // Number of logged edits
+    size_t size() const;
+    bool isOpen() const;
+    // Keeps the changes; the returned batch can go to an EditHistory
+    EditBatch commit();
+    // Undoes every edit, newest first. A step that fails (an order that
+    // a save has since archived) is skipped; the first such error is
+    // rethrown once the rest are undone.
+    void rollback();
+};
+
+// Committed transactions that can be undone and redone, newest last. It
+// keeps up to its limit; recording a new one clears the redo side. Undo
+// and redo run as transactions of their own, so either happens entirely
+// or not at all. The store must change only through recorded
+// transactions; whoever reloads it clears the history.
+class EditHistory {
+private:
+    std::deque<EditBatch> undoStack;
+    std::vector<EditBatch> redoStack;
+    size_t limit;
+
+    void push(const EditBatch& batch);
+
+public:
+    static const size_t DEFAULT_LIMIT = 100;
+
+    explicit EditHistory(size_t limit = DEFAULT_LIMIT);
+
+    // Batches without edits are not kept
+    void record(const EditBatch& batch);
+    bool canUndo() const;
+    bool canRedo() const;
+    // Descriptions of what undo()/redo() would apply next
+    const std::string& nextUndo() const;
+    const std::string& nextRedo() const;
+    // Return the description of the batch undone or redone. Throw
+    // std::logic_error when there is nothing to do; when applying fails,
+    // the store and the history stay as they were.
+    std::string undo(DataStore& store);
+    std::string redo(DataStore& store);
+    void clear();
+};
+
+#endif
@@ -0,0 +1,38 @@
+#ifndef VALIDATION_H
+#define VALIDATION_H
+
+#include <string>
+#include <vector>
+
+// Instruction sets the batch checks can classify characters with
+enum ValidationKernel {
+    // The widest one this CPU runs
+    VALIDATION_BEST,
+    VALIDATION_SCALAR,
+    VALIDATION_SSE42,
+    VALIDATION_AVX2
+};
+
+// BULSTAT and phone number rules shared by Supplier and bulk ingestion.
+// Every check returns 0 for a valid value, otherwise the exact message the
+// Supplier setters throw. The batch versions classify characters with
+// SIMD, run large batches on the shared TaskScheduler and report the same
+// first error as the one-at-a-time checks. Their kernel is picked once at
+// runtime from what the CPU supports (AVX2, then SSE4.2, then scalar), so
+// one binary runs everywhere.
+class Validation {
+public:
+    static const char* checkBulstat(const std::string& bulstat);
+    static const char* checkPhoneNumber(const std::string& phone);
+
+    // A kernel the CPU lacks throws std::invalid_argument
+    static std::vector<const char*> checkBulstats(const std::vector<std::string>& values,
+                                                  ValidationKernel kernel = VALIDATION_BEST);
+    static std::vector<const char*> checkPhoneNumbers(const std::vector<std::string>& values,
+                                                      ValidationKernel kernel = VALIDATION_BEST);
+
+    static bool hasKernel(ValidationKernel kernel);
+    static const char* kernelName(ValidationKernel kernel = VALIDATION_BEST);
+};
+
+#endif
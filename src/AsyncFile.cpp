@@ -0,0 +1,594 @@
+#include "AsyncFile.h"
+#include <fstream>
+#include <stdexcept>
+#include <algorithm>
+#include <cstring>
+#include <cerrno>
+
+#if OPTICAL_IO_URING && defined(__linux__)
+#define OPTICAL_HAVE_RING 1
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <unordered_map>
+#else
+#define OPTICAL_HAVE_RING 0
+#endif
+
+// Issues reads and writes at explicit offsets and reports them complete
+class IoEngine {
+public:
+    enum Operation { READ, WRITE };
+
+    virtual ~IoEngine() {}
+    virtual void submit(Operation operation, char* data, size_t length, size_t offset, size_t tag) = 0;
+    // Waits for one submitted request; result is a byte count or -errno
+    virtual void wait(size_t& tag, long& result) = 0;
+    // Closes the file; false if buffered data could not be written
+    virtual bool close() = 0;
+};
+
+namespace {
+
+// One blocking call at a time through a stream; requests complete inside
+// submit() and wait() hands back their results in order
+class BlockingEngine : public IoEngine {
+private:
+    std::fstream file;
+    std::deque<std::pair<size_t, long> > done;
+
+public:
+    BlockingEngine(const std::string& path, bool writing) {
+        std::ios::openmode mode = std::ios::binary |
+                                  (writing ? std::ios::out | std::ios::trunc : std::ios::in);
+        file.open(path.c_str(), mode);
+        if (!file) {
+            throw std::runtime_error("Cannot open " + path);
+        }
+    }
+
+    void submit(Operation operation, char* data, size_t length, size_t offset, size_t tag) {
+        long result;
+        file.clear();
+        if (operation == READ) {
+            file.seekg(static_cast<std::streamoff>(offset));
+            file.read(data, static_cast<std::streamsize>(length));
+            result = file.bad() ? -EIO : static_cast<long>(file.gcount());
+        } else {
+            file.seekp(static_cast<std::streamoff>(offset));
+            file.write(data, static_cast<std::streamsize>(length));
+            result = file ? static_cast<long>(length) : -EIO;
+        }
+        done.push_back(std::make_pair(tag, result));
+    }
+
+    void wait(size_t& tag, long& result) {
+        if (done.empty()) {
+            throw std::logic_error("No I/O request is pending");
+        }
+        tag = done.front().first;
+        result = done.front().second;
+        done.pop_front();
+    }
+
+    bool close() {
+        file.close();
+        return !file.fail();
+    }
+};
+
+#if OPTICAL_HAVE_RING
+
+// Minimal io_uring driver over the raw system calls: one submission per
+// request, completions reaped from the shared ring. Kernels without the
+// READ/WRITE opcodes (before 5.6) answer EINVAL; those requests, and all
+// later ones, are done with pread/pwrite instead.
+class RingEngine : public IoEngine {
+private:
+    struct Request {
+        Operation operation;
+        char* data;
+        size_t length;
+        size_t offset;
+    };
+
+    static const unsigned ENTRIES = 8;
+
+    int fd;
+    int ringFd;
+    void* sqRing;
+    size_t sqRingSize;
+    void* cqRing;
+    size_t cqRingSize;
+    io_uring_sqe* sqes;
+    size_t sqesSize;
+    unsigned* sqTail;
+    unsigned* sqMask;
+    unsigned* sqArray;
+    unsigned* cqHead;
+    unsigned* cqTail;
+    unsigned* cqMask;
+    io_uring_cqe* cqes;
+    bool ringWorks;
+    std::unordered_map<size_t, Request> requests;
+    std::deque<std::pair<size_t, long> > done;
+
+    RingEngine() : fd(-1), ringFd(-1), sqRing(MAP_FAILED), sqRingSize(0), cqRing(MAP_FAILED),
+                   cqRingSize(0), sqes(0), sqesSize(0), ringWorks(true) {}
+
+    bool setUp() {
+        io_uring_params params;
+        std::memset(&params, 0, sizeof(params));
+        ringFd = static_cast<int>(syscall(__NR_io_uring_setup, ENTRIES, &params));
+        if (ringFd < 0) {
+            return false;
+        }
+
+        sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        bool singleMap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+        if (singleMap) {
+            sqRingSize = cqRingSize = std::max(sqRingSize, cqRingSize);
+        }
+        sqRing = mmap(0, sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                      ringFd, IORING_OFF_SQ_RING);
+        if (sqRing == MAP_FAILED) {
+            return false;
+        }
+        if (singleMap) {
+            cqRing = sqRing;
+        } else {
+            cqRing = mmap(0, cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                          ringFd, IORING_OFF_CQ_RING);
+            if (cqRing == MAP_FAILED) {
+                return false;
+            }
+        }
+        sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+        void* sqeMap = mmap(0, sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                            ringFd, IORING_OFF_SQES);
+        if (sqeMap == MAP_FAILED) {
+            return false;
+        }
+        sqes = static_cast<io_uring_sqe*>(sqeMap);
+
+        char* sq = static_cast<char*>(sqRing);
+        char* cq = static_cast<char*>(cqRing);
+        sqTail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+        sqMask = reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+        sqArray = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+        cqHead = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+        cqTail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+        cqMask = reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+        cqes = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+        return true;
+    }
+
+    long direct(const Request& request) {
+        ssize_t result = request.operation == READ
+            ? pread(fd, request.data, request.length, static_cast<off_t>(request.offset))
+            : pwrite(fd, request.data, request.length, static_cast<off_t>(request.offset));
+        return result < 0 ? -errno : static_cast<long>(result);
+    }
+
+public:
+    ~RingEngine() {
+        if (sqes) {
+            munmap(sqes, sqesSize);
+        }
+        if (cqRing != MAP_FAILED && cqRing != sqRing) {
+            munmap(cqRing, cqRingSize);
+        }
+        if (sqRing != MAP_FAILED) {
+            munmap(sqRing, sqRingSize);
+        }
+        if (ringFd >= 0) {
+            ::close(ringFd);
+        }
+        if (fd >= 0) {
+            ::close(fd);
+        }
+    }
+
+    static bool probe() {
+        RingEngine engine;
+        return engine.setUp();
+    }
+
+    // Null when io_uring is unavailable; throws when the file cannot be opened
+    static RingEngine* open(const std::string& path, bool writing) {
+        std::unique_ptr<RingEngine> engine(new RingEngine());
+        if (!engine->setUp()) {
+            return 0;
+        }
+        engine->fd = writing ? ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644)
+                             : ::open(path.c_str(), O_RDONLY);
+        if (engine->fd < 0) {
+            throw std::runtime_error("Cannot open " + path);
+        }
+        return engine.release();
+    }
+
+    void submit(Operation operation, char* data, size_t length, size_t offset, size_t tag) {
+        Request request = { operation, data, length, offset };
+        if (!ringWorks) {
+            done.push_back(std::make_pair(tag, direct(request)));
+            return;
+        }
+
+        unsigned tail = *sqTail;
+        unsigned index = tail & *sqMask;
+        io_uring_sqe* sqe = &sqes[index];
+        std::memset(sqe, 0, sizeof(*sqe));
+        sqe->opcode = operation == READ ? IORING_OP_READ : IORING_OP_WRITE;
+        sqe->fd = fd;
+        sqe->addr = reinterpret_cast<unsigned long>(data);
+        sqe->len = static_cast<unsigned>(length);
+        sqe->off = offset;
+        sqe->user_data = tag;
+        sqArray[index] = index;
+        __atomic_store_n(sqTail, tail + 1, __ATOMIC_RELEASE);
+
+        requests[tag] = request;
+        if (syscall(__NR_io_uring_enter, ringFd, 1, 0, 0, 0, 0) < 0) {
+            throw std::runtime_error(std::string("io_uring submit failed: ") + std::strerror(errno));
+        }
+    }
+
+    void wait(size_t& tag, long& result) {
+        if (!done.empty()) {
+            tag = done.front().first;
+            result = done.front().second;
+            done.pop_front();
+            return;
+        }
+
+        while (true) {
+            unsigned head = *cqHead;
+            if (head != __atomic_load_n(cqTail, __ATOMIC_ACQUIRE)) {
+                const io_uring_cqe& cqe = cqes[head & *cqMask];
+                tag = static_cast<size_t>(cqe.user_data);
+                result = cqe.res;
+                __atomic_store_n(cqHead, head + 1, __ATOMIC_RELEASE);
+
+                if (result == -EINVAL || result == -EOPNOTSUPP) {
+                    ringWorks = false;
+                    result = direct(requests[tag]);
+                }
+                requests.erase(tag);
+                return;
+            }
+            if (syscall(__NR_io_uring_enter, ringFd, 0, 1, IORING_ENTER_GETEVENTS, 0, 0) < 0 &&
+                errno != EINTR) {
+                throw std::runtime_error(std::string("io_uring wait failed: ") + std::strerror(errno));
+            }
+        }
+    }
+
+    bool close() {
+        int result = ::close(fd);
+        fd = -1;
+        return result == 0;
+    }
+};
+
+#endif
+
+std::unique_ptr<IoEngine> openEngine(const std::string& path, bool writing) {
+#if OPTICAL_HAVE_RING
+    RingEngine* ring = RingEngine::open(path, writing);
+    if (ring) {
+        return std::unique_ptr<IoEngine>(ring);
+    }
+#endif
+    return std::unique_ptr<IoEngine>(new BlockingEngine(path, writing));
+}
+
+}
+
+const char* asyncFileBackend() {
+#if OPTICAL_HAVE_RING
+    static const bool ringAvailable = RingEngine::probe();
+    if (ringAvailable) {
+        return "io_uring";
+    }
+#endif
+    return "threads";
+}
+
+const size_t AsyncFileReader::CHUNK_SIZE;
+const size_t AsyncFileReader::QUEUE_DEPTH;
+const size_t AsyncFileWriter::QUEUE_DEPTH;
+
+AsyncFileReader::AsyncFileReader(const std::string& path)
+    : path(path), available(0), stopping(false) {
+    std::ifstream file(path.c_str(), std::ios::binary | std::ios::ate);
+    if (!file) {
+        throw std::runtime_error("Cannot open " + path);
+    }
+    buffer.assign(static_cast<size_t>(file.tellg()), '\0');
+    file.close();
+
+    engine = openEngine(path, false);
+    worker = std::thread(&AsyncFileReader::run, this);
+}
+
+AsyncFileReader::~AsyncFileReader() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    worker.join();
+}
+
+const char* AsyncFileReader::data() const {
+    return buffer.data();
+}
+
+size_t AsyncFileReader::size() const {
+    return buffer.size();
+}
+
+size_t AsyncFileReader::waitFor(size_t bytes) {
+    size_t target = std::min(bytes, buffer.size());
+    std::unique_lock<std::mutex> lock(mutex);
+    progress.wait(lock, [&]() { return available >= target || !error.empty(); });
+    if (available < target) {
+        throw std::runtime_error(error);
+    }
+    return available;
+}
+
+void AsyncFileReader::run() {
+    const size_t totalSize = buffer.size();
+    const size_t chunkCount = (totalSize + CHUNK_SIZE - 1) / CHUNK_SIZE;
+    std::vector<size_t> received(chunkCount, 0);
+    size_t nextChunk = 0;
+    size_t inFlight = 0;
+    size_t complete = 0;
+
+    try {
+        while (complete < chunkCount) {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (stopping) {
+                    break;
+                }
+            }
+            while (inFlight < QUEUE_DEPTH && nextChunk < chunkCount) {
+                size_t offset = nextChunk * CHUNK_SIZE;
+                engine->submit(IoEngine::READ, &buffer[offset],
+                               std::min(CHUNK_SIZE, totalSize - offset), offset, nextChunk);
+                ++nextChunk;
+                ++inFlight;
+            }
+
+            size_t chunk;
+            long result;
+            engine->wait(chunk, result);
+            --inFlight;
+            if (result <= 0) {
+                throw std::runtime_error(result == 0 ? path + " ended early"
+                                                     : "Cannot read " + path + ": " + std::strerror(-static_cast<int>(result)));
+            }
+
+            received[chunk] += static_cast<size_t>(result);
+            size_t chunkBegin = chunk * CHUNK_SIZE;
+            size_t chunkLength = std::min(CHUNK_SIZE, totalSize - chunkBegin);
+            if (received[chunk] < chunkLength) {
+                // Short read: ask for the rest of the chunk
+                size_t offset = chunkBegin + received[chunk];
+                engine->submit(IoEngine::READ, &buffer[offset], chunkLength - received[chunk], offset, chunk);
+                ++inFlight;
+                continue;
+            }
+
+            size_t before = complete;
+            while (complete < chunkCount &&
+                   received[complete] == std::min(CHUNK_SIZE, totalSize - complete * CHUNK_SIZE)) {
+                ++complete;
+            }
+            if (complete != before) {
+                std::lock_guard<std::mutex> lock(mutex);
+                available = std::min(totalSize, complete * CHUNK_SIZE);
+                progress.notify_all();
+            }
+        }
+    } catch (const std::exception& e) {
+        std::lock_guard<std::mutex> lock(mutex);
+        error = e.what();
+        progress.notify_all();
+    }
+
+    // The kernel may still be writing into the buffer
+    while (inFlight > 0) {
+        size_t chunk;
+        long result;
+        try {
+            engine->wait(chunk, result);
+        } catch (const std::exception&) {
+            break;
+        }
+        --inFlight;
+    }
+    engine->close();
+}
+
+AsyncFileWriter::AsyncFileWriter(const std::string& path)
+    : path(path), outstanding(0), endOffset(0), closing(false) {
+    engine = openEngine(path, true);
+    worker = std::thread(&AsyncFileWriter::run, this);
+}
+
+AsyncFileWriter::~AsyncFileWriter() {
+    if (worker.joinable()) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            closing = true;
+        }
+        workAvailable.notify_all();
+        worker.join();
+        engine->close();
+    }
+}
+
+void AsyncFileWriter::queue(Job& job) {
+    std::unique_lock<std::mutex> lock(mutex);
+    spaceAvailable.wait(lock, [&]() { return outstanding < QUEUE_DEPTH || !error.empty(); });
+    if (!error.empty()) {
+        throw std::runtime_error(error);
+    }
+    pending.push_back(Job());
+    pending.back().bytes.swap(job.bytes);
+    pending.back().offset = job.offset;
+    pending.back().barrier = job.barrier;
+    ++outstanding;
+    workAvailable.notify_one();
+}
+
+void AsyncFileWriter::append(std::string& chunk) {
+    if (chunk.empty()) {
+        return;
+    }
+    Job job;
+    job.offset = endOffset;
+    job.barrier = false;
+    endOffset += chunk.size();
+    job.bytes.swap(chunk);
+    queue(job);
+
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!spare.empty()) {
+        chunk.swap(spare.back());
+        spare.pop_back();
+    }
+}
+
+void AsyncFileWriter::writeAt(size_t offset, const std::string& bytes) {
+    if (bytes.empty()) {
+        return;
+    }
+    Job job;
+    job.offset = offset;
+    job.barrier = true;
+    job.bytes = bytes;
+    queue(job);
+}
+
+size_t AsyncFileWriter::size() const {
+    return endOffset;
+}
+
+void AsyncFileWriter::finish() {
+    if (worker.joinable()) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            closing = true;
+        }
+        workAvailable.notify_all();
+        worker.join();
+        if (!engine->close() && error.empty()) {
+            error = "Cannot write " + path;
+        }
+    }
+    if (!error.empty()) {
+        throw std::runtime_error(error);
+    }
+}
+
+void AsyncFileWriter::run() {
+    std::vector<Job> slots(QUEUE_DEPTH);
+    std::vector<size_t> written(QUEUE_DEPTH, 0);
+    std::vector<bool> busy(QUEUE_DEPTH, false);
+    size_t inFlight = 0;
+    bool failed = false;
+
+    while (true) {
+        std::vector<size_t> started;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            workAvailable.wait(lock, [&]() { return !pending.empty() || closing || inFlight > 0; });
+            if (pending.empty() && inFlight == 0) {
+                return;
+            }
+            // A barrier waits for the slots to drain and then runs alone
+            bool anyBusy = false, alone = false;
+            for (size_t slot = 0; slot < QUEUE_DEPTH; ++slot) {
+                anyBusy = anyBusy || busy[slot];
+                alone = alone || (busy[slot] && slots[slot].barrier);
+            }
+            for (size_t slot = 0; slot < QUEUE_DEPTH && !pending.empty() && !alone; ++slot) {
+                if (pending.front().barrier && anyBusy) {
+                    break;
+                }
+                if (!busy[slot]) {
+                    anyBusy = true;
+                    alone = pending.front().barrier;
+                    slots[slot].bytes.swap(pending.front().bytes);
+                    slots[slot].offset = pending.front().offset;
+                    slots[slot].barrier = alone;
+                    pending.pop_front();
+                    busy[slot] = true;
+                    written[slot] = 0;
+                    started.push_back(slot);
+                }
+            }
+        }
+
+        std::vector<size_t> finished;
+        for (size_t i = 0; i < started.size(); ++i) {
+            size_t slot = started[i];
+            if (failed) {
+                finished.push_back(slot);
+                continue;
+            }
+            engine->submit(IoEngine::WRITE, &slots[slot].bytes[0], slots[slot].bytes.size(),
+                           slots[slot].offset, slot);
+            ++inFlight;
+        }
+
+        if (inFlight > 0 && finished.empty()) {
+            size_t slot;
+            long result = 0;
+            try {
+                engine->wait(slot, result);
+            } catch (const std::exception& e) {
+                std::lock_guard<std::mutex> lock(mutex);
+                error = e.what();
+                spaceAvailable.notify_all();
+                return;
+            }
+            --inFlight;
+            if (result <= 0) {
+                failed = true;
+                std::lock_guard<std::mutex> lock(mutex);
+                error = "Cannot write " + path + ": " + std::strerror(result < 0 ? -static_cast<int>(result) : EIO);
+                finished.push_back(slot);
+            } else if (written[slot] + static_cast<size_t>(result) < slots[slot].bytes.size()) {
+                // Short write: send the rest
+                written[slot] += static_cast<size_t>(result);
+                engine->submit(IoEngine::WRITE, &slots[slot].bytes[written[slot]],
+                               slots[slot].bytes.size() - written[slot],
+                               slots[slot].offset + written[slot], slot);
+                ++inFlight;
+            } else {
+                finished.push_back(slot);
+            }
+        }
+
+        if (!finished.empty()) {
+            std::lock_guard<std::mutex> lock(mutex);
+            for (size_t i = 0; i < finished.size(); ++i) {
+                size_t slot = finished[i];
+                busy[slot] = false;
+                slots[slot].bytes.clear();
+                spare.push_back(std::string());
+                spare.back().swap(slots[slot].bytes);
+                --outstanding;
+            }
+            spaceAvailable.notify_all();
+        }
+    }
+}
@@ -0,0 +1,308 @@
+#include "CatalogDelta.h"
+#include "DataFormat.h"
+#include "DataFile.h"
+#include "Crc32c.h"
+#include "Codecs.h"
+#include <fstream>
+#include <sstream>
+#include <unordered_map>
+#include <stdexcept>
+#include <cstdlib>
+#include <cerrno>
+#include <cstdio>
+
+namespace {
+
+std::string trim(const std::string& text) {
+    size_t first = text.find_first_not_of(" \t\r");
+    if (first == std::string::npos) {
+        return "";
+    }
+    size_t last = text.find_last_not_of(" \t\r");
+    return text.substr(first, last - first + 1);
+}
+
+bool parseUnsigned(const std::string& text, unsigned int& value) {
+    if (text.empty() || text[0] == '-') {
+        return false;
+    }
+    char* end = 0;
+    errno = 0;
+    unsigned long parsed = std::strtoul(text.c_str(), &end, 10);
+    if (errno != 0 || *end != '\0' || parsed == 0 || parsed > 0xFFFFFFFFul) {
+        return false;
+    }
+    value = static_cast<unsigned int>(parsed);
+    return true;
+}
+
+bool parseDouble(const std::string& text, double& value) {
+    if (text.empty()) {
+        return false;
+    }
+    char* end = 0;
+    errno = 0;
+    value = std::strtod(text.c_str(), &end);
+    return errno == 0 && *end == '\0';
+}
+
+// Builds one change from the fields after the BULSTAT; throws on bad input
+MaterialChange parseChange(const std::vector<std::string>& fields) {
+    MaterialChange change;
+    const std::string& operation = fields[1];
+
+    if (operation == "price") {
+        if (fields.size() != 4 || !parseUnsigned(fields[2], change.materialId) ||
+            !parseDouble(fields[3], change.price)) {
+            throw std::invalid_argument("expected bulstat,price,materialId,newPrice");
+        }
+        if (change.price < 0) {
+            throw std::invalid_argument("Price cannot be negative");
+        }
+        change.kind = MaterialChange::UPDATE_PRICE;
+    } else if (operation == "remove") {
+        if (fields.size() != 3 || !parseUnsigned(fields[2], change.materialId)) {
+            throw std::invalid_argument("expected bulstat,remove,materialId");
+        }
+        change.kind = MaterialChange::REMOVE_MATERIAL;
+    } else if (operation == "add") {
+        double thickness = 0, diopter = 0, price = 0;
+        if (fields.size() != 7 || !parseDouble(fields[3], thickness) ||
+            !parseDouble(fields[4], diopter) || !parseDouble(fields[6], price)) {
+            throw std::invalid_argument("expected bulstat,add,type,thickness,diopter,materialName,price");
+        }
+        change.kind = MaterialChange::ADD_MATERIAL;
+        change.material.setType(fields[2]);
+        change.material.setThickness(thickness);
+        change.material.setDiopter(diopter);
+        change.material.setMaterialName(fields[5]);
+        change.material.setPrice(price);
+    } else {
+        throw std::invalid_argument("unknown operation '" + operation + "'");
+    }
+    return change;
+}
+
+}
+
+CatalogChangeLog::CatalogChangeLog(const std::string& path) : path(path) {}
+
+void CatalogChangeLog::appendRecord(std::string& out, const CatalogDelta& delta) {
+    std::ostringstream record;
+    writeDelta(record, delta);
+    std::string body = record.str();
+
+    char frame[48];
+    std::snprintf(frame, sizeof(frame), "J %lu %08x\n", static_cast<unsigned long>(body.size()),
+                  static_cast<unsigned int>(Crc32c::compute(body.data(), body.size())));
+    out += frame;
+    out += body;
+}
+
+void CatalogChangeLog::append(const CatalogDelta& delta) const {
+    bool isNew;
+    {
+        std::ifstream existing(path.c_str());
+        isNew = !existing || existing.peek() == std::ifstream::traits_type::eof();
+    }
+
+    std::string bytes;
+    if (isNew) {
+        std::ostringstream header;
+        writeFormatHeader(header);
+        bytes = header.str();
+    }
+    appendRecord(bytes, delta);
+
+    std::ofstream file(path.c_str(), std::ios::app | std::ios::binary);
+    if (!file) {
+        throw std::runtime_error("Cannot open catalog change log");
+    }
+    file.write(bytes.data(), static_cast<std::streamsize>(bytes.size()));
+    file.flush();
+    if (!file) {
+        throw std::runtime_error("Cannot write catalog change log");
+    }
+}
+
+std::vector<CatalogDelta> CatalogChangeLog::recover() const {
+    std::vector<CatalogDelta> deltas;
+    if (!DataFile::exists(path)) {
+        return deltas;
+    }
+    std::string bytes = DataFile::readAll(path);
+    if (bytes.empty()) {
+        return deltas;
+    }
+
+    size_t headerEnd = bytes.find('\n');
+    std::istringstream header(bytes.substr(0, headerEnd == std::string::npos ? bytes.size() : headerEnd + 1));
+    int formatVersion = readFormatHeader(header);
+    size_t position = formatVersion == 1 ? 0 : headerEnd + 1;
+    bool clean;
+
+    if (formatVersion < 4) {
+        // Unframed records from before checksums; upgraded below
+        std::istringstream records(bytes.substr(position));
+        CatalogDelta delta;
+        while (readDelta(records, formatVersion, delta)) {
+            deltas.push_back(delta);
+        }
+        clean = false;
+    } else {
+        while (position < bytes.size()) {
+            // "J <length> <crc>" followed by the record itself
+            size_t frameEnd = bytes.find('\n', position);
+            unsigned long length = 0;
+            unsigned int checksum = 0;
+            if (frameEnd == std::string::npos ||
+                std::sscanf(bytes.c_str() + position, "J %lu %8x", &length, &checksum) != 2 ||
+                length > bytes.size() - frameEnd - 1) {
+                break;
+            }
+            const char* body = bytes.data() + frameEnd + 1;
+            if (Crc32c::compute(body, length) != checksum) {
+                break;
+            }
+            std::istringstream record(std::string(body, length));
+            CatalogDelta delta;
+            if (!readDelta(record, formatVersion, delta)) {
+                break;
+            }
+            deltas.push_back(delta);
+            position = frameEnd + 1 + length;
+        }
+        clean = position == bytes.size();
+    }
+
+    if (!clean) {
+        // Keep only the intact records so later appends stay reachable
+        std::ostringstream rewrittenHeader;
+        writeFormatHeader(rewrittenHeader);
+        std::string rewritten = rewrittenHeader.str();
+        for (size_t i = 0; i < deltas.size(); ++i) {
+            appendRecord(rewritten, deltas[i]);
+        }
+        DataFile::writeAtomically(path, rewritten, false);
+    }
+    return deltas;
+}
+
+void CatalogChangeLog::truncate() const {
+    std::ofstream file(path.c_str(), std::ios::trunc);
+    if (!file) {
+        throw std::runtime_error("Cannot reset catalog change log");
+    }
+}
+
+void CatalogChangeLog::writeDelta(std::ostream& os, const CatalogDelta& delta) {
+    os << "D " << delta.supplierBulstat << " " << delta.baseVersion << " "
+       << delta.changes.size() << "\n";
+    for (size_t i = 0; i < delta.changes.size(); ++i) {
+        const MaterialChange& change = delta.changes[i];
+        switch (change.kind) {
+            case MaterialChange::UPDATE_PRICE: {
+                // Every digit the data files keep, so a replay restores the
+                // price exactly
+                std::string price;
+                codec::appendDouble(price, change.price);
+                os << "P " << change.materialId << " " << price << "\n";
+                break;
+            }
+            case MaterialChange::REMOVE_MATERIAL:
+                os << "R " << change.materialId << "\n";
+                break;
+            case MaterialChange::ADD_MATERIAL:
+                os << "A\n";
+                change.material.saveToFile(os);
+                break;
+        }
+    }
+    // Marks the record complete; a torn tail has no end marker
+    os << "E\n";
+}
+
+bool CatalogChangeLog::readDelta(std::istream& is, int formatVersion, CatalogDelta& delta) {
+    std::string tag;
+    size_t changeCount = 0;
+    if (!(is >> tag) || tag != "D" ||
+        !(is >> delta.supplierBulstat >> delta.baseVersion >> changeCount)) {
+        return false;
+    }
+
+    delta.changes.clear();
+    for (size_t i = 0; i < changeCount; ++i) {
+        MaterialChange change;
+        if (!(is >> tag)) {
+            return false;
+        }
+        if (tag == "P") {
+            change.kind = MaterialChange::UPDATE_PRICE;
+            is >> change.materialId >> change.price;
+        } else if (tag == "R") {
+            change.kind = MaterialChange::REMOVE_MATERIAL;
+            is >> change.materialId;
+        } else if (tag == "A") {
+            change.kind = MaterialChange::ADD_MATERIAL;
+            is.ignore();
+            change.material.loadFromFile(is, formatVersion);
+            change.materialId = change.material.getId();
+        } else {
+            return false;
+        }
+        if (!is) {
+            return false;
+        }
+        delta.changes.push_back(change);
+    }
+
+    return (is >> tag) && tag == "E";
+}
+
+std::vector<CatalogDelta> CatalogChangeLog::parseCsv(std::istream& is, std::vector<std::string>& errors) {
+    std::vector<CatalogDelta> deltas;
+    std::unordered_map<std::string, size_t> deltaIndex;
+    std::string text;
+    size_t lineNumber = 0;
+
+    while (std::getline(is, text)) {
+        ++lineNumber;
+        text = trim(text);
+        if (text.empty() || text[0] == '#') {
+            continue;
+        }
+
+        std::vector<std::string> fields;
+        std::istringstream row(text);
+        std::string field;
+        while (std::getline(row, field, ',')) {
+            fields.push_back(trim(field));
+        }
+        if (lineNumber == 1 && !fields.empty() && fields[0] == "bulstat") {
+            continue;
+        }
+
+        try {
+            if (fields.size() < 3) {
+                throw std::invalid_argument("expected bulstat,operation,...");
+            }
+            MaterialChange change = parseChange(fields);
+
+            std::unordered_map<std::string, size_t>::const_iterator found = deltaIndex.find(fields[0]);
+            size_t target;
+            if (found == deltaIndex.end()) {
+                target = deltas.size();
+                deltaIndex[fields[0]] = target;
+                CatalogDelta delta;
+                delta.supplierBulstat = fields[0];
+                deltas.push_back(delta);
+            } else {
+                target = found->second;
+            }
+            deltas[target].changes.push_back(change);
+        } catch (const std::exception& e) {
+            errors.push_back("line " + std::to_string(lineNumber) + ": " + e.what());
+        }
+    }
+    return deltas;
+}
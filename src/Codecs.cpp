@@ -0,0 +1,116 @@
+#include "Codecs.h"
+#include "MaterialCatalog.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cmath>
+#include <cerrno>
+
+namespace {
+
+const char* skipSpaces(const char* begin, const char* end) {
+    while (begin < end && (*begin == ' ' || *begin == '\t' || *begin == '\r')) {
+        ++begin;
+    }
+    return begin;
+}
+
+// The number must fill the line, give or take surrounding whitespace; the
+// parser may not run on into the next line
+void checkNumber(const char* parsedEnd, const char* begin, const char* end) {
+    if (parsedEnd == begin || parsedEnd > end || errno == ERANGE || skipSpaces(parsedEnd, end) != end) {
+        throw std::runtime_error("Malformed number in data: " + std::string(begin, end));
+    }
+}
+
+}
+
+void codec::appendUnsigned(std::string& out, unsigned long long value) {
+    char digits[20];
+    int length = 0;
+    do {
+        digits[length++] = static_cast<char>('0' + value % 10);
+        value /= 10;
+    } while (value != 0);
+    while (length > 0) {
+        out += digits[--length];
+    }
+}
+
+void codec::appendSigned(std::string& out, long long value) {
+    if (value < 0) {
+        out += '-';
+        appendUnsigned(out, 0ull - static_cast<unsigned long long>(value));
+    } else {
+        appendUnsigned(out, static_cast<unsigned long long>(value));
+    }
+}
+
+void codec::appendDouble(std::string& out, double value) {
+    // Prices and most other values are decimals of at most four places;
+    // when the double is exactly such a decimal, integer digits print it
+    // without a trip through snprintf and strtod
+    const double FAST_LIMIT = 1e12;
+    const long long FAST_SCALE = 10000;
+    if (value > -FAST_LIMIT && value < FAST_LIMIT) {
+        long long units = std::llround(value * FAST_SCALE);
+        if (static_cast<double>(units) / FAST_SCALE == value) {
+            if (units < 0) {
+                out += '-';
+                units = -units;
+            }
+            appendUnsigned(out, static_cast<unsigned long long>(units / FAST_SCALE));
+            long long fraction = units % FAST_SCALE;
+            if (fraction != 0) {
+                out += '.';
+                for (long long digit = FAST_SCALE / 10; fraction != 0; digit /= 10) {
+                    out += static_cast<char>('0' + fraction / digit);
+                    fraction %= digit;
+                }
+            }
+            return;
+        }
+    }
+
+    // Fifteen significant digits print every value that needs no more
+    // as %g or an ostream would (12.5, 0.1); values that do not read back
+    // from them, such as a sum of prices, get all seventeen. Plain %g
+    // would round a price of 123.4567 on every save.
+    char buffer[32];
+    int length = std::snprintf(buffer, sizeof(buffer), "%.15g", value);
+    if (std::strtod(buffer, 0) != value) {
+        length = std::snprintf(buffer, sizeof(buffer), "%.17g", value);
+    }
+    out.append(buffer, static_cast<size_t>(length));
+}
+
+unsigned long long codec::parseUnsigned(const char* begin, const char* end) {
+    char* parsedEnd = 0;
+    errno = 0;
+    unsigned long long value = std::strtoull(begin, &parsedEnd, 10);
+    checkNumber(parsedEnd, begin, end);
+    return value;
+}
+
+long long codec::parseSigned(const char* begin, const char* end) {
+    char* parsedEnd = 0;
+    errno = 0;
+    long long value = std::strtoll(begin, &parsedEnd, 10);
+    checkNumber(parsedEnd, begin, end);
+    return value;
+}
+
+double codec::parseDouble(const char* begin, const char* end) {
+    char* parsedEnd = 0;
+    errno = 0;
+    double value = std::strtod(begin, &parsedEnd);
+    checkNumber(parsedEnd, begin, end);
+    return value;
+}
+
+std::shared_ptr<const OpticalMaterial> codec::resolve(const MaterialCatalog* catalog, const std::string& owner,
+                                                      unsigned int id, unsigned int version) {
+    if (!catalog) {
+        throw std::runtime_error("Order lines need a material catalog to load");
+    }
+    return catalog->resolve(owner, id, version);
+}
@@ -0,0 +1,204 @@
+#include "CompactText.h"
+#include <unordered_map>
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <functional>
+#include <stdexcept>
+#include <cstring>
+#include <cmath>
+
+const size_t StringPool::MAX_SIZE;
+const double FixedDecimal::SCALE = 10000.0;
+const double FixedDecimal::LIMIT = 200000.0;
+
+namespace {
+
+const size_t POOL_CHUNK_SIZE = 4096;
+const size_t POOL_CHUNK_COUNT = StringPool::MAX_SIZE / POOL_CHUNK_SIZE;
+
+// The map owns the text; lookups by id go through fixed chunks of
+// pointers to its keys, which never move, so get() takes no lock. A
+// chunk is published before any id in it is handed out.
+struct Pool {
+    std::mutex mutex;
+    std::unordered_map<std::string, StringPool::Id> ids;
+    std::atomic<const std::string**> chunks[POOL_CHUNK_COUNT];
+    std::atomic<size_t> count;
+
+    Pool() : count(0) {
+        for (size_t i = 0; i < POOL_CHUNK_COUNT; ++i) {
+            chunks[i].store(0, std::memory_order_relaxed);
+        }
+        add(std::string());
+    }
+
+    // Caller holds mutex
+    StringPool::Id add(const std::string& text) {
+        size_t id = count.load(std::memory_order_relaxed);
+        if (id >= StringPool::MAX_SIZE) {
+            throw std::length_error("String pool is full");
+        }
+        const std::string** chunk = chunks[id / POOL_CHUNK_SIZE].load(std::memory_order_relaxed);
+        if (!chunk) {
+            chunk = new const std::string*[POOL_CHUNK_SIZE];
+            chunks[id / POOL_CHUNK_SIZE].store(chunk, std::memory_order_release);
+        }
+        chunk[id % POOL_CHUNK_SIZE] = &ids.insert(std::make_pair(text, static_cast<StringPool::Id>(id))).first->first;
+        count.store(id + 1, std::memory_order_release);
+        return static_cast<StringPool::Id>(id);
+    }
+};
+
+// Never destroyed, so records destroyed at exit can still read their text
+Pool& pool() {
+    static Pool* instance = new Pool();
+    return *instance;
+}
+
+// Loading interns the same few types and names over and over from
+// several threads; a small per-thread cache of recent hits keeps most
+// calls off the pool's lock
+struct RecentEntry {
+    const std::string* text;
+    StringPool::Id id;
+};
+
+const size_t RECENT_SLOTS = 64;
+thread_local RecentEntry recent[RECENT_SLOTS];
+
+}
+
+StringPool::Id StringPool::intern(const std::string& text) {
+    if (text.empty()) {
+        return 0;
+    }
+    RecentEntry& slot = recent[std::hash<std::string>()(text) % RECENT_SLOTS];
+    if (slot.text && *slot.text == text) {
+        return slot.id;
+    }
+    Pool& shared = pool();
+    std::lock_guard<std::mutex> lock(shared.mutex);
+    std::unordered_map<std::string, Id>::const_iterator found = shared.ids.find(text);
+    Id id = found != shared.ids.end() ? found->second : shared.add(text);
+    slot.text = &get(id);
+    slot.id = id;
+    return id;
+}
+
+const std::string& StringPool::get(Id id) {
+    const std::string** chunk = pool().chunks[id / POOL_CHUNK_SIZE].load(std::memory_order_acquire);
+    return *chunk[id % POOL_CHUNK_SIZE];
+}
+
+size_t StringPool::size() {
+    return pool().count.load(std::memory_order_acquire);
+}
+
+MemoryFootprint StringPool::memoryUsage() {
+    Pool& shared = pool();
+    std::lock_guard<std::mutex> lock(shared.mutex);
+    MemoryFootprint footprint;
+    footprint.count = shared.ids.size();
+    footprint.bytes = memory::hashMapBytes(shared.ids);
+    for (std::unordered_map<std::string, Id>::const_iterator it = shared.ids.begin(); it != shared.ids.end(); ++it) {
+        footprint.bytes += memory::stringBytes(it->first);
+    }
+    size_t chunkCount = (footprint.count + POOL_CHUNK_SIZE - 1) / POOL_CHUNK_SIZE;
+    footprint.bytes += chunkCount * memory::allocationBytes(POOL_CHUNK_SIZE * sizeof(const std::string*));
+    return footprint;
+}
+
+CompactString::CompactString() {
+    std::memset(bytes, 0, sizeof(bytes));
+}
+
+CompactString::CompactString(const std::string& text) {
+    copyFrom(text.data(), text.size());
+}
+
+CompactString::CompactString(const CompactString& other) {
+    if (other.onHeap()) {
+        copyFrom(other.heapData(), other.heapLength());
+    } else {
+        std::memcpy(bytes, other.bytes, sizeof(bytes));
+    }
+}
+
+CompactString& CompactString::operator=(const CompactString& other) {
+    if (this != &other) {
+        CompactString copy(other);
+        takeFrom(copy);
+    }
+    return *this;
+}
+
+CompactString::~CompactString() {
+    release();
+}
+
+const char* CompactString::heapData() const {
+    char* data;
+    std::memcpy(&data, bytes, sizeof(data));
+    return data;
+}
+
+uint32_t CompactString::heapLength() const {
+    uint32_t length;
+    std::memcpy(&length, bytes + 8, sizeof(length));
+    return length;
+}
+
+void CompactString::release() {
+    if (onHeap()) {
+        delete[] heapData();
+    }
+}
+
+void CompactString::takeFrom(CompactString& other) {
+    release();
+    std::memcpy(bytes, other.bytes, sizeof(bytes));
+    // The heap block, if any, now belongs to this object
+    std::memset(other.bytes, 0, sizeof(other.bytes));
+}
+
+void CompactString::copyFrom(const char* data, size_t length) {
+    std::memset(bytes, 0, sizeof(bytes));
+    if (length <= INLINE_CAPACITY) {
+        std::memcpy(bytes, data, length);
+        bytes[15] = static_cast<char>(length);
+        return;
+    }
+    if (length > UINT32_MAX) {
+        throw std::length_error("Text is too long");
+    }
+    char* copy = new char[length];
+    std::memcpy(copy, data, length);
+    uint32_t storedLength = static_cast<uint32_t>(length);
+    std::memcpy(bytes, &copy, sizeof(copy));
+    std::memcpy(bytes + 8, &storedLength, sizeof(storedLength));
+    bytes[15] = static_cast<char>(ON_HEAP);
+}
+
+std::string CompactString::str() const {
+    if (onHeap()) {
+        return std::string(heapData(), heapLength());
+    }
+    return std::string(bytes, static_cast<unsigned char>(bytes[15]));
+}
+
+void CompactString::assign(const std::string& text) {
+    CompactString copy(text);
+    takeFrom(copy);
+}
+
+size_t CompactString::heapBytes() const {
+    return onHeap() ? memory::allocationBytes(heapLength()) : 0;
+}
+
+void FixedDecimal::assign(double value) {
+    if (!(std::fabs(value) <= LIMIT)) {
+        throw std::out_of_range("Number out of range: must be between -200000 and 200000");
+    }
+    units = static_cast<int32_t>(std::lround(value * SCALE));
+}
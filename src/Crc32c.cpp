@@ -0,0 +1,132 @@
+#include "Crc32c.h"
+#include "TaskScheduler.h"
+#include <algorithm>
+#include <cstring>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <nmmintrin.h>
+#define CRC32C_HARDWARE 1
+#endif
+
+namespace {
+
+const uint32_t POLYNOMIAL = 0x82F63B78u;   // reflected Castagnoli
+
+struct Tables {
+    uint32_t slices[8][256];
+
+    Tables() {
+        for (uint32_t i = 0; i < 256; ++i) {
+            uint32_t crc = i;
+            for (int bit = 0; bit < 8; ++bit) {
+                crc = (crc >> 1) ^ (POLYNOMIAL & (0u - (crc & 1u)));
+            }
+            slices[0][i] = crc;
+        }
+        for (uint32_t i = 0; i < 256; ++i) {
+            for (int slice = 1; slice < 8; ++slice) {
+                uint32_t previous = slices[slice - 1][i];
+                slices[slice][i] = (previous >> 8) ^ slices[0][previous & 0xFF];
+            }
+        }
+    }
+};
+
+const Tables& tables() {
+    static const Tables instance;
+    return instance;
+}
+
+uint32_t extendSoftware(uint32_t crc, const unsigned char* data, size_t length) {
+    const Tables& t = tables();
+    while (length >= 8) {
+        uint32_t low = crc ^ (static_cast<uint32_t>(data[0]) | static_cast<uint32_t>(data[1]) << 8 |
+                              static_cast<uint32_t>(data[2]) << 16 | static_cast<uint32_t>(data[3]) << 24);
+        crc = t.slices[7][low & 0xFF] ^ t.slices[6][(low >> 8) & 0xFF] ^
+              t.slices[5][(low >> 16) & 0xFF] ^ t.slices[4][low >> 24] ^
+              t.slices[3][data[4]] ^ t.slices[2][data[5]] ^
+              t.slices[1][data[6]] ^ t.slices[0][data[7]];
+        data += 8;
+        length -= 8;
+    }
+    while (length-- > 0) {
+        crc = (crc >> 8) ^ t.slices[0][(crc ^ *data++) & 0xFF];
+    }
+    return crc;
+}
+
+#ifdef CRC32C_HARDWARE
+
+__attribute__((target("sse4.2")))
+uint32_t extendHardware(uint32_t crc, const unsigned char* data, size_t length) {
+#if defined(__x86_64__)
+    uint64_t wide = crc;
+    while (length >= 8) {
+        uint64_t word;
+        std::memcpy(&word, data, sizeof(word));
+        wide = _mm_crc32_u64(wide, word);
+        data += 8;
+        length -= 8;
+    }
+    crc = static_cast<uint32_t>(wide);
+#endif
+    while (length >= 4) {
+        uint32_t word;
+        std::memcpy(&word, data, sizeof(word));
+        crc = _mm_crc32_u32(crc, word);
+        data += 4;
+        length -= 4;
+    }
+    while (length-- > 0) {
+        crc = _mm_crc32_u8(crc, *data++);
+    }
+    return crc;
+}
+
+bool hasHardware() {
+    static const bool supported = __builtin_cpu_supports("sse4.2");
+    return supported;
+}
+
+#endif
+
+}
+
+uint32_t Crc32c::extend(uint32_t crc, const void* data, size_t length) {
+    const unsigned char* bytes = static_cast<const unsigned char*>(data);
+    crc = ~crc;
+#ifdef CRC32C_HARDWARE
+    if (hasHardware()) {
+        return ~extendHardware(crc, bytes, length);
+    }
+#endif
+    return ~extendSoftware(crc, bytes, length);
+}
+
+uint32_t Crc32c::compute(const void* data, size_t length) {
+    return extend(0, data, length);
+}
+
+std::vector<uint32_t> Crc32c::blocks(const char* data, size_t length, size_t blockSize) {
+    size_t blockCount = (length + blockSize - 1) / blockSize;
+    std::vector<uint32_t> checksums(blockCount);
+
+    // A task per block only pays off once there are a few blocks each
+    const size_t MIN_BLOCKS_PER_TASK = 4;
+    TaskScheduler::instance().parallelFor(0, blockCount, MIN_BLOCKS_PER_TASK, [&](size_t first, size_t last) {
+        for (size_t block = first; block < last; ++block) {
+            size_t offset = block * blockSize;
+            checksums[block] = compute(data + offset, std::min(blockSize, length - offset));
+        }
+    });
+    return checksums;
+}
+
+const char* Crc32c::kernelName() {
+#ifdef CRC32C_HARDWARE
+    if (hasHardware()) {
+        return "SSE4.2";
+    }
+#endif
+    return "slicing-by-8";
+}
@@ -0,0 +1,371 @@
+#include "DataFile.h"
+#include "DataFormat.h"
+#include "Crc32c.h"
+#include <fstream>
+#include <sstream>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <cerrno>
+#include <fcntl.h>
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+namespace {
+
+const char PAYLOAD_TAG[] = "#PAYLOAD ";
+const char END_TAG[] = "#END\n";
+const size_t END_LENGTH = sizeof(END_TAG) - 1;
+const size_t CHECKSUM_LINE = 9;   // 8 hex digits and a newline
+const int SIZE_FIELD_WIDTH = 20;  // digits of the largest 64-bit size
+
+void appendHex(std::string& out, uint32_t value) {
+    char buffer[16];
+    std::snprintf(buffer, sizeof(buffer), "%08x\n", value);
+    out.append(buffer, CHECKSUM_LINE);
+}
+
+bool parseHex(const char* text, uint32_t& value) {
+    value = 0;
+    for (int i = 0; i < 8; ++i) {
+        char c = text[i];
+        int digit;
+        if (c >= '0' && c <= '9') {
+            digit = c - '0';
+        } else if (c >= 'a' && c <= 'f') {
+            digit = c - 'a' + 10;
+        } else {
+            return false;
+        }
+        value = (value << 4) | static_cast<uint32_t>(digit);
+    }
+    return text[8] == '\n';
+}
+
+// Flushes the file's data to disk, so a rename that survives a power loss
+// never names a file whose blocks were lost
+void syncFile(const std::string& path) {
+#ifdef _WIN32
+    int fd = _open(path.c_str(), _O_RDWR | _O_BINARY);
+    bool synced = fd >= 0 && _commit(fd) == 0;
+    if (fd >= 0) {
+        _close(fd);
+    }
+#else
+    int fd = ::open(path.c_str(), O_RDONLY);
+    bool synced = fd >= 0 && ::fsync(fd) == 0;
+    if (fd >= 0) {
+        ::close(fd);
+    }
+#endif
+    if (!synced) {
+        throw std::runtime_error("Cannot flush " + path + " to disk");
+    }
+}
+
+// Makes renames in the directory holding path durable. Windows has no
+// directory handle to flush; some file systems refuse it with EINVAL.
+void syncDirectory(const std::string& path) {
+#ifndef _WIN32
+    std::string::size_type slash = path.find_last_of('/');
+    std::string directory = slash == std::string::npos ? "." : path.substr(0, slash == 0 ? 1 : slash);
+    int fd = ::open(directory.c_str(), O_RDONLY);
+    bool synced = fd >= 0 && (::fsync(fd) == 0 || errno == EINVAL);
+    if (fd >= 0) {
+        ::close(fd);
+    }
+    if (!synced) {
+        throw std::runtime_error("Cannot flush directory " + directory + " to disk");
+    }
+#else
+    (void)path;
+#endif
+}
+
+// The payload length and its block checksums folded into one value, so
+// any change to the payload changes it (short of a checksum collision)
+uint64_t payloadStamp(size_t payloadBytes, const std::vector<uint32_t>& checksums) {
+    uint32_t folded = 0;
+    for (size_t i = 0; i < checksums.size(); ++i) {
+        unsigned char bytes[4] = { static_cast<unsigned char>(checksums[i]),
+                                   static_cast<unsigned char>(checksums[i] >> 8),
+                                   static_cast<unsigned char>(checksums[i] >> 16),
+                                   static_cast<unsigned char>(checksums[i] >> 24) };
+        folded = Crc32c::extend(folded, bytes, sizeof(bytes));
+    }
+    return (static_cast<uint64_t>(payloadBytes) << 32) ^ folded;
+}
+
+}
+
+const size_t DataFile::BLOCK_SIZE;
+
+bool DataFile::exists(const std::string& path) {
+    std::ifstream file(path.c_str());
+    return static_cast<bool>(file);
+}
+
+std::string DataFile::backupPath(const std::string& path) {
+    return path + ".bak";
+}
+
+void DataFile::writeAtomically(const std::string& path, const std::string& bytes, bool keepBackup) {
+    std::string temporary = path + ".tmp";
+    {
+        std::ofstream file(temporary.c_str(), std::ios::binary | std::ios::trunc);
+        if (!file) {
+            throw std::runtime_error("Cannot open " + temporary);
+        }
+        file.write(bytes.data(), static_cast<std::streamsize>(bytes.size()));
+        file.flush();
+        if (!file) {
+            std::remove(temporary.c_str());
+            throw std::runtime_error("Cannot write " + temporary);
+        }
+    }
+
+    replace(temporary, path, keepBackup);
+}
+
+void DataFile::replace(const std::string& temporary, const std::string& path, bool keepBackup) {
+    // The data must be on disk before a rename can expose it
+    syncFile(temporary);
+    if (keepBackup && exists(path)) {
+        std::string backup = backupPath(path);
+        std::remove(backup.c_str());
+        if (std::rename(path.c_str(), backup.c_str()) != 0) {
+            throw std::runtime_error("Cannot keep a backup of " + path);
+        }
+    } else {
+        // rename() does not replace an existing file on Windows
+        std::remove(path.c_str());
+    }
+    if (std::rename(temporary.c_str(), path.c_str()) != 0) {
+        throw std::runtime_error("Cannot replace " + path);
+    }
+    syncDirectory(path);
+}
+
+std::string DataFile::readAll(const std::string& path) {
+    std::ifstream file(path.c_str(), std::ios::binary | std::ios::ate);
+    if (!file) {
+        throw std::runtime_error("Cannot open " + path);
+    }
+    // One read of the known size, not a character at a time
+    std::string bytes(static_cast<size_t>(file.tellg()), '\0');
+    file.seekg(0);
+    if (!bytes.empty() && !file.read(&bytes[0], static_cast<std::streamsize>(bytes.size()))) {
+        throw std::runtime_error("Cannot read " + path);
+    }
+    return bytes;
+}
+
+DataFileWriter::DataFileWriter(const std::string& path)
+    : path(path), temporary(path + ".tmp"), file(temporary), payloadBytes(0), committed(false) {
+    std::ostringstream header;
+    writeFormatHeader(header);
+    header << PAYLOAD_TAG;
+    chunk = header.str();
+    sizeField = chunk.size();
+    chunk.append(SIZE_FIELD_WIDTH, '0');
+    chunk += " " + std::to_string(DataFile::BLOCK_SIZE) + "\n";
+    file.append(chunk);
+}
+
+DataFileWriter::~DataFileWriter() {
+    if (!committed) {
+        try {
+            file.finish();
+        } catch (const std::exception&) {
+            // The temporary is discarded either way
+        }
+        std::remove(temporary.c_str());
+    }
+}
+
+size_t DataFileWriter::threshold() const {
+    return DataFile::BLOCK_SIZE;
+}
+
+void DataFileWriter::emit(std::string& text, size_t length) {
+    if (length == 0) {
+        return;
+    }
+    for (size_t offset = 0; offset < length; offset += DataFile::BLOCK_SIZE) {
+        checksums.push_back(Crc32c::compute(text.data() + offset,
+                                            std::min(DataFile::BLOCK_SIZE, length - offset)));
+    }
+    payloadBytes += length;
+
+    if (length == text.size()) {
+        file.append(text);
+    } else {
+        chunk.assign(text, 0, length);
+        text.erase(0, length);
+        file.append(chunk);
+    }
+}
+
+void DataFileWriter::drain(std::string& text) {
+    emit(text, text.size() / DataFile::BLOCK_SIZE * DataFile::BLOCK_SIZE);
+}
+
+void DataFileWriter::commit(std::string& text) {
+    emit(text, text.size());
+
+    chunk.clear();
+    for (size_t i = 0; i < checksums.size(); ++i) {
+        appendHex(chunk, checksums[i]);
+    }
+    chunk += END_TAG;
+    file.append(chunk);
+
+    char size[32];
+    std::snprintf(size, sizeof(size), "%0*llu", SIZE_FIELD_WIDTH,
+                  static_cast<unsigned long long>(payloadBytes));
+    file.writeAt(sizeField, std::string(size, SIZE_FIELD_WIDTH));
+    file.finish();
+
+    DataFile::replace(temporary, path, true);
+    committed = true;
+}
+
+uint64_t DataFileWriter::generationStamp() const {
+    return payloadStamp(payloadBytes, checksums);
+}
+
+DataFileReader::DataFileReader(const std::string& path)
+    : path(path), file(path), formatVersion(1), payloadBegin(0), payloadEnd(0),
+      blockSize(DataFile::BLOCK_SIZE), position(0), verified(0) {
+    readFrame();
+    position = verified = payloadBegin;
+}
+
+void DataFileReader::readFrame() {
+    // The header and the frame line are in the first chunk
+    size_t head = file.waitFor(AsyncFileReader::CHUNK_SIZE);
+    const char* bytes = file.data();
+
+    const char* newline = static_cast<const char*>(std::memchr(bytes, '\n', head));
+    size_t headerEnd = newline ? static_cast<size_t>(newline - bytes) : head;
+    std::istringstream header(std::string(bytes, newline ? headerEnd + 1 : head));
+    try {
+        formatVersion = readFormatHeader(header);
+    } catch (const std::exception& e) {
+        throw DataIntegrityError(path + ": " + e.what());
+    }
+
+    if (formatVersion < 4) {
+        payloadBegin = formatVersion == 1 ? 0 : std::min(headerEnd + 1, head);
+        payloadEnd = file.size();
+        return;
+    }
+
+    // Frame line: "#PAYLOAD <bytes> <blockSize>"
+    size_t frameBegin = headerEnd + 1;
+    const char* frameNewline = frameBegin < head
+        ? static_cast<const char*>(std::memchr(bytes + frameBegin, '\n', head - frameBegin)) : 0;
+    if (!frameNewline ||
+        std::strncmp(bytes + frameBegin, PAYLOAD_TAG, sizeof(PAYLOAD_TAG) - 1) != 0) {
+        throw DataIntegrityError(path + ": missing payload frame");
+    }
+    size_t frameEnd = static_cast<size_t>(frameNewline - bytes);
+    unsigned long long payloadBytes = 0, frameBlockSize = 0;
+    std::istringstream frame(std::string(bytes + frameBegin + sizeof(PAYLOAD_TAG) - 1,
+                                         frameNewline));
+    if (!(frame >> payloadBytes >> frameBlockSize) || frameBlockSize == 0) {
+        throw DataIntegrityError(path + ": malformed payload frame");
+    }
+
+    payloadBegin = frameEnd + 1;
+    blockSize = static_cast<size_t>(frameBlockSize);
+    unsigned long long blockCount = (payloadBytes + frameBlockSize - 1) / frameBlockSize;
+    unsigned long long expected = payloadBegin + payloadBytes + blockCount * CHECKSUM_LINE + END_LENGTH;
+    if (file.size() != expected) {
+        throw DataIntegrityError(path + ": file is truncated or has trailing data");
+    }
+    payloadEnd = payloadBegin + static_cast<size_t>(payloadBytes);
+    readChecksums();
+}
+
+void DataFileReader::readChecksums() {
+    // The table trails the payload; read it directly rather than wait for
+    // the whole file to arrive
+    size_t tableLength = file.size() - payloadEnd;
+    std::string table(tableLength, '\0');
+    std::ifstream tail(path.c_str(), std::ios::binary);
+    tail.seekg(static_cast<std::streamoff>(payloadEnd));
+    if (!tail.read(&table[0], static_cast<std::streamsize>(tableLength)) ||
+        table.compare(tableLength - END_LENGTH, END_LENGTH, END_TAG) != 0) {
+        throw DataIntegrityError(path + ": missing checksum table");
+    }
+
+    checksums.resize((tableLength - END_LENGTH) / CHECKSUM_LINE);
+    for (size_t block = 0; block < checksums.size(); ++block) {
+        if (!parseHex(table.data() + block * CHECKSUM_LINE, checksums[block])) {
+            throw DataIntegrityError(path + ": malformed checksum table");
+        }
+    }
+}
+
+void DataFileReader::verify(size_t begin, size_t end) {
+    file.waitFor(end);
+    if (formatVersion < 4 || begin == end) {
+        return;
+    }
+    size_t firstBlock = (begin - payloadBegin) / blockSize;
+    std::vector<uint32_t> actual = Crc32c::blocks(file.data() + begin, end - begin, blockSize);
+    for (size_t i = 0; i < actual.size(); ++i) {
+        if (actual[i] != checksums[firstBlock + i]) {
+            std::ostringstream message;
+            message << path << ": checksum mismatch in block " << firstBlock + i
+                    << " (bytes " << (firstBlock + i) * blockSize << "+)";
+            throw DataIntegrityError(message.str());
+        }
+    }
+}
+
+int DataFileReader::getFormatVersion() const {
+    return formatVersion;
+}
+
+uint64_t DataFileReader::generationStamp() const {
+    return formatVersion < 4 ? 0 : payloadStamp(payloadEnd - payloadBegin, checksums);
+}
+
+bool DataFileReader::next(const char*& lineBegin, const char*& lineEnd) {
+    const char* bytes = file.data();
+    while (position < payloadEnd) {
+        const void* newline = position < verified
+            ? std::memchr(bytes + position, '\n', verified - position) : 0;
+        if (newline) {
+            lineBegin = bytes + position;
+            lineEnd = static_cast<const char*>(newline);
+            position = static_cast<size_t>(lineEnd - bytes) + 1;
+            return true;
+        }
+        if (verified == payloadEnd) {
+            // Last line without a newline: parsers may look past its end,
+            // so let the reads behind it finish first
+            file.waitFor(file.size());
+            lineBegin = bytes + position;
+            lineEnd = bytes + payloadEnd;
+            position = payloadEnd;
+            return true;
+        }
+        size_t end = std::min(payloadEnd, verified + blockSize);
+        verify(verified, end);
+        verified = end;
+    }
+    return false;
+}
+
+void DataFileReader::finish() {
+    verify(verified, payloadEnd);
+    verified = payloadEnd;
+    file.waitFor(file.size());
+}
@@ -0,0 +1,35 @@
+#include "DataFormat.h"
+#include <string>
+#include <sstream>
+#include <stdexcept>
+
+namespace {
+
+const char FORMAT_TAG[] = "OPTICAL-DATA";
+
+}
+
+void writeFormatHeader(std::ostream& os) {
+    os << FORMAT_TAG << " " << DATA_FORMAT_VERSION << "\n";
+}
+
+int readFormatHeader(std::istream& is) {
+    // Legacy files start directly with a record count
+    if (is.peek() != FORMAT_TAG[0]) {
+        return 1;
+    }
+
+    std::string line;
+    std::getline(is, line);
+    std::istringstream header(line);
+    std::string tag;
+    int version = 0;
+    header >> tag >> version;
+    if (tag != FORMAT_TAG || version < 1) {
+        throw std::runtime_error("Unrecognized data file header");
+    }
+    if (version > DATA_FORMAT_VERSION) {
+        throw std::runtime_error("Data file was written by a newer version");
+    }
+    return version;
+}
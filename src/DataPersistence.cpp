@@ -0,0 +1,259 @@
+#include "DataPersistence.h"
+#include <iostream>
+#include <memory>
+#include <unordered_set>
+#include "DataFile.h"
+#include "DataFormat.h"
+#include "Metrics.h"
+#include "Validation.h"
+#include "ModelReflection.h"
+#include "TaskScheduler.h"
+#include "IndexFile.h"
+
+std::string DataPersistence::filePath(const std::string& name, bool fromBackup) {
+    return fromBackup ? DataFile::backupPath(name) : name;
+}
+
+void DataPersistence::saveSnapshot(const DataSnapshot& snapshot) {
+    METRIC_TIMER(METRIC_SAVE_DATA);
+    
+    // Every shard writes its own files in parallel, each block going to
+    // disk while the next one is serialized. Each file replaces its
+    // predecessor atomically; the predecessor is kept as <file>.bak
+    size_t shardCount = snapshot.shards.size();
+    DataStore::forEachShard(shardCount, [&](size_t shard) {
+        const ShardSnapshot& data = snapshot.shards[shard];
+        ShardFiles files = ShardFiles::forShard(shard, shardCount);
+        
+        std::string text;
+        DataFileWriter catalogFile(files.catalog);
+        MaterialCatalog::saveEntries(text, data.catalog, &catalogFile);
+        catalogFile.commit(text);
+        
+        text.clear();
+        DataFileWriter suppliersFile(files.suppliers);
+        TextWriter(text, &suppliersFile).sequence("Suppliers", data.suppliers);
+        suppliersFile.commit(text);
+        
+        // The shard's lookups over exactly these suppliers, for the next
+        // load to adopt
+        if (data.indexes) {
+            IndexFile::write(files.index, suppliersFile.generationStamp(), *data.indexes);
+        } else {
+            ShardIndexes indexes;
+            indexes.build(data.suppliers);
+            IndexFile::write(files.index, suppliersFile.generationStamp(), indexes);
+        }
+        
+        text.clear();
+        DataFileWriter ordersFile(files.orders);
+        TextWriter(text, &ordersFile).sequence("Orders", data.orders);
+        ordersFile.commit(text);
+        
+        if (data.aggregates) {
+            text.clear();
+            DataFileWriter aggregatesFile(files.aggregates);
+            data.aggregates->save(text, &aggregatesFile);
+            aggregatesFile.commit(text);
+        }
+    });
+    DataStore::recordShardCount(shardCount);
+}
+
+void DataPersistence::registerLoadedSuppliers(DataStore& loaded, std::vector<std::vector<Supplier> >& shardSuppliers,
+                                              std::vector<std::shared_ptr<ShardIndexes> >& prebuilt) {
+    std::vector<std::string> bulstats, phoneNumbers;
+    for (size_t shard = 0; shard < shardSuppliers.size(); ++shard) {
+        for (size_t i = 0; i < shardSuppliers[shard].size(); ++i) {
+            bulstats.push_back(shardSuppliers[shard][i].getBulstat());
+            phoneNumbers.push_back(shardSuppliers[shard][i].getPhoneNumber());
+        }
+    }
+    if (bulstats.empty()) {
+        return;
+    }
+    
+    // Records read from disk skip the setters, so validate them in bulk
+    std::vector<const char*> bulstatErrors = Validation::checkBulstats(bulstats);
+    std::vector<const char*> phoneErrors = Validation::checkPhoneNumbers(phoneNumbers);
+    
+    // The store is empty, so duplicates are among the records read so far
+    std::unordered_set<std::string> bulstatsSeen, phoneNumbersSeen;
+    size_t shardCount = shardSuppliers.size();
+    std::vector<std::vector<Supplier> > accepted(shardCount);
+    int duplicateCount = 0;
+    int invalidCount = 0;
+    size_t record = 0;
+    for (size_t shard = 0; shard < shardCount; ++shard) {
+        for (size_t i = 0; i < shardSuppliers[shard].size(); ++i, ++record) {
+            Supplier& supplier = shardSuppliers[shard][i];
+            
+            const char* error = bulstatErrors[record] ? bulstatErrors[record] : phoneErrors[record];
+            if (error) {
+                invalidCount++;
+                std::cerr << "Warning: Skipping invalid supplier with BULSTAT: " 
+                          << supplier.getBulstat() << " (" << error << ")" << std::endl;
+            } else if (bulstatsSeen.count(bulstats[record])) {
+                duplicateCount++;
+                std::cerr << "Warning: Skipping duplicate supplier with BULSTAT: " 
+                          << supplier.getBulstat() << std::endl;
+            } else if (phoneNumbersSeen.count(phoneNumbers[record])) {
+                duplicateCount++;
+                std::cerr << "Warning: Skipping duplicate supplier with phone number: " 
+                          << supplier.getPhoneNumber() << std::endl;
+            } else {
+                bulstatsSeen.insert(bulstats[record]);
+                phoneNumbersSeen.insert(phoneNumbers[record]);
+                size_t target = DataStore::shardIndexOf(bulstats[record], shardCount);
+                if (target == shard) {
+                    accepted[shard].push_back(std::move(supplier));
+                    continue;
+                }
+                // Filed under the wrong shard: neither shard's indexes fit
+                prebuilt[target].reset();
+                accepted[target].push_back(std::move(supplier));
+            }
+            // A shard that lost records no longer matches its indexes
+            prebuilt[shard].reset();
+        }
+    }
+    loaded.addLoadedSuppliers(accepted, prebuilt);
+    
+    if (duplicateCount > 0) {
+        std::cout << "\n⚠ Skipped " << duplicateCount 
+                  << " duplicate supplier(s) during load.\n";
+    }
+    if (invalidCount > 0) {
+        std::cout << "\n⚠ Skipped " << invalidCount 
+                  << " invalid supplier(s) during load.\n";
+    }
+}
+
+bool DataPersistence::readFiles(DataStore& loaded, bool fromBackup) {
+    METRIC_TIMER(METRIC_LOAD_DATA);
+    
+    // The load runs as a task graph. Each shard reads its catalog and then
+    // the orders that refer to it, while its suppliers file and the indexes
+    // saved with it are read alongside; every block is parsed as soon as it
+    // has arrived and been verified. Suppliers are registered once all
+    // files are parsed (that adds catalog versions, so no order may be
+    // parsing then), the change logs are replayed, and finally each shard
+    // indexes its orders.
+    size_t shardCount = loaded.getShardCount();
+    std::vector<std::vector<Supplier> > shardSuppliers(shardCount);
+    std::vector<std::shared_ptr<ShardIndexes> > prebuilt(shardCount);
+    std::vector<std::vector<Order> > shardOrders(shardCount);
+    std::vector<char> ordersFound(shardCount, 0);
+    std::vector<size_t> duplicateOrders(shardCount, 0);
+    size_t replayed = 0;
+    
+    TaskGraph load;
+    TaskGraph::TaskId registerSuppliers = load.add([&]() {
+        registerLoadedSuppliers(loaded, shardSuppliers, prebuilt);
+    });
+    // Price-list changes made since the last full save
+    TaskGraph::TaskId replayChanges = load.add([&]() {
+        replayed = loaded.replayChangeLogs();
+    });
+    load.precede(registerSuppliers, replayChanges);
+    
+    for (size_t shard = 0; shard < shardCount; ++shard) {
+        TaskGraph::TaskId readCatalog = load.add([&, shard]() {
+            DataShard& target = loaded.getShard(shard);
+            std::string catalogPath = filePath(target.getFiles().catalog, fromBackup);
+            if (DataFile::exists(catalogPath)) {
+                DataFileReader file(catalogPath);
+                target.getCatalog().load(file);
+                file.finish();
+            }
+        });
+        
+        TaskGraph::TaskId readSuppliers = load.add([&, shard]() {
+            DataShard& target = loaded.getShard(shard);
+            std::string suppliersPath = filePath(target.getFiles().suppliers, fromBackup);
+            if (DataFile::exists(suppliersPath)) {
+                DataFileReader file(suppliersPath);
+                TextReader<DataFileReader> reader(file, file.getFormatVersion());
+                size_t supplierCount = reader.count();
+                shardSuppliers[shard].resize(supplierCount);
+                for (size_t i = 0; i < supplierCount; ++i) {
+                    reader.read(shardSuppliers[shard][i]);
+                }
+                file.finish();
+                
+                // Indexes saved with this very file spare the shard
+                // indexing every supplier again
+                prebuilt[shard] = std::make_shared<ShardIndexes>();
+                if (!IndexFile::read(filePath(target.getFiles().index, fromBackup),
+                                     file.generationStamp(), *prebuilt[shard])) {
+                    prebuilt[shard].reset();
+                }
+            }
+        });
+        
+        // Orders resolve against their own shard's catalog
+        TaskGraph::TaskId readOrders = load.add([&, shard]() {
+            DataShard& target = loaded.getShard(shard);
+            std::string ordersPath = filePath(target.getFiles().orders, fromBackup);
+            if (!DataFile::exists(ordersPath)) {
+                return;
+            }
+            DataFileReader file(ordersPath);
+            TextReader<DataFileReader> reader(file, file.getFormatVersion(), &target.getCatalog());
+            std::vector<Order>& orders = shardOrders[shard];
+            orders.resize(reader.count());
+            for (size_t i = 0; i < orders.size(); ++i) {
+                reader.read(orders[i]);
+            }
+            file.finish();
+            ordersFound[shard] = 1;
+        });
+        
+        // Files saved before the totals were kept have orders but none;
+        // loadDataFromFile recounts those shards
+        TaskGraph::TaskId readAggregates = load.add([&, shard]() {
+            DataShard& target = loaded.getShard(shard);
+            std::string aggregatesPath = filePath(target.getFiles().aggregates, fromBackup);
+            if (DataFile::exists(aggregatesPath)) {
+                DataFileReader file(aggregatesPath);
+                target.loadAggregates(file);
+                file.finish();
+            } else if (DataFile::exists(filePath(target.getFiles().orders, fromBackup))) {
+                target.forgetAggregates();
+            }
+        });
+        
+        TaskGraph::TaskId indexOrders = load.add([&, shard]() {
+            DataShard& target = loaded.getShard(shard);
+            duplicateOrders[shard] = shardOrders[shard].size() - target.addLoadedOrders(shardOrders[shard]);
+        });
+        
+        load.precede(readCatalog, readOrders);
+        load.precede(readSuppliers, registerSuppliers);
+        load.precede(readOrders, registerSuppliers);
+        load.precede(replayChanges, indexOrders);
+        load.precede(readAggregates, registerSuppliers);
+    }
+    load.run();
+    
+    if (replayed > 0) {
+        std::cout << "\n[OK] Replayed " << replayed << " catalog update(s) from "
+                  << "the change log.\n";
+    }
+    
+    size_t duplicateCount = 0;
+    for (size_t shard = 0; shard < shardCount; ++shard) {
+        duplicateCount += duplicateOrders[shard];
+    }
+    if (duplicateCount > 0) {
+        std::cout << "\n⚠ Skipped " << duplicateCount 
+                  << " duplicate order(s) during load.\n";
+    }
+    
+    for (size_t shard = 0; shard < shardCount; ++shard) {
+        if (ordersFound[shard]) {
+            return true;
+        }
+    }
+    return false;
+}
@@ -0,0 +1,558 @@
+#include "DataShard.h"
+#include <stdexcept>
+
+ShardFiles ShardFiles::forShard(size_t shard, size_t shardCount) {
+    std::string suffix = shardCount > 1 ? "-s" + std::to_string(shard) : "";
+    ShardFiles files;
+    files.catalog = "catalog" + suffix + ".dat";
+    files.suppliers = "suppliers" + suffix + ".dat";
+    files.orders = "orders" + suffix + ".dat";
+    files.changeLog = "catalog" + suffix + ".log";
+    files.archive = "orders" + suffix;
+    files.aggregates = "aggregates" + suffix + ".dat";
+    files.index = "index" + suffix + ".dat";
+    return files;
+}
+
+std::vector<std::string> ShardFiles::dataFiles() const {
+    std::vector<std::string> names;
+    names.push_back(catalog);
+    names.push_back(suppliers);
+    names.push_back(orders);
+    names.push_back(aggregates);
+    names.push_back(index);
+    return names;
+}
+
+DataShard::DataShard(const ShardFiles& files)
+    : files(files), archive(files.archive), indexes(std::make_shared<ShardIndexes>()),
+      changeLog(files.changeLog), aggregates(std::make_shared<OrderAggregates>()) {}
+
+void DataShard::rebuildIndex() {
+    indexes = std::make_shared<ShardIndexes>();
+    indexes->build(suppliers);
+}
+
+std::shared_ptr<const ShardIndexes> DataShard::currentIndexes() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return indexes;
+}
+
+ShardIndexes& DataShard::writableIndexesLocked() {
+    if (indexes.use_count() > 1) {
+        indexes = std::make_shared<ShardIndexes>(*indexes);
+    }
+    return *indexes;
+}
+
+void DataShard::rebuildOrderIndex() {
+    orderIndex.clear();
+    for (size_t i = 0; i < orders.size(); ++i) {
+        orderIndex.add(i, orders[i], orders[i].contentHash());
+    }
+}
+
+void DataShard::validatePosition(int position) const {
+    if (position < 0 || position >= static_cast<int>(suppliers.size())) {
+        throw std::out_of_range("Invalid supplier index");
+    }
+}
+
+const ShardFiles& DataShard::getFiles() const {
+    return files;
+}
+
+size_t DataShard::getSupplierCount() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return suppliers.size();
+}
+
+size_t DataShard::getOrderCount() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return orders.size();
+}
+
+Supplier DataShard::getSupplier(int position) const {
+    std::lock_guard<std::mutex> lock(mutex);
+    validatePosition(position);
+    return suppliers[position];
+}
+
+int DataShard::getSupplierId(int position) const {
+    std::lock_guard<std::mutex> lock(mutex);
+    validatePosition(position);
+    return supplierIds[position];
+}
+
+CowVector<Order> DataShard::getOrders() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return orders;
+}
+
+int DataShard::findByBulstat(const std::string& bulstat) const {
+    return currentIndexes()->supplierIndex.findByBulstat(bulstat);
+}
+
+int DataShard::findByPhone(const std::string& phoneNumber) const {
+    return currentIndexes()->supplierIndex.findByPhone(phoneNumber);
+}
+
+std::vector<SupplierMatch> DataShard::search(const std::string& query, size_t limit) const {
+    return currentIndexes()->supplierIndex.search(query, limit);
+}
+
+std::vector<MaterialMatch> DataShard::nearestMaterials(const MaterialQuery& query) const {
+    return currentIndexes()->materialIndex.nearest(query);
+}
+
+void DataShard::addSupplier(const Supplier& supplier, int supplierId) {
+    std::lock_guard<std::mutex> lock(mutex);
+    int position = static_cast<int>(suppliers.size());
+    ShardIndexes& writable = writableIndexesLocked();
+    writable.supplierIndex.add(position, supplier);
+    suppliers.push_back(supplier);
+    supplierIds.push_back(supplierId);
+    for (const auto& material : supplier.getMaterials()) {
+        catalog.registerVersion(supplier.getBulstat(), material);
+        writable.materialIndex.add(position, material);
+    }
+    stockCounters.reset(supplier);
+}
+
+void DataShard::removeLastSupplier() {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (suppliers.empty()) {
+        throw std::logic_error("Shard has no suppliers");
+    }
+    int position = static_cast<int>(suppliers.size()) - 1;
+    const Supplier& supplier = suppliers[position];
+    ShardIndexes& writable = writableIndexesLocked();
+    writable.supplierIndex.removeLast(supplier);
+    for (const auto& material : supplier.getMaterials()) {
+        writable.materialIndex.remove(position, material.getId());
+    }
+    stockCounters.remove(supplier.getBulstat());
+    suppliers.pop_back();
+    supplierIds.pop_back();
+}
+
+void DataShard::commitStockLocked(const Order& order, StockCounters::Reservation& reservation) {
+    const std::string& bulstat = order.getSupplierBulstat();
+    if (!stockCounters.isCurrent(bulstat, reservation)) {
+        StockCounters::cancel(reservation);
+        reservation = StockCounters::Reservation();
+        reservation = stockCounters.reserve(bulstat, order.stockLines());
+    }
+    if (reservation.lines.empty()) {
+        return;
+    }
+    // The counters never let reservations exceed these levels, so this
+    // cannot fall short
+    int position = indexes->supplierIndex.findByBulstat(bulstat);
+    suppliers.mutableAt(position).reserveStock(reservation.lines);
+}
+
+void DataShard::resetStockCountersLocked() {
+    stockCounters.clear();
+    for (size_t i = 0; i < suppliers.size(); ++i) {
+        if (suppliers[i].tracksStock()) {
+            stockCounters.reset(suppliers[i]);
+        }
+    }
+}
+
+bool DataShard::addOrderLocked(const Order& order, StockCounters::Reservation* reservation) {
+    uint64_t contentHash = order.contentHash();
+    if (orderIndex.findDuplicate(order, contentHash, orders) != -1 ||
+        archive.holdsDuplicate(order, contentHash, catalog)) {
+        if (reservation) {
+            StockCounters::cancel(*reservation);
+        }
+        return false;
+    }
+    if (reservation) {
+        commitStockLocked(order, *reservation);
+    }
+    orderIndex.add(orders.size(), order, contentHash);
+    orders.push_back(order);
+    // Loaded orders are already in the loaded aggregates
+    if (reservation && !order.isCancelled()) {
+        aggregateLocked(order, 1);
+    }
+    return true;
+}
+
+bool DataShard::addOrder(const Order& order) {
+    StockCounters::Reservation reservation = stockCounters.reserve(order.getSupplierBulstat(), order.stockLines());
+    std::lock_guard<std::mutex> lock(mutex);
+    return addOrderLocked(order, &reservation);
+}
+
+size_t DataShard::addOrders(const std::vector<Order>& newOrders, std::vector<std::string>* stockErrors,
+                            std::vector<Order>* added) {
+    // Every order's stock is taken first; the lock is then held once for
+    // the whole batch
+    std::vector<StockCounters::Reservation> reservations(newOrders.size());
+    std::vector<std::string> shortages(newOrders.size());
+    for (size_t i = 0; i < newOrders.size(); ++i) {
+        try {
+            reservations[i] = stockCounters.reserve(newOrders[i].getSupplierBulstat(), newOrders[i].stockLines());
+        } catch (const InsufficientStockError& e) {
+            shortages[i] = e.what();
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    size_t addedCount = 0;
+    for (size_t i = 0; i < newOrders.size(); ++i) {
+        try {
+            if (!shortages[i].empty()) {
+                throw InsufficientStockError(shortages[i]);
+            }
+            if (addOrderLocked(newOrders[i], &reservations[i])) {
+                ++addedCount;
+                if (added) {
+                    added->push_back(newOrders[i]);
+                }
+            }
+        } catch (const InsufficientStockError& e) {
+            if (stockErrors) {
+                const Order& order = newOrders[i];
+                std::string name = order.getIdempotencyKey().empty() ?
+                    order.getOrderId() : order.getIdempotencyKey();
+                stockErrors->push_back("order " + name + ": " + e.what());
+            }
+        }
+    }
+    return addedCount;
+}
+
+void DataShard::addLoadedSuppliers(const std::vector<Supplier>& loadedSuppliers, int firstSupplierId,
+                                   const std::shared_ptr<ShardIndexes>& prebuilt) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!suppliers.empty()) {
+        throw std::logic_error("Loaded suppliers must go into an empty shard");
+    }
+    for (size_t i = 0; i < loadedSuppliers.size(); ++i) {
+        const Supplier& supplier = loadedSuppliers[i];
+        suppliers.push_back(supplier);
+        supplierIds.push_back(firstSupplierId + static_cast<int>(i));
+        for (const auto& material : supplier.getMaterials()) {
+            catalog.registerVersion(supplier.getBulstat(), material);
+        }
+    }
+    if (prebuilt && prebuilt->supplierIndex.size() == suppliers.size()) {
+        indexes = prebuilt;
+    } else {
+        rebuildIndex();
+    }
+    resetStockCountersLocked();
+}
+
+size_t DataShard::addLoadedOrders(const std::vector<Order>& loadedOrders) {
+    std::lock_guard<std::mutex> lock(mutex);
+    size_t added = 0;
+    for (size_t i = 0; i < loadedOrders.size(); ++i) {
+        if (addOrderLocked(loadedOrders[i], 0)) {
+            ++added;
+        }
+    }
+    return added;
+}
+
+std::vector<Order> DataShard::findOrders(const std::string& bulstat, const std::string& orderId) const {
+    std::lock_guard<std::mutex> lock(mutex);
+    std::vector<Order> found;
+    for (size_t i = 0; i < orders.size(); ++i) {
+        if (orders[i].getOrderId() == orderId && orders[i].getSupplierBulstat() == bulstat) {
+            found.push_back(orders[i]);
+        }
+    }
+    return found;
+}
+
+long DataShard::findStoredLocked(const Order& order, bool cancelled) const {
+    for (size_t i = orders.size(); i > 0; --i) {
+        const Order& stored = orders[i - 1];
+        if (stored.isCancelled() == cancelled && stored.getOrderId() == order.getOrderId() &&
+            stored.sameContent(order)) {
+            return static_cast<long>(i - 1);
+        }
+    }
+    return -1;
+}
+
+void DataShard::releaseStockLocked(const Order& order) {
+    int position = indexes->supplierIndex.findByBulstat(order.getSupplierBulstat());
+    if (position != -1 && suppliers[position].tracksStock()) {
+        std::vector<std::pair<unsigned int, int> > lines = order.stockLines();
+        suppliers.mutableAt(position).releaseStock(lines);
+        stockCounters.release(order.getSupplierBulstat(), lines);
+    }
+}
+
+void DataShard::aggregateLocked(const Order& order, int sign) {
+    if (!aggregates) {
+        return;
+    }
+    if (aggregates.use_count() > 1) {
+        aggregates = std::make_shared<OrderAggregates>(*aggregates);
+    }
+    if (sign > 0) {
+        aggregates->add(order);
+    } else {
+        aggregates->subtract(order);
+    }
+}
+
+void DataShard::cancelOrder(const Order& order) {
+    std::lock_guard<std::mutex> lock(mutex);
+    long found = findStoredLocked(order, false);
+    if (found == -1) {
+        throw std::invalid_argument("Order " + order.getOrderId() + " is not among the open orders");
+    }
+    orders.mutableAt(found).cancel();
+    releaseStockLocked(orders[found]);
+    aggregateLocked(orders[found], -1);
+}
+
+void DataShard::removeOrder(const Order& order) {
+    std::lock_guard<std::mutex> lock(mutex);
+    long found = findStoredLocked(order, order.isCancelled());
+    if (found == -1) {
+        throw std::invalid_argument("Order " + order.getOrderId() + " is no longer among the current orders");
+    }
+    size_t position = static_cast<size_t>(found);
+    if (!orders[position].isCancelled()) {
+        releaseStockLocked(orders[position]);
+        aggregateLocked(orders[position], -1);
+    }
+    if (position + 1 == orders.size()) {
+        orderIndex.remove(position, orders[position], orders[position].contentHash());
+        orders.pop_back();
+    } else {
+        // Later orders shift down; only a save's archiving can put the
+        // order anywhere but last
+        orders.erase(position);
+        rebuildOrderIndex();
+    }
+}
+
+void DataShard::reinstateOrder(const Order& order) {
+    std::lock_guard<std::mutex> lock(mutex);
+    long found = findStoredLocked(order, true);
+    if (found == -1) {
+        throw std::invalid_argument("Order " + order.getOrderId() + " is not among the cancelled orders");
+    }
+    StockCounters::Reservation reservation =
+        stockCounters.reserve(order.getSupplierBulstat(), orders[found].stockLines());
+    commitStockLocked(orders[found], reservation);
+    orders.mutableAt(found).reinstate();
+    aggregateLocked(orders[found], 1);
+}
+
+void DataShard::setStock(int position, unsigned int materialId, int onHand) {
+    std::lock_guard<std::mutex> lock(mutex);
+    validatePosition(position);
+    suppliers.mutableAt(position).setStock(materialId, onHand);
+    stockCounters.reset(suppliers[position]);
+}
+
+void DataShard::clear() {
+    std::lock_guard<std::mutex> lock(mutex);
+    suppliers.clear();
+    supplierIds.clear();
+    orders.clear();
+    catalog.clear();
+    indexes = std::make_shared<ShardIndexes>();
+    orderIndex.clear();
+    aggregates = std::make_shared<OrderAggregates>();
+    stockCounters.clear();
+}
+
+const MaterialCatalog& DataShard::getCatalog() const {
+    return catalog;
+}
+
+MaterialCatalog& DataShard::getCatalog() {
+    return catalog;
+}
+
+std::shared_ptr<const OpticalMaterial> DataShard::resolveVersion(const std::string& bulstat,
+                                                                 unsigned int id, unsigned int version) const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return catalog.resolve(bulstat, id, version);
+}
+
+CatalogDelta DataShard::applyDeltaLocked(int position, const std::vector<MaterialChange>& changes) {
+    validatePosition(position);
+    Supplier& supplier = suppliers.mutableAt(position);
+    CatalogDelta applied = supplier.applyDelta(changes);
+    stockCounters.reset(supplier);
+
+    for (size_t i = 0; i < applied.changes.size(); ++i) {
+        if (applied.changes[i].kind == MaterialChange::REMOVE_MATERIAL) {
+            writableIndexesLocked().materialIndex.remove(position, applied.changes[i].materialId);
+            continue;
+        }
+        int materialPosition = supplier.findMaterial(applied.changes[i].materialId);
+        if (materialPosition != -1) {
+            catalog.registerVersion(supplier.getBulstat(), supplier.getMaterials()[materialPosition]);
+            writableIndexesLocked().materialIndex.add(position, supplier.getMaterials()[materialPosition]);
+        }
+    }
+    return applied;
+}
+
+CatalogDelta DataShard::applyCatalogDelta(int position, const std::vector<MaterialChange>& changes) {
+    std::lock_guard<std::mutex> lock(mutex);
+    CatalogDelta applied = applyDeltaLocked(position, changes);
+    if (!applied.changes.empty()) {
+        changeLog.append(applied);
+    }
+    return applied;
+}
+
+size_t DataShard::replayChangeLog() {
+    std::lock_guard<std::mutex> lock(mutex);
+    std::vector<CatalogDelta> deltas = changeLog.recover();
+    size_t replayed = 0;
+    for (size_t i = 0; i < deltas.size(); ++i) {
+        int position = indexes->supplierIndex.findByBulstat(deltas[i].supplierBulstat);
+        // Older records are already part of the suppliers file
+        if (position == -1 ||
+            suppliers[position].getCatalogVersion() != deltas[i].baseVersion) {
+            continue;
+        }
+        try {
+            applyDeltaLocked(position, deltas[i].changes);
+            ++replayed;
+        } catch (const std::invalid_argument&) {
+            // A record that no longer fits is dropped with the rest of its chain
+        }
+    }
+    return replayed;
+}
+
+void DataShard::truncateChangeLog() const {
+    changeLog.truncate();
+}
+
+const OrderArchive& DataShard::getArchive() const {
+    return archive;
+}
+
+void DataShard::loadArchiveManifest() {
+    std::lock_guard<std::mutex> lock(mutex);
+    archive.loadManifest(catalog);
+}
+
+void DataShard::archiveColdOrders() {
+    std::lock_guard<std::mutex> lock(mutex);
+    size_t before = orders.size();
+    orders = archive.sealColdOrders(orders, catalog);
+    // Positions only shift when something was sealed away
+    if (orders.size() != before) {
+        rebuildOrderIndex();
+    }
+}
+
+std::shared_ptr<const OrderAggregates> DataShard::getAggregates() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!aggregates) {
+        return std::make_shared<const OrderAggregates>();
+    }
+    return aggregates;
+}
+
+void DataShard::loadAggregates(DataFileReader& file) {
+    std::shared_ptr<OrderAggregates> loaded = std::make_shared<OrderAggregates>();
+    loaded->load(file);
+    std::lock_guard<std::mutex> lock(mutex);
+    aggregates = loaded;
+}
+
+void DataShard::forgetAggregates() {
+    std::lock_guard<std::mutex> lock(mutex);
+    aggregates.reset();
+}
+
+bool DataShard::rebuildAggregates() {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (aggregates) {
+        return false;
+    }
+    std::shared_ptr<OrderAggregates> rebuilt = std::make_shared<OrderAggregates>();
+    const std::vector<ArchiveSegment>& segments = archive.getSegments();
+    for (size_t s = 0; s < segments.size(); ++s) {
+        std::vector<Order> archived = archive.loadSegment(segments[s].period, catalog);
+        for (size_t i = 0; i < archived.size(); ++i) {
+            if (!archived[i].isCancelled()) {
+                rebuilt->add(archived[i]);
+            }
+        }
+    }
+    for (size_t i = 0; i < orders.size(); ++i) {
+        if (!orders[i].isCancelled()) {
+            rebuilt->add(orders[i]);
+        }
+    }
+    aggregates = rebuilt;
+    return true;
+}
+
+MemoryUsage DataShard::memoryUsage() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    MemoryUsage usage;
+    usage.suppliers.count = suppliers.size();
+    usage.suppliers.bytes = suppliers.memoryBytes() + supplierIds.memoryBytes();
+    for (size_t i = 0; i < suppliers.size(); ++i) {
+        suppliers[i].addMemoryUsage(usage);
+    }
+    catalog.addMemoryUsage(usage);
+    usage.orders.count = orders.size();
+    usage.orders.bytes = orders.memoryBytes();
+    for (size_t i = 0; i < orders.size(); ++i) {
+        usage.orders.bytes += orders[i].heapBytes();
+    }
+    usage.indexes.count = indexes->supplierIndex.size() + orderIndex.size() + indexes->materialIndex.size();
+    usage.indexes.bytes = indexes->supplierIndex.memoryBytes() + orderIndex.memoryBytes() +
+                          indexes->materialIndex.memoryBytes() + archive.memoryBytes();
+    if (aggregates) {
+        usage.indexes.count += aggregates->size();
+        usage.indexes.bytes += aggregates->memoryBytes();
+    }
+    return usage;
+}
+
+ShardSnapshot DataShard::snapshot() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    ShardSnapshot result;
+    result.suppliers = suppliers;
+    result.supplierIds = supplierIds;
+    result.orders = orders;
+    result.catalog = catalog.getEntries();
+    result.indexes = indexes;
+    result.aggregates = aggregates;
+    return result;
+}
+
+void DataShard::restore(const ShardSnapshot& snapshot) {
+    std::lock_guard<std::mutex> lock(mutex);
+    suppliers = snapshot.suppliers;
+    supplierIds = snapshot.supplierIds;
+    orders = snapshot.orders;
+    catalog.restore(snapshot.catalog);
+    // Copied, since this shard will keep changing its own
+    aggregates.reset();
+    if (snapshot.aggregates) {
+        aggregates = std::make_shared<OrderAggregates>(*snapshot.aggregates);
+    }
+    if (snapshot.indexes) {
+        indexes = std::make_shared<ShardIndexes>(*snapshot.indexes);
+    } else {
+        rebuildIndex();
+    }
+    rebuildOrderIndex();
+    resetStockCountersLocked();
+}
@@ -0,0 +1,620 @@
+#include "DataStore.h"
+#include "DataFile.h"
+#include "Metrics.h"
+#include "TaskScheduler.h"
+#include <stdexcept>
+#include <sstream>
+#include <fstream>
+#include <map>
+#include <unordered_map>
+#include <algorithm>
+#include <cstdlib>
+#include <cstdint>
+
+namespace {
+
+const char SHARD_MANIFEST[] = "shards.idx";
+
+// Orders rendered per scheduler task when listing them
+const size_t RENDER_GRAIN = 512;
+
+// Takes the next item from whichever sequence has the earliest date, so
+// each shard keeps its own order and a single shard is left untouched
+template <typename Item, typename DateOf>
+std::vector<Item> mergeByDate(std::vector<std::vector<Item> >& sequences, DateOf dateOf) {
+    std::vector<Item> merged;
+    std::vector<size_t> next(sequences.size(), 0);
+    while (true) {
+        int best = -1;
+        for (size_t s = 0; s < sequences.size(); ++s) {
+            if (next[s] < sequences[s].size() &&
+                (best == -1 || dateOf(sequences[s][next[s]]) < dateOf(sequences[best][next[best]]))) {
+                best = static_cast<int>(s);
+            }
+        }
+        if (best == -1) {
+            return merged;
+        }
+        merged.push_back(sequences[best][next[best]++]);
+    }
+}
+
+}
+
+size_t DataSnapshot::supplierCount() const {
+    return directory.size();
+}
+
+size_t DataSnapshot::orderCount() const {
+    size_t total = 0;
+    for (size_t i = 0; i < shards.size(); ++i) {
+        total += shards[i].orders.size();
+    }
+    return total;
+}
+
+size_t DataStore::configuredShardCount() {
+    std::ifstream manifest(SHARD_MANIFEST);
+    size_t recorded = 0;
+    if (manifest >> recorded && recorded >= 1 && recorded <= MAX_SHARD_COUNT) {
+        return recorded;
+    }
+
+    // Data written before sharding is one shard under the original names
+    ShardFiles legacy = ShardFiles::forShard(0, 1);
+    if (DataFile::exists(legacy.suppliers) || DataFile::exists(legacy.orders) ||
+        DataFile::exists(DataFile::backupPath(legacy.suppliers))) {
+        return 1;
+    }
+
+    const char* requested = std::getenv("OPTICAL_SHARDS");
+    if (requested) {
+        long count = std::strtol(requested, 0, 10);
+        if (count >= 1 && count <= static_cast<long>(MAX_SHARD_COUNT)) {
+            return static_cast<size_t>(count);
+        }
+    }
+    return DEFAULT_SHARD_COUNT;
+}
+
+void DataStore::recordShardCount(size_t shardCount) {
+    std::ostringstream manifest;
+    manifest << shardCount << "\n";
+    DataFile::writeAtomically(SHARD_MANIFEST, manifest.str(), false);
+}
+
+size_t DataStore::shardIndexOf(const std::string& bulstat, size_t shardCount) {
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < bulstat.size(); ++i) {
+        hash ^= static_cast<unsigned char>(bulstat[i]);
+        hash *= 16777619u;
+    }
+    return hash % shardCount;
+}
+
+void DataStore::forEachShard(size_t shardCount, const std::function<void(size_t)>& task) {
+    TaskScheduler::instance().forEach(shardCount, task);
+}
+
+DataStore::DataStore(size_t shardCount) {
+    if (shardCount < 1 || shardCount > MAX_SHARD_COUNT) {
+        throw std::invalid_argument("Invalid shard count");
+    }
+    for (size_t shard = 0; shard < shardCount; ++shard) {
+        shards.push_back(std::unique_ptr<DataShard>(
+            new DataShard(ShardFiles::forShard(shard, shardCount))));
+    }
+}
+
+const SupplierLocation& DataStore::locate(int supplierIndex) const {
+    if (supplierIndex < 0 || supplierIndex >= static_cast<int>(directory.size())) {
+        throw std::out_of_range("Invalid supplier index");
+    }
+    return directory[supplierIndex];
+}
+
+DataShard& DataStore::shardOf(const std::string& bulstat) {
+    return *shards[shardIndexOf(bulstat, shards.size())];
+}
+
+const DataShard& DataStore::shardOf(const std::string& bulstat) const {
+    return *shards[shardIndexOf(bulstat, shards.size())];
+}
+
+size_t DataStore::getShardCount() const {
+    return shards.size();
+}
+
+DataShard& DataStore::getShard(size_t shard) {
+    return *shards.at(shard);
+}
+
+const DataShard& DataStore::getShard(size_t shard) const {
+    return *shards.at(shard);
+}
+
+int DataStore::getSupplierCount() const {
+    return static_cast<int>(directory.size());
+}
+
+int DataStore::getOrderCount() const {
+    size_t total = 0;
+    for (size_t i = 0; i < shards.size(); ++i) {
+        total += shards[i]->getOrderCount();
+    }
+    return static_cast<int>(total);
+}
+
+Supplier DataStore::getSupplier(int index) const {
+    const SupplierLocation& location = locate(index);
+    return shards[location.shard]->getSupplier(location.position);
+}
+
+int DataStore::findSupplier(const std::string& bulstat) const {
+    const DataShard& shard = shardOf(bulstat);
+    int position = shard.findByBulstat(bulstat);
+    return position == -1 ? -1 : shard.getSupplierId(position);
+}
+
+bool DataStore::bulstatExists(const std::string& bulstat) const {
+    METRIC_TIMER(METRIC_SUPPLIER_LOOKUP_BULSTAT);
+    return shardOf(bulstat).findByBulstat(bulstat) != -1;
+}
+
+bool DataStore::phoneNumberExists(const std::string& phoneNumber) const {
+    METRIC_TIMER(METRIC_SUPPLIER_LOOKUP_PHONE);
+    for (size_t i = 0; i < shards.size(); ++i) {
+        if (shards[i]->findByPhone(phoneNumber) != -1) {
+            return true;
+        }
+    }
+    return false;
+}
+
+std::vector<SupplierMatch> DataStore::searchSuppliers(const std::string& query, size_t limit) const {
+    std::vector<std::vector<SupplierMatch> > perShard(shards.size());
+    forEachShard(shards.size(), [&](size_t shard) {
+        perShard[shard] = shards[shard]->search(query, limit);
+        for (size_t i = 0; i < perShard[shard].size(); ++i) {
+            SupplierMatch& match = perShard[shard][i];
+            match.supplierIndex = shards[shard]->getSupplierId(match.supplierIndex);
+        }
+    });
+
+    // Best score first; equal scores (and the empty query) keep insertion order
+    std::multimap<std::pair<double, int>, SupplierMatch> ranked;
+    for (size_t shard = 0; shard < perShard.size(); ++shard) {
+        for (size_t i = 0; i < perShard[shard].size(); ++i) {
+            const SupplierMatch& match = perShard[shard][i];
+            ranked.insert(std::make_pair(std::make_pair(-match.score, match.supplierIndex), match));
+        }
+    }
+    std::vector<SupplierMatch> matches;
+    for (const auto& entry : ranked) {
+        if (matches.size() == limit) {
+            break;
+        }
+        matches.push_back(entry.second);
+    }
+    return matches;
+}
+
+std::vector<MaterialMatch> DataStore::nearestMaterials(const MaterialQuery& query) const {
+    std::vector<MaterialMatch> matches;
+    for (size_t shard = 0; shard < shards.size(); ++shard) {
+        std::vector<MaterialMatch> found = shards[shard]->nearestMaterials(query);
+        for (size_t i = 0; i < found.size(); ++i) {
+            found[i].supplierIndex = shards[shard]->getSupplierId(found[i].supplierIndex);
+            matches.push_back(found[i]);
+        }
+    }
+    std::sort(matches.begin(), matches.end(), MaterialIndex::closer);
+    if (matches.size() > query.limit) {
+        matches.resize(query.limit);
+    }
+    return matches;
+}
+
+void DataStore::addSupplier(const Supplier& supplier) {
+    std::lock_guard<std::mutex> lock(directoryMutex);
+    if (bulstatExists(supplier.getBulstat())) {
+        throw std::invalid_argument("A supplier with this BULSTAT already exists!");
+    }
+    if (phoneNumberExists(supplier.getPhoneNumber())) {
+        throw std::invalid_argument("A supplier with this phone number already exists!");
+    }
+
+    size_t shard = shardIndexOf(supplier.getBulstat(), shards.size());
+    SupplierLocation location;
+    location.shard = static_cast<unsigned int>(shard);
+    location.position = static_cast<unsigned int>(shards[shard]->getSupplierCount());
+    shards[shard]->addSupplier(supplier, static_cast<int>(directory.size()));
+    directory.push_back(location);
+}
+
+void DataStore::removeLastSupplier(const std::string& bulstat) {
+    std::lock_guard<std::mutex> lock(directoryMutex);
+    DataShard& shard = shardOf(bulstat);
+    int position = shard.findByBulstat(bulstat);
+    if (directory.empty() || position == -1 ||
+        shard.getSupplierId(position) != static_cast<int>(directory.size()) - 1) {
+        throw std::logic_error("Supplier " + bulstat + " was not added last");
+    }
+    shard.removeLastSupplier();
+    directory.pop_back();
+}
+
+void DataStore::addMaterial(int supplierIndex, const OpticalMaterial& material) {
+    MaterialChange change;
+    change.kind = MaterialChange::ADD_MATERIAL;
+    change.material = material;
+    applyCatalogDelta(supplierIndex, std::vector<MaterialChange>(1, change));
+}
+
+CatalogDelta DataStore::applyCatalogDelta(int supplierIndex, const std::vector<MaterialChange>& changes) {
+    const SupplierLocation& location = locate(supplierIndex);
+    return shards[location.shard]->applyCatalogDelta(location.position, changes);
+}
+
+size_t DataStore::replayChangeLogs() {
+    std::vector<size_t> replayed(shards.size(), 0);
+    forEachShard(shards.size(), [&](size_t shard) {
+        replayed[shard] = shards[shard]->replayChangeLog();
+    });
+    size_t total = 0;
+    for (size_t i = 0; i < replayed.size(); ++i) {
+        total += replayed[i];
+    }
+    return total;
+}
+
+void DataStore::truncateChangeLogs() const {
+    for (size_t i = 0; i < shards.size(); ++i) {
+        shards[i]->truncateChangeLog();
+    }
+}
+
+bool DataStore::addOrder(const Order& order) {
+    return shardOf(order.getSupplierBulstat()).addOrder(order);
+}
+
+size_t DataStore::addOrders(const std::vector<Order>& newOrders, std::vector<std::string>* stockErrors,
+                            std::vector<Order>* added) {
+    // Duplicates always share a supplier, hence a shard, so each shard
+    // can check its group on its own
+    std::vector<std::vector<Order> > perShard(shards.size());
+    for (size_t i = 0; i < newOrders.size(); ++i) {
+        perShard[shardIndexOf(newOrders[i].getSupplierBulstat(), shards.size())].push_back(newOrders[i]);
+    }
+    std::vector<size_t> addedCounts(shards.size(), 0);
+    std::vector<std::vector<std::string> > errors(shards.size());
+    std::vector<std::vector<Order> > addedOrders(shards.size());
+    forEachShard(shards.size(), [&](size_t shard) {
+        addedCounts[shard] = shards[shard]->addOrders(perShard[shard], &errors[shard],
+                                                      added ? &addedOrders[shard] : 0);
+    });
+
+    size_t total = 0;
+    for (size_t shard = 0; shard < addedCounts.size(); ++shard) {
+        total += addedCounts[shard];
+        if (added) {
+            added->insert(added->end(), addedOrders[shard].begin(), addedOrders[shard].end());
+        }
+        if (stockErrors) {
+            stockErrors->insert(stockErrors->end(), errors[shard].begin(), errors[shard].end());
+        }
+    }
+    return total;
+}
+
+std::vector<Order> DataStore::findOrders(const std::string& bulstat, const std::string& orderId) const {
+    return shardOf(bulstat).findOrders(bulstat, orderId);
+}
+
+void DataStore::cancelOrder(const Order& order) {
+    shardOf(order.getSupplierBulstat()).cancelOrder(order);
+}
+
+void DataStore::removeOrder(const Order& order) {
+    shardOf(order.getSupplierBulstat()).removeOrder(order);
+}
+
+void DataStore::reinstateOrder(const Order& order) {
+    shardOf(order.getSupplierBulstat()).reinstateOrder(order);
+}
+
+void DataStore::setStock(int supplierIndex, unsigned int materialId, int onHand) {
+    const SupplierLocation& location = locate(supplierIndex);
+    shards[location.shard]->setStock(location.position, materialId, onHand);
+}
+
+void DataStore::clear() {
+    std::lock_guard<std::mutex> lock(directoryMutex);
+    for (size_t i = 0; i < shards.size(); ++i) {
+        shards[i]->clear();
+    }
+    directory.clear();
+}
+
+std::shared_ptr<const OpticalMaterial> DataStore::resolveMaterial(int supplierIndex, int materialIndex) const {
+    const Supplier supplier = getSupplier(supplierIndex);
+    OpticalMaterial material = supplier.getMaterial(materialIndex);
+    return resolveVersion(supplier.getBulstat(), material.getId(), material.getVersion());
+}
+
+std::shared_ptr<const OpticalMaterial> DataStore::resolveVersion(const std::string& bulstat,
+                                                                 unsigned int id, unsigned int version) const {
+    return shardOf(bulstat).resolveVersion(bulstat, id, version);
+}
+
+std::vector<std::string> DataStore::renderOrders() const {
+    typedef std::pair<std::string, std::string> DatedText;
+    std::vector<std::vector<DatedText> > perShard(shards.size());
+    forEachShard(shards.size(), [&](size_t shard) {
+        // Large shards are rendered in pieces; idle workers steal them
+        const CowVector<Order> orders = shards[shard]->getOrders();
+        std::vector<DatedText>& texts = perShard[shard];
+        texts.resize(orders.size());
+        TaskScheduler::instance().parallelFor(0, orders.size(), RENDER_GRAIN, [&](size_t first, size_t last) {
+            for (size_t i = first; i < last; ++i) {
+                texts[i] = DatedText(orders[i].getOrderDate(), orders[i].render());
+            }
+        });
+    });
+
+    std::vector<DatedText> merged = mergeByDate(perShard,
+        [](const DatedText& entry) -> const std::string& { return entry.first; });
+    std::vector<std::string> rendered;
+    rendered.reserve(merged.size());
+    for (size_t i = 0; i < merged.size(); ++i) {
+        rendered.push_back(merged[i].second);
+    }
+    return rendered;
+}
+
+std::vector<ArchiveSegment> DataStore::getArchiveSegments() const {
+    std::map<std::string, ArchiveSegment> byPeriod;
+    for (size_t i = 0; i < shards.size(); ++i) {
+        const std::vector<ArchiveSegment>& segments = shards[i]->getArchive().getSegments();
+        for (size_t s = 0; s < segments.size(); ++s) {
+            std::map<std::string, ArchiveSegment>::iterator found = byPeriod.find(segments[s].period);
+            if (found == byPeriod.end()) {
+                byPeriod[segments[s].period] = segments[s];
+            } else {
+                found->second.orderCount += segments[s].orderCount;
+                found->second.rawBytes += segments[s].rawBytes;
+                found->second.storedBytes += segments[s].storedBytes;
+            }
+        }
+    }
+
+    std::vector<ArchiveSegment> merged;
+    for (const auto& entry : byPeriod) {
+        merged.push_back(entry.second);
+    }
+    return merged;
+}
+
+size_t DataStore::getArchivedOrderCount() const {
+    size_t total = 0;
+    for (size_t i = 0; i < shards.size(); ++i) {
+        total += shards[i]->getArchive().getArchivedOrderCount();
+    }
+    return total;
+}
+
+std::vector<Order> DataStore::loadArchivedOrders(const std::string& period) const {
+    std::vector<std::vector<Order> > perShard(shards.size());
+    forEachShard(shards.size(), [&](size_t shard) {
+        const DataShard& source = *shards[shard];
+        const std::vector<ArchiveSegment>& segments = source.getArchive().getSegments();
+        for (size_t s = 0; s < segments.size(); ++s) {
+            if (segments[s].period == period) {
+                perShard[shard] = source.getArchive().loadSegment(period, source.getCatalog());
+                break;
+            }
+        }
+    });
+    return mergeByDate(perShard, [](const Order& order) { return order.getOrderDate(); });
+}
+
+void DataStore::loadArchiveManifests() {
+    for (size_t i = 0; i < shards.size(); ++i) {
+        shards[i]->loadArchiveManifest();
+    }
+}
+
+void DataStore::archiveColdOrders() {
+    forEachShard(shards.size(), [&](size_t shard) {
+        shards[shard]->archiveColdOrders();
+    });
+}
+
+MemoryUsage DataStore::memoryUsage() const {
+    std::vector<MemoryUsage> perShard(shards.size());
+    forEachShard(shards.size(), [&](size_t shard) {
+        perShard[shard] = shards[shard]->memoryUsage();
+    });
+    MemoryUsage usage;
+    for (size_t i = 0; i < perShard.size(); ++i) {
+        usage += perShard[i];
+    }
+    usage.suppliers.bytes += directory.memoryBytes();
+    usage.strings = StringPool::memoryUsage();
+    return usage;
+}
+
+AggregateTotals DataStore::orderTotals() const {
+    AggregateTotals totals;
+    for (size_t i = 0; i < shards.size(); ++i) {
+        totals += shards[i]->getAggregates()->getOverall();
+    }
+    return totals;
+}
+
+AggregateTotals DataStore::supplierSpend(const std::string& bulstat) const {
+    return shardOf(bulstat).getAggregates()->supplierTotals(bulstat);
+}
+
+AggregateTotals DataStore::supplierSpend(const std::string& bulstat,
+                                         const std::string& fromPeriod, const std::string& toPeriod) const {
+    return shardOf(bulstat).getAggregates()->supplierTotals(bulstat, fromPeriod, toPeriod);
+}
+
+MaterialDemand DataStore::materialDemand(const std::string& type, const std::string& materialName) const {
+    MaterialDemand total;
+    total.type = type;
+    total.materialName = materialName;
+    for (size_t i = 0; i < shards.size(); ++i) {
+        MaterialDemand demand = shards[i]->getAggregates()->materialDemand(type, materialName);
+        total.quantity += demand.quantity;
+        total.amountUnits += demand.amountUnits;
+    }
+    return total;
+}
+
+AggregateTotals DataStore::totalsBetween(const std::string& fromDay, const std::string& toDay) const {
+    AggregateTotals totals;
+    for (size_t i = 0; i < shards.size(); ++i) {
+        totals += shards[i]->getAggregates()->totalsBetween(fromDay, toDay);
+    }
+    return totals;
+}
+
+std::vector<SupplierSpend> DataStore::topSuppliers(size_t limit) const {
+    // A supplier's orders all live in its shard, so the lists just join
+    std::vector<SupplierSpend> spend;
+    for (size_t i = 0; i < shards.size(); ++i) {
+        std::vector<SupplierSpend> shardSpend = shards[i]->getAggregates()->allSupplierSpend();
+        spend.insert(spend.end(), shardSpend.begin(), shardSpend.end());
+    }
+    size_t count = std::min(limit, spend.size());
+    std::partial_sort(spend.begin(), spend.begin() + count, spend.end(),
+                      [](const SupplierSpend& a, const SupplierSpend& b) {
+        if (a.totals.amountUnits != b.totals.amountUnits) {
+            return a.totals.amountUnits > b.totals.amountUnits;
+        }
+        return a.bulstat < b.bulstat;
+    });
+    spend.resize(count);
+    return spend;
+}
+
+std::vector<MaterialDemand> DataStore::topMaterials(size_t limit) const {
+    // The same material can be ordered in every shard
+    std::vector<MaterialDemand> demand;
+    std::unordered_map<std::string, size_t> positions;
+    for (size_t i = 0; i < shards.size(); ++i) {
+        std::vector<MaterialDemand> shardDemand = shards[i]->getAggregates()->allMaterialDemand();
+        for (size_t m = 0; m < shardDemand.size(); ++m) {
+            std::string key = shardDemand[m].type + '\n' + shardDemand[m].materialName;
+            std::unordered_map<std::string, size_t>::iterator found = positions.find(key);
+            if (found == positions.end()) {
+                positions[key] = demand.size();
+                demand.push_back(shardDemand[m]);
+            } else {
+                demand[found->second].quantity += shardDemand[m].quantity;
+                demand[found->second].amountUnits += shardDemand[m].amountUnits;
+            }
+        }
+    }
+    size_t count = std::min(limit, demand.size());
+    std::partial_sort(demand.begin(), demand.begin() + count, demand.end(),
+                      [](const MaterialDemand& a, const MaterialDemand& b) {
+        if (a.quantity != b.quantity) {
+            return a.quantity > b.quantity;
+        }
+        return a.type != b.type ? a.type < b.type : a.materialName < b.materialName;
+    });
+    demand.resize(count);
+    return demand;
+}
+
+std::vector<DayRow> DataStore::recentDays(size_t limit) const {
+    std::map<std::string, AggregateTotals> days;
+    for (size_t i = 0; i < shards.size(); ++i) {
+        std::vector<DayRow> shardDays = shards[i]->getAggregates()->recentDays(limit);
+        for (size_t d = 0; d < shardDays.size(); ++d) {
+            days[shardDays[d].day] += shardDays[d].totals;
+        }
+    }
+    std::vector<DayRow> recent;
+    for (std::map<std::string, AggregateTotals>::const_reverse_iterator day = days.rbegin();
+         day != days.rend() && recent.size() < limit; ++day) {
+        DayRow row;
+        row.day = day->first;
+        row.totals = day->second;
+        recent.push_back(row);
+    }
+    return recent;
+}
+
+size_t DataStore::rebuildMissingAggregates() {
+    std::vector<char> rebuilt(shards.size(), 0);
+    forEachShard(shards.size(), [&](size_t shard) {
+        rebuilt[shard] = shards[shard]->rebuildAggregates() ? 1 : 0;
+    });
+    size_t count = 0;
+    for (size_t i = 0; i < rebuilt.size(); ++i) {
+        count += rebuilt[i];
+    }
+    return count;
+}
+
+void DataStore::addLoadedSuppliers(const std::vector<std::vector<Supplier> >& shardSuppliers,
+                                   const std::vector<std::shared_ptr<ShardIndexes> >& prebuilt) {
+    if (shardSuppliers.size() != shards.size() || prebuilt.size() != shards.size()) {
+        throw std::invalid_argument("Loaded suppliers have a different shard count");
+    }
+    std::lock_guard<std::mutex> lock(directoryMutex);
+    if (!directory.empty()) {
+        throw std::logic_error("Loaded suppliers must go into an empty store");
+    }
+    std::vector<int> firstIds(shards.size());
+    for (size_t shard = 0; shard < shards.size(); ++shard) {
+        firstIds[shard] = static_cast<int>(directory.size());
+        SupplierLocation location;
+        location.shard = static_cast<unsigned int>(shard);
+        for (size_t i = 0; i < shardSuppliers[shard].size(); ++i) {
+            location.position = static_cast<unsigned int>(i);
+            directory.push_back(location);
+        }
+    }
+    forEachShard(shards.size(), [&](size_t shard) {
+        shards[shard]->addLoadedSuppliers(shardSuppliers[shard], firstIds[shard], prebuilt[shard]);
+    });
+}
+
+DataSnapshot DataStore::snapshot() const {
+    DataSnapshot result;
+    result.directory = directory;
+    for (size_t i = 0; i < shards.size(); ++i) {
+        result.shards.push_back(shards[i]->snapshot());
+    }
+    return result;
+}
+
+void DataStore::restore(const DataSnapshot& snapshot) {
+    if (snapshot.shards.size() != shards.size()) {
+        throw std::invalid_argument("Snapshot has a different shard count");
+    }
+    std::lock_guard<std::mutex> lock(directoryMutex);
+    directory = snapshot.directory;
+    for (size_t i = 0; i < shards.size(); ++i) {
+        shards[i]->restore(snapshot.shards[i]);
+    }
+}
+
+void DataStore::swap(DataStore& other) {
+    if (&other == this) {
+        return;
+    }
+    if (other.shards.size() != shards.size()) {
+        throw std::invalid_argument("Stores have different shard counts");
+    }
+    std::lock(directoryMutex, other.directoryMutex);
+    std::lock_guard<std::mutex> lock(directoryMutex, std::adopt_lock);
+    std::lock_guard<std::mutex> otherLock(other.directoryMutex, std::adopt_lock);
+    shards.swap(other.shards);
+    std::swap(directory, other.directory);
+}
@@ -0,0 +1,66 @@
+#include "IndexFile.h"
+#include "DataFile.h"
+#include "Codecs.h"
+#include "Crc32c.h"
+#include <cstdio>
+#include <cinttypes>
+
+namespace {
+
+const char INDEX_MAGIC[] = "OIDX1\n";
+const size_t MAGIC_LENGTH = sizeof(INDEX_MAGIC) - 1;
+const size_t STAMP_LENGTH = 26;     // 16 and 8 hex digits, a space and a newline
+
+}
+
+void ShardIndexes::build(const CowVector<Supplier>& suppliers) {
+    supplierIndex.clear();
+    materialIndex.clear();
+    for (size_t i = 0; i < suppliers.size(); ++i) {
+        supplierIndex.add(static_cast<int>(i), suppliers[i]);
+        for (const auto& material : suppliers[i].getMaterials()) {
+            materialIndex.add(static_cast<int>(i), material);
+        }
+    }
+}
+
+void IndexFile::write(const std::string& path, uint64_t suppliersStamp, const ShardIndexes& indexes) {
+    std::string body;
+    BinaryWriter writer(body);
+    indexes.supplierIndex.save(writer);
+    indexes.materialIndex.save(writer);
+
+    char stamp[32];
+    std::snprintf(stamp, sizeof(stamp), "%016" PRIx64 " %08x\n", suppliersStamp,
+                  static_cast<unsigned int>(Crc32c::compute(body.data(), body.size())));
+    std::string bytes(INDEX_MAGIC, MAGIC_LENGTH);
+    bytes.append(stamp, STAMP_LENGTH);
+    bytes += body;
+    // Kept as .bak with the suppliers file, so a load from the backups
+    // finds the indexes of that save too
+    DataFile::writeAtomically(path, bytes, true);
+}
+
+bool IndexFile::read(const std::string& path, uint64_t suppliersStamp, ShardIndexes& indexes) {
+    if (suppliersStamp == 0 || !DataFile::exists(path)) {
+        return false;
+    }
+    try {
+        std::string bytes = DataFile::readAll(path);
+        size_t bodyBegin = MAGIC_LENGTH + STAMP_LENGTH;
+        uint64_t stamp = 0;
+        unsigned int checksum = 0;
+        if (bytes.size() < bodyBegin || bytes.compare(0, MAGIC_LENGTH, INDEX_MAGIC) != 0 ||
+            std::sscanf(bytes.c_str() + MAGIC_LENGTH, "%16" SCNx64 " %8x", &stamp, &checksum) != 2 ||
+            stamp != suppliersStamp ||
+            Crc32c::compute(bytes.data() + bodyBegin, bytes.size() - bodyBegin) != checksum) {
+            return false;
+        }
+        BinaryReader reader(bytes.data() + bodyBegin, bytes.data() + bytes.size());
+        indexes.supplierIndex.load(reader);
+        indexes.materialIndex.load(reader);
+        return reader.atEnd();
+    } catch (const std::exception&) {
+        return false;
+    }
+}
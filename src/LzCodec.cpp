@@ -0,0 +1,164 @@
+#include "LzCodec.h"
+#include <stdexcept>
+#include <vector>
+#include <cstring>
+#include <cstdint>
+
+namespace {
+
+const size_t MIN_MATCH = 4;
+const size_t MAX_OFFSET = 65535;
+const int HASH_BITS = 14;
+// The last bytes are always emitted as literals so matches never run
+// past the end of the input.
+const size_t END_LITERALS = 5;
+// Most output one input byte can stand for: a 255 continuation byte of a
+// match length. A header claiming more than this is corrupt.
+const size_t MAX_EXPANSION = 255;
+
+uint32_t readWord(const char* p) {
+    uint32_t value;
+    std::memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+uint32_t hashWord(uint32_t value) {
+    return (value * 2654435761u) >> (32 - HASH_BITS);
+}
+
+void writeLength(std::string& out, size_t length) {
+    while (length >= 255) {
+        out.push_back(static_cast<char>(255));
+        length -= 255;
+    }
+    out.push_back(static_cast<char>(length));
+}
+
+size_t readLength(const std::string& in, size_t& pos, size_t length) {
+    if (length != 15) {
+        return length;
+    }
+    unsigned char byte;
+    do {
+        if (pos >= in.size()) {
+            throw std::runtime_error("Compressed data is truncated");
+        }
+        byte = static_cast<unsigned char>(in[pos++]);
+        length += byte;
+    } while (byte == 255);
+    return length;
+}
+
+void emitSequence(std::string& out, const char* literals, size_t literalCount,
+                  size_t matchLength, size_t offset) {
+    size_t matchCode = matchLength >= MIN_MATCH ? matchLength - MIN_MATCH : 0;
+    unsigned char token = static_cast<unsigned char>(
+        ((literalCount < 15 ? literalCount : 15) << 4) | (matchCode < 15 ? matchCode : 15));
+    out.push_back(static_cast<char>(token));
+    if (literalCount >= 15) {
+        writeLength(out, literalCount - 15);
+    }
+    out.append(literals, literalCount);
+    if (matchLength == 0) {
+        return;
+    }
+    out.push_back(static_cast<char>(offset & 0xFF));
+    out.push_back(static_cast<char>((offset >> 8) & 0xFF));
+    if (matchCode >= 15) {
+        writeLength(out, matchCode - 15);
+    }
+}
+
+}
+
+std::string LzCodec::compress(const std::string& input) {
+    std::string out;
+    uint32_t size = static_cast<uint32_t>(input.size());
+    out.append(reinterpret_cast<const char*>(&size), sizeof(size));
+
+    const char* base = input.data();
+    size_t length = input.size();
+    std::vector<size_t> table(static_cast<size_t>(1) << HASH_BITS, static_cast<size_t>(-1));
+
+    size_t anchor = 0;
+    size_t pos = 0;
+    while (length >= END_LITERALS + MIN_MATCH && pos + MIN_MATCH + END_LITERALS <= length) {
+        uint32_t word = readWord(base + pos);
+        uint32_t slot = hashWord(word);
+        size_t candidate = table[slot];
+        table[slot] = pos;
+
+        if (candidate == static_cast<size_t>(-1) || pos - candidate > MAX_OFFSET ||
+            readWord(base + candidate) != word) {
+            ++pos;
+            continue;
+        }
+
+        size_t matchLength = MIN_MATCH;
+        while (pos + matchLength + END_LITERALS < length &&
+               base[candidate + matchLength] == base[pos + matchLength]) {
+            ++matchLength;
+        }
+
+        emitSequence(out, base + anchor, pos - anchor, matchLength, pos - candidate);
+        pos += matchLength;
+        anchor = pos;
+    }
+
+    emitSequence(out, base + anchor, length - anchor, 0, 0);
+    return out;
+}
+
+std::string LzCodec::decompress(const std::string& input) {
+    if (input.size() < sizeof(uint32_t)) {
+        throw std::runtime_error("Compressed data is truncated");
+    }
+    uint32_t size;
+    std::memcpy(&size, input.data(), sizeof(size));
+
+    // The header is not checksummed, so it is only trusted as far as the
+    // rest of the input could possibly expand
+    if (size > (input.size() - sizeof(uint32_t)) * MAX_EXPANSION) {
+        throw std::runtime_error("Compressed data is corrupt");
+    }
+    std::string out;
+    out.reserve(size);
+    size_t pos = sizeof(uint32_t);
+    while (pos < input.size()) {
+        unsigned char token = static_cast<unsigned char>(input[pos++]);
+
+        size_t literalCount = readLength(input, pos, token >> 4);
+        if (pos + literalCount > input.size()) {
+            throw std::runtime_error("Compressed data is truncated");
+        }
+        if (out.size() + literalCount > size) {
+            throw std::runtime_error("Compressed data is corrupt");
+        }
+        out.append(input, pos, literalCount);
+        pos += literalCount;
+        if (pos == input.size()) {
+            break;
+        }
+
+        if (pos + 2 > input.size()) {
+            throw std::runtime_error("Compressed data is truncated");
+        }
+        size_t offset = static_cast<unsigned char>(input[pos]) |
+                        (static_cast<size_t>(static_cast<unsigned char>(input[pos + 1])) << 8);
+        pos += 2;
+        size_t matchLength = readLength(input, pos, token & 0x0F) + MIN_MATCH;
+        if (offset == 0 || offset > out.size() || out.size() + matchLength > size) {
+            throw std::runtime_error("Compressed data is corrupt");
+        }
+        // Byte-by-byte copy so overlapping matches repeat correctly
+        size_t from = out.size() - offset;
+        for (size_t i = 0; i < matchLength; ++i) {
+            out.push_back(out[from + i]);
+        }
+    }
+
+    if (out.size() != size) {
+        throw std::runtime_error("Compressed data is corrupt");
+    }
+    return out;
+}
@@ -0,0 +1,92 @@
+#include "MaterialCatalog.h"
+#include <stdexcept>
+#include "ModelReflection.h"
+#include "DataFile.h"
+
+MaterialCatalog::MaterialCatalog() {}
+
+std::string MaterialCatalog::makeKey(const std::string& bulstat, unsigned int id, unsigned int version) {
+    return bulstat + ":" + std::to_string(id) + ":" + std::to_string(version);
+}
+
+std::shared_ptr<const OpticalMaterial> MaterialCatalog::registerVersion(const std::string& bulstat,
+                                                                        const OpticalMaterial& material) {
+    if (material.getId() == 0) {
+        throw std::invalid_argument("Only materials with an id can be cataloged");
+    }
+
+    std::string key = makeKey(bulstat, material.getId(), material.getVersion());
+    std::unordered_map<std::string, size_t>::const_iterator found = index.find(key);
+    if (found != index.end()) {
+        return entries[found->second].material;
+    }
+
+    CatalogEntry entry;
+    entry.supplierBulstat = bulstat;
+    entry.material = std::make_shared<const OpticalMaterial>(material);
+    index[key] = entries.size();
+    entries.push_back(entry);
+    return entry.material;
+}
+
+std::shared_ptr<const OpticalMaterial> MaterialCatalog::resolve(const std::string& bulstat,
+                                                                unsigned int id, unsigned int version) const {
+    std::unordered_map<std::string, size_t>::const_iterator found =
+        index.find(makeKey(bulstat, id, version));
+    if (found == index.end()) {
+        throw std::runtime_error("Unknown material reference " + makeKey(bulstat, id, version));
+    }
+    return entries[found->second].material;
+}
+
+bool MaterialCatalog::contains(const std::string& bulstat, unsigned int id, unsigned int version) const {
+    return index.find(makeKey(bulstat, id, version)) != index.end();
+}
+
+const CowVector<CatalogEntry>& MaterialCatalog::getEntries() const {
+    return entries;
+}
+
+size_t MaterialCatalog::size() const {
+    return entries.size();
+}
+
+void MaterialCatalog::addMemoryUsage(MemoryUsage& usage) const {
+    usage.catalog.count += entries.size();
+    usage.catalog.bytes += entries.memoryBytes() + memory::hashMapBytes(index);
+    for (size_t i = 0; i < entries.size(); ++i) {
+        usage.catalog.bytes += memory::stringBytes(entries[i].supplierBulstat) +
+                               memory::sharedBytes(sizeof(OpticalMaterial)) + entries[i].material->heapBytes();
+    }
+    for (std::unordered_map<std::string, size_t>::const_iterator it = index.begin(); it != index.end(); ++it) {
+        usage.catalog.bytes += memory::stringBytes(it->first);
+    }
+}
+
+void MaterialCatalog::restore(const CowVector<CatalogEntry>& snapshot) {
+    entries = snapshot;
+    index.clear();
+    for (size_t i = 0; i < entries.size(); ++i) {
+        const OpticalMaterial& material = *entries[i].material;
+        index[makeKey(entries[i].supplierBulstat, material.getId(), material.getVersion())] = i;
+    }
+}
+
+void MaterialCatalog::clear() {
+    entries.clear();
+    index.clear();
+}
+
+void MaterialCatalog::saveEntries(std::string& out, const CowVector<CatalogEntry>& entries, TextSink* sink) {
+    TextWriter(out, sink).sequence("Catalog", entries);
+}
+
+void MaterialCatalog::load(DataFileReader& file) {
+    CowVector<CatalogEntry> loaded;
+    TextReader<DataFileReader>(file, file.getFormatVersion()).sequence("Catalog", loaded);
+
+    clear();
+    for (const auto& entry : loaded) {
+        registerVersion(entry.supplierBulstat, *entry.material);
+    }
+}
@@ -0,0 +1,426 @@
+#include "MaterialIndex.h"
+#include "MemoryUsage.h"
+#include "Codecs.h"
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <cctype>
+#include <cstdlib>
+#include <stdexcept>
+
+namespace {
+
+void saveNames(BinaryWriter& writer, const std::unordered_map<std::string, uint32_t>& ids) {
+    writer.field("Names", static_cast<unsigned int>(ids.size()));
+    for (std::unordered_map<std::string, uint32_t>::const_iterator it = ids.begin(); it != ids.end(); ++it) {
+        writer.field("Name", it->first);
+        writer.field("Id", it->second);
+    }
+}
+
+void loadNames(BinaryReader& reader, std::unordered_map<std::string, uint32_t>& ids) {
+    unsigned int count = 0;
+    reader.field("Names", count);
+    ids.reserve(count);
+    std::string name;
+    unsigned int id = 0;
+    for (unsigned int i = 0; i < count; ++i) {
+        reader.field("Name", name);
+        reader.field("Id", id);
+        ids[name] = id;
+    }
+}
+
+// 64-bit keys as two 32-bit fields, low half first
+void saveKey(BinaryWriter& writer, uint64_t key) {
+    writer.field("Key low", static_cast<unsigned int>(key & 0xffffffffu));
+    writer.field("Key high", static_cast<unsigned int>(key >> 32));
+}
+
+uint64_t loadKey(BinaryReader& reader) {
+    unsigned int low = 0, high = 0;
+    reader.field("Key low", low);
+    reader.field("Key high", high);
+    return (static_cast<uint64_t>(high) << 32) | low;
+}
+
+}
+
+const double MaterialIndex::DIOPTER_STEP = 0.25;
+const double MaterialIndex::THICKNESS_STEP = 0.5;
+const double MaterialIndex::PRICE_STEP = 5.0;
+
+MaterialIndex::MaterialIndex() : liveCount(0) {}
+
+std::string MaterialIndex::normalize(const std::string& text) {
+    std::string result(text);
+    for (size_t i = 0; i < result.size(); ++i) {
+        unsigned char c = static_cast<unsigned char>(result[i]);
+        if (c < 0x80) {
+            result[i] = static_cast<char>(::tolower(c));
+        }
+    }
+    return result;
+}
+
+uint64_t MaterialIndex::materialKey(int supplierIndex, unsigned int materialId) {
+    return (static_cast<uint64_t>(static_cast<uint32_t>(supplierIndex)) << 32) | materialId;
+}
+
+int MaterialIndex::cellCoordinate(double value, double step) {
+    // Clamped so absurd values cannot overflow the ring arithmetic
+    const double LIMIT = 1 << 28;
+    double cell = std::floor(value / step);
+    return static_cast<int>(std::max(-LIMIT, std::min(LIMIT, cell)));
+}
+
+uint64_t MaterialIndex::cellKey(int x, int y) {
+    return (static_cast<uint64_t>(static_cast<uint32_t>(x)) << 32) | static_cast<uint32_t>(y);
+}
+
+uint32_t MaterialIndex::intern(std::unordered_map<std::string, uint32_t>& ids, const std::string& text) {
+    std::unordered_map<std::string, uint32_t>::const_iterator found = ids.find(text);
+    if (found != ids.end()) {
+        return found->second;
+    }
+    uint32_t id = static_cast<uint32_t>(ids.size());
+    ids[text] = id;
+    return id;
+}
+
+void MaterialIndex::add(int supplierIndex, const OpticalMaterial& material) {
+    // Only cataloged materials have an id to be found by
+    if (material.getId() == 0) {
+        return;
+    }
+    remove(supplierIndex, material.getId());
+
+    Point point;
+    point.diopter = material.getDiopter();
+    point.thickness = material.getThickness();
+    point.price = material.getPrice();
+    point.nameId = intern(nameIds, normalize(material.getMaterialName()));
+
+    Entry entry;
+    entry.supplierIndex = static_cast<uint32_t>(supplierIndex);
+    entry.materialId = material.getId();
+    entry.version = material.getVersion();
+    entry.typeId = intern(typeIds, normalize(material.getType()));
+    if (entry.typeId == grids.size()) {
+        Grid grid;
+        grid.minX = grid.minY = INT_MAX;
+        grid.maxX = grid.maxY = INT_MIN;
+        grids.push_back(grid);
+    }
+
+    Grid& grid = grids[entry.typeId];
+    int x = cellCoordinate(point.diopter, DIOPTER_STEP);
+    int y = cellCoordinate(point.thickness, THICKNESS_STEP);
+    grid.minX = std::min(grid.minX, x);
+    grid.maxX = std::max(grid.maxX, x);
+    grid.minY = std::min(grid.minY, y);
+    grid.maxY = std::max(grid.maxY, y);
+
+    if (!freeEntries.empty()) {
+        point.entry = freeEntries.back();
+        freeEntries.pop_back();
+    } else {
+        point.entry = static_cast<uint32_t>(entries.size());
+        entries.push_back(Entry());
+    }
+    entry.cell = cellKey(x, y);
+    std::vector<Point>& cell = grid.cells[entry.cell];
+    entry.cellSlot = static_cast<uint32_t>(cell.size());
+    cell.push_back(point);
+    entries[point.entry] = entry;
+
+    byMaterial[materialKey(supplierIndex, entry.materialId)] = point.entry;
+    ++liveCount;
+}
+
+void MaterialIndex::remove(int supplierIndex, unsigned int materialId) {
+    std::unordered_map<uint64_t, uint32_t>::iterator found =
+        byMaterial.find(materialKey(supplierIndex, materialId));
+    if (found == byMaterial.end()) {
+        return;
+    }
+    uint32_t id = found->second;
+    const Entry& entry = entries[id];
+    Grid& grid = grids[entry.typeId];
+    std::unordered_map<uint64_t, std::vector<Point> >::iterator cell = grid.cells.find(entry.cell);
+
+    // Swap the last point of the cell into the freed slot
+    std::vector<Point>& list = cell->second;
+    list[entry.cellSlot] = list.back();
+    entries[list.back().entry].cellSlot = entry.cellSlot;
+    list.pop_back();
+    if (list.empty()) {
+        grid.cells.erase(cell);
+    }
+
+    freeEntries.push_back(id);
+    byMaterial.erase(found);
+    --liveCount;
+}
+
+void MaterialIndex::clear() {
+    entries.clear();
+    freeEntries.clear();
+    byMaterial.clear();
+    grids.clear();
+    typeIds.clear();
+    nameIds.clear();
+    liveCount = 0;
+}
+
+size_t MaterialIndex::size() const {
+    return liveCount;
+}
+
+size_t MaterialIndex::memoryBytes() const {
+    size_t bytes = memory::vectorBytes(entries) + memory::vectorBytes(freeEntries) +
+                   memory::hashMapBytes(byMaterial) + memory::vectorBytes(grids) +
+                   memory::hashMapBytes(typeIds) + memory::hashMapBytes(nameIds);
+    for (size_t g = 0; g < grids.size(); ++g) {
+        bytes += memory::hashMapBytes(grids[g].cells);
+        for (std::unordered_map<uint64_t, std::vector<Point> >::const_iterator it = grids[g].cells.begin();
+             it != grids[g].cells.end(); ++it) {
+            bytes += memory::vectorBytes(it->second);
+        }
+    }
+    for (std::unordered_map<std::string, uint32_t>::const_iterator it = typeIds.begin(); it != typeIds.end(); ++it) {
+        bytes += memory::stringBytes(it->first);
+    }
+    for (std::unordered_map<std::string, uint32_t>::const_iterator it = nameIds.begin(); it != nameIds.end(); ++it) {
+        bytes += memory::stringBytes(it->first);
+    }
+    return bytes;
+}
+
+void MaterialIndex::save(BinaryWriter& writer) const {
+    saveNames(writer, typeIds);
+    saveNames(writer, nameIds);
+
+    writer.field("Entries", static_cast<unsigned int>(entries.size()));
+    for (size_t i = 0; i < entries.size(); ++i) {
+        const Entry& entry = entries[i];
+        writer.field("Supplier", entry.supplierIndex);
+        writer.field("Material id", entry.materialId);
+        writer.field("Version", entry.version);
+        writer.field("Type", entry.typeId);
+        writer.field("Cell slot", entry.cellSlot);
+        saveKey(writer, entry.cell);
+    }
+    writer.field("Free entries", static_cast<unsigned int>(freeEntries.size()));
+    for (size_t i = 0; i < freeEntries.size(); ++i) {
+        writer.field("Entry", freeEntries[i]);
+    }
+
+    writer.field("Grids", static_cast<unsigned int>(grids.size()));
+    for (size_t g = 0; g < grids.size(); ++g) {
+        const Grid& grid = grids[g];
+        writer.field("Min x", grid.minX);
+        writer.field("Max x", grid.maxX);
+        writer.field("Min y", grid.minY);
+        writer.field("Max y", grid.maxY);
+        writer.field("Cells", static_cast<unsigned int>(grid.cells.size()));
+        for (std::unordered_map<uint64_t, std::vector<Point> >::const_iterator it = grid.cells.begin();
+             it != grid.cells.end(); ++it) {
+            saveKey(writer, it->first);
+            writer.field("Points", static_cast<unsigned int>(it->second.size()));
+            for (size_t i = 0; i < it->second.size(); ++i) {
+                const Point& point = it->second[i];
+                writer.field("Diopter", point.diopter);
+                writer.field("Thickness", point.thickness);
+                writer.field("Price", point.price);
+                writer.field("Entry", point.entry);
+                writer.field("Name", point.nameId);
+            }
+        }
+    }
+}
+
+void MaterialIndex::load(BinaryReader& reader) {
+    clear();
+    loadNames(reader, typeIds);
+    loadNames(reader, nameIds);
+
+    unsigned int count = 0;
+    reader.field("Entries", count);
+    entries.resize(count);
+    for (size_t i = 0; i < entries.size(); ++i) {
+        Entry& entry = entries[i];
+        reader.field("Supplier", entry.supplierIndex);
+        reader.field("Material id", entry.materialId);
+        reader.field("Version", entry.version);
+        reader.field("Type", entry.typeId);
+        reader.field("Cell slot", entry.cellSlot);
+        entry.cell = loadKey(reader);
+    }
+    reader.field("Free entries", count);
+    freeEntries.resize(count);
+    std::vector<char> live(entries.size(), 1);
+    for (size_t i = 0; i < freeEntries.size(); ++i) {
+        reader.field("Entry", freeEntries[i]);
+        if (freeEntries[i] >= entries.size()) {
+            throw std::runtime_error("Invalid free entry in a material index");
+        }
+        live[freeEntries[i]] = 0;
+    }
+
+    reader.field("Grids", count);
+    grids.resize(count);
+    for (size_t g = 0; g < grids.size(); ++g) {
+        Grid& grid = grids[g];
+        reader.field("Min x", grid.minX);
+        reader.field("Max x", grid.maxX);
+        reader.field("Min y", grid.minY);
+        reader.field("Max y", grid.maxY);
+        unsigned int cellCount = 0;
+        reader.field("Cells", cellCount);
+        grid.cells.reserve(cellCount);
+        for (unsigned int c = 0; c < cellCount; ++c) {
+            std::vector<Point>& points = grid.cells[loadKey(reader)];
+            reader.field("Points", count);
+            points.resize(count);
+            for (size_t i = 0; i < points.size(); ++i) {
+                Point& point = points[i];
+                reader.field("Diopter", point.diopter);
+                reader.field("Thickness", point.thickness);
+                reader.field("Price", point.price);
+                reader.field("Entry", point.entry);
+                reader.field("Name", point.nameId);
+            }
+        }
+    }
+
+    // The material lookup follows from the live entries
+    byMaterial.reserve(entries.size() - freeEntries.size());
+    for (size_t i = 0; i < entries.size(); ++i) {
+        if (live[i]) {
+            byMaterial[materialKey(static_cast<int>(entries[i].supplierIndex), entries[i].materialId)] =
+                static_cast<uint32_t>(i);
+            ++liveCount;
+        }
+    }
+}
+
+bool MaterialIndex::closer(const MaterialMatch& a, const MaterialMatch& b) {
+    if (a.distance != b.distance) {
+        return a.distance < b.distance;
+    }
+    if (a.supplierIndex != b.supplierIndex) {
+        return a.supplierIndex < b.supplierIndex;
+    }
+    return a.materialId < b.materialId;
+}
+
+void MaterialIndex::searchGrid(const Grid& grid, const MaterialQuery& query, long nameId,
+                               std::vector<MaterialMatch>& best) const {
+    if (grid.cells.empty()) {
+        return;
+    }
+    double qx = query.diopter / DIOPTER_STEP;
+    double qy = query.thickness / THICKNESS_STEP;
+    int cx = cellCoordinate(query.diopter, DIOPTER_STEP);
+    int cy = cellCoordinate(query.thickness, THICKNESS_STEP);
+    int lastRing = std::max(std::max(std::abs(cx - grid.minX), std::abs(cx - grid.maxX)),
+                            std::max(std::abs(cy - grid.minY), std::abs(cy - grid.maxY)));
+    // How far the query sits from the nearest side of its own cell
+    double margin = std::min(std::min(qx - std::floor(qx), std::ceil(qx) - qx),
+                             std::min(qy - std::floor(qy), std::ceil(qy) - qy));
+    double priceScale = query.usePrice ? 1.0 / PRICE_STEP : 0.0;
+
+    auto scanCell = [&](int x, int y) {
+        if (x < grid.minX || x > grid.maxX || y < grid.minY || y > grid.maxY) {
+            return;
+        }
+        std::unordered_map<uint64_t, std::vector<Point> >::const_iterator cell =
+            grid.cells.find(cellKey(x, y));
+        if (cell == grid.cells.end()) {
+            return;
+        }
+        const std::vector<Point>& points = cell->second;
+        for (size_t i = 0; i < points.size(); ++i) {
+            const Point& point = points[i];
+            if (nameId >= 0 && point.nameId != static_cast<uint32_t>(nameId)) {
+                continue;
+            }
+            double dx = point.diopter / DIOPTER_STEP - qx;
+            double dy = point.thickness / THICKNESS_STEP - qy;
+            double dp = (point.price - query.price) * priceScale;
+            // Squared while searching; the root is taken once at the end
+            double distance = dx * dx + dy * dy + dp * dp;
+            if (best.size() == query.limit && distance > best.front().distance) {
+                continue;
+            }
+
+            const Entry& entry = entries[point.entry];
+            MaterialMatch match;
+            match.supplierIndex = static_cast<int>(entry.supplierIndex);
+            match.materialId = entry.materialId;
+            match.version = entry.version;
+            match.distance = distance;
+            if (best.size() < query.limit) {
+                best.push_back(match);
+                std::push_heap(best.begin(), best.end(), closer);
+            } else if (closer(match, best.front())) {
+                std::pop_heap(best.begin(), best.end(), closer);
+                best.back() = match;
+                std::push_heap(best.begin(), best.end(), closer);
+            }
+        }
+    };
+
+    scanCell(cx, cy);
+    for (int ring = 1; ring <= lastRing; ++ring) {
+        // Every cell of ring r lies at least r - 1 + margin steps away
+        double reach = ring - 1 + margin;
+        if (best.size() == query.limit && best.front().distance < reach * reach) {
+            break;
+        }
+        for (int x = cx - ring; x <= cx + ring; ++x) {
+            scanCell(x, cy - ring);
+            scanCell(x, cy + ring);
+        }
+        for (int y = cy - ring + 1; y <= cy + ring - 1; ++y) {
+            scanCell(cx - ring, y);
+            scanCell(cx + ring, y);
+        }
+    }
+}
+
+std::vector<MaterialMatch> MaterialIndex::nearest(const MaterialQuery& query) const {
+    std::vector<MaterialMatch> best;
+    if (query.limit == 0) {
+        return best;
+    }
+
+    long nameId = -1;
+    if (!query.materialName.empty()) {
+        std::unordered_map<std::string, uint32_t>::const_iterator found =
+            nameIds.find(normalize(query.materialName));
+        if (found == nameIds.end()) {
+            return best;
+        }
+        nameId = static_cast<long>(found->second);
+    }
+
+    if (!query.type.empty()) {
+        std::unordered_map<std::string, uint32_t>::const_iterator found = typeIds.find(normalize(query.type));
+        if (found == typeIds.end()) {
+            return best;
+        }
+        searchGrid(grids[found->second], query, nameId, best);
+    } else {
+        for (size_t i = 0; i < grids.size(); ++i) {
+            searchGrid(grids[i], query, nameId, best);
+        }
+    }
+
+    std::sort_heap(best.begin(), best.end(), closer);
+    for (size_t i = 0; i < best.size(); ++i) {
+        best[i].distance = std::sqrt(best[i].distance);
+    }
+    return best;
+}
@@ -0,0 +1,78 @@
+#include "MemoryUsage.h"
+#include <sstream>
+#include <iomanip>
+
+double MemoryFootprint::bytesPerRecord() const {
+    return count == 0 ? 0.0 : static_cast<double>(bytes) / static_cast<double>(count);
+}
+
+MemoryFootprint& MemoryFootprint::operator+=(const MemoryFootprint& other) {
+    count += other.count;
+    bytes += other.bytes;
+    return *this;
+}
+
+size_t MemoryUsage::totalBytes() const {
+    return suppliers.bytes + materials.bytes + catalog.bytes + orders.bytes + indexes.bytes + strings.bytes;
+}
+
+MemoryUsage& MemoryUsage::operator+=(const MemoryUsage& other) {
+    suppliers += other.suppliers;
+    materials += other.materials;
+    catalog += other.catalog;
+    orders += other.orders;
+    indexes += other.indexes;
+    strings += other.strings;
+    return *this;
+}
+
+namespace {
+
+void reportLine(std::ostringstream& out, const char* name, const MemoryFootprint& footprint) {
+    out << std::left << std::setw(20) << name << std::right
+        << std::setw(12) << footprint.count
+        << std::setw(14) << std::fixed << std::setprecision(1) << footprint.bytes / 1024.0 << " KiB"
+        << std::setw(12) << footprint.bytesPerRecord() << " B each\n";
+}
+
+}
+
+std::string MemoryUsage::report() const {
+    std::ostringstream out;
+    out << std::left << std::setw(20) << "Records" << std::right
+        << std::setw(12) << "Count" << std::setw(18) << "Memory" << std::setw(19) << "Per record" << "\n";
+    out << std::string(69, '-') << "\n";
+    reportLine(out, "Suppliers", suppliers);
+    reportLine(out, "Materials", materials);
+    reportLine(out, "Catalog versions", catalog);
+    reportLine(out, "Orders", orders);
+    reportLine(out, "Index entries", indexes);
+    reportLine(out, "Pooled strings", strings);
+    out << std::string(69, '-') << "\n";
+    out << std::left << std::setw(32) << "Total" << std::right
+        << std::setw(14) << std::fixed << std::setprecision(1) << totalBytes() / 1024.0 << " KiB\n";
+    return out.str();
+}
+
+size_t memory::allocationBytes(size_t requested) {
+    const size_t HEADER = sizeof(size_t);
+    const size_t GRANULE = 16;
+    const size_t MINIMUM = 32;
+    size_t block = (requested + HEADER + GRANULE - 1) / GRANULE * GRANULE;
+    return block < MINIMUM ? MINIMUM : block;
+}
+
+size_t memory::stringBytes(const std::string& text) {
+    // Short strings live inside the object itself
+    const char* data = text.data();
+    const char* object = reinterpret_cast<const char*>(&text);
+    if (data >= object && data < object + sizeof(text)) {
+        return 0;
+    }
+    return allocationBytes(text.capacity() + 1);
+}
+
+size_t memory::sharedBytes(size_t objectSize) {
+    const size_t CONTROL_BLOCK = sizeof(void*) + 2 * sizeof(int);
+    return allocationBytes(CONTROL_BLOCK + objectSize);
+}
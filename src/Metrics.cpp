@@ -0,0 +1,240 @@
+#include "Metrics.h"
+#include <atomic>
+#include <mutex>
+#include <vector>
+#include <memory>
+#include <sstream>
+#include <iomanip>
+#include <cstdlib>
+
+namespace {
+
+const char* const METRIC_NAMES[METRIC_COUNT] = {
+    "loadDataFromFile",
+    "saveDataToFile",
+    "Order::addItem",
+    "Order::calculateTotalPrice",
+    "supplierLookup.bulstat",
+    "supplierLookup.phone",
+    "supplierSearch",
+    "render.order",
+    "render.materials",
+    "renderCache.hit",
+    "renderCache.miss"
+};
+
+// Written only by the owning thread, read by reports: relaxed atomics
+// compile to plain loads and stores but keep the cross-thread read defined.
+struct ThreadSlot {
+    std::atomic<uint64_t> counts[METRIC_COUNT];
+    std::atomic<uint64_t> totals[METRIC_COUNT];
+    std::atomic<uint64_t> maxima[METRIC_COUNT];
+    std::atomic<uint64_t> buckets[METRIC_COUNT][LatencyHistogram::BUCKET_COUNT];
+
+    ThreadSlot() {
+        clear();
+    }
+
+    void clear() {
+        for (int m = 0; m < METRIC_COUNT; ++m) {
+            counts[m].store(0, std::memory_order_relaxed);
+            totals[m].store(0, std::memory_order_relaxed);
+            maxima[m].store(0, std::memory_order_relaxed);
+            for (int b = 0; b < LatencyHistogram::BUCKET_COUNT; ++b) {
+                buckets[m][b].store(0, std::memory_order_relaxed);
+            }
+        }
+    }
+};
+
+void bump(std::atomic<uint64_t>& cell, uint64_t amount) {
+    cell.store(cell.load(std::memory_order_relaxed) + amount, std::memory_order_relaxed);
+}
+
+std::atomic<bool> enabled(false);
+std::mutex registryMutex;
+// Slots outlive their threads so work done by finished threads still counts
+std::vector<std::unique_ptr<ThreadSlot> > registry;
+
+ThreadSlot& localSlot() {
+    thread_local ThreadSlot* slot = 0;
+    if (!slot) {
+        std::lock_guard<std::mutex> lock(registryMutex);
+        registry.push_back(std::unique_ptr<ThreadSlot>(new ThreadSlot()));
+        slot = registry.back().get();
+    }
+    return *slot;
+}
+
+struct MergedMetric {
+    uint64_t count;
+    uint64_t total;
+    uint64_t maximum;
+    std::vector<uint64_t> buckets;
+
+    MergedMetric() : count(0), total(0), maximum(0), buckets(LatencyHistogram::BUCKET_COUNT, 0) {}
+
+    uint64_t percentile(double fraction) const {
+        if (count == 0) {
+            return 0;
+        }
+        uint64_t rank = static_cast<uint64_t>(fraction * static_cast<double>(count - 1)) + 1;
+        uint64_t seen = 0;
+        for (int b = 0; b < LatencyHistogram::BUCKET_COUNT; ++b) {
+            seen += buckets[b];
+            if (seen >= rank) {
+                return LatencyHistogram::bucketLowerBound(b);
+            }
+        }
+        return maximum;
+    }
+};
+
+std::vector<MergedMetric> mergeAll() {
+    std::vector<MergedMetric> merged(METRIC_COUNT);
+    std::lock_guard<std::mutex> lock(registryMutex);
+    for (size_t t = 0; t < registry.size(); ++t) {
+        const ThreadSlot& slot = *registry[t];
+        for (int m = 0; m < METRIC_COUNT; ++m) {
+            merged[m].count += slot.counts[m].load(std::memory_order_relaxed);
+            merged[m].total += slot.totals[m].load(std::memory_order_relaxed);
+            uint64_t maximum = slot.maxima[m].load(std::memory_order_relaxed);
+            if (maximum > merged[m].maximum) {
+                merged[m].maximum = maximum;
+            }
+            for (int b = 0; b < LatencyHistogram::BUCKET_COUNT; ++b) {
+                merged[m].buckets[b] += slot.buckets[m][b].load(std::memory_order_relaxed);
+            }
+        }
+    }
+    return merged;
+}
+
+double toMicros(uint64_t nanoseconds) {
+    return static_cast<double>(nanoseconds) / 1000.0;
+}
+
+}
+
+int LatencyHistogram::bucketOf(uint64_t value) {
+    if (value < 32) {
+        return static_cast<int>(value);
+    }
+    int highestBit = 63;
+    while (!(value >> highestBit)) {
+        --highestBit;
+    }
+    int exponent = highestBit - 4;
+    return 16 * exponent + static_cast<int>(value >> exponent);
+}
+
+uint64_t LatencyHistogram::bucketLowerBound(int bucket) {
+    if (bucket < 32) {
+        return static_cast<uint64_t>(bucket);
+    }
+    int exponent = bucket / 16 - 1;
+    uint64_t mantissa = static_cast<uint64_t>(bucket % 16 + 16);
+    return mantissa << exponent;
+}
+
+bool Metrics::isEnabled() {
+    return enabled.load(std::memory_order_relaxed);
+}
+
+void Metrics::setEnabled(bool value) {
+    enabled.store(value, std::memory_order_relaxed);
+}
+
+void Metrics::configureFromEnvironment() {
+    const char* value = std::getenv("OPTICAL_METRICS");
+    if (value && *value && std::string(value) != "0") {
+        setEnabled(true);
+    }
+}
+
+const char* Metrics::nameOf(MetricId id) {
+    return METRIC_NAMES[id];
+}
+
+void Metrics::recordLatency(MetricId id, uint64_t nanoseconds) {
+    ThreadSlot& slot = localSlot();
+    bump(slot.counts[id], 1);
+    bump(slot.totals[id], nanoseconds);
+    bump(slot.buckets[id][LatencyHistogram::bucketOf(nanoseconds)], 1);
+    if (nanoseconds > slot.maxima[id].load(std::memory_order_relaxed)) {
+        slot.maxima[id].store(nanoseconds, std::memory_order_relaxed);
+    }
+}
+
+void Metrics::increment(MetricId id, uint64_t amount) {
+    if (!isEnabled()) {
+        return;
+    }
+    bump(localSlot().counts[id], amount);
+}
+
+std::string Metrics::reportText() {
+    std::vector<MergedMetric> merged = mergeAll();
+    std::ostringstream os;
+    os << std::left << std::setw(30) << "Metric"
+       << std::right << std::setw(10) << "Count"
+       << std::setw(12) << "Total ms"
+       << std::setw(11) << "Mean us"
+       << std::setw(11) << "p50 us"
+       << std::setw(11) << "p99 us"
+       << std::setw(11) << "Max us" << "\n";
+    os << std::string(96, '-') << "\n";
+    os << std::fixed << std::setprecision(2);
+    for (int m = 0; m < METRIC_COUNT; ++m) {
+        const MergedMetric& metric = merged[m];
+        double mean = metric.count ? toMicros(metric.total) / static_cast<double>(metric.count) : 0.0;
+        os << std::left << std::setw(30) << METRIC_NAMES[m]
+           << std::right << std::setw(10) << metric.count
+           << std::setw(12) << toMicros(metric.total) / 1000.0
+           << std::setw(11) << mean
+           << std::setw(11) << toMicros(metric.percentile(0.50))
+           << std::setw(11) << toMicros(metric.percentile(0.99))
+           << std::setw(11) << toMicros(metric.maximum) << "\n";
+    }
+    return os.str();
+}
+
+std::string Metrics::reportJson() {
+    std::vector<MergedMetric> merged = mergeAll();
+    std::ostringstream os;
+    os << "{\n  \"metrics\": [\n";
+    for (int m = 0; m < METRIC_COUNT; ++m) {
+        const MergedMetric& metric = merged[m];
+        os << "    {\"name\": \"" << METRIC_NAMES[m] << "\""
+           << ", \"count\": " << metric.count
+           << ", \"totalNs\": " << metric.total
+           << ", \"p50Ns\": " << metric.percentile(0.50)
+           << ", \"p90Ns\": " << metric.percentile(0.90)
+           << ", \"p99Ns\": " << metric.percentile(0.99)
+           << ", \"maxNs\": " << metric.maximum << "}"
+           << (m + 1 < METRIC_COUNT ? "," : "") << "\n";
+    }
+    os << "  ]\n}\n";
+    return os.str();
+}
+
+void Metrics::reset() {
+    std::lock_guard<std::mutex> lock(registryMutex);
+    for (size_t t = 0; t < registry.size(); ++t) {
+        registry[t]->clear();
+    }
+}
+
+ScopedMetricTimer::ScopedMetricTimer(MetricId id) : id(id), active(Metrics::isEnabled()) {
+    if (active) {
+        start = std::chrono::steady_clock::now();
+    }
+}
+
+ScopedMetricTimer::~ScopedMetricTimer() {
+    if (active) {
+        std::chrono::steady_clock::duration elapsed = std::chrono::steady_clock::now() - start;
+        Metrics::recordLatency(id, static_cast<uint64_t>(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count()));
+    }
+}
@@ -1,11 +1,24 @@
 #include "OpticalMaterial.h"
+#include "ModelReflection.h"
+#include "MemoryUsage.h"
 #include <stdexcept>
 #include <iomanip>
+#include <cmath>
 
 void OpticalMaterial::validateThickness(double t) const {
-    if (t <= 0) {
+    // Values under half a ten-thousandth would be stored as 0
+    if (!(t >= 0.5 / FixedDecimal::SCALE)) {
         throw std::invalid_argument("Thickness must be positive");
     }
+    if (t > FixedDecimal::LIMIT) {
+        throw std::invalid_argument("Thickness cannot exceed 200000 mm");
+    }
+}
+
+void OpticalMaterial::validateDiopter(double d) const {
+    if (!(std::fabs(d) <= FixedDecimal::LIMIT)) {
+        throw std::invalid_argument("Diopter must be between -200000 and 200000");
+    }
 }
 
 void OpticalMaterial::validatePrice(double p) const {
@@ -15,66 +28,107 @@ void OpticalMaterial::validatePrice(double p) const {
 }
 
 OpticalMaterial::OpticalMaterial() 
-    : type("Unknown"), thickness(1.0), diopter(0.0), materialName("Unknown"), price(0.0) {
+    : id(0), version(0), thickness(1.0), price(0.0) {
+    // Interned once instead of on every default construction
+    static const PooledString UNKNOWN("Unknown");
+    type = UNKNOWN;
+    materialName = UNKNOWN;
 }
 
 OpticalMaterial::OpticalMaterial(const std::string& type, double thickness, double diopter, 
                                const std::string& materialName, double price)
-    : type(type), diopter(diopter), materialName(materialName) {
+    : id(0), version(0), type(type), materialName(materialName) {
     validateThickness(thickness);
+    validateDiopter(diopter);
     validatePrice(price);
-    this->thickness = thickness;
+    this->thickness.assign(thickness);
+    this->diopter.assign(diopter);
     this->price = price;
 }
 
 OpticalMaterial::OpticalMaterial(const OpticalMaterial& other)
-    : type(other.type), thickness(other.thickness), diopter(other.diopter),
-      materialName(other.materialName), price(other.price) {
+    : id(other.id), version(other.version), type(other.type), materialName(other.materialName),
+      thickness(other.thickness), diopter(other.diopter), price(other.price) {
+}
+
+OpticalMaterial& OpticalMaterial::operator=(const OpticalMaterial& other) {
+    if (this != &other) {
+        id = other.id;
+        version = other.version;
+        type = other.type;
+        materialName = other.materialName;
+        thickness = other.thickness;
+        diopter = other.diopter;
+        price = other.price;
+    }
+    return *this;
 }
 
 OpticalMaterial::~OpticalMaterial() {}
 
-std::string OpticalMaterial::getType() const {
-    return type;
+unsigned int OpticalMaterial::getId() const {
+    return id;
+}
+
+unsigned int OpticalMaterial::getVersion() const {
+    return version;
+}
+
+const std::string& OpticalMaterial::getType() const {
+    return type.str();
 }
 
 double OpticalMaterial::getThickness() const {
-    return thickness;
+    return thickness.value();
 }
 
 double OpticalMaterial::getDiopter() const {
-    return diopter;
+    return diopter.value();
 }
 
-std::string OpticalMaterial::getMaterialName() const {
-    return materialName;
+const std::string& OpticalMaterial::getMaterialName() const {
+    return materialName.str();
 }
 
 double OpticalMaterial::getPrice() const {
     return price;
 }
 
+size_t OpticalMaterial::heapBytes() const {
+    // Type and name text is counted once, in the StringPool
+    return 0;
+}
+
+void OpticalMaterial::setId(unsigned int id) {
+    this->id = id;
+}
+
+void OpticalMaterial::setVersion(unsigned int version) {
+    this->version = version;
+}
+
 void OpticalMaterial::setType(const std::string& type) {
     if (type.empty()) {
         throw std::invalid_argument("Type cannot be empty");
     }
-    this->type = type;
+    this->type.assign(type);
 }
 
 void OpticalMaterial::setThickness(double thickness) {
     validateThickness(thickness);
-    this->thickness = thickness;
+    this->thickness.assign(thickness);
 }
 
 void OpticalMaterial::setDiopter(double diopter) {
-    this->diopter = diopter;
+    validateDiopter(diopter);
+    this->diopter.assign(diopter);
 }
 
 void OpticalMaterial::setMaterialName(const std::string& materialName) {
     if (materialName.empty()) {
         throw std::invalid_argument("Material name cannot be empty");
     }
-    this->materialName = materialName;
+    this->materialName.assign(materialName);
 }
 
 void OpticalMaterial::setPrice(double price) {
@@ -83,10 +137,10 @@ void OpticalMaterial::setPrice(double price) {
 }
 
 std::ostream& operator<<(std::ostream& os, const OpticalMaterial& material) {
-    os << "Type: " << material.type 
-       << ", Thickness: " << std::fixed << std::setprecision(2) << material.thickness << "mm"
-       << ", Diopter: " << material.diopter 
-       << ", Material: " << material.materialName 
+    os << "Type: " << material.getType()
+       << ", Thickness: " << std::fixed << std::setprecision(2) << material.getThickness() << "mm"
+       << ", Diopter: " << material.getDiopter()
+       << ", Material: " << material.getMaterialName()
        << ", Price: " << material.price << " BGN";
     return os;
 }
@@ -122,20 +176,13 @@ std::istream& operator>>(std::istream& is, OpticalMaterial& material) {
 }
 
 void OpticalMaterial::saveToFile(std::ostream& os) const {
-    os << type << "\n"
-       << thickness << "\n"
-       << diopter << "\n"
-       << materialName << "\n"
-       << price << "\n";
+    std::string text;
+    TextWriter(text).write(*this);
+    os.write(text.data(), static_cast<std::streamsize>(text.size()));
 }
 
-void OpticalMaterial::loadFromFile(std::istream& is) {
-    std::getline(is, type);
-    is >> thickness;
-    is >> diopter;
-    is.ignore();
-    std::getline(is, materialName);
-    is >> price;
-    is.ignore();
+void OpticalMaterial::loadFromFile(std::istream& is, int formatVersion) {
+    StreamLines lines(is);
+    TextReader<StreamLines>(lines, formatVersion).read(*this);
 }
 
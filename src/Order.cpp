@@ -1,14 +1,67 @@
 #include "Order.h"
+#include "ModelReflection.h"
+#include "MemoryUsage.h"
+#include "Metrics.h"
+#include "RenderCache.h"
 #include <stdexcept>
 #include <iomanip>
 #include <sstream>
 #include <ctime>
 #include <random>
+#include <unordered_map>
+#include <cstring>
+#include <cstdint>
+#include <algorithm>
+
+namespace {
+
+std::string exactNumber(double value) {
+    // Bit pattern keeps exact equality semantics (with -0.0 folded into 0.0)
+    if (value == 0.0) {
+        value = 0.0;
+    }
+    uint64_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    return std::to_string(bits);
+}
+
+const uint64_t FNV_OFFSET = 14695981039346656037ULL;
+const uint64_t FNV_PRIME = 1099511628211ULL;
+
+uint64_t fnvBytes(uint64_t hash, const void* data, size_t length) {
+    const unsigned char* bytes = static_cast<const unsigned char*>(data);
+    for (size_t i = 0; i < length; ++i) {
+        hash = (hash ^ bytes[i]) * FNV_PRIME;
+    }
+    return hash;
+}
+
+uint64_t fnvString(uint64_t hash, const std::string& text) {
+    // The length keeps ("ab", "c") apart from ("a", "bc")
+    uint64_t length = text.size();
+    return fnvBytes(fnvBytes(hash, &length, sizeof(length)), text.data(), text.size());
+}
+
+uint64_t fnvNumber(uint64_t hash, double value) {
+    if (value == 0.0) {
+        value = 0.0;
+    }
+    return fnvBytes(hash, &value, sizeof(value));
+}
+
+// Lines with equal keys are merged, matching the comparison in addItem
+std::string mergeKey(const OpticalMaterial& material) {
+    return material.getType() + '\n' + material.getMaterialName() + '\n' +
+           exactNumber(material.getThickness()) + '\n' + exactNumber(material.getDiopter());
+}
+
+}
 
 void Order::calculateTotalPrice() {
+    METRIC_TIMER(METRIC_ORDER_CALCULATE_TOTAL);
     totalPrice = 0.0;
     for (const auto& item : items) {
-        totalPrice += item.material.getPrice() * item.quantity;
+        totalPrice += item.unitPrice * item.quantity;
     }
 }
 
@@ -19,35 +72,58 @@ void Order::validateQuantity(int quantity) const {
 }
 
 std::string Order::generateOrderId() const {
-    std::random_device rd;
-    std::mt19937 gen(rd());
+    // Seeded once per thread; bulk creation would otherwise pay for a
+    // random_device read on every order
+    thread_local std::mt19937 gen(std::random_device{}());
     std::uniform_int_distribution<> dis(10000, 99999);
     return "ORD" + std::to_string(dis(gen));
 }
 
 std::string Order::getCurrentDate() const {
     time_t now = time(0);
+    struct tm local;
+#ifdef _WIN32
+    localtime_s(&local, &now);
+#else
+    localtime_r(&now, &local);
+#endif
     char buffer[80];
-    strftime(buffer, sizeof(buffer), "%Y-%m-%d %H:%M:%S", localtime(&now));
+    strftime(buffer, sizeof(buffer), "%Y-%m-%d %H:%M:%S", &local);
     return std::string(buffer);
 }
 
 Order::Order() 
     : orderId(generateOrderId()), supplierName("Unknown"), 
       supplierBulstat("000000000"), totalPrice(0.0), 
-      orderDate(getCurrentDate()) {
+      orderDate(getCurrentDate()), cancelled(false), revision(RenderCache::nextRevision()) {
 }
 
 Order::Order(const Supplier& supplier)
     : orderId(generateOrderId()), supplierName(supplier.getName()),
       supplierBulstat(supplier.getBulstat()), totalPrice(0.0),
-      orderDate(getCurrentDate()) {
+      orderDate(getCurrentDate()), cancelled(false), revision(RenderCache::nextRevision()) {
 }
 
 Order::Order(const Order& other)
     : orderId(other.orderId), supplierName(other.supplierName),
       supplierBulstat(other.supplierBulstat), items(other.items),
-      totalPrice(other.totalPrice), orderDate(other.orderDate) {
+      totalPrice(other.totalPrice), orderDate(other.orderDate),
+      idempotencyKey(other.idempotencyKey), cancelled(other.cancelled), revision(other.revision) {
+}
+
+Order& Order::operator=(const Order& other) {
+    if (this != &other) {
+        orderId = other.orderId;
+        supplierName = other.supplierName;
+        supplierBulstat = other.supplierBulstat;
+        items = other.items;
+        totalPrice = other.totalPrice;
+        orderDate = other.orderDate;
+        idempotencyKey = other.idempotencyKey;
+        cancelled = other.cancelled;
+        revision = other.revision;
+    }
+    return *this;
 }
 
 Order::~Order() {
@@ -78,15 +154,111 @@ int Order::getItemCount() const {
     return static_cast<int>(items.size());
 }
 
-void Order::addItem(const OpticalMaterial& material, int quantity) {
+const std::vector<OrderItem>& Order::getItems() const {
+    return items;
+}
+
+size_t Order::heapBytes() const {
+    return memory::stringBytes(orderId) + memory::stringBytes(supplierName) +
+           memory::stringBytes(supplierBulstat) + memory::stringBytes(orderDate) +
+           memory::stringBytes(idempotencyKey) + memory::vectorBytes(items);
+}
+
+std::string Order::getIdempotencyKey() const {
+    return idempotencyKey;
+}
+
+void Order::setIdempotencyKey(const std::string& key) {
+    if (key.find('\n') != std::string::npos) {
+        throw std::invalid_argument("Idempotency key cannot contain a line break");
+    }
+    idempotencyKey = key;
+}
+
+std::string Order::contentKey() const {
+    std::vector<std::string> lines;
+    lines.reserve(items.size());
+    for (const auto& item : items) {
+        lines.push_back(mergeKey(*item.material) + '\n' + exactNumber(item.unitPrice) + '\n' +
+                        std::to_string(item.quantity));
+    }
+    std::sort(lines.begin(), lines.end());
+
+    std::string key = supplierBulstat + '\n' + orderDate;
+    for (size_t i = 0; i < lines.size(); ++i) {
+        key += '\x1e';
+        key += lines[i];
+    }
+    return key;
+}
+
+uint64_t Order::contentHash() const {
+    // Same fields as contentKey(), hashed without building the string:
+    // each line on its own, then the sorted line hashes
+    std::vector<uint64_t> lines;
+    lines.reserve(items.size());
+    for (const auto& item : items) {
+        const OpticalMaterial& material = *item.material;
+        uint64_t line = fnvString(FNV_OFFSET, material.getType());
+        line = fnvString(line, material.getMaterialName());
+        line = fnvNumber(line, material.getThickness());
+        line = fnvNumber(line, material.getDiopter());
+        line = fnvNumber(line, item.unitPrice);
+        line = fnvBytes(line, &item.quantity, sizeof(item.quantity));
+        lines.push_back(line);
+    }
+    std::sort(lines.begin(), lines.end());
+
+    uint64_t hash = fnvString(fnvString(FNV_OFFSET, supplierBulstat), orderDate);
+    return lines.empty() ? hash : fnvBytes(hash, &lines[0], lines.size() * sizeof(lines[0]));
+}
+
+bool Order::sameContent(const Order& other) const {
+    return supplierBulstat == other.supplierBulstat && orderDate == other.orderDate &&
+           items.size() == other.items.size() && contentKey() == other.contentKey();
+}
+
+bool Order::isCancelled() const {
+    return cancelled;
+}
+
+void Order::cancel() {
+    if (cancelled) {
+        throw std::logic_error("Order " + orderId + " is already cancelled");
+    }
+    cancelled = true;
+    touch();
+}
+
+void Order::reinstate() {
+    if (!cancelled) {
+        throw std::logic_error("Order " + orderId + " is not cancelled");
+    }
+    cancelled = false;
+    touch();
+}
+
+std::vector<std::pair<unsigned int, int> > Order::stockLines() const {
+    std::vector<std::pair<unsigned int, int> > lines;
+    lines.reserve(items.size());
+    for (const auto& item : items) {
+        if (item.material->getId() != 0) {
+            lines.push_back(std::make_pair(item.material->getId(), item.quantity));
+        }
+    }
+    return lines;
+}
+
+void Order::addItem(const std::shared_ptr<const OpticalMaterial>& material, int quantity) {
+    METRIC_TIMER(METRIC_ORDER_ADD_ITEM);
     validateQuantity(quantity);
     
     bool found = false;
     for (auto& item : items) {
-        if (item.material.getType() == material.getType() &&
-            item.material.getMaterialName() == material.getMaterialName() &&
-            item.material.getThickness() == material.getThickness() &&
-            item.material.getDiopter() == material.getDiopter()) {
+        if (item.material->getType() == material->getType() &&
+            item.material->getMaterialName() == material->getMaterialName() &&
+            item.material->getThickness() == material->getThickness() &&
+            item.material->getDiopter() == material->getDiopter()) {
             item.quantity += quantity;
             found = true;
             break;
@@ -98,6 +270,34 @@ void Order::addItem(const OpticalMaterial& material, int quantity) {
     }
     
     calculateTotalPrice();
+    touch();
+}
+
+void Order::addItem(const OpticalMaterial& material, int quantity) {
+    addItem(std::make_shared<const OpticalMaterial>(material), quantity);
+}
+
+void Order::addItems(const std::vector<std::pair<std::shared_ptr<const OpticalMaterial>, int> >& lines) {
+    // Same merge rule as addItem, keyed by type, name, thickness and diopter
+    std::unordered_map<std::string, size_t> positions;
+    for (size_t i = 0; i < items.size(); ++i) {
+        positions[mergeKey(*items[i].material)] = i;
+    }
+    
+    for (const auto& line : lines) {
+        validateQuantity(line.second);
+        std::string key = mergeKey(*line.first);
+        std::unordered_map<std::string, size_t>::const_iterator found = positions.find(key);
+        if (found != positions.end()) {
+            items[found->second].quantity += line.second;
+        } else {
+            positions[key] = items.size();
+            items.push_back(OrderItem(line.first, line.second));
+        }
+    }
+    
+    calculateTotalPrice();
+    touch();
 }
 
 void Order::removeItem(int index) {
@@ -106,98 +306,98 @@ void Order::removeItem(int index) {
     }
     items.erase(items.begin() + index);
     calculateTotalPrice();
+    touch();
 }
 
 void Order::clearOrder() {
     items.clear();
     totalPrice = 0.0;
+    touch();
+}
+
+void Order::touch() {
+    revision = RenderCache::nextRevision();
 }
 
 bool Order::isEmpty() const {
     return items.empty();
 }
 
-void Order::displayOrder() const {
-    std::cout << "\n" << std::string(100, '=') << std::endl;
-    std::cout << "ORDER DETAILS" << std::endl;
-    std::cout << std::string(100, '=') << std::endl;
-    std::cout << "Order ID: " << orderId << std::endl;
-    std::cout << "Supplier: " << supplierName << " (Bulstat: " << supplierBulstat << ")" << std::endl;
-    std::cout << "Order Date: " << orderDate << std::endl;
-    std::cout << std::string(100, '-') << std::endl;
+std::string Order::renderOrder() const {
+    std::ostringstream out;
+    out << std::fixed << std::setprecision(2);
+    out << "\n" << std::string(100, '=') << "\n";
+    out << "ORDER DETAILS\n";
+    out << std::string(100, '=') << "\n";
+    out << "Order ID: " << orderId << "\n";
+    out << "Supplier: " << supplierName << " (Bulstat: " << supplierBulstat << ")\n";
+    out << "Order Date: " << orderDate << "\n";
+    if (cancelled) {
+        out << "Status: CANCELLED\n";
+    }
+    out << std::string(100, '-') << "\n";
     
     if (items.empty()) {
-        std::cout << "No items in order." << std::endl;
+        out << "No items in order.\n";
     } else {
-        std::cout << std::left << std::setw(5) << "No."
-                  << std::setw(20) << "Type"
-                  << std::setw(15) << "Material"
-                  << std::setw(12) << "Thickness"
-                  << std::setw(10) << "Diopter"
-                  << std::setw(10) << "Quantity"
-                  << std::setw(12) << "Price/Unit"
-                  << std::setw(12) << "Subtotal" << std::endl;
-        std::cout << std::string(100, '-') << std::endl;
+        out << std::left << std::setw(5) << "No."
+            << std::setw(20) << "Type"
+            << std::setw(15) << "Material"
+            << std::setw(12) << "Thickness"
+            << std::setw(10) << "Diopter"
+            << std::setw(10) << "Quantity"
+            << std::setw(12) << "Price/Unit"
+            << std::setw(12) << "Subtotal" << "\n";
+        out << std::string(100, '-') << "\n";
         
         for (size_t i = 0; i < items.size(); ++i) {
             const auto& item = items[i];
-            double subtotal = item.material.getPrice() * item.quantity;
+            double subtotal = item.unitPrice * item.quantity;
             
-            std::cout << std::left << std::setw(5) << (i + 1)
-                      << std::setw(20) << item.material.getType()
-                      << std::setw(15) << item.material.getMaterialName()
-                      << std::setw(12) << (std::to_string(item.material.getThickness()) + "mm")
-                      << std::setw(10) << item.material.getDiopter()
-                      << std::setw(10) << item.quantity
-                      << std::setw(12) << std::fixed << std::setprecision(2) << item.material.getPrice()
-                      << std::setw(12) << std::fixed << std::setprecision(2) << subtotal << std::endl;
+            out << std::left << std::setw(5) << (i + 1)
+                << std::setw(20) << item.material->getType()
+                << std::setw(15) << item.material->getMaterialName()
+                << std::setw(12) << (std::to_string(item.material->getThickness()) + "mm")
+                << std::setw(10) << item.material->getDiopter()
+                << std::setw(10) << item.quantity
+                << std::setw(12) << item.unitPrice
+                << std::setw(12) << subtotal << "\n";
         }
     }
     
-    std::cout << std::string(100, '=') << std::endl;
-    std::cout << std::right << std::setw(88) << "TOTAL: " 
-              << std::fixed << std::setprecision(2) << totalPrice << " BGN" << std::endl;
-    std::cout << std::string(100, '=') << std::endl;
+    out << std::string(100, '=') << "\n";
+    out << std::right << std::setw(88) << "TOTAL: " 
+        << totalPrice << " BGN\n";
+    out << std::string(100, '=') << "\n";
+    return out.str();
+}
+
+void Order::displayOrder() const {
+    std::cout << render();
+}
+
+std::string Order::render() const {
+    METRIC_TIMER(METRIC_RENDER_ORDER);
+    std::string text;
+    if (!RenderCache::shared().find(RenderCache::VIEW_ORDER_DETAILS, revision, text)) {
+        text = renderOrder();
+        RenderCache::shared().store(RenderCache::VIEW_ORDER_DETAILS, revision, text);
+    }
+    return text;
 }
 
 std::ostream& operator<<(std::ostream& os, const Order& order) {
-    order.displayOrder();
+    os << order.render();
     return os;
 }
 
 void Order::saveToFile(std::ostream& os) const {
-    os << orderId << "\n"
-       << supplierName << "\n"
-       << supplierBulstat << "\n"
-       << orderDate << "\n"
-       << totalPrice << "\n"
-       << items.size() << "\n";
-    
-    for (const auto& item : items) {
-        item.material.saveToFile(os);
-        os << item.quantity << "\n";
-    }
+    std::string text;
+    TextWriter(text).write(*this);
+    os.write(text.data(), static_cast<std::streamsize>(text.size()));
 }
 
-void Order::loadFromFile(std::istream& is) {
-    std::getline(is, orderId);
-    std::getline(is, supplierName);
-    std::getline(is, supplierBulstat);
-    std::getline(is, orderDate);
-    is >> totalPrice;
-    
-    size_t itemCount;
-    is >> itemCount;
-    is.ignore();
-    
-    items.clear();
-    for (size_t i = 0; i < itemCount; ++i) {
-        OpticalMaterial material;
-        material.loadFromFile(is);
-        int quantity;
-        is >> quantity;
-        is.ignore();
-        items.push_back(OrderItem(material, quantity));
-    }
+void Order::loadFromFile(std::istream& is, const MaterialCatalog& catalog, int formatVersion) {
+    StreamLines lines(is);
+    TextReader<StreamLines>(lines, formatVersion, &catalog).read(*this);
 }
-
@@ -0,0 +1,244 @@
+#include "OrderAggregates.h"
+#include <algorithm>
+#include <cmath>
+#include "OrderArchive.h"
+#include "MemoryUsage.h"
+#include "ModelReflection.h"
+#include "DataFile.h"
+
+namespace {
+
+const double UNITS_PER_BGN = 10000.0;
+
+}
+
+double AggregateTotals::amount() const {
+    return amountUnits / UNITS_PER_BGN;
+}
+
+AggregateTotals& AggregateTotals::operator+=(const AggregateTotals& other) {
+    orderCount += other.orderCount;
+    amountUnits += other.amountUnits;
+    return *this;
+}
+
+double MaterialDemand::amount() const {
+    return amountUnits / UNITS_PER_BGN;
+}
+
+long long OrderAggregates::toUnits(double amount) {
+    return std::llround(amount * UNITS_PER_BGN);
+}
+
+std::string OrderAggregates::dayOf(const std::string& orderDate) {
+    // Order dates look like "YYYY-MM-DD HH:MM:SS"
+    return orderDate.substr(0, 10);
+}
+
+std::string OrderAggregates::materialKey(const std::string& type, const std::string& materialName) {
+    return type + '\n' + materialName;
+}
+
+void OrderAggregates::apply(const Order& order, int sign) {
+    AggregateTotals delta;
+    delta.orderCount = sign;
+    delta.amountUnits = sign * toUnits(order.getTotalPrice());
+    overall += delta;
+
+    const std::string& date = order.getOrderDate();
+    std::unordered_map<std::string, SupplierTotals>::iterator supplier =
+        bySupplier.insert(std::make_pair(order.getSupplierBulstat(), SupplierTotals())).first;
+    supplier->second.overall += delta;
+    std::string period = OrderArchive::periodOf(date);
+    AggregateTotals& month = supplier->second.byPeriod[period];
+    month += delta;
+    if (month.orderCount == 0) {
+        supplier->second.byPeriod.erase(period);
+    }
+    if (supplier->second.overall.orderCount == 0) {
+        bySupplier.erase(supplier);
+    }
+
+    std::string day = dayOf(date);
+    AggregateTotals& dayTotals = byDay[day];
+    dayTotals += delta;
+    if (dayTotals.orderCount == 0) {
+        byDay.erase(day);
+    }
+
+    for (const auto& item : order.getItems()) {
+        const OpticalMaterial& material = *item.material;
+        std::string key = materialKey(material.getType(), material.getMaterialName());
+        std::unordered_map<std::string, MaterialDemand>::iterator demand = byMaterial.find(key);
+        if (demand == byMaterial.end()) {
+            demand = byMaterial.insert(std::make_pair(key, MaterialDemand())).first;
+            demand->second.type = material.getType();
+            demand->second.materialName = material.getMaterialName();
+        }
+        demand->second.quantity += sign * item.quantity;
+        demand->second.amountUnits += sign * toUnits(item.unitPrice * item.quantity);
+        if (demand->second.quantity == 0) {
+            byMaterial.erase(demand);
+        }
+    }
+}
+
+void OrderAggregates::add(const Order& order) {
+    apply(order, 1);
+}
+
+void OrderAggregates::subtract(const Order& order) {
+    apply(order, -1);
+}
+
+void OrderAggregates::clear() {
+    overall = AggregateTotals();
+    bySupplier.clear();
+    byMaterial.clear();
+    byDay.clear();
+}
+
+const AggregateTotals& OrderAggregates::getOverall() const {
+    return overall;
+}
+
+AggregateTotals OrderAggregates::supplierTotals(const std::string& bulstat) const {
+    std::unordered_map<std::string, SupplierTotals>::const_iterator found = bySupplier.find(bulstat);
+    return found == bySupplier.end() ? AggregateTotals() : found->second.overall;
+}
+
+AggregateTotals OrderAggregates::supplierTotals(const std::string& bulstat,
+                                                const std::string& fromPeriod, const std::string& toPeriod) const {
+    AggregateTotals totals;
+    std::unordered_map<std::string, SupplierTotals>::const_iterator found = bySupplier.find(bulstat);
+    if (found == bySupplier.end()) {
+        return totals;
+    }
+    const std::map<std::string, AggregateTotals>& months = found->second.byPeriod;
+    std::map<std::string, AggregateTotals>::const_iterator month = months.lower_bound(fromPeriod);
+    for (; month != months.end() && month->first <= toPeriod; ++month) {
+        totals += month->second;
+    }
+    return totals;
+}
+
+MaterialDemand OrderAggregates::materialDemand(const std::string& type, const std::string& materialName) const {
+    std::unordered_map<std::string, MaterialDemand>::const_iterator found =
+        byMaterial.find(materialKey(type, materialName));
+    if (found != byMaterial.end()) {
+        return found->second;
+    }
+    MaterialDemand none;
+    none.type = type;
+    none.materialName = materialName;
+    return none;
+}
+
+AggregateTotals OrderAggregates::totalsBetween(const std::string& fromDay, const std::string& toDay) const {
+    AggregateTotals totals;
+    std::map<std::string, AggregateTotals>::const_iterator day = byDay.lower_bound(fromDay);
+    for (; day != byDay.end() && day->first <= toDay; ++day) {
+        totals += day->second;
+    }
+    return totals;
+}
+
+std::vector<SupplierSpend> OrderAggregates::allSupplierSpend() const {
+    std::vector<SupplierSpend> spend;
+    spend.reserve(bySupplier.size());
+    for (const auto& supplier : bySupplier) {
+        SupplierSpend entry;
+        entry.bulstat = supplier.first;
+        entry.totals = supplier.second.overall;
+        spend.push_back(entry);
+    }
+    return spend;
+}
+
+std::vector<MaterialDemand> OrderAggregates::allMaterialDemand() const {
+    std::vector<MaterialDemand> demand;
+    demand.reserve(byMaterial.size());
+    for (const auto& material : byMaterial) {
+        demand.push_back(material.second);
+    }
+    return demand;
+}
+
+std::vector<DayRow> OrderAggregates::recentDays(size_t limit) const {
+    std::vector<DayRow> days;
+    for (std::map<std::string, AggregateTotals>::const_reverse_iterator day = byDay.rbegin();
+         day != byDay.rend() && days.size() < limit; ++day) {
+        DayRow row;
+        row.day = day->first;
+        row.totals = day->second;
+        days.push_back(row);
+    }
+    return days;
+}
+
+size_t OrderAggregates::size() const {
+    size_t count = byMaterial.size() + byDay.size();
+    for (const auto& supplier : bySupplier) {
+        count += 1 + supplier.second.byPeriod.size();
+    }
+    return count;
+}
+
+size_t OrderAggregates::memoryBytes() const {
+    size_t bytes = memory::hashMapBytes(bySupplier) + memory::hashMapBytes(byMaterial) +
+                   memory::treeMapBytes(byDay);
+    for (const auto& supplier : bySupplier) {
+        bytes += memory::stringBytes(supplier.first) + memory::treeMapBytes(supplier.second.byPeriod);
+    }
+    for (const auto& material : byMaterial) {
+        bytes += memory::stringBytes(material.first) + memory::stringBytes(material.second.type) +
+                 memory::stringBytes(material.second.materialName);
+    }
+    return bytes;
+}
+
+void OrderAggregates::save(std::string& out, TextSink* sink) const {
+    std::vector<SupplierPeriodRow> supplierRows;
+    for (const auto& supplier : bySupplier) {
+        for (const auto& month : supplier.second.byPeriod) {
+            SupplierPeriodRow row;
+            row.bulstat = supplier.first;
+            row.period = month.first;
+            row.totals = month.second;
+            supplierRows.push_back(row);
+        }
+    }
+    std::vector<MaterialDemand> materialRows = allMaterialDemand();
+    std::vector<DayRow> dayRows = recentDays(byDay.size());
+
+    TextWriter writer(out, sink);
+    writer.sequence("Supplier months", supplierRows);
+    writer.sequence("Material demand", materialRows);
+    writer.sequence("Days", dayRows);
+}
+
+void OrderAggregates::load(DataFileReader& file) {
+    std::vector<SupplierPeriodRow> supplierRows;
+    std::vector<MaterialDemand> materialRows;
+    std::vector<DayRow> dayRows;
+    TextReader<DataFileReader> reader(file, file.getFormatVersion());
+    reader.sequence("Supplier months", supplierRows);
+    reader.sequence("Material demand", materialRows);
+    reader.sequence("Days", dayRows);
+
+    clear();
+    // Every order has one supplier month and one day, so either set of
+    // rows adds up to the overall totals
+    for (size_t i = 0; i < supplierRows.size(); ++i) {
+        SupplierTotals& supplier = bySupplier[supplierRows[i].bulstat];
+        supplier.overall += supplierRows[i].totals;
+        supplier.byPeriod[supplierRows[i].period] += supplierRows[i].totals;
+        overall += supplierRows[i].totals;
+    }
+    for (size_t i = 0; i < materialRows.size(); ++i) {
+        byMaterial[materialKey(materialRows[i].type, materialRows[i].materialName)] = materialRows[i];
+    }
+    for (size_t i = 0; i < dayRows.size(); ++i) {
+        byDay[dayRows[i].day] += dayRows[i].totals;
+    }
+}
@@ -0,0 +1,360 @@
+#include "OrderArchive.h"
+#include "LzCodec.h"
+#include "DataFormat.h"
+#include "ModelReflection.h"
+#include "DataFile.h"
+#include "Crc32c.h"
+#include "OrderIndex.h"
+#include "MemoryUsage.h"
+#include <stdexcept>
+#include <fstream>
+#include <sstream>
+#include <map>
+#include <unordered_map>
+#include <ctime>
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
+#include <iterator>
+
+namespace {
+
+// OSEG2 segments carry the CRC-32C of the compressed bytes after the magic
+const char SEGMENT_MAGIC[] = "OSEG2\n";
+const char LEGACY_SEGMENT_MAGIC[] = "OSEG1\n";
+const size_t MAGIC_LENGTH = sizeof(SEGMENT_MAGIC) - 1;
+const size_t CHECKSUM_LENGTH = 9;   // 8 hex digits and a newline
+
+// Keys files start "OKEYS1 <orders> <crc32c>"; each order follows as
+// "<content hash> <key length>" and a line with the scoped key
+const char KEYS_MAGIC[] = "OKEYS1";
+
+// Whether a segment order indexed in sealed has order's id and content
+bool isSealed(const Order& order, const std::unordered_multimap<uint64_t, size_t>& sealed,
+              const std::vector<Order>& orders) {
+    typedef std::unordered_multimap<uint64_t, size_t>::const_iterator Iterator;
+    std::pair<Iterator, Iterator> range = sealed.equal_range(order.contentHash());
+    for (Iterator it = range.first; it != range.second; ++it) {
+        const Order& candidate = orders[it->second];
+        if (candidate.getOrderId() == order.getOrderId() && candidate.sameContent(order)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+}
+
+OrderArchive::OrderArchive(const std::string& baseName) : baseName(baseName) {
+}
+
+std::string OrderArchive::manifestPath() const {
+    return baseName + ".idx";
+}
+
+std::string OrderArchive::segmentPath(const std::string& period) const {
+    return baseName + "-" + period + ".seg";
+}
+
+std::string OrderArchive::keysPath(const std::string& period) const {
+    return baseName + "-" + period + ".keys";
+}
+
+std::string OrderArchive::periodOf(const std::string& orderDate) {
+    // Order dates look like "YYYY-MM-DD HH:MM:SS"
+    if (orderDate.size() < 7 || orderDate[4] != '-') {
+        return "";
+    }
+    for (size_t i = 0; i < 7; ++i) {
+        if (i != 4 && !::isdigit(static_cast<unsigned char>(orderDate[i]))) {
+            return "";
+        }
+    }
+    return orderDate.substr(0, 7);
+}
+
+std::string OrderArchive::currentPeriod() {
+    time_t now = time(0);
+    struct tm local;
+#ifdef _WIN32
+    localtime_s(&local, &now);
+#else
+    localtime_r(&now, &local);
+#endif
+    char buffer[16];
+    strftime(buffer, sizeof(buffer), "%Y-%m", &local);
+    return std::string(buffer);
+}
+
+void OrderArchive::loadManifest(const MaterialCatalog& catalog) {
+    segments.clear();
+    sealedKeys.clear();
+    sealedHashes.clear();
+    std::ifstream manifest(manifestPath().c_str());
+    if (!manifest) {
+        return;
+    }
+
+    ArchiveSegment segment;
+    while (manifest >> segment.period >> segment.orderCount
+                    >> segment.rawBytes >> segment.storedBytes) {
+        segments.push_back(segment);
+    }
+    // Archives sealed before keys files existed get them here, once
+    for (const auto& sealed : segments) {
+        if (!readKeys(sealed)) {
+            std::vector<Order> orders = loadSegment(sealed.period, catalog);
+            writeKeys(sealed.period, orders);
+        }
+    }
+}
+
+void OrderArchive::saveManifest() const {
+    std::ostringstream manifest;
+    for (const auto& segment : segments) {
+        manifest << segment.period << " " << segment.orderCount << " "
+                 << segment.rawBytes << " " << segment.storedBytes << "\n";
+    }
+    DataFile::writeAtomically(manifestPath(), manifest.str(), false);
+}
+
+const std::vector<ArchiveSegment>& OrderArchive::getSegments() const {
+    return segments;
+}
+
+size_t OrderArchive::getArchivedOrderCount() const {
+    size_t total = 0;
+    for (const auto& segment : segments) {
+        total += segment.orderCount;
+    }
+    return total;
+}
+
+size_t OrderArchive::memoryBytes() const {
+    size_t bytes = memory::hashMapBytes(sealedKeys) + memory::hashMapBytes(sealedHashes);
+    for (const auto& key : sealedKeys) {
+        bytes += memory::stringBytes(key);
+    }
+    return bytes;
+}
+
+ArchiveSegment* OrderArchive::findSegment(const std::string& period) {
+    for (auto& segment : segments) {
+        if (segment.period == period) {
+            return &segment;
+        }
+    }
+    return 0;
+}
+
+const ArchiveSegment* OrderArchive::findSegment(const std::string& period) const {
+    for (const auto& segment : segments) {
+        if (segment.period == period) {
+            return &segment;
+        }
+    }
+    return 0;
+}
+
+void OrderArchive::addKeys(const Order& order) {
+    sealedHashes.insert(order.contentHash());
+    std::string key = OrderIndex::scopedKey(order);
+    if (!key.empty()) {
+        sealedKeys.insert(key);
+    }
+}
+
+void OrderArchive::writeKeys(const std::string& period, const std::vector<Order>& orders) {
+    std::string body;
+    for (const auto& order : orders) {
+        std::string key = OrderIndex::scopedKey(order);
+        char line[48];
+        std::snprintf(line, sizeof(line), "%016llx %lu\n", static_cast<unsigned long long>(order.contentHash()),
+                      static_cast<unsigned long>(key.size()));
+        body += line;
+        body += key;
+        body += '\n';
+        addKeys(order);
+    }
+    char header[48];
+    std::snprintf(header, sizeof(header), "%s %lu %08x\n", KEYS_MAGIC, static_cast<unsigned long>(orders.size()),
+                  static_cast<unsigned int>(Crc32c::compute(body.data(), body.size())));
+    DataFile::writeAtomically(keysPath(period), header + body, false);
+}
+
+bool OrderArchive::readKeys(const ArchiveSegment& segment) {
+    std::string path = keysPath(segment.period);
+    if (!DataFile::exists(path)) {
+        return false;
+    }
+    std::string contents = DataFile::readAll(path);
+    char magic[8] = "";
+    unsigned long count = 0;
+    unsigned int checksum = 0;
+    size_t bodyBegin = contents.find('\n') + 1;
+    if (bodyBegin == 0 ||
+        std::sscanf(contents.c_str(), "%7s %lu %8x", magic, &count, &checksum) != 3 ||
+        std::string(magic) != KEYS_MAGIC || count != segment.orderCount ||
+        Crc32c::compute(contents.data() + bodyBegin, contents.size() - bodyBegin) != checksum) {
+        return false;
+    }
+
+    std::vector<std::pair<uint64_t, std::string> > entries;
+    const char* cursor = contents.c_str() + bodyBegin;
+    const char* end = contents.c_str() + contents.size();
+    while (cursor < end) {
+        char* after = 0;
+        uint64_t hash = std::strtoull(cursor, &after, 16);
+        unsigned long length = std::strtoul(after, &after, 10);
+        if (*after != '\n' || static_cast<size_t>(end - after - 1) < length + 1 || after[1 + length] != '\n') {
+            return false;
+        }
+        entries.push_back(std::make_pair(hash, std::string(after + 1, length)));
+        cursor = after + length + 2;
+    }
+    if (entries.size() != count) {
+        return false;
+    }
+    for (const auto& entry : entries) {
+        sealedHashes.insert(entry.first);
+        if (!entry.second.empty()) {
+            sealedKeys.insert(entry.second);
+        }
+    }
+    return true;
+}
+
+bool OrderArchive::holdsDuplicate(const Order& order, uint64_t contentHash, const MaterialCatalog& catalog) const {
+    std::string key = OrderIndex::scopedKey(order);
+    if (!key.empty() && sealedKeys.count(key)) {
+        return true;
+    }
+    if (!sealedHashes.count(contentHash)) {
+        return false;
+    }
+    // The date is part of the content, so only its month can hold a match
+    std::string period = periodOf(order.getOrderDate());
+    if (!findSegment(period)) {
+        return false;
+    }
+    std::vector<Order> sealed = loadSegment(period, catalog);
+    for (const auto& candidate : sealed) {
+        if (!key.empty() && !candidate.getIdempotencyKey().empty()) {
+            continue;
+        }
+        if (!candidate.isCancelled() && candidate.contentHash() == contentHash && candidate.sameContent(order)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void OrderArchive::writeSegment(const std::string& period, const std::vector<Order>& orders) {
+    std::ostringstream header;
+    writeFormatHeader(header);
+    std::string payload = header.str();
+    TextWriter(payload).sequence("Orders", orders);
+    std::string compressed = LzCodec::compress(payload);
+
+    char checksum[16];
+    std::snprintf(checksum, sizeof(checksum), "%08x\n",
+                  static_cast<unsigned int>(Crc32c::compute(compressed.data(), compressed.size())));
+    std::string bytes(SEGMENT_MAGIC, MAGIC_LENGTH);
+    bytes.append(checksum, CHECKSUM_LENGTH);
+    bytes += compressed;
+    // A crash mid-write leaves the previous segment in place
+    DataFile::writeAtomically(segmentPath(period), bytes, false);
+    writeKeys(period, orders);
+
+    ArchiveSegment* existing = findSegment(period);
+    if (!existing) {
+        ArchiveSegment created;
+        created.period = period;
+        segments.push_back(created);
+        existing = &segments.back();
+    }
+    existing->orderCount = orders.size();
+    existing->rawBytes = payload.size();
+    existing->storedBytes = bytes.size();
+}
+
+CowVector<Order> OrderArchive::sealColdOrders(const CowVector<Order>& orders,
+                                              const MaterialCatalog& catalog) {
+    std::string hotPeriod = currentPeriod();
+    CowVector<Order> hot;
+    std::map<std::string, std::vector<Order> > cold;
+
+    for (const auto& order : orders) {
+        std::string period = periodOf(order.getOrderDate());
+        if (period.empty() || period >= hotPeriod) {
+            hot.push_back(order);
+        } else {
+            cold[period].push_back(order);
+        }
+    }
+
+    if (cold.empty()) {
+        return orders;
+    }
+
+    for (auto& entry : cold) {
+        std::vector<Order> merged;
+        if (findSegment(entry.first)) {
+            // Late arrivals for a sealed month are merged into a fresh copy
+            // of the segment. An order already sealed (same id and content,
+            // left in orders.dat by an interrupted save) is not sealed
+            // twice; order ids are random and dates are per second, so
+            // neither tells distinct orders apart on its own.
+            merged = loadSegment(entry.first, catalog);
+        }
+        std::unordered_multimap<uint64_t, size_t> sealed;
+        for (size_t i = 0; i < merged.size(); ++i) {
+            sealed.insert(std::make_pair(merged[i].contentHash(), i));
+        }
+        for (const auto& order : entry.second) {
+            if (!isSealed(order, sealed, merged)) {
+                merged.push_back(order);
+            }
+        }
+        writeSegment(entry.first, merged);
+    }
+
+    saveManifest();
+    return hot;
+}
+
+std::vector<Order> OrderArchive::loadSegment(const std::string& period,
+                                             const MaterialCatalog& catalog) const {
+    std::ifstream file(segmentPath(period).c_str(), std::ios::binary);
+    if (!file) {
+        throw std::runtime_error("Archive segment not found: " + period);
+    }
+    std::string contents((std::istreambuf_iterator<char>(file)),
+                         std::istreambuf_iterator<char>());
+
+    size_t compressedBegin;
+    if (contents.compare(0, MAGIC_LENGTH, SEGMENT_MAGIC) == 0) {
+        unsigned int stored = 0;
+        compressedBegin = MAGIC_LENGTH + CHECKSUM_LENGTH;
+        if (contents.size() < compressedBegin ||
+            std::sscanf(contents.c_str() + MAGIC_LENGTH, "%8x", &stored) != 1 ||
+            Crc32c::compute(contents.data() + compressedBegin,
+                            contents.size() - compressedBegin) != stored) {
+            throw DataIntegrityError("Archive segment " + period + " failed its checksum");
+        }
+    } else if (contents.compare(0, MAGIC_LENGTH, LEGACY_SEGMENT_MAGIC) == 0) {
+        compressedBegin = MAGIC_LENGTH;
+    } else {
+        throw std::runtime_error("Invalid archive segment: " + period);
+    }
+
+    std::string payload = LzCodec::decompress(contents.substr(compressedBegin));
+    std::istringstream header(payload);
+    int formatVersion = readFormatHeader(header);
+    size_t headerLength = header.tellg() < 0 ? payload.size() : static_cast<size_t>(header.tellg());
+
+    BufferLines lines(payload.c_str() + headerLength, payload.c_str() + payload.size());
+    std::vector<Order> orders;
+    TextReader<BufferLines>(lines, formatVersion, &catalog).sequence("Orders", orders);
+    return orders;
+}
@@ -0,0 +1,205 @@
+#include "OrderBatch.h"
+#include "TaskScheduler.h"
+#include <sstream>
+#include <stdexcept>
+#include <unordered_map>
+#include <algorithm>
+#include <cstdlib>
+#include <cerrno>
+
+namespace {
+
+typedef std::unordered_map<unsigned int, std::shared_ptr<const OpticalMaterial> > MaterialMap;
+
+struct ResolvedSupplier {
+    int supplierIndex;
+    MaterialMap materials;
+};
+
+struct OrderGroup {
+    std::string orderRef;
+    std::vector<size_t> lines;
+};
+
+// Outcome of one order group, filled by a scheduler task
+struct GroupOutcome {
+    bool accepted;
+    Order order;
+    std::vector<std::string> errors;
+
+    GroupOutcome() : accepted(false) {}
+};
+
+std::string trim(const std::string& text) {
+    size_t first = text.find_first_not_of(" \t\r");
+    if (first == std::string::npos) {
+        return "";
+    }
+    size_t last = text.find_last_not_of(" \t\r");
+    return text.substr(first, last - first + 1);
+}
+
+bool parseNumber(const std::string& text, long& value) {
+    if (text.empty()) {
+        return false;
+    }
+    char* end = 0;
+    errno = 0;
+    value = std::strtol(text.c_str(), &end, 10);
+    return errno == 0 && *end == '\0';
+}
+
+std::string lineError(const OrderBatchLine& line, const std::string& message) {
+    return "line " + std::to_string(line.lineNumber) + " (order " + line.orderRef + "): " + message;
+}
+
+void buildGroup(const DataStore& store, const std::vector<OrderBatchLine>& lines,
+                const OrderGroup& group,
+                const std::unordered_map<std::string, ResolvedSupplier>& suppliers,
+                GroupOutcome& outcome) {
+    const OrderBatchLine& first = lines[group.lines[0]];
+    std::unordered_map<std::string, ResolvedSupplier>::const_iterator supplier =
+        suppliers.find(first.supplierBulstat);
+    if (supplier == suppliers.end()) {
+        outcome.errors.push_back(lineError(first, "unknown supplier BULSTAT " + first.supplierBulstat));
+        return;
+    }
+
+    std::vector<std::pair<std::shared_ptr<const OpticalMaterial>, int> > items;
+    items.reserve(group.lines.size());
+    for (size_t i = 0; i < group.lines.size(); ++i) {
+        const OrderBatchLine& line = lines[group.lines[i]];
+        if (line.supplierBulstat != first.supplierBulstat) {
+            outcome.errors.push_back(lineError(line, "an order can only contain one supplier"));
+            continue;
+        }
+        if (line.quantity < 1 || line.quantity > OrderBatch::MAX_LINE_QUANTITY) {
+            outcome.errors.push_back(lineError(line, "quantity must be between 1 and " +
+                                               std::to_string(OrderBatch::MAX_LINE_QUANTITY)));
+            continue;
+        }
+        MaterialMap::const_iterator material = supplier->second.materials.find(line.materialId);
+        if (material == supplier->second.materials.end()) {
+            outcome.errors.push_back(lineError(line, "supplier has no material #" +
+                                               std::to_string(line.materialId)));
+            continue;
+        }
+        items.push_back(std::make_pair(material->second, line.quantity));
+    }
+
+    if (!outcome.errors.empty()) {
+        return;
+    }
+
+    outcome.order = Order(store.getSupplier(supplier->second.supplierIndex));
+    outcome.order.setIdempotencyKey(group.orderRef);
+    outcome.order.addItems(items);
+    outcome.accepted = true;
+}
+
+}
+
+std::vector<OrderBatchLine> OrderBatch::parseCsv(std::istream& is, std::vector<std::string>& errors) {
+    std::vector<OrderBatchLine> lines;
+    std::string text;
+    size_t lineNumber = 0;
+
+    while (std::getline(is, text)) {
+        ++lineNumber;
+        text = trim(text);
+        if (text.empty() || text[0] == '#') {
+            continue;
+        }
+
+        std::vector<std::string> fields;
+        std::istringstream row(text);
+        std::string field;
+        while (std::getline(row, field, ',')) {
+            fields.push_back(trim(field));
+        }
+        if (lineNumber == 1 && !fields.empty() && fields[0] == "orderRef") {
+            continue;
+        }
+
+        long materialId = 0, quantity = 0;
+        if (fields.size() != 4 || fields[0].empty() ||
+            !parseNumber(fields[2], materialId) || materialId <= 0 ||
+            !parseNumber(fields[3], quantity)) {
+            errors.push_back("line " + std::to_string(lineNumber) +
+                             ": expected orderRef,bulstat,materialId,quantity");
+            continue;
+        }
+
+        OrderBatchLine line;
+        line.lineNumber = lineNumber;
+        line.orderRef = fields[0];
+        line.supplierBulstat = fields[1];
+        line.materialId = static_cast<unsigned int>(materialId);
+        line.quantity = static_cast<int>(std::max(std::min(quantity, 1L << 30), -(1L << 30)));
+        lines.push_back(line);
+    }
+    return lines;
+}
+
+OrderBatchResult OrderBatch::build(const DataStore& store, const std::vector<OrderBatchLine>& lines) {
+    OrderBatchResult result;
+    result.acceptedLines = 0;
+    result.rejectedOrders = 0;
+
+    // Group lines per order ref, keeping the order refs first appear in
+    std::vector<OrderGroup> groups;
+    std::unordered_map<std::string, size_t> groupIndex;
+    for (size_t i = 0; i < lines.size(); ++i) {
+        std::unordered_map<std::string, size_t>::const_iterator found = groupIndex.find(lines[i].orderRef);
+        if (found == groupIndex.end()) {
+            groupIndex[lines[i].orderRef] = groups.size();
+            OrderGroup group;
+            group.orderRef = lines[i].orderRef;
+            groups.push_back(group);
+            groups.back().lines.push_back(i);
+        } else {
+            groups[found->second].lines.push_back(i);
+        }
+    }
+
+    // Resolve each supplier and its current catalog versions once
+    std::unordered_map<std::string, ResolvedSupplier> suppliers;
+    for (size_t i = 0; i < lines.size(); ++i) {
+        const std::string& bulstat = lines[i].supplierBulstat;
+        if (suppliers.count(bulstat)) {
+            continue;
+        }
+        int supplierIndex = store.findSupplier(bulstat);
+        if (supplierIndex == -1) {
+            continue;
+        }
+        ResolvedSupplier& resolved = suppliers[bulstat];
+        resolved.supplierIndex = supplierIndex;
+        const Supplier supplier = store.getSupplier(supplierIndex);
+        for (const auto& material : supplier.getMaterials()) {
+            resolved.materials[material.getId()] =
+                store.resolveVersion(bulstat, material.getId(), material.getVersion());
+        }
+    }
+
+    // Price the orders in parallel, a few hundred per scheduler task
+    std::vector<GroupOutcome> outcomes(groups.size());
+    const size_t GROUPS_PER_TASK = 256;
+    TaskScheduler::instance().parallelFor(0, groups.size(), GROUPS_PER_TASK, [&](size_t first, size_t last) {
+        for (size_t g = first; g < last; ++g) {
+            buildGroup(store, lines, groups[g], suppliers, outcomes[g]);
+        }
+    });
+
+    result.orders.reserve(groups.size());
+    for (size_t g = 0; g < outcomes.size(); ++g) {
+        if (outcomes[g].accepted) {
+            result.orders.push_back(outcomes[g].order);
+            result.acceptedLines += groups[g].lines.size();
+        } else {
+            ++result.rejectedOrders;
+            result.errors.insert(result.errors.end(), outcomes[g].errors.begin(), outcomes[g].errors.end());
+        }
+    }
+    return result;
+}
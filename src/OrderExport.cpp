@@ -0,0 +1,534 @@
+#include "OrderExport.h"
+#include "OrderArchive.h"
+#include "TaskScheduler.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+
+const size_t OrderExporter::ORDERS_PER_CHUNK;
+const size_t OrderExporter::CHUNKS_PER_BATCH;
+const uint32_t OrderExporter::COLUMNAR_VERSION;
+
+namespace {
+
+enum ColumnType {
+    COLUMN_STRING = 0,
+    COLUMN_INT = 1,
+    COLUMN_DOUBLE = 2
+};
+
+struct Column {
+    const char* name;
+    ColumnType type;
+};
+
+// One row per order line; CSV and the columnar format share it
+const Column COLUMNS[] = {
+    {"order_id", COLUMN_STRING},
+    {"order_date", COLUMN_STRING},
+    {"supplier_bulstat", COLUMN_STRING},
+    {"supplier_name", COLUMN_STRING},
+    {"status", COLUMN_STRING},
+    {"idempotency_key", COLUMN_STRING},
+    {"order_total", COLUMN_DOUBLE},
+    {"line", COLUMN_INT},
+    {"material_id", COLUMN_INT},
+    {"material_version", COLUMN_INT},
+    {"type", COLUMN_STRING},
+    {"material_name", COLUMN_STRING},
+    {"thickness", COLUMN_DOUBLE},
+    {"diopter", COLUMN_DOUBLE},
+    {"unit_price", COLUMN_DOUBLE},
+    {"quantity", COLUMN_INT},
+    {"line_total", COLUMN_DOUBLE}
+};
+const size_t COLUMN_COUNT = sizeof(COLUMNS) / sizeof(COLUMNS[0]);
+
+const char ROW_GROUP_MAGIC[] = "RGRP";
+const char COLUMNAR_MAGIC[] = "OCOL";
+
+void appendUnsigned(std::string& out, unsigned long long value) {
+    char digits[24];
+    char* first = digits + sizeof(digits);
+    do {
+        *--first = static_cast<char>('0' + value % 10);
+        value /= 10;
+    } while (value != 0);
+    out.append(first, digits + sizeof(digits));
+}
+
+void appendInteger(std::string& out, long long value) {
+    if (value < 0) {
+        out += '-';
+        appendUnsigned(out, static_cast<unsigned long long>(-(value + 1)) + 1);
+    } else {
+        appendUnsigned(out, static_cast<unsigned long long>(value));
+    }
+}
+
+// Prices, thicknesses and diopters are nearly always whole cents; those
+// are written with two decimals without going through printf
+void appendNumber(std::string& out, double value) {
+    double cents = value * 100.0;
+    double rounded = std::floor(cents + 0.5);
+    if (std::fabs(cents - rounded) < 1e-6 && std::fabs(rounded) < 1e15) {
+        long long whole = static_cast<long long>(rounded);
+        if (whole < 0) {
+            out += '-';
+            whole = -whole;
+        }
+        appendUnsigned(out, static_cast<unsigned long long>(whole / 100));
+        out += '.';
+        out += static_cast<char>('0' + whole % 100 / 10);
+        out += static_cast<char>('0' + whole % 10);
+    } else {
+        char buffer[32];
+        std::snprintf(buffer, sizeof(buffer), "%.10g", value);
+        out += buffer;
+    }
+}
+
+void appendCsvText(std::string& out, const std::string& text) {
+    if (text.find_first_of(",\"\r\n") == std::string::npos) {
+        out += text;
+        return;
+    }
+    out += '"';
+    for (size_t i = 0; i < text.size(); ++i) {
+        if (text[i] == '"') {
+            out += '"';
+        }
+        out += text[i];
+    }
+    out += '"';
+}
+
+void appendJsonText(std::string& out, const std::string& text) {
+    static const char HEX[] = "0123456789abcdef";
+    out += '"';
+    for (size_t i = 0; i < text.size(); ++i) {
+        unsigned char c = static_cast<unsigned char>(text[i]);
+        switch (c) {
+            case '"': out += "\\\""; break;
+            case '\\': out += "\\\\"; break;
+            case '\n': out += "\\n"; break;
+            case '\r': out += "\\r"; break;
+            case '\t': out += "\\t"; break;
+            default:
+                if (c < 0x20) {
+                    out += "\\u00";
+                    out += HEX[c >> 4];
+                    out += HEX[c & 0xF];
+                } else {
+                    out += static_cast<char>(c);
+                }
+        }
+    }
+    out += '"';
+}
+
+void putU32(std::string& out, uint32_t value) {
+    char bytes[4];
+    for (int i = 0; i < 4; ++i) {
+        bytes[i] = static_cast<char>((value >> (8 * i)) & 0xFF);
+    }
+    out.append(bytes, sizeof(bytes));
+}
+
+void putU64(std::string& out, uint64_t value) {
+    char bytes[8];
+    for (int i = 0; i < 8; ++i) {
+        bytes[i] = static_cast<char>((value >> (8 * i)) & 0xFF);
+    }
+    out.append(bytes, sizeof(bytes));
+}
+
+void putDouble(std::string& out, double value) {
+    uint64_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    putU64(out, bits);
+}
+
+// The order's own fields, read once for all of its rows
+struct OrderFields {
+    std::string id;
+    std::string date;
+    std::string bulstat;
+    std::string name;
+    std::string status;
+    std::string key;
+    double total;
+
+    explicit OrderFields(const Order& order)
+        : id(order.getOrderId()), date(order.getOrderDate()), bulstat(order.getSupplierBulstat()),
+          name(order.getSupplierName()), status(order.isCancelled() ? "Cancelled" : "Placed"),
+          key(order.getIdempotencyKey()), total(order.getTotalPrice()) {}
+};
+
+// Feeds the rows of an order to a sink: beginOrder() once, then for every
+// row beginRow() (which supplies the order's columns) and the line's
+// columns through text(), integer() and number(); returns the line count
+template <typename Sink>
+size_t emitRows(const Order& order, Sink& sink) {
+    OrderFields fields(order);
+    sink.beginOrder(fields);
+    const std::vector<OrderItem>& items = order.getItems();
+    size_t rowCount = std::max<size_t>(items.size(), 1);
+    const std::string none;
+    for (size_t i = 0; i < rowCount; ++i) {
+        const OrderItem* item = i < items.size() ? &items[i] : 0;
+        const OpticalMaterial* material = item ? item->material.get() : 0;
+        sink.beginRow();
+        sink.integer(item ? static_cast<long long>(i + 1) : 0);
+        sink.integer(material ? material->getId() : 0);
+        sink.integer(material ? material->getVersion() : 0);
+        sink.text(material ? material->getType() : none);
+        sink.text(material ? material->getMaterialName() : none);
+        sink.number(material ? material->getThickness() : 0.0);
+        sink.number(material ? material->getDiopter() : 0.0);
+        sink.number(item ? item->unitPrice : 0.0);
+        sink.integer(item ? item->quantity : 0);
+        sink.number(item ? item->unitPrice * item->quantity : 0.0);
+        sink.endRow();
+    }
+    return items.size();
+}
+
+class CsvSink {
+private:
+    std::string& out;
+    // The order's columns, rendered once and repeated on each of its rows
+    std::string orderColumns;
+
+public:
+    explicit CsvSink(std::string& out) : out(out) {}
+
+    void beginOrder(const OrderFields& fields) {
+        orderColumns.clear();
+        const std::string* texts[] = {&fields.id, &fields.date, &fields.bulstat,
+                                      &fields.name, &fields.status, &fields.key};
+        for (size_t i = 0; i < sizeof(texts) / sizeof(texts[0]); ++i) {
+            appendCsvText(orderColumns, *texts[i]);
+            orderColumns += ',';
+        }
+        appendNumber(orderColumns, fields.total);
+    }
+    void beginRow() {
+        out += orderColumns;
+    }
+    void text(const std::string& value) {
+        out += ',';
+        appendCsvText(out, value);
+    }
+    void integer(long long value) {
+        out += ',';
+        appendInteger(out, value);
+    }
+    void number(double value) {
+        out += ',';
+        appendNumber(out, value);
+    }
+    void endRow() {
+        out += '\n';
+    }
+};
+
+class ColumnSink {
+private:
+    std::vector<std::string> columns;
+    size_t column;
+    uint32_t rows;
+    const OrderFields* order;
+
+public:
+    ColumnSink() : columns(COLUMN_COUNT), column(0), rows(0), order(0) {}
+
+    void beginOrder(const OrderFields& fields) {
+        order = &fields;
+    }
+    void beginRow() {
+        column = 0;
+        text(order->id);
+        text(order->date);
+        text(order->bulstat);
+        text(order->name);
+        text(order->status);
+        text(order->key);
+        number(order->total);
+    }
+
+    void text(const std::string& value) {
+        putU32(columns[column], static_cast<uint32_t>(value.size()));
+        columns[column++] += value;
+    }
+    void integer(long long value) {
+        putU64(columns[column++], static_cast<uint64_t>(value));
+    }
+    void number(double value) {
+        putDouble(columns[column++], value);
+    }
+    void endRow() {
+        ++rows;
+    }
+
+    size_t rowCount() const {
+        return rows;
+    }
+
+    void writeRowGroup(std::string& out) const {
+        out.append(ROW_GROUP_MAGIC, 4);
+        putU32(out, rows);
+        for (size_t c = 0; c < columns.size(); ++c) {
+            putU64(out, columns[c].size());
+            out += columns[c];
+        }
+    }
+};
+
+void appendJsonOrder(std::string& out, const Order& order) {
+    OrderFields fields(order);
+    out += "{\"order_id\":";
+    appendJsonText(out, fields.id);
+    out += ",\"order_date\":";
+    appendJsonText(out, fields.date);
+    out += ",\"supplier_bulstat\":";
+    appendJsonText(out, fields.bulstat);
+    out += ",\"supplier_name\":";
+    appendJsonText(out, fields.name);
+    out += ",\"status\":";
+    appendJsonText(out, fields.status);
+    out += ",\"idempotency_key\":";
+    appendJsonText(out, fields.key);
+    out += ",\"order_total\":";
+    appendNumber(out, fields.total);
+    out += ",\"lines\":[";
+    const std::vector<OrderItem>& items = order.getItems();
+    for (size_t i = 0; i < items.size(); ++i) {
+        const OrderItem& item = items[i];
+        const OpticalMaterial& material = *item.material;
+        out += i == 0 ? "{\"line\":" : ",{\"line\":";
+        appendUnsigned(out, i + 1);
+        out += ",\"material_id\":";
+        appendUnsigned(out, material.getId());
+        out += ",\"material_version\":";
+        appendUnsigned(out, material.getVersion());
+        out += ",\"type\":";
+        appendJsonText(out, material.getType());
+        out += ",\"material_name\":";
+        appendJsonText(out, material.getMaterialName());
+        out += ",\"thickness\":";
+        appendNumber(out, material.getThickness());
+        out += ",\"diopter\":";
+        appendNumber(out, material.getDiopter());
+        out += ",\"unit_price\":";
+        appendNumber(out, item.unitPrice);
+        out += ",\"quantity\":";
+        appendInteger(out, item.quantity);
+        out += ",\"line_total\":";
+        appendNumber(out, item.unitPrice * item.quantity);
+        out += '}';
+    }
+    out += "]}\n";
+}
+
+}
+
+bool ExportFilter::matches(const std::string& orderDate) const {
+    if (!from.empty() && orderDate.compare(0, from.size(), from) < 0) {
+        return false;
+    }
+    if (!to.empty() && orderDate.compare(0, to.size(), to) > 0) {
+        return false;
+    }
+    return true;
+}
+
+bool ExportFilter::coversPeriod(const std::string& period) const {
+    if (!from.empty() && period.compare(0, std::string::npos, from, 0, period.size()) < 0) {
+        return false;
+    }
+    if (!to.empty() && period.compare(0, to.size(), to) > 0) {
+        return false;
+    }
+    return true;
+}
+
+OrderExporter::OrderExporter(const std::string& path, ExportFormat format)
+    : format(format), file(path), orderCount(0), lineCount(0), rowCount(0), chunkBytes(0), finished(false) {
+    writeHeader();
+}
+
+void OrderExporter::writeHeader() {
+    std::string header;
+    if (format == EXPORT_CSV) {
+        for (size_t c = 0; c < COLUMN_COUNT; ++c) {
+            if (c > 0) {
+                header += ',';
+            }
+            header += COLUMNS[c].name;
+        }
+        header += '\n';
+    } else if (format == EXPORT_COLUMNAR) {
+        header.append(COLUMNAR_MAGIC, 4);
+        putU32(header, COLUMNAR_VERSION);
+        putU32(header, static_cast<uint32_t>(COLUMN_COUNT));
+        for (size_t c = 0; c < COLUMN_COUNT; ++c) {
+            header += static_cast<char>(COLUMNS[c].type);
+            size_t length = std::strlen(COLUMNS[c].name);
+            putU32(header, static_cast<uint32_t>(length));
+            header.append(COLUMNS[c].name, length);
+        }
+    }
+    file.append(header);
+}
+
+void OrderExporter::formatChunk(const std::vector<const Order*>& orders, size_t first, size_t last,
+                                std::string& text, size_t& lines, size_t& rows) const {
+    lines = 0;
+    rows = 0;
+    if (format == EXPORT_CSV) {
+        CsvSink sink(text);
+        for (size_t i = first; i < last; ++i) {
+            lines += emitRows(*orders[i], sink);
+        }
+    } else if (format == EXPORT_NDJSON) {
+        for (size_t i = first; i < last; ++i) {
+            appendJsonOrder(text, *orders[i]);
+            lines += orders[i]->getItems().size();
+        }
+    } else {
+        ColumnSink sink;
+        for (size_t i = first; i < last; ++i) {
+            lines += emitRows(*orders[i], sink);
+        }
+        rows = sink.rowCount();
+        sink.writeRowGroup(text);
+    }
+}
+
+void OrderExporter::write(const std::vector<const Order*>& orders) {
+    if (finished) {
+        throw std::logic_error("Export already finished");
+    }
+    // Chunks have a fixed size so the file does not depend on the
+    // number of workers
+    size_t chunkCount = (orders.size() + ORDERS_PER_CHUNK - 1) / ORDERS_PER_CHUNK;
+    std::vector<std::string> texts(chunkCount);
+    std::vector<size_t> lines(chunkCount, 0);
+    std::vector<size_t> rows(chunkCount, 0);
+    TaskScheduler::instance().forEach(chunkCount, [&](size_t chunk) {
+        size_t first = chunk * ORDERS_PER_CHUNK;
+        size_t last = std::min(orders.size(), first + ORDERS_PER_CHUNK);
+        // Sized like the last full chunk, so the text rarely regrows
+        texts[chunk].reserve(chunkBytes + chunkBytes / 8);
+        formatChunk(orders, first, last, texts[chunk], lines[chunk], rows[chunk]);
+    });
+
+    for (size_t chunk = 0; chunk < chunkCount; ++chunk) {
+        if (format == EXPORT_COLUMNAR) {
+            rowGroupOffsets.push_back(file.size());
+        }
+        chunkBytes = std::max(chunkBytes, texts[chunk].size());
+        file.append(texts[chunk]);
+        lineCount += lines[chunk];
+        rowCount += rows[chunk];
+    }
+    orderCount += orders.size();
+}
+
+void OrderExporter::writeFooter() {
+    std::string footer;
+    uint64_t footerOffset = file.size();
+    putU32(footer, static_cast<uint32_t>(rowGroupOffsets.size()));
+    for (size_t i = 0; i < rowGroupOffsets.size(); ++i) {
+        putU64(footer, rowGroupOffsets[i]);
+    }
+    putU64(footer, rowCount);
+    putU64(footer, footerOffset);
+    footer.append(COLUMNAR_MAGIC, 4);
+    file.append(footer);
+}
+
+ExportSummary OrderExporter::finish() {
+    if (!finished) {
+        finished = true;
+        if (format == EXPORT_COLUMNAR) {
+            writeFooter();
+        }
+        file.finish();
+    }
+    ExportSummary summary;
+    summary.orders = orderCount;
+    summary.lines = lineCount;
+    summary.bytes = file.size();
+    return summary;
+}
+
+ExportSummary OrderExporter::exportOrders(const DataStore& store, const std::string& path,
+                                          ExportFormat format, const ExportFilter& filter) {
+    OrderExporter exporter(path, format);
+    const size_t BATCH_SIZE = ORDERS_PER_CHUNK * CHUNKS_PER_BATCH;
+    std::vector<const Order*> batch;
+    batch.reserve(BATCH_SIZE);
+
+    // Segments come back sorted by period
+    std::vector<ArchiveSegment> segments = store.getArchiveSegments();
+    for (size_t s = 0; s < segments.size(); ++s) {
+        if (!filter.coversPeriod(segments[s].period)) {
+            continue;
+        }
+        std::vector<Order> orders = store.loadArchivedOrders(segments[s].period);
+        for (size_t i = 0; i < orders.size(); ++i) {
+            if (filter.matches(orders[i].getOrderDate())) {
+                batch.push_back(&orders[i]);
+                if (batch.size() == BATCH_SIZE) {
+                    exporter.write(batch);
+                    batch.clear();
+                }
+            }
+        }
+        exporter.write(batch);
+        batch.clear();
+    }
+
+    // The hot orders are merged by date straight out of frozen copies of
+    // the shards, without copying the orders themselves
+    size_t shardCount = store.getShardCount();
+    std::vector<CowVector<Order> > hot;
+    for (size_t shard = 0; shard < shardCount; ++shard) {
+        hot.push_back(store.getShard(shard).getOrders());
+    }
+    std::vector<size_t> next(shardCount, 0);
+    std::vector<std::string> heads(shardCount);
+    for (size_t shard = 0; shard < shardCount; ++shard) {
+        if (!hot[shard].empty()) {
+            heads[shard] = hot[shard][0].getOrderDate();
+        }
+    }
+    while (true) {
+        int best = -1;
+        for (size_t shard = 0; shard < shardCount; ++shard) {
+            if (next[shard] < hot[shard].size() && (best == -1 || heads[shard] < heads[best])) {
+                best = static_cast<int>(shard);
+            }
+        }
+        if (best == -1) {
+            break;
+        }
+        const Order& order = hot[best][next[best]];
+        if (filter.matches(heads[best])) {
+            batch.push_back(&order);
+            if (batch.size() == BATCH_SIZE) {
+                exporter.write(batch);
+                batch.clear();
+            }
+        }
+        if (++next[best] < hot[best].size()) {
+            heads[best] = hot[best][next[best]].getOrderDate();
+        }
+    }
+    exporter.write(batch);
+    return exporter.finish();
+}
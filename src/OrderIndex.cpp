@@ -0,0 +1,77 @@
+#include "OrderIndex.h"
+#include "MemoryUsage.h"
+
+std::string OrderIndex::scopedKey(const Order& order) {
+    std::string key = order.getIdempotencyKey();
+    return key.empty() ? key : order.getSupplierBulstat() + '\n' + key;
+}
+
+void OrderIndex::add(size_t position, const Order& order, uint64_t contentHash) {
+    byContent.insert(std::make_pair(contentHash, position));
+    std::string key = scopedKey(order);
+    if (!key.empty()) {
+        byKey[key] = position;
+    }
+}
+
+void OrderIndex::remove(size_t position, const Order& order, uint64_t contentHash) {
+    typedef std::unordered_multimap<uint64_t, size_t>::iterator Iterator;
+    std::pair<Iterator, Iterator> range = byContent.equal_range(contentHash);
+    for (Iterator it = range.first; it != range.second; ++it) {
+        if (it->second == position) {
+            byContent.erase(it);
+            break;
+        }
+    }
+    std::string key = scopedKey(order);
+    std::unordered_map<std::string, size_t>::iterator found = byKey.find(key);
+    if (!key.empty() && found != byKey.end() && found->second == position) {
+        byKey.erase(found);
+    }
+}
+
+void OrderIndex::clear() {
+    byContent.clear();
+    byKey.clear();
+}
+
+size_t OrderIndex::size() const {
+    return byContent.size();
+}
+
+size_t OrderIndex::memoryBytes() const {
+    size_t bytes = memory::hashMapBytes(byContent) + memory::hashMapBytes(byKey);
+    for (std::unordered_map<std::string, size_t>::const_iterator it = byKey.begin(); it != byKey.end(); ++it) {
+        bytes += memory::stringBytes(it->first);
+    }
+    return bytes;
+}
+
+long OrderIndex::findDuplicate(const Order& order, uint64_t contentHash,
+                               const CowVector<Order>& orders) const {
+    std::string key = scopedKey(order);
+    if (!key.empty()) {
+        std::unordered_map<std::string, size_t>::const_iterator found = byKey.find(key);
+        if (found != byKey.end()) {
+            return static_cast<long>(found->second);
+        }
+    }
+
+    typedef std::unordered_multimap<uint64_t, size_t>::const_iterator Iterator;
+    std::pair<Iterator, Iterator> range = byContent.equal_range(contentHash);
+    for (Iterator it = range.first; it != range.second; ++it) {
+        const Order& candidate = orders[it->second];
+        // Distinct keys mark distinct orders even when the lines agree
+        if (!key.empty() && !candidate.getIdempotencyKey().empty()) {
+            continue;
+        }
+        // A cancelled order may be placed again
+        if (candidate.isCancelled()) {
+            continue;
+        }
+        if (candidate.sameContent(order)) {
+            return static_cast<long>(it->second);
+        }
+    }
+    return -1;
+}
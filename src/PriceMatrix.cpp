@@ -0,0 +1,621 @@
+#include "PriceMatrix.h"
+#include "AsyncFile.h"
+#include "Codecs.h"
+#include "CompactText.h"
+#include "TaskScheduler.h"
+#include <algorithm>
+#include <cmath>
+#include <cctype>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <limits>
+#include <memory>
+#include <queue>
+#include <stdexcept>
+#include <unordered_map>
+
+const size_t PriceMatrix::MIN_OUTLIER_OFFERS;
+const size_t PriceMatrix::SUPPLIERS_PER_PIECE;
+const size_t PriceMatrix::ROWS_PER_CHUNK;
+const size_t PriceMatrix::CHUNKS_PER_BATCH;
+const size_t PriceMatrix::MEMORY_BUDGET;
+
+namespace {
+
+// Prices are compared in ten-thousandths of a BGN, like the order totals
+const double PRICE_SCALE = 10000.0;
+const double FENCE_WIDTH = 1.5;
+
+const char WIDE_HEADER[] =
+    "type,material_name,thickness,diopter,suppliers,min_price,median_price,max_price,"
+    "low_outliers,high_outliers";
+const char LONG_HEADER[] =
+    "type,material_name,thickness,diopter,supplier_bulstat,supplier_name,price,"
+    "suppliers,min_price,median_price,max_price,outlier\n";
+
+// One supplier's price for one kind of material. Once the text ids come
+// from the merged table, which is sorted, comparing the ids compares the
+// texts.
+struct Offer {
+    uint32_t typeId;
+    uint32_t nameId;
+    int32_t thickness;      // ten-thousandths, as the material keeps it
+    int32_t diopter;
+    uint32_t column;        // store-wide supplier number
+    int64_t price;
+};
+
+bool sameKind(const Offer& a, const Offer& b) {
+    return a.typeId == b.typeId && a.nameId == b.nameId &&
+           a.thickness == b.thickness && a.diopter == b.diopter;
+}
+
+// Row order, then supplier, then price, so a supplier's cheapest listing
+// of a kind comes first
+bool offerLess(const Offer& a, const Offer& b) {
+    if (a.typeId != b.typeId) return a.typeId < b.typeId;
+    if (a.nameId != b.nameId) return a.nameId < b.nameId;
+    if (a.thickness != b.thickness) return a.thickness < b.thickness;
+    if (a.diopter != b.diopter) return a.diopter < b.diopter;
+    if (a.column != b.column) return a.column < b.column;
+    return a.price < b.price;
+}
+
+// Ids for the canonical texts of one piece. Types and names are pooled,
+// so each distinct spelling is canonicalized once, keyed by its address.
+class TextTable {
+private:
+    std::unordered_map<const std::string*, uint32_t> byPooled;
+    std::unordered_map<std::string, uint32_t> byText;
+
+public:
+    std::vector<std::string> texts;
+
+    uint32_t idOf(const std::string& pooled) {
+        std::unordered_map<const std::string*, uint32_t>::const_iterator known = byPooled.find(&pooled);
+        if (known != byPooled.end()) {
+            return known->second;
+        }
+        std::string text = PriceMatrix::canonicalText(pooled);
+        std::unordered_map<std::string, uint32_t>::const_iterator found = byText.find(text);
+        uint32_t id;
+        if (found != byText.end()) {
+            id = found->second;
+        } else {
+            id = static_cast<uint32_t>(texts.size());
+            byText[text] = id;
+            texts.push_back(text);
+        }
+        byPooled[&pooled] = id;
+        return id;
+    }
+};
+
+struct Piece {
+    TextTable table;
+    // Piece ids to merged table ids
+    std::vector<uint32_t> merged;
+    size_t offers;
+};
+
+// Merges the sorted runs of offers between bounds pairwise, the pairs of
+// a round in parallel, until one sorted run is left
+void mergeRuns(TaskScheduler& scheduler, std::vector<Offer>& offers, std::vector<size_t> bounds) {
+    while (bounds.size() > 2) {
+        size_t pairCount = (bounds.size() - 1) / 2;
+        scheduler.forEach(pairCount, [&](size_t pair) {
+            std::inplace_merge(offers.begin() + bounds[2 * pair], offers.begin() + bounds[2 * pair + 1],
+                               offers.begin() + bounds[2 * pair + 2], offerLess);
+        });
+        std::vector<size_t> next;
+        for (size_t i = 0; i < bounds.size(); i += 2) {
+            next.push_back(bounds[i]);
+        }
+        if (next.back() != bounds.back()) {
+            next.push_back(bounds.back());
+        }
+        bounds.swap(next);
+    }
+}
+
+// A sorted run of offers. The buffer holds the ones not yet merged; a
+// run spilled to disk refills it from its file, which goes with the run.
+class Run {
+private:
+    std::string path;
+    std::unique_ptr<std::ifstream> file;
+    size_t bufferOffers;
+
+public:
+    std::vector<Offer> buffer;
+    size_t position;
+
+    // Keeps offers in memory
+    explicit Run(std::vector<Offer>& offers) : bufferOffers(0), position(0) {
+        buffer.swap(offers);
+    }
+
+    // Writes offers to path, to be read back readOffers() at a time
+    Run(const std::string& path, const std::vector<Offer>& offers)
+        : path(path), bufferOffers(1), position(0) {
+        {
+            std::ofstream out(path.c_str(), std::ios::binary | std::ios::trunc);
+            if (!out) {
+                throw std::runtime_error("Cannot open " + path);
+            }
+            out.write(reinterpret_cast<const char*>(offers.data()),
+                      static_cast<std::streamsize>(offers.size() * sizeof(Offer)));
+            out.flush();
+            if (!out) {
+                std::remove(path.c_str());
+                throw std::runtime_error("Cannot write " + path);
+            }
+        }
+        file.reset(new std::ifstream(path.c_str(), std::ios::binary));
+        if (!*file) {
+            std::remove(path.c_str());
+            throw std::runtime_error("Cannot open " + path);
+        }
+    }
+
+    ~Run() {
+        if (file) {
+            file.reset();
+            std::remove(path.c_str());
+        }
+    }
+
+    void readOffers(size_t count) {
+        bufferOffers = std::max<size_t>(1, count);
+    }
+
+    const Offer& current() const {
+        return buffer[position];
+    }
+
+    // False once every offer has been taken
+    bool fill() {
+        if (position < buffer.size()) {
+            return true;
+        }
+        if (!file) {
+            return false;
+        }
+        buffer.resize(bufferOffers);
+        file->read(reinterpret_cast<char*>(&buffer[0]), static_cast<std::streamsize>(bufferOffers * sizeof(Offer)));
+        size_t bytes = static_cast<size_t>(file->gcount());
+        if (bytes % sizeof(Offer) != 0 || (!*file && !file->eof())) {
+            throw std::runtime_error("Cannot read " + path);
+        }
+        buffer.resize(bytes / sizeof(Offer));
+        position = 0;
+        return !buffer.empty();
+    }
+};
+
+// Takes offers from all runs in row order, the least current one first
+class RunMerger {
+private:
+    struct Later {
+        const std::vector<std::unique_ptr<Run> >* runs;
+
+        bool operator()(size_t a, size_t b) const {
+            return offerLess((*runs)[b]->current(), (*runs)[a]->current());
+        }
+    };
+
+    std::vector<std::unique_ptr<Run> >& runs;
+    std::priority_queue<size_t, std::vector<size_t>, Later> queue;
+
+public:
+    explicit RunMerger(std::vector<std::unique_ptr<Run> >& runs) : runs(runs) {
+        Later later;
+        later.runs = &runs;
+        queue = std::priority_queue<size_t, std::vector<size_t>, Later>(later);
+        for (size_t i = 0; i < runs.size(); ++i) {
+            if (runs[i]->fill()) {
+                queue.push(i);
+            }
+        }
+    }
+
+    bool next(Offer& offer) {
+        if (queue.empty()) {
+            return false;
+        }
+        size_t run = queue.top();
+        queue.pop();
+        offer = runs[run]->current();
+        ++runs[run]->position;
+        if (runs[run]->fill()) {
+            queue.push(run);
+        }
+        return true;
+    }
+};
+
+// Statistics of one row; prices in ten-thousandths
+struct RowStats {
+    size_t count;
+    int64_t min;
+    int64_t median;
+    int64_t max;
+    double lowFence;
+    double highFence;
+
+    // -1 below the low fence, 1 above the high one, otherwise 0
+    int outlier(int64_t price) const {
+        return price < lowFence ? -1 : (price > highFence ? 1 : 0);
+    }
+};
+
+double quartile(const std::vector<int64_t>& sorted, double q) {
+    double position = q * (sorted.size() - 1);
+    size_t below = static_cast<size_t>(position);
+    if (below + 1 >= sorted.size()) {
+        return static_cast<double>(sorted.back());
+    }
+    double fraction = position - below;
+    return sorted[below] + fraction * (sorted[below + 1] - sorted[below]);
+}
+
+RowStats rowStats(const Offer* first, const Offer* last, std::vector<int64_t>& prices) {
+    prices.clear();
+    for (const Offer* offer = first; offer != last; ++offer) {
+        prices.push_back(offer->price);
+    }
+    std::sort(prices.begin(), prices.end());
+
+    RowStats stats;
+    size_t count = prices.size();
+    stats.count = count;
+    stats.min = prices.front();
+    stats.max = prices.back();
+    // The mean of the middle two is rounded to whole units, which keeps
+    // it a price that prints without binary noise
+    stats.median = count % 2 == 1 ? prices[count / 2]
+                                  : static_cast<int64_t>(std::llround((prices[count / 2 - 1] + prices[count / 2]) / 2.0));
+    stats.lowFence = -std::numeric_limits<double>::infinity();
+    stats.highFence = std::numeric_limits<double>::infinity();
+    if (count >= PriceMatrix::MIN_OUTLIER_OFFERS) {
+        double q1 = quartile(prices, 0.25);
+        double q3 = quartile(prices, 0.75);
+        stats.lowFence = q1 - FENCE_WIDTH * (q3 - q1);
+        stats.highFence = q3 + FENCE_WIDTH * (q3 - q1);
+    }
+    return stats;
+}
+
+void appendCsvText(std::string& out, const std::string& text) {
+    if (text.find_first_of(",\"\r\n") == std::string::npos) {
+        out += text;
+        return;
+    }
+    out += '"';
+    for (size_t i = 0; i < text.size(); ++i) {
+        if (text[i] == '"') {
+            out += '"';
+        }
+        out += text[i];
+    }
+    out += '"';
+}
+
+void appendUnits(std::string& out, int64_t units) {
+    codec::appendDouble(out, units / PRICE_SCALE);
+}
+
+// Everything the row formatters share, read-only once built
+struct MatrixText {
+    MatrixLayout layout;
+    size_t columns;
+    const std::vector<Offer>* offers;
+    const std::vector<size_t>* rowStarts;
+    // Merged table texts and supplier columns, already in CSV form
+    std::vector<std::string> texts;
+    std::vector<std::string> bulstats;
+    std::vector<std::string> supplierNames;
+};
+
+void appendKey(std::string& out, const MatrixText& matrix, const Offer& offer) {
+    out += matrix.texts[offer.typeId];
+    out += ',';
+    out += matrix.texts[offer.nameId];
+    out += ',';
+    codec::appendDouble(out, offer.thickness / FixedDecimal::SCALE);
+    out += ',';
+    codec::appendDouble(out, offer.diopter / FixedDecimal::SCALE);
+}
+
+void appendStats(std::string& out, const RowStats& stats) {
+    out += ',';
+    codec::appendUnsigned(out, stats.count);
+    out += ',';
+    appendUnits(out, stats.min);
+    out += ',';
+    appendUnits(out, stats.median);
+    out += ',';
+    appendUnits(out, stats.max);
+}
+
+// Formats rows [first, last); returns the number of outlying prices
+size_t formatRows(const MatrixText& matrix, size_t first, size_t last, std::string& out) {
+    const std::vector<Offer>& offers = *matrix.offers;
+    const std::vector<size_t>& rowStarts = *matrix.rowStarts;
+    std::vector<int64_t> prices;
+    std::string key;
+    size_t outliers = 0;
+    for (size_t row = first; row < last; ++row) {
+        const Offer* begin = &offers[0] + rowStarts[row];
+        const Offer* end = &offers[0] + rowStarts[row + 1];
+        RowStats stats = rowStats(begin, end, prices);
+
+        if (matrix.layout == MATRIX_WIDE) {
+            appendKey(out, matrix, *begin);
+            appendStats(out, stats);
+            for (int side = -1; side <= 1; side += 2) {
+                out += ',';
+                bool firstListed = true;
+                for (const Offer* offer = begin; offer != end; ++offer) {
+                    if (stats.outlier(offer->price) == side) {
+                        out += firstListed ? "" : " ";
+                        out += matrix.bulstats[offer->column];
+                        firstListed = false;
+                        ++outliers;
+                    }
+                }
+            }
+            // A comma before every supplier's cell, empty where it has
+            // no offer
+            size_t next = 0;
+            for (const Offer* offer = begin; offer != end; ++offer) {
+                out.append(offer->column - next + 1, ',');
+                appendUnits(out, offer->price);
+                next = offer->column + 1;
+            }
+            out.append(matrix.columns - next, ',');
+            out += '\n';
+        } else {
+            key.clear();
+            appendKey(key, matrix, *begin);
+            std::string statsText;
+            appendStats(statsText, stats);
+            for (const Offer* offer = begin; offer != end; ++offer) {
+                out += key;
+                out += ',';
+                out += matrix.bulstats[offer->column];
+                out += ',';
+                out += matrix.supplierNames[offer->column];
+                out += ',';
+                appendUnits(out, offer->price);
+                out += statsText;
+                int side = stats.outlier(offer->price);
+                out += side < 0 ? ",low\n" : (side > 0 ? ",high\n" : ",\n");
+                outliers += side != 0 ? 1 : 0;
+            }
+        }
+    }
+    return outliers;
+}
+
+}
+
+std::string PriceMatrix::canonicalText(const std::string& text) {
+    std::string result;
+    result.reserve(text.size());
+    bool space = false;
+    for (size_t i = 0; i < text.size(); ++i) {
+        unsigned char c = static_cast<unsigned char>(text[i]);
+        if (c == ' ' || c == '\t' || c == '\r' || c == '\n') {
+            space = !result.empty();
+            continue;
+        }
+        if (space) {
+            result += ' ';
+            space = false;
+        }
+        result += static_cast<char>(c < 0x80 ? ::tolower(c) : c);
+    }
+    return result;
+}
+
+PriceMatrixSummary PriceMatrix::exportMatrix(const DataStore& store, const std::string& path,
+                                             MatrixLayout layout, size_t memoryBudget) {
+    TaskScheduler& scheduler = TaskScheduler::instance();
+    DataSnapshot snapshot = store.snapshot();
+    size_t supplierCount = snapshot.directory.size();
+
+    MatrixText matrix;
+    matrix.layout = layout;
+    matrix.columns = supplierCount;
+    matrix.bulstats.resize(supplierCount);
+    matrix.supplierNames.resize(supplierCount);
+
+    // Each piece builds its own text table and counts its offers
+    size_t pieceCount = (supplierCount + SUPPLIERS_PER_PIECE - 1) / SUPPLIERS_PER_PIECE;
+    std::vector<Piece> pieces(pieceCount);
+    auto supplierAt = [&](size_t column) -> const Supplier& {
+        const SupplierLocation& location = snapshot.directory[column];
+        return snapshot.shards[location.shard].suppliers[location.position];
+    };
+    scheduler.forEach(pieceCount, [&](size_t p) {
+        Piece& piece = pieces[p];
+        piece.offers = 0;
+        size_t last = std::min(supplierCount, (p + 1) * SUPPLIERS_PER_PIECE);
+        for (size_t column = p * SUPPLIERS_PER_PIECE; column < last; ++column) {
+            const Supplier& supplier = supplierAt(column);
+            appendCsvText(matrix.bulstats[column], supplier.getBulstat());
+            appendCsvText(matrix.supplierNames[column], supplier.getName());
+
+            const CowVector<OpticalMaterial>& materials = supplier.getMaterials();
+            for (size_t m = 0; m < materials.size(); ++m) {
+                piece.table.idOf(materials[m].getType());
+                piece.table.idOf(materials[m].getMaterialName());
+            }
+            piece.offers += materials.size();
+        }
+    });
+
+    // One sorted table for all pieces; each piece maps its ids onto it
+    std::vector<std::string> merged;
+    for (size_t p = 0; p < pieceCount; ++p) {
+        merged.insert(merged.end(), pieces[p].table.texts.begin(), pieces[p].table.texts.end());
+    }
+    std::sort(merged.begin(), merged.end());
+    merged.erase(std::unique(merged.begin(), merged.end()), merged.end());
+    scheduler.forEach(pieceCount, [&](size_t p) {
+        const std::vector<std::string>& texts = pieces[p].table.texts;
+        pieces[p].merged.resize(texts.size());
+        for (size_t i = 0; i < texts.size(); ++i) {
+            pieces[p].merged[i] =
+                static_cast<uint32_t>(std::lower_bound(merged.begin(), merged.end(), texts[i]) - merged.begin());
+        }
+    });
+
+    // Waves of pieces read their offers and sort them side by side. At
+    // most half the budget is held; a wave that would pass it first
+    // writes what is held to disk as one sorted run. A piece larger than
+    // that still makes a wave of its own.
+    const size_t HELD_OFFERS = std::max<size_t>(1, memoryBudget / 2 / sizeof(Offer));
+    std::vector<std::unique_ptr<Run> > runs;
+    std::vector<Offer> held;
+    std::vector<size_t> heldBounds(1, 0);
+    for (size_t first = 0; first < pieceCount;) {
+        if (!held.empty() && held.size() + pieces[first].offers > HELD_OFFERS) {
+            mergeRuns(scheduler, held, heldBounds);
+            runs.push_back(std::unique_ptr<Run>(new Run(path + ".run" + std::to_string(runs.size()), held)));
+            held.clear();
+            heldBounds.assign(1, 0);
+        }
+        size_t last = first + 1;
+        size_t waveOffers = pieces[first].offers;
+        while (last < pieceCount && held.size() + waveOffers + pieces[last].offers <= HELD_OFFERS) {
+            waveOffers += pieces[last++].offers;
+        }
+        held.resize(held.size() + waveOffers);
+        size_t waveBounds = heldBounds.size() - 1;
+        for (size_t p = first; p < last; ++p) {
+            heldBounds.push_back(heldBounds.back() + pieces[p].offers);
+        }
+        scheduler.forEach(last - first, [&](size_t i) {
+            size_t p = first + i;
+            Piece& piece = pieces[p];
+            Offer* out = held.data() + heldBounds[waveBounds + i];
+            Offer* begin = out;
+            size_t end = std::min(supplierCount, (p + 1) * SUPPLIERS_PER_PIECE);
+            for (size_t column = p * SUPPLIERS_PER_PIECE; column < end; ++column) {
+                const CowVector<OpticalMaterial>& materials = supplierAt(column).getMaterials();
+                for (size_t m = 0; m < materials.size(); ++m) {
+                    const OpticalMaterial& material = materials[m];
+                    Offer offer = Offer();
+                    offer.typeId = piece.merged[piece.table.idOf(material.getType())];
+                    offer.nameId = piece.merged[piece.table.idOf(material.getMaterialName())];
+                    offer.thickness = static_cast<int32_t>(std::lround(material.getThickness() * FixedDecimal::SCALE));
+                    offer.diopter = static_cast<int32_t>(std::lround(material.getDiopter() * FixedDecimal::SCALE));
+                    offer.column = static_cast<uint32_t>(column);
+                    offer.price = std::llround(material.getPrice() * PRICE_SCALE);
+                    *out++ = offer;
+                }
+            }
+            std::sort(begin, out, offerLess);
+        });
+        first = last;
+    }
+    pieces.clear();
+    mergeRuns(scheduler, held, heldBounds);
+
+    // What is still held stays in memory; spilled runs share the other
+    // half of the budget as read buffers
+    size_t spilledRuns = runs.size();
+    for (size_t i = 0; i < spilledRuns; ++i) {
+        runs[i]->readOffers(HELD_OFFERS / spilledRuns);
+    }
+    runs.push_back(std::unique_ptr<Run>(new Run(held)));
+
+    for (size_t i = 0; i < merged.size(); ++i) {
+        matrix.texts.push_back(std::string());
+        appendCsvText(matrix.texts.back(), merged[i]);
+    }
+
+    PriceMatrixSummary summary;
+    summary.rows = 0;
+    summary.comparableRows = 0;
+    summary.suppliers = supplierCount;
+    summary.offers = 0;
+    summary.outliers = 0;
+    summary.spilledRuns = spilledRuns;
+
+    AsyncFileWriter file(path);
+    std::string header;
+    if (layout == MATRIX_WIDE) {
+        header = WIDE_HEADER;
+        for (size_t column = 0; column < supplierCount; ++column) {
+            header += ',';
+            header += matrix.bulstats[column];
+        }
+        header += '\n';
+    } else {
+        header = LONG_HEADER;
+    }
+    file.append(header);
+
+    // The merged offers are cut into batches of rows. Chunks have a fixed
+    // number of rows so the file does not depend on the number of workers;
+    // a batch's chunks are formatted in parallel and written in order.
+    const size_t BATCH_ROWS = ROWS_PER_CHUNK * CHUNKS_PER_BATCH;
+    std::vector<Offer> batchOffers;
+    std::vector<size_t> rowStarts;
+    matrix.offers = &batchOffers;
+    matrix.rowStarts = &rowStarts;
+    size_t chunkBytes = 0;
+    auto writeBatch = [&]() {
+        size_t rowCount = rowStarts.size();
+        rowStarts.push_back(batchOffers.size());
+        summary.rows += rowCount;
+        summary.offers += batchOffers.size();
+        for (size_t row = 0; row < rowCount; ++row) {
+            summary.comparableRows += rowStarts[row + 1] - rowStarts[row] > 1 ? 1 : 0;
+        }
+        size_t chunkCount = (rowCount + ROWS_PER_CHUNK - 1) / ROWS_PER_CHUNK;
+        std::vector<std::string> texts(chunkCount);
+        std::vector<size_t> outliers(chunkCount, 0);
+        scheduler.forEach(chunkCount, [&](size_t chunk) {
+            size_t first = chunk * ROWS_PER_CHUNK;
+            size_t last = std::min(rowCount, first + ROWS_PER_CHUNK);
+            texts[chunk].reserve(chunkBytes + chunkBytes / 8);
+            outliers[chunk] = formatRows(matrix, first, last, texts[chunk]);
+        });
+        for (size_t chunk = 0; chunk < chunkCount; ++chunk) {
+            chunkBytes = std::max(chunkBytes, texts[chunk].size());
+            file.append(texts[chunk]);
+            summary.outliers += outliers[chunk];
+        }
+        batchOffers.clear();
+        rowStarts.clear();
+    };
+
+    // Rows start where the kind changes; a supplier's further listings of
+    // a kind are dropped, its cheapest one coming first
+    RunMerger merger(runs);
+    Offer offer;
+    while (merger.next(offer)) {
+        bool newRow = batchOffers.empty() || !sameKind(batchOffers.back(), offer);
+        if (!newRow && batchOffers.back().column == offer.column) {
+            continue;
+        }
+        if (newRow) {
+            if (rowStarts.size() == BATCH_ROWS) {
+                writeBatch();
+            }
+            rowStarts.push_back(batchOffers.size());
+        }
+        batchOffers.push_back(offer);
+    }
+    if (!rowStarts.empty()) {
+        writeBatch();
+    }
+    file.finish();
+    summary.bytes = file.size();
+    return summary;
+}
@@ -0,0 +1,77 @@
+#include "RenderCache.h"
+#include "Metrics.h"
+#include <atomic>
+
+unsigned long long RenderCache::nextRevision() {
+    static std::atomic<unsigned long long> counter(0);
+    return counter.fetch_add(1, std::memory_order_relaxed) + 1;
+}
+
+RenderCache& RenderCache::shared() {
+    static RenderCache cache;
+    return cache;
+}
+
+RenderCache::RenderCache(size_t capacityBytes) : capacityBytes(capacityBytes), usedBytes(0) {}
+
+// Revisions stay far below 2^60, leaving the top bits for the view
+unsigned long long RenderCache::makeKey(View view, unsigned long long revision) {
+    return (static_cast<unsigned long long>(view) << 60) | revision;
+}
+
+bool RenderCache::find(View view, unsigned long long revision, std::string& text) {
+    std::lock_guard<std::mutex> lock(mutex);
+    std::unordered_map<unsigned long long, std::list<Entry>::iterator>::const_iterator found =
+        positions.find(makeKey(view, revision));
+    if (found == positions.end()) {
+        METRIC_INCREMENT(METRIC_RENDER_CACHE_MISS);
+        return false;
+    }
+    entries.splice(entries.begin(), entries, found->second);
+    text = found->second->text;
+    METRIC_INCREMENT(METRIC_RENDER_CACHE_HIT);
+    return true;
+}
+
+void RenderCache::store(View view, unsigned long long revision, const std::string& text) {
+    // A view larger than the whole cache would only evict everything else
+    if (text.size() > capacityBytes) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    unsigned long long key = makeKey(view, revision);
+    if (positions.count(key)) {
+        return;
+    }
+
+    while (!entries.empty() && usedBytes + text.size() > capacityBytes) {
+        usedBytes -= entries.back().text.size();
+        positions.erase(entries.back().key);
+        entries.pop_back();
+    }
+
+    Entry entry;
+    entry.key = key;
+    entry.text = text;
+    entries.push_front(entry);
+    positions[key] = entries.begin();
+    usedBytes += text.size();
+}
+
+void RenderCache::clear() {
+    std::lock_guard<std::mutex> lock(mutex);
+    entries.clear();
+    positions.clear();
+    usedBytes = 0;
+}
+
+size_t RenderCache::size() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return entries.size();
+}
+
+size_t RenderCache::sizeInBytes() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return usedBytes;
+}
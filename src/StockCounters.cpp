@@ -0,0 +1,135 @@
+#include "StockCounters.h"
+#include <algorithm>
+#include <functional>
+
+const size_t StockCounters::BUCKET_COUNT;
+
+StockCounters::StockCounters() {
+    clear();
+}
+
+size_t StockCounters::bucketOf(const std::string& bulstat) const {
+    return std::hash<std::string>()(bulstat) % BUCKET_COUNT;
+}
+
+std::shared_ptr<StockCounters::SupplierStock> StockCounters::find(const std::string& bulstat) const {
+    std::shared_ptr<const Bucket> bucket = std::atomic_load(&buckets[bucketOf(bulstat)]);
+    Bucket::const_iterator found = bucket->find(bulstat);
+    return found != bucket->end() ? found->second : std::shared_ptr<SupplierStock>();
+}
+
+void StockCounters::publish(const std::string& bulstat, const std::shared_ptr<SupplierStock>& stock) {
+    size_t index = bucketOf(bulstat);
+    std::shared_ptr<Bucket> bucket = std::make_shared<Bucket>(*std::atomic_load(&buckets[index]));
+    if (stock) {
+        (*bucket)[bulstat] = stock;
+    } else {
+        bucket->erase(bulstat);
+    }
+    std::atomic_store(&buckets[index], std::shared_ptr<const Bucket>(bucket));
+}
+
+StockCounters::Reservation StockCounters::reserve(const std::string& bulstat, const Lines& lines) const {
+    Reservation reservation;
+    reservation.stock = find(bulstat);
+    if (!reservation.stock || lines.empty()) {
+        return reservation;
+    }
+    const SupplierStock& stock = *reservation.stock;
+
+    // Lines of the same material add up; sorting brings them together
+    Lines requested(lines);
+    std::sort(requested.begin(), requested.end());
+    for (size_t i = 0; i < requested.size(); ++i) {
+        if (!reservation.lines.empty() && reservation.lines.back().first == requested[i].first) {
+            reservation.lines.back().second += requested[i].second;
+            continue;
+        }
+        if (std::binary_search(stock.materialIds.begin(), stock.materialIds.end(), requested[i].first)) {
+            reservation.lines.push_back(requested[i]);
+        }
+    }
+
+    for (size_t i = 0; i < reservation.lines.size(); ++i) {
+        size_t slot = std::lower_bound(stock.materialIds.begin(), stock.materialIds.end(),
+                                       reservation.lines[i].first) - stock.materialIds.begin();
+        std::atomic<int>& available = stock.available[slot];
+        int wanted = reservation.lines[i].second;
+        int current = available.load(std::memory_order_relaxed);
+        do {
+            if (current < wanted) {
+                unsigned int materialId = reservation.lines[i].first;
+                reservation.lines.resize(i);
+                cancel(reservation);
+                throw InsufficientStockError("Not enough stock of material #" + std::to_string(materialId) +
+                                             ": " + std::to_string(wanted) + " requested, " +
+                                             std::to_string(current) + " on hand");
+            }
+        } while (!available.compare_exchange_weak(current, current - wanted, std::memory_order_acq_rel,
+                                                  std::memory_order_relaxed));
+    }
+    return reservation;
+}
+
+void StockCounters::cancel(const Reservation& reservation) {
+    if (!reservation.stock) {
+        return;
+    }
+    const SupplierStock& stock = *reservation.stock;
+    for (size_t i = 0; i < reservation.lines.size(); ++i) {
+        size_t slot = std::lower_bound(stock.materialIds.begin(), stock.materialIds.end(),
+                                       reservation.lines[i].first) - stock.materialIds.begin();
+        stock.available[slot].fetch_add(reservation.lines[i].second, std::memory_order_acq_rel);
+    }
+}
+
+bool StockCounters::isCurrent(const std::string& bulstat, const Reservation& reservation) const {
+    return find(bulstat) == reservation.stock;
+}
+
+void StockCounters::release(const std::string& bulstat, const Lines& lines) const {
+    std::shared_ptr<SupplierStock> stock = find(bulstat);
+    if (!stock) {
+        return;
+    }
+    for (size_t i = 0; i < lines.size(); ++i) {
+        std::vector<unsigned int>::const_iterator found =
+            std::lower_bound(stock->materialIds.begin(), stock->materialIds.end(), lines[i].first);
+        if (found != stock->materialIds.end() && *found == lines[i].first) {
+            stock->available[found - stock->materialIds.begin()].fetch_add(lines[i].second,
+                                                                            std::memory_order_acq_rel);
+        }
+    }
+}
+
+void StockCounters::reset(const Supplier& supplier) {
+    if (!supplier.tracksStock()) {
+        if (find(supplier.getBulstat())) {
+            remove(supplier.getBulstat());
+        }
+        return;
+    }
+    std::shared_ptr<SupplierStock> stock = std::make_shared<SupplierStock>();
+    const CowVector<OpticalMaterial>& materials = supplier.getMaterials();
+    for (size_t i = 0; i < materials.size(); ++i) {
+        if (supplier.getStock(materials[i].getId()) != Supplier::UNTRACKED_STOCK) {
+            stock->materialIds.push_back(materials[i].getId());
+        }
+    }
+    std::sort(stock->materialIds.begin(), stock->materialIds.end());
+    stock->available.reset(new std::atomic<int>[stock->materialIds.size()]);
+    for (size_t i = 0; i < stock->materialIds.size(); ++i) {
+        stock->available[i].store(supplier.getStock(stock->materialIds[i]), std::memory_order_relaxed);
+    }
+    publish(supplier.getBulstat(), stock);
+}
+
+void StockCounters::remove(const std::string& bulstat) {
+    publish(bulstat, std::shared_ptr<SupplierStock>());
+}
+
+void StockCounters::clear() {
+    for (size_t i = 0; i < BUCKET_COUNT; ++i) {
+        std::atomic_store(&buckets[i], std::shared_ptr<const Bucket>(std::make_shared<Bucket>()));
+    }
+}
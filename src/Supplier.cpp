@@ -1,157 +1,335 @@
 #include "Supplier.h"
+#include "Validation.h"
+#include "Metrics.h"
+#include "ModelReflection.h"
+#include "RenderCache.h"
 #include <stdexcept>
-#include <algorithm>
 #include <iomanip>
-#include <cctype>
+#include <sstream>
 #include <limits>
+#include <unordered_set>
+#include <algorithm>
 
 void Supplier::validateBulstat(const std::string& bulstat) const {
-    if (bulstat.empty()) {
-        throw std::invalid_argument("Bulstat cannot be empty");
+    const char* error = Validation::checkBulstat(bulstat);
+    if (error) {
+        throw std::invalid_argument(error);
     }
+}
 
-    if (!std::all_of(bulstat.begin(), bulstat.end(), ::isdigit)) {
-        throw std::invalid_argument("Bulstat must contain only digits");
+void Supplier::validatePhoneNumber(const std::string& phone) const {
+    const char* error = Validation::checkPhoneNumber(phone);
+    if (error) {
+        throw std::invalid_argument(error);
     }
+}
+
+const int Supplier::UNTRACKED_STOCK;
+
+Supplier::Supplier() 
+    : bulstat("000000000"), name("Unknown"), location("Unknown"), phoneNumber("0000000000"),
+      nextMaterialId(1), catalogVersion(0), revision(RenderCache::nextRevision()) {
+}
+
+Supplier::Supplier(const std::string& bulstat, const std::string& name, 
+                  const std::string& location, const std::string& phoneNumber)
+    : name(name), location(location), nextMaterialId(1), catalogVersion(0),
+      revision(RenderCache::nextRevision()) {
+    validateBulstat(bulstat);
+    validatePhoneNumber(phoneNumber);
+    this->bulstat.assign(bulstat);
+    this->phoneNumber.assign(phoneNumber);
+}
 
-    if (bulstat.length() != 9 && bulstat.length() != 13) {
-        throw std::invalid_argument("Bulstat must be 9 or 13 digits");
+Supplier::Supplier(const Supplier& other)
+    : bulstat(other.bulstat), name(other.name), location(other.location),
+      phoneNumber(other.phoneNumber), materials(other.materials),
+      nextMaterialId(other.nextMaterialId), catalogVersion(other.catalogVersion),
+      materialPositions(other.materialPositions), stock(other.stock), revision(other.revision) {
+}
+
+Supplier& Supplier::operator=(const Supplier& other) {
+    if (this != &other) {
+        bulstat = other.bulstat;
+        name = other.name;
+        location = other.location;
+        phoneNumber = other.phoneNumber;
+        materials = other.materials;
+        nextMaterialId = other.nextMaterialId;
+        catalogVersion = other.catalogVersion;
+        materialPositions = other.materialPositions;
+        stock = other.stock;
+        revision = other.revision;
     }
+    return *this;
 }
 
-void Supplier::validatePhoneNumber(const std::string& phone) const {
-    if (phone.empty()) {
-        throw std::invalid_argument("Phone number cannot be empty");
+Supplier::~Supplier() {
+    materials.clear();
+}
+
+void Supplier::rebuildMaterialPositions() {
+    materialPositions.assign(nextMaterialId, 0);
+    for (size_t i = 0; i < materials.size(); ++i) {
+        setMaterialPosition(materials[i].getId(), i);
     }
+}
 
-    // Count digits and validate characters
-    int digitCount = 0;
-    bool startsWithPlus = false;
-    
-    for (size_t i = 0; i < phone.length(); ++i) {
-        char c = phone[i];
-        
-        if (::isdigit(c)) {
-            digitCount++;
-        } else if (c == '+') {
-            if (i == 0) {
-                startsWithPlus = true;
-            } else {
-                throw std::invalid_argument("Phone number: '+' can only appear at the start");
-            }
-        } else if (c != '-' && c != ' ' && c != '(' && c != ')' && c != '.') {
-            throw std::invalid_argument("Phone number contains invalid characters");
+void Supplier::setMaterialPosition(unsigned int materialId, size_t position) {
+    if (materialId >= materialPositions.size()) {
+        materialPositions.resize(materialId + 1, 0);
+    }
+    materialPositions[materialId] = static_cast<uint32_t>(position + 1);
+}
+
+void Supplier::numberLoadedMaterials() {
+    for (size_t i = 0; i < materials.size(); ++i) {
+        unsigned int id = materials[i].getId();
+        if (id == 0) {
+            OpticalMaterial& material = materials.mutableAt(i);
+            material.setId(nextMaterialId++);
+            material.setVersion(1);
+        } else if (id >= nextMaterialId) {
+            nextMaterialId = id + 1;
         }
     }
+    rebuildMaterialPositions();
+    touch();
+}
+
+void Supplier::touch() {
+    revision = RenderCache::nextRevision();
+}
 
-    // Validate digit count (E.164 standard: 7-15 digits)
-    if (digitCount < 7) {
-        throw std::invalid_argument("Phone number must contain at least 7 digits");
+// Moves the last material into the gap so removal stays O(1)
+void Supplier::removeMaterialAt(size_t position) {
+    std::vector<StockLevel>::iterator level = findStock(materials[position].getId());
+    if (level != stock.end()) {
+        stock.erase(level);
     }
-    if (digitCount > 15) {
-        throw std::invalid_argument("Phone number cannot contain more than 15 digits");
+    materialPositions[materials[position].getId()] = 0;
+    size_t last = materials.size() - 1;
+    if (position != last) {
+        materials.set(position, materials[last]);
+        setMaterialPosition(materials[position].getId(), position);
     }
+    materials.pop_back();
+    touch();
+}
 
-    // If starts with +, ensure it's followed by at least one digit
-    if (startsWithPlus && digitCount == 0) {
-        throw std::invalid_argument("Phone number starting with '+' must contain digits");
-    }
+namespace {
 
-    // Ensure phone number doesn't consist only of formatting characters
-    if (digitCount == 0) {
-        throw std::invalid_argument("Phone number must contain at least one digit");
-    }
+bool byMaterialId(const StockLevel& level, unsigned int materialId) {
+    return level.materialId < materialId;
 }
 
-Supplier::Supplier() 
-    : bulstat("000000000"), name("Unknown"), location("Unknown"), phoneNumber("0000000000") {
 }
 
-Supplier::Supplier(const std::string& bulstat, const std::string& name, 
-                  const std::string& location, const std::string& phoneNumber)
-    : name(name), location(location) {
-    validateBulstat(bulstat);
-    validatePhoneNumber(phoneNumber);
-    this->bulstat = bulstat;
-    this->phoneNumber = phoneNumber;
+std::vector<StockLevel>::iterator Supplier::findStock(unsigned int materialId) {
+    std::vector<StockLevel>::iterator found =
+        std::lower_bound(stock.begin(), stock.end(), materialId, byMaterialId);
+    return found != stock.end() && found->materialId == materialId ? found : stock.end();
 }
 
-Supplier::Supplier(const Supplier& other)
-    : bulstat(other.bulstat), name(other.name), location(other.location),
-      phoneNumber(other.phoneNumber), materials(other.materials) {
+std::vector<StockLevel>::const_iterator Supplier::findStock(unsigned int materialId) const {
+    std::vector<StockLevel>::const_iterator found =
+        std::lower_bound(stock.begin(), stock.end(), materialId, byMaterialId);
+    return found != stock.end() && found->materialId == materialId ? found : stock.end();
 }
 
-Supplier::~Supplier() {
-    materials.clear();
+void Supplier::normalizeLoadedStock() {
+    std::vector<StockLevel> loaded;
+    loaded.swap(stock);
+    for (size_t i = 0; i < loaded.size(); ++i) {
+        if (findMaterial(loaded[i].materialId) != -1 && loaded[i].onHand >= 0) {
+            stock.push_back(loaded[i]);
+        }
+    }
+    std::sort(stock.begin(), stock.end(), [](const StockLevel& a, const StockLevel& b) {
+        return a.materialId < b.materialId;
+    });
 }
 
 std::string Supplier::getBulstat() const {
-    return bulstat;
+    return bulstat.str();
 }
 
 std::string Supplier::getName() const {
-    return name;
+    return name.str();
 }
 
 std::string Supplier::getLocation() const {
-    return location;
+    return location.str();
 }
 
 std::string Supplier::getPhoneNumber() const {
-    return phoneNumber;
+    return phoneNumber.str();
 }
 
-const std::vector<OpticalMaterial>& Supplier::getMaterials() const {
+const CowVector<OpticalMaterial>& Supplier::getMaterials() const {
     return materials;
 }
 
+unsigned int Supplier::getCatalogVersion() const {
+    return catalogVersion;
+}
+
+int Supplier::findMaterial(unsigned int materialId) const {
+    if (materialId >= materialPositions.size()) {
+        return -1;
+    }
+    return static_cast<int>(materialPositions[materialId]) - 1;
+}
+
 void Supplier::setBulstat(const std::string& bulstat) {
     validateBulstat(bulstat);
-    this->bulstat = bulstat;
+    this->bulstat.assign(bulstat);
+    touch();
 }
 
 void Supplier::setName(const std::string& name) {
     if (name.empty()) {
         throw std::invalid_argument("Name cannot be empty");
     }
-    this->name = name;
+    this->name.assign(name);
+    touch();
 }
 
 void Supplier::setLocation(const std::string& location) {
     if (location.empty()) {
         throw std::invalid_argument("Location cannot be empty");
     }
-    this->location = location;
+    this->location.assign(location);
+    touch();
 }
 
 void Supplier::setPhoneNumber(const std::string& phoneNumber) {
     validatePhoneNumber(phoneNumber);
-    this->phoneNumber = phoneNumber;
+    this->phoneNumber.assign(phoneNumber);
+    touch();
 }
 
 void Supplier::addMaterial(const OpticalMaterial& material) {
+    if (material.getId() == 0) {
+        OpticalMaterial numbered(material);
+        numbered.setId(nextMaterialId++);
+        numbered.setVersion(1);
+        setMaterialPosition(numbered.getId(), materials.size());
+        materials.push_back(numbered);
+        touch();
+        return;
+    }
+    
+    if (findMaterial(material.getId()) != -1) {
+        throw std::invalid_argument("Material #" + std::to_string(material.getId()) + " already exists");
+    }
+    if (material.getId() >= nextMaterialId) {
+        nextMaterialId = material.getId() + 1;
+    }
+    setMaterialPosition(material.getId(), materials.size());
     materials.push_back(material);
+    touch();
 }
 
 void Supplier::removeMaterial(int index) {
     if (index < 0 || index >= static_cast<int>(materials.size())) {
         throw std::out_of_range("Invalid material index");
     }
-    materials.erase(materials.begin() + index);
+    removeMaterialAt(static_cast<size_t>(index));
 }
 
-void Supplier::displayMaterials() const {
+CatalogDelta Supplier::applyDelta(const std::vector<MaterialChange>& changes) {
+    // Check every change against the state the earlier ones leave behind
+    std::unordered_set<unsigned int> added, removed;
+    for (size_t i = 0; i < changes.size(); ++i) {
+        const MaterialChange& change = changes[i];
+        unsigned int id = change.kind == MaterialChange::ADD_MATERIAL ?
+            change.material.getId() : change.materialId;
+        bool exists = !removed.count(id) && (added.count(id) || findMaterial(id) != -1);
+        
+        if (change.kind == MaterialChange::ADD_MATERIAL) {
+            if (id != 0 && exists) {
+                throw std::invalid_argument("Material #" + std::to_string(id) + " already exists");
+            }
+            if (id != 0) {
+                added.insert(id);
+                removed.erase(id);
+            }
+        } else if (!exists) {
+            throw std::invalid_argument("Supplier has no material #" + std::to_string(id));
+        } else if (change.kind == MaterialChange::UPDATE_PRICE) {
+            if (change.price < 0) {
+                throw std::invalid_argument("Price cannot be negative");
+            }
+        } else {
+            removed.insert(id);
+            added.erase(id);
+        }
+    }
+    
+    CatalogDelta applied;
+    applied.supplierBulstat = bulstat.str();
+    applied.baseVersion = catalogVersion;
+    applied.changes.reserve(changes.size());
+    
+    for (size_t i = 0; i < changes.size(); ++i) {
+        MaterialChange change = changes[i];
+        switch (change.kind) {
+            case MaterialChange::ADD_MATERIAL:
+                addMaterial(change.material);
+                change.material = materials.back();
+                change.materialId = change.material.getId();
+                break;
+            case MaterialChange::UPDATE_PRICE: {
+                OpticalMaterial& material = materials.mutableAt(findMaterial(change.materialId));
+                material.setPrice(change.price);
+                material.setVersion(material.getVersion() + 1);
+                break;
+            }
+            case MaterialChange::REMOVE_MATERIAL:
+                removeMaterialAt(findMaterial(change.materialId));
+                break;
+        }
+        applied.changes.push_back(change);
+    }
+    
+    if (!changes.empty()) {
+        ++catalogVersion;
+        touch();
+    }
+    return applied;
+}
+
+std::string Supplier::renderMaterials() const {
+    std::ostringstream out;
     if (materials.empty()) {
-        std::cout << "No materials available from this supplier." << std::endl;
-        return;
+        out << "No materials available from this supplier.\n";
+        return out.str();
     }
     
-    std::cout << "\nAvailable materials:" << std::endl;
-    std::cout << std::string(80, '-') << std::endl;
+    out << "\nAvailable materials:\n";
+    out << std::string(80, '-') << "\n";
     for (size_t i = 0; i < materials.size(); ++i) {
-        std::cout << "[" << (i + 1) << "] " << materials[i] << std::endl;
+        out << "[" << (i + 1) << "] #" << materials[i].getId() << " " << materials[i];
+        int onHand = getStock(materials[i].getId());
+        if (onHand != UNTRACKED_STOCK) {
+            out << ", In stock: " << onHand;
+        }
+        out << "\n";
+    }
+    out << std::string(80, '-') << "\n";
+    return out.str();
+}
+
+void Supplier::displayMaterials() const {
+    METRIC_TIMER(METRIC_RENDER_MATERIALS);
+    // Redraws of an unchanged catalog are a copy out of the render cache
+    std::string text;
+    if (!RenderCache::shared().find(RenderCache::VIEW_SUPPLIER_MATERIALS, revision, text)) {
+        text = renderMaterials();
+        RenderCache::shared().store(RenderCache::VIEW_SUPPLIER_MATERIALS, revision, text);
     }
-    std::cout << std::string(80, '-') << std::endl;
+    std::cout << text;
 }
 
 int Supplier::getMaterialCount() const {
@@ -165,14 +343,109 @@ OpticalMaterial Supplier::getMaterial(int index) const {
     return materials[index];
 }
 
+void Supplier::addMemoryUsage(MemoryUsage& usage) const {
+    usage.suppliers.bytes += name.heapBytes() + memory::vectorBytes(stock);
+    usage.materials.count += materials.size();
+    usage.materials.bytes += materials.memoryBytes() + memory::vectorBytes(materialPositions);
+    for (size_t i = 0; i < materials.size(); ++i) {
+        usage.materials.bytes += materials[i].heapBytes();
+    }
+}
+
+int Supplier::getStock(unsigned int materialId) const {
+    std::vector<StockLevel>::const_iterator level = findStock(materialId);
+    return level != stock.end() ? level->onHand : UNTRACKED_STOCK;
+}
+
+bool Supplier::tracksStock() const {
+    return !stock.empty();
+}
+
+void Supplier::setStock(unsigned int materialId, int onHand) {
+    if (findMaterial(materialId) == -1) {
+        throw std::invalid_argument("Supplier has no material #" + std::to_string(materialId));
+    }
+    if (onHand < UNTRACKED_STOCK) {
+        throw std::invalid_argument("Stock cannot be negative");
+    }
+    
+    std::vector<StockLevel>::iterator level = findStock(materialId);
+    if (onHand == UNTRACKED_STOCK) {
+        if (level != stock.end()) {
+            stock.erase(level);
+        }
+    } else if (level != stock.end()) {
+        level->onHand = onHand;
+    } else {
+        stock.insert(std::lower_bound(stock.begin(), stock.end(), materialId, byMaterialId),
+                     StockLevel(materialId, onHand));
+    }
+    touch();
+}
+
+void Supplier::reserveStock(const std::vector<std::pair<unsigned int, int> >& lines) {
+    // Lines of the same material add up; sorting brings them together
+    std::vector<std::pair<unsigned int, int> > requested(lines);
+    std::sort(requested.begin(), requested.end());
+    size_t merged = 0;
+    for (size_t i = 0; i < requested.size(); ++i) {
+        if (merged > 0 && requested[merged - 1].first == requested[i].first) {
+            requested[merged - 1].second += requested[i].second;
+        } else {
+            requested[merged++] = requested[i];
+        }
+    }
+    requested.resize(merged);
+    
+    // Check the whole order first so a short line leaves every level as it was
+    std::vector<std::vector<StockLevel>::iterator> levels(requested.size(), stock.end());
+    bool counted = false;
+    for (size_t i = 0; i < requested.size(); ++i) {
+        levels[i] = findStock(requested[i].first);
+        if (levels[i] == stock.end()) {
+            continue;
+        }
+        if (requested[i].second > levels[i]->onHand) {
+            throw InsufficientStockError("Not enough stock of material #" + std::to_string(requested[i].first) +
+                                         ": " + std::to_string(requested[i].second) + " requested, " +
+                                         std::to_string(levels[i]->onHand) + " on hand");
+        }
+        counted = true;
+    }
+    if (!counted) {
+        return;
+    }
+    
+    for (size_t i = 0; i < requested.size(); ++i) {
+        if (levels[i] != stock.end()) {
+            levels[i]->onHand -= requested[i].second;
+        }
+    }
+    touch();
+}
+
+void Supplier::releaseStock(const std::vector<std::pair<unsigned int, int> >& lines) {
+    bool changed = false;
+    for (size_t i = 0; i < lines.size(); ++i) {
+        std::vector<StockLevel>::iterator level = findStock(lines[i].first);
+        if (level != stock.end()) {
+            level->onHand += lines[i].second;
+            changed = true;
+        }
+    }
+    if (changed) {
+        touch();
+    }
+}
+
 std::ostream& operator<<(std::ostream& os, const Supplier& supplier) {
     os << "\n" << std::string(80, '=') << std::endl;
     os << "Supplier Information:" << std::endl;
     os << std::string(80, '=') << std::endl;
-    os << "Bulstat: " << supplier.bulstat << std::endl;
-    os << "Name: " << supplier.name << std::endl;
-    os << "Location: " << supplier.location << std::endl;
-    os << "Phone: " << supplier.phoneNumber << std::endl;
+    os << "Bulstat: " << supplier.getBulstat() << std::endl;
+    os << "Name: " << supplier.getName() << std::endl;
+    os << "Location: " << supplier.getLocation() << std::endl;
+    os << "Phone: " << supplier.getPhoneNumber() << std::endl;
     os << "Number of materials: " << supplier.materials.size() << std::endl;
     os << std::string(80, '=') << std::endl;
     return os;
@@ -222,32 +495,12 @@ std::istream& operator>>(std::istream& is, Supplier& supplier) {
 }
 
 void Supplier::saveToFile(std::ostream& os) const {
-    os << bulstat << "\n"
-       << name << "\n"
-       << location << "\n"
-       << phoneNumber << "\n"
-       << materials.size() << "\n";
-    
-    for (const auto& material : materials) {
-        material.saveToFile(os);
-    }
+    std::string text;
+    TextWriter(text).write(*this);
+    os.write(text.data(), static_cast<std::streamsize>(text.size()));
 }
 
-void Supplier::loadFromFile(std::istream& is) {
-    std::getline(is, bulstat);
-    std::getline(is, name);
-    std::getline(is, location);
-    std::getline(is, phoneNumber);
-    
-    size_t materialCount;
-    is >> materialCount;
-    is.ignore();
-    
-    materials.clear();
-    for (size_t i = 0; i < materialCount; ++i) {
-        OpticalMaterial material;
-        material.loadFromFile(is);
-        materials.push_back(material);
-    }
+void Supplier::loadFromFile(std::istream& is, int formatVersion) {
+    StreamLines lines(is);
+    TextReader<StreamLines>(lines, formatVersion).read(*this);
 }
-
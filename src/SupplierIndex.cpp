@@ -0,0 +1,417 @@
+#include "SupplierIndex.h"
+#include "MemoryUsage.h"
+#include "Metrics.h"
+#include "Codecs.h"
+#include <algorithm>
+#include <cctype>
+#include <stdexcept>
+
+namespace {
+
+const double EXACT_SCORE = 3.0;
+const double PREFIX_SCORE = 2.0;
+const double FUZZY_SCORE = 1.0;
+const double LOCATION_WEIGHT = 0.6;
+
+// Per-thread scratch buffers so a query does not allocate and zero
+// supplier-sized arrays every time; concurrent readers stay independent.
+struct SearchScratch {
+    std::vector<double> totals;
+    std::vector<double> termScores;
+    std::vector<size_t> matchedTerms;
+    std::vector<int> sharedGrams;
+    std::vector<int> touched;
+    std::vector<int> touchedTokens;
+};
+
+thread_local SearchScratch scratch;
+
+void saveLookup(BinaryWriter& writer, const std::unordered_map<std::string, int>& lookup) {
+    writer.field("Entries", static_cast<unsigned int>(lookup.size()));
+    for (std::unordered_map<std::string, int>::const_iterator it = lookup.begin(); it != lookup.end(); ++it) {
+        writer.field("Key", it->first);
+        writer.field("Supplier", it->second);
+    }
+}
+
+void loadLookup(BinaryReader& reader, std::unordered_map<std::string, int>& lookup) {
+    unsigned int count = 0;
+    reader.field("Entries", count);
+    lookup.reserve(count);
+    std::string key;
+    int supplierIndex = 0;
+    for (unsigned int i = 0; i < count; ++i) {
+        reader.field("Key", key);
+        reader.field("Supplier", supplierIndex);
+        lookup[key] = supplierIndex;
+    }
+}
+
+bool betterMatch(const SupplierMatch& a, const SupplierMatch& b) {
+    if (a.score != b.score) {
+        return a.score > b.score;
+    }
+    return a.supplierIndex < b.supplierIndex;
+}
+
+}
+
+SupplierIndex::SupplierIndex() : supplierCount(0) {}
+
+std::vector<std::string> SupplierIndex::tokenize(const std::string& text) {
+    std::vector<std::string> result;
+    std::string current;
+    for (size_t i = 0; i < text.size(); ++i) {
+        unsigned char c = static_cast<unsigned char>(text[i]);
+        // Non-ASCII bytes (e.g. Cyrillic UTF-8) are kept as word characters
+        if (c >= 0x80 || ::isalnum(c)) {
+            current.push_back(static_cast<char>(c < 0x80 ? ::tolower(c) : c));
+        } else if (!current.empty()) {
+            result.push_back(current);
+            current.clear();
+        }
+    }
+    if (!current.empty()) {
+        result.push_back(current);
+    }
+    return result;
+}
+
+std::vector<uint32_t> SupplierIndex::trigramsOf(const std::string& token) {
+    // Padded so that short tokens and word starts still produce grams
+    std::string padded = "  " + token + " ";
+    std::vector<uint32_t> result;
+    for (size_t i = 0; i + 3 <= padded.size(); ++i) {
+        result.push_back((static_cast<uint32_t>(static_cast<unsigned char>(padded[i])) << 16) |
+                         (static_cast<uint32_t>(static_cast<unsigned char>(padded[i + 1])) << 8) |
+                         static_cast<uint32_t>(static_cast<unsigned char>(padded[i + 2])));
+    }
+    std::sort(result.begin(), result.end());
+    result.erase(std::unique(result.begin(), result.end()), result.end());
+    return result;
+}
+
+int SupplierIndex::boundedDistance(const std::string& a, const std::string& b, int limit) {
+    int lengthGap = static_cast<int>(a.size()) - static_cast<int>(b.size());
+    if (lengthGap > limit || -lengthGap > limit) {
+        return limit + 1;
+    }
+
+    std::vector<int> previous(b.size() + 1), current(b.size() + 1);
+    for (size_t j = 0; j <= b.size(); ++j) {
+        previous[j] = static_cast<int>(j);
+    }
+    for (size_t i = 1; i <= a.size(); ++i) {
+        current[0] = static_cast<int>(i);
+        int rowBest = current[0];
+        for (size_t j = 1; j <= b.size(); ++j) {
+            int substitution = previous[j - 1] + (a[i - 1] == b[j - 1] ? 0 : 1);
+            current[j] = std::min(std::min(previous[j] + 1, current[j - 1] + 1), substitution);
+            rowBest = std::min(rowBest, current[j]);
+        }
+        if (rowBest > limit) {
+            return limit + 1;
+        }
+        previous.swap(current);
+    }
+    return previous[b.size()];
+}
+
+void SupplierIndex::addToken(const std::string& token, int supplierIndex, Field field) {
+    std::map<std::string, int>::iterator entry = tokenIds.find(token);
+    if (entry == tokenIds.end()) {
+        int tokenId = static_cast<int>(tokenText.size());
+        entry = tokenIds.insert(std::make_pair(token, tokenId)).first;
+        tokenText.push_back(token);
+        postings.push_back(std::vector<Posting>());
+        std::vector<uint32_t> grams = trigramsOf(token);
+        for (size_t i = 0; i < grams.size(); ++i) {
+            trigrams[grams[i]].push_back(tokenId);
+        }
+    }
+    Posting posting;
+    posting.supplierIndex = supplierIndex;
+    posting.field = static_cast<unsigned char>(field);
+    postings[entry->second].push_back(posting);
+}
+
+void SupplierIndex::add(int supplierIndex, const Supplier& supplier) {
+    byBulstat[supplier.getBulstat()] = supplierIndex;
+    byPhone[supplier.getPhoneNumber()] = supplierIndex;
+
+    std::vector<std::string> nameTokens = tokenize(supplier.getName());
+    for (size_t i = 0; i < nameTokens.size(); ++i) {
+        addToken(nameTokens[i], supplierIndex, NAME_FIELD);
+    }
+    std::vector<std::string> locationTokens = tokenize(supplier.getLocation());
+    for (size_t i = 0; i < locationTokens.size(); ++i) {
+        addToken(locationTokens[i], supplierIndex, LOCATION_FIELD);
+    }
+    ++supplierCount;
+}
+
+void SupplierIndex::removeLast(const Supplier& supplier) {
+    if (supplierCount == 0) {
+        throw std::logic_error("Supplier index is empty");
+    }
+    int supplierIndex = static_cast<int>(supplierCount - 1);
+    std::unordered_map<std::string, int>::iterator bulstat = byBulstat.find(supplier.getBulstat());
+    if (bulstat == byBulstat.end() || bulstat->second != supplierIndex) {
+        throw std::logic_error("Supplier " + supplier.getBulstat() + " was not added last");
+    }
+    byBulstat.erase(bulstat);
+    std::unordered_map<std::string, int>::iterator phone = byPhone.find(supplier.getPhoneNumber());
+    if (phone != byPhone.end() && phone->second == supplierIndex) {
+        byPhone.erase(phone);
+    }
+
+    std::vector<std::string> tokens = tokenize(supplier.getName());
+    std::vector<std::string> locationTokens = tokenize(supplier.getLocation());
+    tokens.insert(tokens.end(), locationTokens.begin(), locationTokens.end());
+    for (size_t i = 0; i < tokens.size(); ++i) {
+        std::map<std::string, int>::const_iterator entry = tokenIds.find(tokens[i]);
+        if (entry == tokenIds.end()) {
+            continue;
+        }
+        // The newest supplier's postings are at the end of every list
+        std::vector<Posting>& list = postings[entry->second];
+        while (!list.empty() && list.back().supplierIndex == supplierIndex) {
+            list.pop_back();
+        }
+    }
+    --supplierCount;
+}
+
+void SupplierIndex::clear() {
+    byBulstat.clear();
+    byPhone.clear();
+    tokenIds.clear();
+    tokenText.clear();
+    postings.clear();
+    trigrams.clear();
+    supplierCount = 0;
+}
+
+size_t SupplierIndex::size() const {
+    return supplierCount;
+}
+
+size_t SupplierIndex::memoryBytes() const {
+    size_t bytes = memory::hashMapBytes(byBulstat) + memory::hashMapBytes(byPhone) +
+                   memory::treeMapBytes(tokenIds) + memory::vectorBytes(tokenText) +
+                   memory::vectorBytes(postings) + memory::hashMapBytes(trigrams);
+    for (std::unordered_map<std::string, int>::const_iterator it = byBulstat.begin(); it != byBulstat.end(); ++it) {
+        bytes += memory::stringBytes(it->first);
+    }
+    for (std::unordered_map<std::string, int>::const_iterator it = byPhone.begin(); it != byPhone.end(); ++it) {
+        bytes += memory::stringBytes(it->first);
+    }
+    // Every token is held twice: as a dictionary key and in tokenText
+    for (size_t i = 0; i < tokenText.size(); ++i) {
+        bytes += 2 * memory::stringBytes(tokenText[i]) + memory::vectorBytes(postings[i]);
+    }
+    for (std::unordered_map<uint32_t, std::vector<int> >::const_iterator it = trigrams.begin();
+         it != trigrams.end(); ++it) {
+        bytes += memory::vectorBytes(it->second);
+    }
+    return bytes;
+}
+
+void SupplierIndex::save(BinaryWriter& writer) const {
+    writer.field("Suppliers", static_cast<unsigned int>(supplierCount));
+    saveLookup(writer, byBulstat);
+    saveLookup(writer, byPhone);
+    // In dictionary order, so load() appends to the ordered map
+    writer.field("Tokens", static_cast<unsigned int>(tokenText.size()));
+    for (std::map<std::string, int>::const_iterator it = tokenIds.begin(); it != tokenIds.end(); ++it) {
+        writer.field("Token", it->first);
+        writer.field("Token id", it->second);
+        const std::vector<Posting>& list = postings[it->second];
+        writer.field("Postings", static_cast<unsigned int>(list.size()));
+        for (size_t i = 0; i < list.size(); ++i) {
+            // Supplier and field in one number
+            writer.field("Posting", static_cast<unsigned int>(list[i].supplierIndex) * 2 + list[i].field);
+        }
+    }
+}
+
+void SupplierIndex::load(BinaryReader& reader) {
+    clear();
+    unsigned int count = 0;
+    reader.field("Suppliers", count);
+    supplierCount = count;
+    loadLookup(reader, byBulstat);
+    loadLookup(reader, byPhone);
+
+    unsigned int tokenCount = 0;
+    reader.field("Tokens", tokenCount);
+    tokenText.resize(tokenCount);
+    postings.resize(tokenCount);
+    std::string token;
+    for (unsigned int i = 0; i < tokenCount; ++i) {
+        unsigned int tokenId = 0, postingCount = 0;
+        reader.field("Token", token);
+        reader.field("Token id", tokenId);
+        if (tokenId >= tokenCount || !tokenText[tokenId].empty()) {
+            throw std::runtime_error("Invalid token id in a supplier index");
+        }
+        tokenIds.insert(tokenIds.end(), std::make_pair(token, static_cast<int>(tokenId)));
+        tokenText[tokenId] = token;
+
+        reader.field("Postings", postingCount);
+        std::vector<Posting>& list = postings[tokenId];
+        list.resize(postingCount);
+        for (unsigned int j = 0; j < postingCount; ++j) {
+            unsigned int packed = 0;
+            reader.field("Posting", packed);
+            list[j].supplierIndex = static_cast<int>(packed / 2);
+            list[j].field = static_cast<unsigned char>(packed % 2);
+        }
+    }
+
+    // Recomputed from the distinct tokens, in token id order as add() left them
+    for (size_t tokenId = 0; tokenId < tokenText.size(); ++tokenId) {
+        std::vector<uint32_t> grams = trigramsOf(tokenText[tokenId]);
+        for (size_t i = 0; i < grams.size(); ++i) {
+            trigrams[grams[i]].push_back(static_cast<int>(tokenId));
+        }
+    }
+}
+
+int SupplierIndex::findByBulstat(const std::string& bulstat) const {
+    std::unordered_map<std::string, int>::const_iterator found = byBulstat.find(bulstat);
+    return found == byBulstat.end() ? -1 : found->second;
+}
+
+int SupplierIndex::findByPhone(const std::string& phoneNumber) const {
+    std::unordered_map<std::string, int>::const_iterator found = byPhone.find(phoneNumber);
+    return found == byPhone.end() ? -1 : found->second;
+}
+
+void SupplierIndex::scoreToken(int tokenId, double base, std::vector<double>& termScores,
+                               std::vector<int>& touched) const {
+    const std::vector<Posting>& list = postings[tokenId];
+    for (size_t i = 0; i < list.size(); ++i) {
+        double score = list[i].field == NAME_FIELD ? base : base * LOCATION_WEIGHT;
+        double& best = termScores[list[i].supplierIndex];
+        if (best == 0.0) {
+            touched.push_back(list[i].supplierIndex);
+        }
+        best = std::max(best, score);
+    }
+}
+
+void SupplierIndex::matchTerm(const std::string& term, std::vector<double>& termScores,
+                              std::vector<int>& touched) const {
+    // Prefix matches (including the exact token) from the ordered dictionary
+    std::map<std::string, int>::const_iterator it = tokenIds.lower_bound(term);
+    for (; it != tokenIds.end() && it->first.compare(0, term.size(), term) == 0; ++it) {
+        double base = it->first.size() == term.size() ? EXACT_SCORE : PREFIX_SCORE;
+        scoreToken(it->second, base, termScores, touched);
+    }
+
+    // Close spellings: candidates share trigrams, then edit distance decides.
+    // Very short words are too ambiguous for typo matching.
+    int limit = term.size() <= 2 ? 0 : (term.size() <= 5 ? 1 : 2);
+    if (limit == 0) {
+        return;
+    }
+
+    std::vector<uint32_t> grams = trigramsOf(term);
+    std::vector<int>& shared = scratch.sharedGrams;
+    std::vector<int>& candidates = scratch.touchedTokens;
+    if (shared.size() < tokenText.size()) {
+        shared.resize(tokenText.size(), 0);
+    }
+    candidates.clear();
+    for (size_t i = 0; i < grams.size(); ++i) {
+        std::unordered_map<uint32_t, std::vector<int> >::const_iterator bucket = trigrams.find(grams[i]);
+        if (bucket == trigrams.end()) {
+            continue;
+        }
+        for (size_t j = 0; j < bucket->second.size(); ++j) {
+            int tokenId = bucket->second[j];
+            if (shared[tokenId]++ == 0) {
+                candidates.push_back(tokenId);
+            }
+        }
+    }
+
+    int requiredShared = std::max(1, static_cast<int>(grams.size()) - 3 * limit);
+    for (size_t i = 0; i < candidates.size(); ++i) {
+        int tokenId = candidates[i];
+        bool close = shared[tokenId] >= requiredShared;
+        shared[tokenId] = 0;
+        if (!close) {
+            continue;
+        }
+        int distance = boundedDistance(term, tokenText[tokenId], limit);
+        if (distance == 0 || distance > limit) {
+            continue;
+        }
+        scoreToken(tokenId, FUZZY_SCORE / distance, termScores, touched);
+    }
+}
+
+std::vector<SupplierMatch> SupplierIndex::search(const std::string& query, size_t limit) const {
+    METRIC_TIMER(METRIC_SUPPLIER_SEARCH);
+    std::vector<SupplierMatch> matches;
+    std::vector<std::string> terms = tokenize(query);
+
+    if (terms.empty()) {
+        for (size_t i = 0; i < supplierCount && i < limit; ++i) {
+            SupplierMatch match;
+            match.supplierIndex = static_cast<int>(i);
+            match.score = 0.0;
+            matches.push_back(match);
+        }
+        return matches;
+    }
+
+    // Every query word has to match; scores add up across words
+    std::vector<double>& totals = scratch.totals;
+    std::vector<double>& termScores = scratch.termScores;
+    std::vector<size_t>& matchedTerms = scratch.matchedTerms;
+    std::vector<int>& touched = scratch.touched;
+    if (totals.size() < supplierCount) {
+        totals.resize(supplierCount, 0.0);
+        termScores.resize(supplierCount, 0.0);
+        matchedTerms.resize(supplierCount, 0);
+    }
+    
+    // Suppliers matched by the previous word; only they can still qualify
+    std::vector<int> candidates;
+    for (size_t t = 0; t < terms.size(); ++t) {
+        touched.clear();
+        matchTerm(terms[t], termScores, touched);
+        for (size_t i = 0; i < touched.size(); ++i) {
+            int supplier = touched[i];
+            if (matchedTerms[supplier] == t) {
+                totals[supplier] += termScores[supplier];
+                matchedTerms[supplier] = t + 1;
+            }
+            termScores[supplier] = 0.0;
+        }
+        if (t == 0) {
+            candidates = touched;
+        }
+    }
+
+    for (size_t i = 0; i < candidates.size(); ++i) {
+        int supplier = candidates[i];
+        if (matchedTerms[supplier] == terms.size()) {
+            SupplierMatch match;
+            match.supplierIndex = supplier;
+            match.score = totals[supplier];
+            matches.push_back(match);
+        }
+        // Leave the scratch buffers zeroed for the next query
+        totals[supplier] = 0.0;
+        matchedTerms[supplier] = 0;
+    }
+
+    size_t keep = std::min(limit, matches.size());
+    std::partial_sort(matches.begin(), matches.begin() + keep, matches.end(), betterMatch);
+    matches.resize(keep);
+    return matches;
+}
@@ -0,0 +1,324 @@
+#include "TaskScheduler.h"
+#include <algorithm>
+#include <stdexcept>
+#include <cstdlib>
+
+const size_t TaskScheduler::MAX_WORKER_COUNT;
+const size_t TaskScheduler::PIECES_PER_WORKER;
+
+namespace {
+    // The scheduler whose pool runs this thread, and the thread's queue
+    thread_local TaskScheduler* currentScheduler = 0;
+    thread_local size_t currentQueue = 0;
+}
+
+size_t TaskScheduler::configuredWorkerCount() {
+    const char* requested = std::getenv("OPTICAL_THREADS");
+    if (requested) {
+        long count = std::strtol(requested, 0, 10);
+        if (count >= 1 && count <= static_cast<long>(MAX_WORKER_COUNT)) {
+            return static_cast<size_t>(count);
+        }
+    }
+    return std::max(1u, std::thread::hardware_concurrency());
+}
+
+TaskScheduler& TaskScheduler::instance() {
+    static TaskScheduler scheduler;
+    return scheduler;
+}
+
+TaskScheduler::TaskScheduler(size_t workerCount) : queued(0), idleWorkers(0), idleWaiters(0), stopping(false) {
+    workerCount = std::max<size_t>(1, std::min(workerCount, MAX_WORKER_COUNT));
+    for (size_t i = 0; i < workerCount; ++i) {
+        queues.push_back(std::unique_ptr<Queue>(new Queue()));
+    }
+    for (size_t i = 1; i < workerCount; ++i) {
+        threads.push_back(std::thread(&TaskScheduler::workerLoop, this, i));
+    }
+}
+
+TaskScheduler::~TaskScheduler() {
+    {
+        std::lock_guard<std::mutex> lock(sleepMutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    finished.notify_all();
+    for (size_t i = 0; i < threads.size(); ++i) {
+        threads[i].join();
+    }
+}
+
+size_t TaskScheduler::getWorkerCount() const {
+    return queues.size();
+}
+
+size_t TaskScheduler::ownQueue() const {
+    return currentScheduler == this ? currentQueue : 0;
+}
+
+void TaskScheduler::submit(const std::function<void()>& task, TaskGroup* group) {
+    Job job;
+    job.run = task;
+    job.group = group;
+    {
+        Queue& queue = *queues[ownQueue()];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        queue.jobs.push_back(job);
+    }
+    ++queued;
+    // A sleeper counts itself before checking queued, so it either sees
+    // this job or is woken here. An idle pool thread is enough; waiters
+    // are woken to help only when the whole pool is busy.
+    if (idleWorkers.load() > 0) {
+        std::lock_guard<std::mutex> lock(sleepMutex);
+        wake.notify_one();
+    } else if (idleWaiters.load() > 0) {
+        std::lock_guard<std::mutex> lock(sleepMutex);
+        finished.notify_all();
+    }
+}
+
+bool TaskScheduler::takeJob(Job& job) {
+    if (queued.load() == 0) {
+        return false;
+    }
+    // Newest own task first (its data is still in cache), then the oldest
+    // task of every other queue in turn
+    size_t self = ownQueue();
+    if (self != 0) {
+        Queue& queue = *queues[self];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if (!queue.jobs.empty()) {
+            job = queue.jobs.back();
+            queue.jobs.pop_back();
+            --queued;
+            return true;
+        }
+    }
+    for (size_t i = 1; i <= queues.size(); ++i) {
+        size_t victim = (self + i) % queues.size();
+        if (victim == self && self != 0) {
+            continue;
+        }
+        Queue& queue = *queues[victim];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if (!queue.jobs.empty()) {
+            job = queue.jobs.front();
+            queue.jobs.pop_front();
+            --queued;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool TaskScheduler::runOne() {
+    Job job;
+    if (!takeJob(job)) {
+        return false;
+    }
+    std::exception_ptr error;
+    try {
+        job.run();
+    } catch (...) {
+        error = std::current_exception();
+    }
+    job.group->finish(error);
+    return true;
+}
+
+void TaskScheduler::waitForGroup(TaskGroup& group) {
+    std::unique_lock<std::mutex> lock(sleepMutex);
+    ++idleWaiters;
+    finished.wait(lock, [&]() { return stopping || queued.load() > 0 || group.pending.load() == 0; });
+    --idleWaiters;
+}
+
+void TaskScheduler::groupFinished() {
+    std::lock_guard<std::mutex> lock(sleepMutex);
+    finished.notify_all();
+}
+
+void TaskScheduler::workerLoop(size_t index) {
+    currentScheduler = this;
+    currentQueue = index;
+    for (;;) {
+        if (runOne()) {
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(sleepMutex);
+        if (stopping && queued.load() == 0) {
+            return;
+        }
+        ++idleWorkers;
+        wake.wait(lock, [this]() { return stopping || queued.load() > 0; });
+        --idleWorkers;
+    }
+}
+
+void TaskScheduler::forEach(size_t count, const std::function<void(size_t)>& task) {
+    if (count == 0) {
+        return;
+    }
+    TaskGroup group(*this);
+    for (size_t i = 1; i < count; ++i) {
+        group.run([&task, i]() { task(i); });
+    }
+    // The caller takes the first task itself rather than sitting idle
+    try {
+        task(0);
+    } catch (...) {
+        // The other tasks still use task
+        group.waitIdle();
+        throw;
+    }
+    group.wait();
+}
+
+std::vector<TaskScheduler::Range> TaskScheduler::split(size_t begin, size_t end, size_t grain) const {
+    std::vector<Range> pieces;
+    if (begin >= end) {
+        return pieces;
+    }
+    size_t length = end - begin;
+    size_t maxPieces = queues.size() == 1 ? 1 : queues.size() * PIECES_PER_WORKER;
+    size_t count = std::min(maxPieces, (length + std::max<size_t>(grain, 1) - 1) / std::max<size_t>(grain, 1));
+    count = std::max<size_t>(count, 1);
+    size_t size = (length + count - 1) / count;
+    for (size_t first = begin; first < end; first += size) {
+        pieces.push_back(Range(first, std::min(end, first + size)));
+    }
+    return pieces;
+}
+
+void TaskScheduler::parallelFor(size_t begin, size_t end, size_t grain,
+                                const std::function<void(size_t, size_t)>& body) {
+    std::vector<Range> pieces = split(begin, end, grain);
+    if (pieces.size() == 1) {
+        body(pieces[0].first, pieces[0].second);
+        return;
+    }
+    forEach(pieces.size(), [&](size_t piece) {
+        body(pieces[piece].first, pieces[piece].second);
+    });
+}
+
+TaskGroup::TaskGroup(TaskScheduler& scheduler) : scheduler(scheduler), pending(0) {}
+
+TaskGroup::~TaskGroup() {
+    waitIdle();
+}
+
+void TaskGroup::run(const std::function<void()>& task) {
+    ++pending;
+    scheduler.submit(task, this);
+}
+
+void TaskGroup::finish(std::exception_ptr error) {
+    if (error) {
+        std::lock_guard<std::mutex> lock(failureMutex);
+        if (!failure) {
+            failure = error;
+        }
+    }
+    // The waiter may destroy the group as soon as pending reaches zero
+    TaskScheduler& owner = scheduler;
+    if (--pending == 0) {
+        owner.groupFinished();
+    }
+}
+
+void TaskGroup::waitIdle() {
+    while (pending.load() > 0) {
+        if (!scheduler.runOne()) {
+            scheduler.waitForGroup(*this);
+        }
+    }
+}
+
+void TaskGroup::wait() {
+    waitIdle();
+    std::lock_guard<std::mutex> lock(failureMutex);
+    if (failure) {
+        std::exception_ptr error = failure;
+        failure = std::exception_ptr();
+        std::rethrow_exception(error);
+    }
+}
+
+bool TaskGroup::failed() {
+    std::lock_guard<std::mutex> lock(failureMutex);
+    return static_cast<bool>(failure);
+}
+
+TaskGraph::TaskId TaskGraph::add(const std::function<void()>& task) {
+    Node node;
+    node.task = task;
+    node.predecessors = 0;
+    nodes.push_back(node);
+    return nodes.size() - 1;
+}
+
+void TaskGraph::precede(TaskId before, TaskId after) {
+    if (before >= nodes.size() || after >= nodes.size()) {
+        throw std::out_of_range("Unknown task in task graph");
+    }
+    nodes[before].successors.push_back(after);
+    ++nodes[after].predecessors;
+}
+
+size_t TaskGraph::size() const {
+    return nodes.size();
+}
+
+void TaskGraph::run(TaskScheduler& scheduler) {
+    // Every task must be reachable in dependency order before any starts
+    std::vector<size_t> waiting(nodes.size());
+    std::vector<TaskId> ready;
+    for (TaskId id = 0; id < nodes.size(); ++id) {
+        waiting[id] = nodes[id].predecessors;
+        if (waiting[id] == 0) {
+            ready.push_back(id);
+        }
+    }
+    std::vector<TaskId> roots(ready);
+    size_t ordered = 0;
+    while (!ready.empty()) {
+        TaskId id = ready.back();
+        ready.pop_back();
+        ++ordered;
+        for (size_t i = 0; i < nodes[id].successors.size(); ++i) {
+            if (--waiting[nodes[id].successors[i]] == 0) {
+                ready.push_back(nodes[id].successors[i]);
+            }
+        }
+    }
+    if (ordered != nodes.size()) {
+        throw std::logic_error("Task graph has a cycle");
+    }
+
+    std::unique_ptr<std::atomic<size_t>[]> remaining(new std::atomic<size_t>[nodes.size()]);
+    for (TaskId id = 0; id < nodes.size(); ++id) {
+        remaining[id].store(nodes[id].predecessors);
+    }
+
+    TaskGroup group(scheduler);
+    std::function<void(TaskId)> start = [&](TaskId id) {
+        group.run([&, id]() {
+            nodes[id].task();
+            // The last predecessor to finish releases a task
+            for (size_t i = 0; i < nodes[id].successors.size(); ++i) {
+                TaskId next = nodes[id].successors[i];
+                if (--remaining[next] == 0 && !group.failed()) {
+                    start(next);
+                }
+            }
+        });
+    };
+    for (size_t i = 0; i < roots.size(); ++i) {
+        start(roots[i]);
+    }
+    group.wait();
+}
@@ -0,0 +1,386 @@
+#include "Transaction.h"
+#include <map>
+#include <stdexcept>
+
+const size_t EditHistory::DEFAULT_LIMIT;
+
+namespace {
+
+StoreEdit supplierEdit(StoreEdit::Kind kind, const Supplier& supplier) {
+    StoreEdit edit;
+    edit.kind = kind;
+    edit.supplier = supplier;
+    return edit;
+}
+
+StoreEdit orderEdit(StoreEdit::Kind kind, const Order& order) {
+    StoreEdit edit;
+    edit.kind = kind;
+    edit.order = order;
+    return edit;
+}
+
+StoreEdit stockEdit(const std::string& bulstat, unsigned int materialId, int onHand) {
+    StoreEdit edit;
+    edit.kind = StoreEdit::SET_STOCK;
+    edit.supplierBulstat = bulstat;
+    edit.materialId = materialId;
+    edit.onHand = onHand;
+    return edit;
+}
+
+StoreEdit deltaEdit(const std::string& bulstat, const std::vector<MaterialChange>& changes) {
+    StoreEdit edit;
+    edit.kind = StoreEdit::CATALOG_DELTA;
+    edit.supplierBulstat = bulstat;
+    edit.changes = changes;
+    return edit;
+}
+
+}
+
+Transaction::Transaction(DataStore& store, const std::string& description)
+    : store(store), open(true) {
+    batch.description = description;
+}
+
+Transaction::~Transaction() {
+    if (open) {
+        try {
+            rollback();
+        } catch (...) {
+            // Nothing more can be undone while unwinding
+        }
+    }
+}
+
+void Transaction::checkOpen() const {
+    if (!open) {
+        throw std::logic_error("Transaction is already committed or rolled back");
+    }
+}
+
+void Transaction::record(const StoreEdit& edit, const std::vector<StoreEdit>& inverse) {
+    if (!open) {
+        return;
+    }
+    batch.edits.push_back(edit);
+    batch.inverses.insert(batch.inverses.end(), inverse.rbegin(), inverse.rend());
+}
+
+void Transaction::perform(const StoreEdit& edit) {
+    switch (edit.kind) {
+        case StoreEdit::ADD_SUPPLIER:
+            performAddSupplier(edit.supplier);
+            break;
+        case StoreEdit::REMOVE_SUPPLIER:
+            performRemoveSupplier(edit.supplier.getBulstat());
+            break;
+        case StoreEdit::ADD_ORDER:
+            performAddOrder(edit.order);
+            break;
+        case StoreEdit::REMOVE_ORDER:
+            performRemoveOrder(edit.order);
+            break;
+        case StoreEdit::CANCEL_ORDER:
+            performCancelOrder(edit.order);
+            break;
+        case StoreEdit::REINSTATE_ORDER:
+            performReinstateOrder(edit.order);
+            break;
+        case StoreEdit::SET_STOCK:
+            performSetStock(edit.supplierBulstat, edit.materialId, edit.onHand);
+            break;
+        case StoreEdit::CATALOG_DELTA:
+            performCatalogDelta(edit.supplierBulstat, edit.changes);
+            break;
+    }
+}
+
+void Transaction::performAddSupplier(const Supplier& supplier) {
+    store.addSupplier(supplier);
+    record(supplierEdit(StoreEdit::ADD_SUPPLIER, supplier),
+           std::vector<StoreEdit>(1, supplierEdit(StoreEdit::REMOVE_SUPPLIER, supplier)));
+}
+
+void Transaction::performRemoveSupplier(const std::string& bulstat) {
+    int supplierIndex = store.findSupplier(bulstat);
+    if (supplierIndex == -1) {
+        throw std::invalid_argument("No supplier with BULSTAT " + bulstat);
+    }
+    // Materials and stock may have changed since it was added
+    Supplier removed = store.getSupplier(supplierIndex);
+    store.removeLastSupplier(bulstat);
+    record(supplierEdit(StoreEdit::REMOVE_SUPPLIER, removed),
+           std::vector<StoreEdit>(1, supplierEdit(StoreEdit::ADD_SUPPLIER, removed)));
+}
+
+bool Transaction::performAddOrder(const Order& order) {
+    if (!store.addOrder(order)) {
+        return false;
+    }
+    record(orderEdit(StoreEdit::ADD_ORDER, order),
+           std::vector<StoreEdit>(1, orderEdit(StoreEdit::REMOVE_ORDER, order)));
+    return true;
+}
+
+void Transaction::performRemoveOrder(const Order& order) {
+    store.removeOrder(order);
+    record(orderEdit(StoreEdit::REMOVE_ORDER, order),
+           std::vector<StoreEdit>(1, orderEdit(StoreEdit::ADD_ORDER, order)));
+}
+
+void Transaction::performCancelOrder(const Order& order) {
+    store.cancelOrder(order);
+    record(orderEdit(StoreEdit::CANCEL_ORDER, order),
+           std::vector<StoreEdit>(1, orderEdit(StoreEdit::REINSTATE_ORDER, order)));
+}
+
+void Transaction::performReinstateOrder(const Order& order) {
+    store.reinstateOrder(order);
+    record(orderEdit(StoreEdit::REINSTATE_ORDER, order),
+           std::vector<StoreEdit>(1, orderEdit(StoreEdit::CANCEL_ORDER, order)));
+}
+
+void Transaction::performSetStock(const std::string& bulstat, unsigned int materialId, int onHand) {
+    int supplierIndex = store.findSupplier(bulstat);
+    if (supplierIndex == -1) {
+        throw std::invalid_argument("No supplier with BULSTAT " + bulstat);
+    }
+    int previous = store.getSupplier(supplierIndex).getStock(materialId);
+    store.setStock(supplierIndex, materialId, onHand);
+    record(stockEdit(bulstat, materialId, onHand),
+           std::vector<StoreEdit>(1, stockEdit(bulstat, materialId, previous)));
+}
+
+CatalogDelta Transaction::performCatalogDelta(const std::string& bulstat,
+                                              const std::vector<MaterialChange>& changes) {
+    int supplierIndex = store.findSupplier(bulstat);
+    if (supplierIndex == -1) {
+        throw std::invalid_argument("No supplier with BULSTAT " + bulstat);
+    }
+
+    // The materials the changes touch, as they are now
+    std::map<unsigned int, OpticalMaterial> current;
+    std::map<unsigned int, int> stockBefore;
+    {
+        const Supplier& supplier = store.getSupplier(supplierIndex);
+        for (size_t i = 0; i < changes.size(); ++i) {
+            unsigned int id = changes[i].materialId;
+            int position = changes[i].kind == MaterialChange::ADD_MATERIAL ? -1 : supplier.findMaterial(id);
+            if (position != -1 && !current.count(id)) {
+                current[id] = supplier.getMaterials()[position];
+                stockBefore[id] = supplier.getStock(id);
+            }
+        }
+    }
+
+    CatalogDelta applied = store.applyCatalogDelta(supplierIndex, changes);
+
+    // Follow the applied changes forward; each one's opposite is taken
+    // back in reverse
+    std::vector<MaterialChange> undoChanges;
+    std::vector<StoreEdit> restoredStock;
+    for (size_t i = 0; i < applied.changes.size(); ++i) {
+        const MaterialChange& change = applied.changes[i];
+        MaterialChange opposite;
+        opposite.materialId = change.materialId;
+        switch (change.kind) {
+            case MaterialChange::ADD_MATERIAL:
+                opposite.kind = MaterialChange::REMOVE_MATERIAL;
+                current[change.materialId] = change.material;
+                break;
+            case MaterialChange::UPDATE_PRICE: {
+                OpticalMaterial& material = current[change.materialId];
+                opposite.kind = MaterialChange::UPDATE_PRICE;
+                opposite.price = material.getPrice();
+                material.setPrice(change.price);
+                material.setVersion(material.getVersion() + 1);
+                break;
+            }
+            case MaterialChange::REMOVE_MATERIAL: {
+                // Back under its own id and newest version
+                opposite.kind = MaterialChange::ADD_MATERIAL;
+                opposite.material = current[change.materialId];
+                current.erase(change.materialId);
+                std::map<unsigned int, int>::iterator level = stockBefore.find(change.materialId);
+                if (level != stockBefore.end()) {
+                    if (level->second != Supplier::UNTRACKED_STOCK) {
+                        restoredStock.push_back(stockEdit(bulstat, change.materialId, level->second));
+                    }
+                    stockBefore.erase(level);
+                }
+                break;
+            }
+        }
+        undoChanges.push_back(opposite);
+    }
+
+    if (!applied.changes.empty()) {
+        std::vector<StoreEdit> inverse(1, deltaEdit(bulstat, std::vector<MaterialChange>(undoChanges.rbegin(),
+                                                                                         undoChanges.rend())));
+        inverse.insert(inverse.end(), restoredStock.begin(), restoredStock.end());
+        record(deltaEdit(bulstat, applied.changes), inverse);
+    }
+    return applied;
+}
+
+void Transaction::addSupplier(const Supplier& supplier) {
+    checkOpen();
+    performAddSupplier(supplier);
+}
+
+void Transaction::addMaterial(int supplierIndex, const OpticalMaterial& material) {
+    MaterialChange change;
+    change.kind = MaterialChange::ADD_MATERIAL;
+    change.material = material;
+    applyCatalogDelta(supplierIndex, std::vector<MaterialChange>(1, change));
+}
+
+bool Transaction::addOrder(const Order& order) {
+    checkOpen();
+    return performAddOrder(order);
+}
+
+size_t Transaction::addOrders(const std::vector<Order>& newOrders, std::vector<std::string>* stockErrors) {
+    checkOpen();
+    std::vector<Order> added;
+    size_t count = store.addOrders(newOrders, stockErrors, &added);
+    for (size_t i = 0; i < added.size(); ++i) {
+        record(orderEdit(StoreEdit::ADD_ORDER, added[i]),
+               std::vector<StoreEdit>(1, orderEdit(StoreEdit::REMOVE_ORDER, added[i])));
+    }
+    return count;
+}
+
+void Transaction::cancelOrder(const Order& order) {
+    checkOpen();
+    performCancelOrder(order);
+}
+
+void Transaction::setStock(int supplierIndex, unsigned int materialId, int onHand) {
+    checkOpen();
+    performSetStock(store.getSupplier(supplierIndex).getBulstat(), materialId, onHand);
+}
+
+CatalogDelta Transaction::applyCatalogDelta(int supplierIndex, const std::vector<MaterialChange>& changes) {
+    checkOpen();
+    return performCatalogDelta(store.getSupplier(supplierIndex).getBulstat(), changes);
+}
+
+void Transaction::apply(const StoreEdit& edit) {
+    checkOpen();
+    perform(edit);
+}
+
+size_t Transaction::size() const {
+    return batch.edits.size();
+}
+
+bool Transaction::isOpen() const {
+    return open;
+}
+
+EditBatch Transaction::commit() {
+    checkOpen();
+    open = false;
+    return batch;
+}
+
+void Transaction::rollback() {
+    checkOpen();
+    // Closed first, so the inverses are not logged in turn
+    open = false;
+    bool failed = false;
+    std::string firstError;
+    for (size_t i = batch.inverses.size(); i > 0; --i) {
+        try {
+            perform(batch.inverses[i - 1]);
+        } catch (const std::exception& e) {
+            if (!failed) {
+                failed = true;
+                firstError = e.what();
+            }
+        }
+    }
+    batch.edits.clear();
+    batch.inverses.clear();
+    if (failed) {
+        throw std::runtime_error("Rollback was incomplete: " + firstError);
+    }
+}
+
+EditHistory::EditHistory(size_t limit) : limit(limit) {}
+
+void EditHistory::push(const EditBatch& batch) {
+    undoStack.push_back(batch);
+    if (undoStack.size() > limit) {
+        undoStack.pop_front();
+    }
+}
+
+void EditHistory::record(const EditBatch& batch) {
+    if (batch.edits.empty()) {
+        return;
+    }
+    push(batch);
+    redoStack.clear();
+}
+
+bool EditHistory::canUndo() const {
+    return !undoStack.empty();
+}
+
+bool EditHistory::canRedo() const {
+    return !redoStack.empty();
+}
+
+const std::string& EditHistory::nextUndo() const {
+    if (undoStack.empty()) {
+        throw std::logic_error("Nothing to undo");
+    }
+    return undoStack.back().description;
+}
+
+const std::string& EditHistory::nextRedo() const {
+    if (redoStack.empty()) {
+        throw std::logic_error("Nothing to redo");
+    }
+    return redoStack.back().description;
+}
+
+std::string EditHistory::undo(DataStore& store) {
+    if (undoStack.empty()) {
+        throw std::logic_error("Nothing to undo");
+    }
+    const EditBatch& batch = undoStack.back();
+    Transaction transaction(store, batch.description);
+    for (size_t i = batch.inverses.size(); i > 0; --i) {
+        transaction.apply(batch.inverses[i - 1]);
+    }
+    transaction.commit();
+    // Replaying the edits as they were applied redoes the batch
+    redoStack.push_back(batch);
+    undoStack.pop_back();
+    return redoStack.back().description;
+}
+
+std::string EditHistory::redo(DataStore& store) {
+    if (redoStack.empty()) {
+        throw std::logic_error("Nothing to redo");
+    }
+    const EditBatch& batch = redoStack.back();
+    Transaction transaction(store, batch.description);
+    for (size_t i = 0; i < batch.edits.size(); ++i) {
+        transaction.apply(batch.edits[i]);
+    }
+    // The redone batch carries inverses taken from the store as it is now
+    push(transaction.commit());
+    redoStack.pop_back();
+    return undoStack.back().description;
+}
+
+void EditHistory::clear() {
+    undoStack.clear();
+    redoStack.clear();
+}
@@ -0,0 +1,328 @@
+#include "Validation.h"
+#include "TaskScheduler.h"
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <cstdint>
+#include <stdexcept>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define VALIDATION_SIMD 1
+#endif
+
+namespace {
+
+// Batch checks are split into scheduler tasks of this many values
+const size_t VALUES_PER_TASK = 4096;
+
+const char* const BULSTAT_EMPTY = "Bulstat cannot be empty";
+const char* const BULSTAT_NOT_DIGITS = "Bulstat must contain only digits";
+const char* const BULSTAT_LENGTH = "Bulstat must be 9 or 13 digits";
+const char* const PHONE_EMPTY = "Phone number cannot be empty";
+const char* const PHONE_PLUS = "Phone number: '+' can only appear at the start";
+const char* const PHONE_INVALID = "Phone number contains invalid characters";
+const char* const PHONE_TOO_SHORT = "Phone number must contain at least 7 digits";
+const char* const PHONE_TOO_LONG = "Phone number cannot contain more than 15 digits";
+const char* const PHONE_PLUS_NO_DIGITS = "Phone number starting with '+' must contain digits";
+const char* const PHONE_NO_DIGITS = "Phone number must contain at least one digit";
+
+const char* bulstatLengthError(size_t length) {
+    return (length != 9 && length != 13) ? BULSTAT_LENGTH : 0;
+}
+
+const char* phoneCountError(int digitCount, bool startsWithPlus) {
+    // Validate digit count (E.164 standard: 7-15 digits)
+    if (digitCount < 7) {
+        return PHONE_TOO_SHORT;
+    }
+    if (digitCount > 15) {
+        return PHONE_TOO_LONG;
+    }
+    if (startsWithPlus && digitCount == 0) {
+        return PHONE_PLUS_NO_DIGITS;
+    }
+    if (digitCount == 0) {
+        return PHONE_NO_DIGITS;
+    }
+    return 0;
+}
+
+#ifdef VALIDATION_SIMD
+
+struct CharClasses {
+    uint32_t digits;
+    uint32_t plus;
+    uint32_t formatting;
+};
+
+// Classifiers for one block of WIDTH bytes; bit i describes byte i
+struct Sse42 {
+    static const size_t WIDTH = 16;
+
+    __attribute__((target("sse4.2")))
+    static CharClasses classify(const char* block) {
+        const int MODE = _SIDD_UBYTE_OPS | _SIDD_BIT_MASK;
+        const __m128i DIGIT_RANGE = _mm_setr_epi8('0', '9', 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0);
+        const __m128i FORMATTING = _mm_setr_epi8('-', ' ', '(', ')', '.', 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0);
+        __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(block));
+        CharClasses classes;
+        classes.digits = static_cast<uint32_t>(
+            _mm_cvtsi128_si32(_mm_cmpestrm(DIGIT_RANGE, 2, bytes, 16, MODE | _SIDD_CMP_RANGES)));
+        classes.formatting = static_cast<uint32_t>(
+            _mm_cvtsi128_si32(_mm_cmpestrm(FORMATTING, 5, bytes, 16, MODE | _SIDD_CMP_EQUAL_ANY)));
+        classes.plus = static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(bytes, _mm_set1_epi8('+'))));
+        return classes;
+    }
+};
+
+struct Avx2 {
+    static const size_t WIDTH = 32;
+
+    __attribute__((target("avx2")))
+    static CharClasses classify(const char* block) {
+        __m256i bytes = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(block));
+        __m256i isDigit = _mm256_and_si256(_mm256_cmpgt_epi8(bytes, _mm256_set1_epi8('0' - 1)),
+                                           _mm256_cmpgt_epi8(_mm256_set1_epi8('9' + 1), bytes));
+        __m256i isPlus = _mm256_cmpeq_epi8(bytes, _mm256_set1_epi8('+'));
+        __m256i isFormat = _mm256_or_si256(
+            _mm256_or_si256(_mm256_cmpeq_epi8(bytes, _mm256_set1_epi8('-')),
+                            _mm256_cmpeq_epi8(bytes, _mm256_set1_epi8(' '))),
+            _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(bytes, _mm256_set1_epi8('(')),
+                                            _mm256_cmpeq_epi8(bytes, _mm256_set1_epi8(')'))),
+                            _mm256_cmpeq_epi8(bytes, _mm256_set1_epi8('.'))));
+        CharClasses classes;
+        classes.digits = static_cast<uint32_t>(_mm256_movemask_epi8(isDigit));
+        classes.plus = static_cast<uint32_t>(_mm256_movemask_epi8(isPlus));
+        classes.formatting = static_cast<uint32_t>(_mm256_movemask_epi8(isFormat));
+        return classes;
+    }
+};
+
+// Points block at the WIDTH bytes starting at offset and returns the mask
+// of lanes that hold real characters; a short tail is copied to padded
+template <size_t WIDTH>
+uint32_t loadBlock(const std::string& value, size_t offset, const char*& block, char* padded) {
+    size_t remaining = value.size() - offset;
+    if (remaining >= WIDTH) {
+        block = value.data() + offset;
+        return 0xFFFFFFFFu >> (32 - WIDTH);
+    }
+    std::memset(padded, 0, WIDTH);
+    std::memcpy(padded, value.data() + offset, remaining);
+    block = padded;
+    return (1u << remaining) - 1;
+}
+
+// The scans are flattened into the target-specific batch loops below, so
+// each is compiled once per instruction set; the rest of the program keeps
+// the baseline target and runs on any CPU
+template <typename Classifier>
+inline const char* simdBulstat(const std::string& value) {
+    if (value.empty()) {
+        return BULSTAT_EMPTY;
+    }
+    char padded[Classifier::WIDTH];
+    for (size_t offset = 0; offset < value.size(); offset += Classifier::WIDTH) {
+        const char* block;
+        uint32_t lanes = loadBlock<Classifier::WIDTH>(value, offset, block, padded);
+        if ((Classifier::classify(block).digits & lanes) != lanes) {
+            return BULSTAT_NOT_DIGITS;
+        }
+    }
+    return bulstatLengthError(value.size());
+}
+
+template <typename Classifier>
+inline const char* simdPhone(const std::string& value) {
+    if (value.empty()) {
+        return PHONE_EMPTY;
+    }
+    char padded[Classifier::WIDTH];
+    int digitCount = 0;
+    for (size_t offset = 0; offset < value.size(); offset += Classifier::WIDTH) {
+        const char* block;
+        uint32_t lanes = loadBlock<Classifier::WIDTH>(value, offset, block, padded);
+        CharClasses classes = Classifier::classify(block);
+
+        uint32_t misplacedPlus = classes.plus & lanes;
+        if (offset == 0) {
+            misplacedPlus &= ~1u;
+        }
+        uint32_t invalid = lanes & ~(classes.digits | classes.plus | classes.formatting);
+        uint32_t problems = misplacedPlus | invalid;
+        if (problems) {
+            // The scalar loop reports whichever problem comes first
+            uint32_t first = problems & (0u - problems);
+            return (first & misplacedPlus) ? PHONE_PLUS : PHONE_INVALID;
+        }
+        digitCount += __builtin_popcount(classes.digits & lanes);
+    }
+    return phoneCountError(digitCount, value[0] == '+');
+}
+
+__attribute__((target("sse4.2,popcnt"), flatten))
+void sse42Bulstats(const std::string* values, const char** errors, size_t count) {
+    for (size_t i = 0; i < count; ++i) {
+        errors[i] = simdBulstat<Sse42>(values[i]);
+    }
+}
+
+__attribute__((target("sse4.2,popcnt"), flatten))
+void sse42Phones(const std::string* values, const char** errors, size_t count) {
+    for (size_t i = 0; i < count; ++i) {
+        errors[i] = simdPhone<Sse42>(values[i]);
+    }
+}
+
+__attribute__((target("avx2,popcnt"), flatten))
+void avx2Bulstats(const std::string* values, const char** errors, size_t count) {
+    for (size_t i = 0; i < count; ++i) {
+        errors[i] = simdBulstat<Avx2>(values[i]);
+    }
+}
+
+__attribute__((target("avx2,popcnt"), flatten))
+void avx2Phones(const std::string* values, const char** errors, size_t count) {
+    for (size_t i = 0; i < count; ++i) {
+        errors[i] = simdPhone<Avx2>(values[i]);
+    }
+}
+
+#endif
+
+void scalarBulstats(const std::string* values, const char** errors, size_t count) {
+    for (size_t i = 0; i < count; ++i) {
+        errors[i] = Validation::checkBulstat(values[i]);
+    }
+}
+
+void scalarPhones(const std::string* values, const char** errors, size_t count) {
+    for (size_t i = 0; i < count; ++i) {
+        errors[i] = Validation::checkPhoneNumber(values[i]);
+    }
+}
+
+// Batch loops over a range of values, one pair per instruction set
+struct Kernel {
+    const char* name;
+    void (*bulstats)(const std::string* values, const char** errors, size_t count);
+    void (*phones)(const std::string* values, const char** errors, size_t count);
+};
+
+const Kernel SCALAR_KERNEL = { "scalar", scalarBulstats, scalarPhones };
+#ifdef VALIDATION_SIMD
+const Kernel SSE42_KERNEL = { "sse4.2", sse42Bulstats, sse42Phones };
+const Kernel AVX2_KERNEL = { "avx2", avx2Bulstats, avx2Phones };
+#endif
+
+bool cpuHas(ValidationKernel kernel) {
+#ifdef VALIDATION_SIMD
+    static const bool popcnt = __builtin_cpu_supports("popcnt");
+    static const bool sse42 = popcnt && __builtin_cpu_supports("sse4.2");
+    static const bool avx2 = popcnt && __builtin_cpu_supports("avx2");
+    if (kernel == VALIDATION_SSE42) {
+        return sse42;
+    }
+    if (kernel == VALIDATION_AVX2) {
+        return avx2;
+    }
+#endif
+    return kernel == VALIDATION_SCALAR;
+}
+
+// The widest kernel the CPU runs, checked once
+ValidationKernel bestKernel() {
+    static const ValidationKernel best = cpuHas(VALIDATION_AVX2) ? VALIDATION_AVX2
+                                       : cpuHas(VALIDATION_SSE42) ? VALIDATION_SSE42
+                                       : VALIDATION_SCALAR;
+    return best;
+}
+
+const Kernel& kernelFor(ValidationKernel kernel) {
+    if (kernel == VALIDATION_BEST) {
+        kernel = bestKernel();
+    }
+    if (!cpuHas(kernel)) {
+        throw std::invalid_argument("This CPU cannot run the requested validation kernel");
+    }
+#ifdef VALIDATION_SIMD
+    if (kernel == VALIDATION_AVX2) {
+        return AVX2_KERNEL;
+    }
+    if (kernel == VALIDATION_SSE42) {
+        return SSE42_KERNEL;
+    }
+#endif
+    return SCALAR_KERNEL;
+}
+
+}
+
+const char* Validation::checkBulstat(const std::string& bulstat) {
+    if (bulstat.empty()) {
+        return BULSTAT_EMPTY;
+    }
+
+    if (!std::all_of(bulstat.begin(), bulstat.end(), ::isdigit)) {
+        return BULSTAT_NOT_DIGITS;
+    }
+
+    return bulstatLengthError(bulstat.length());
+}
+
+const char* Validation::checkPhoneNumber(const std::string& phone) {
+    if (phone.empty()) {
+        return PHONE_EMPTY;
+    }
+
+    // Count digits and validate characters
+    int digitCount = 0;
+    bool startsWithPlus = false;
+    
+    for (size_t i = 0; i < phone.length(); ++i) {
+        char c = phone[i];
+        
+        if (::isdigit(c)) {
+            digitCount++;
+        } else if (c == '+') {
+            if (i == 0) {
+                startsWithPlus = true;
+            } else {
+                return PHONE_PLUS;
+            }
+        } else if (c != '-' && c != ' ' && c != '(' && c != ')' && c != '.') {
+            return PHONE_INVALID;
+        }
+    }
+
+    return phoneCountError(digitCount, startsWithPlus);
+}
+
+std::vector<const char*> Validation::checkBulstats(const std::vector<std::string>& values,
+                                                   ValidationKernel kernel) {
+    const Kernel& chosen = kernelFor(kernel);
+    std::vector<const char*> errors(values.size());
+    TaskScheduler::instance().parallelFor(0, values.size(), VALUES_PER_TASK, [&](size_t first, size_t last) {
+        chosen.bulstats(&values[first], &errors[first], last - first);
+    });
+    return errors;
+}
+
+std::vector<const char*> Validation::checkPhoneNumbers(const std::vector<std::string>& values,
+                                                       ValidationKernel kernel) {
+    const Kernel& chosen = kernelFor(kernel);
+    std::vector<const char*> errors(values.size());
+    TaskScheduler::instance().parallelFor(0, values.size(), VALUES_PER_TASK, [&](size_t first, size_t last) {
+        chosen.phones(&values[first], &errors[first], last - first);
+    });
+    return errors;
+}
+
+bool Validation::hasKernel(ValidationKernel kernel) {
+    return kernel == VALIDATION_BEST || cpuHas(kernel);
+}
+
+const char* Validation::kernelName(ValidationKernel kernel) {
+    return kernelFor(kernel).name;
+}
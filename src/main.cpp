@@ -4,38 +4,81 @@
 #include <limits>
 #include <iomanip>
 #include <cfloat>
+#include <climits>
 #include <string>
+#include <future>
+#include <chrono>
+#include <random>
+#include <cstdio>
+#include <cstdlib>
 #ifdef _WIN32
 #include <windows.h>
 #endif
 #include "OpticalMaterial.h"
 #include "Supplier.h"
 #include "Order.h"
+#include "DataStore.h"
+#include "DataFormat.h"
+#include "DataFile.h"
+#include "Validation.h"
+#include "Metrics.h"
+#include "OrderBatch.h"
+#include "ModelReflection.h"
+#include "TaskScheduler.h"
+#include "OrderExport.h"
+#include "Transaction.h"
+#include "DataPersistence.h"
+#include "PriceMatrix.h"
 
 // Function prototypes
 void displayMainMenu();
-void addSupplier(std::vector<Supplier>& suppliers);
-void addMaterialToSupplier(std::vector<Supplier>& suppliers);
-void displayAllSuppliers(const std::vector<Supplier>& suppliers);
-void displaySupplierDetails(const std::vector<Supplier>& suppliers);
-void createOrder(const std::vector<Supplier>& suppliers, std::vector<Order>& orders);
-void displayAllOrders(const std::vector<Order>& orders);
-void saveDataToFile(const std::vector<Supplier>& suppliers, const std::vector<Order>& orders);
-void loadDataFromFile(std::vector<Supplier>& suppliers, std::vector<Order>& orders);
-int selectSupplier(const std::vector<Supplier>& suppliers);
-bool bulstatExists(const std::vector<Supplier>& suppliers, const std::string& bulstat);
-bool phoneNumberExists(const std::vector<Supplier>& suppliers, const std::string& phoneNumber);
+void addSupplier(DataStore& store, EditHistory& history);
+void addMaterialToSupplier(DataStore& store, EditHistory& history);
+void displayAllSuppliers(const DataStore& store);
+void displaySupplierDetails(const DataStore& store);
+void createOrder(DataStore& store, EditHistory& history);
+void displayAllOrders(const DataStore& store);
+void browseOrderArchive(const DataStore& store);
+void importOrderBatch(DataStore& store, EditHistory& history);
+void applyPriceListUpdate(DataStore& store, EditHistory& history);
+void findNearestMaterials(const DataStore& store);
+void updateStockLevel(DataStore& store, EditHistory& history);
+void cancelOrder(DataStore& store, EditHistory& history);
+void exportOrders(const DataStore& store);
+void displayMemoryUsage(const DataStore& store);
+void undoLastChange(DataStore& store, EditHistory& history);
+void redoLastChange(DataStore& store, EditHistory& history);
+void displayDashboard(const DataStore& store);
+void exportPriceMatrix(const DataStore& store);
+bool keepPartialBatch(size_t applied, const std::string& what);
+void saveDataToFile(DataStore& store);
+void saveDataInBackground(DataStore& store, std::future<void>& pendingSave);
+void finishBackgroundSave(std::future<void>& pendingSave, bool wait);
+void loadDataFromFile(DataStore& store);
+int selectSupplier(const DataStore& store);
+void displayMetrics();
+void writeMetricsReport();
 void clearScreen();
 void pauseScreen();
 int getValidatedInt(const std::string& prompt, int min = INT_MIN, int max = INT_MAX);
 double getValidatedDouble(const std::string& prompt, double min = -DBL_MAX, double max = DBL_MAX);
+int runWorkload(size_t supplierCount);
 
-int main() {
+int main(int argc, char* argv[]) {
+    // Non-interactive synthetic session; make release-pgo trains with it
+    if (argc > 1 && std::string(argv[1]) == "--workload") {
+        const size_t DEFAULT_WORKLOAD_SUPPLIERS = 2000;
+        return runWorkload(argc > 2 ? std::strtoul(argv[2], 0, 10) : DEFAULT_WORKLOAD_SUPPLIERS);
+    }
+    
     try {
-        std::vector<Supplier> suppliers;
-        std::vector<Order> orders;
+        Metrics::configureFromEnvironment();
+        
+        DataStore store;
+        EditHistory history;
+        std::future<void> pendingSave;
         
-        loadDataFromFile(suppliers, orders);
+        loadDataFromFile(store);
         
         int choice;
         bool running = true;
@@ -46,38 +89,82 @@ int main() {
         std::cout << std::string(65, '=') << std::endl;
         
         while (running) {
+            finishBackgroundSave(pendingSave, false);
             displayMainMenu();
-            choice = getValidatedInt("Enter choice: ", 0, 8);
+            choice = getValidatedInt("Enter choice: ", 0, 21);
             
             try {
                 switch (choice) {
                     case 1:
-                        addSupplier(suppliers);
+                        addSupplier(store, history);
                         break;
                     case 2:
-                        addMaterialToSupplier(suppliers);
+                        addMaterialToSupplier(store, history);
                         break;
                     case 3:
-                        displayAllSuppliers(suppliers);
+                        displayAllSuppliers(store);
                         break;
                     case 4:
-                        displaySupplierDetails(suppliers);
+                        displaySupplierDetails(store);
                         break;
                     case 5:
-                        createOrder(suppliers, orders);
+                        createOrder(store, history);
                         break;
                     case 6:
-                        displayAllOrders(orders);
+                        displayAllOrders(store);
                         break;
                     case 7:
-                        saveDataToFile(suppliers, orders);
+                        saveDataInBackground(store, pendingSave);
                         break;
                     case 8:
-                        loadDataFromFile(suppliers, orders);
+                        finishBackgroundSave(pendingSave, true);
+                        loadDataFromFile(store);
+                        history.clear();
+                        break;
+                    case 9:
+                        browseOrderArchive(store);
+                        break;
+                    case 10:
+                        displayMetrics();
+                        break;
+                    case 11:
+                        importOrderBatch(store, history);
+                        break;
+                    case 12:
+                        applyPriceListUpdate(store, history);
+                        break;
+                    case 13:
+                        findNearestMaterials(store);
+                        break;
+                    case 14:
+                        updateStockLevel(store, history);
+                        break;
+                    case 15:
+                        cancelOrder(store, history);
+                        break;
+                    case 16:
+                        exportOrders(store);
+                        break;
+                    case 17:
+                        displayMemoryUsage(store);
+                        break;
+                    case 18:
+                        undoLastChange(store, history);
+                        break;
+                    case 19:
+                        redoLastChange(store, history);
+                        break;
+                    case 20:
+                        displayDashboard(store);
+                        break;
+                    case 21:
+                        exportPriceMatrix(store);
                         break;
                     case 0:
+                        finishBackgroundSave(pendingSave, true);
                         std::cout << "\nSaving data...\n";
-                        saveDataToFile(suppliers, orders);
+                        saveDataToFile(store);
+                        writeMetricsReport();
                         std::cout << "Thank you for using the system!\n";
                         running = false;
                         break;
@@ -118,11 +205,24 @@ void displayMainMenu() {
     std::cout << "6. Display All Orders" << std::endl;
     std::cout << "7. Save Data to File" << std::endl;
     std::cout << "8. Load Data from File" << std::endl;
+    std::cout << "9. Browse Order Archive" << std::endl;
+    std::cout << "10. Runtime Metrics" << std::endl;
+    std::cout << "11. Import Order Batch" << std::endl;
+    std::cout << "12. Apply Price List Update" << std::endl;
+    std::cout << "13. Find Nearest Materials" << std::endl;
+    std::cout << "14. Update Stock Level" << std::endl;
+    std::cout << "15. Cancel Order" << std::endl;
+    std::cout << "16. Export Orders" << std::endl;
+    std::cout << "17. Memory Usage" << std::endl;
+    std::cout << "18. Undo Last Change" << std::endl;
+    std::cout << "19. Redo Last Change" << std::endl;
+    std::cout << "20. Spend & Demand Dashboard" << std::endl;
+    std::cout << "21. Price Comparison Matrix" << std::endl;
     std::cout << "0. Exit" << std::endl;
     std::cout << std::string(65, '=') << std::endl;
 }
 
-void addSupplier(std::vector<Supplier>& suppliers) {
+void addSupplier(DataStore& store, EditHistory& history) {
     clearScreen();
     std::cout << "\n=== ADD SUPPLIER ===\n\n";
     
@@ -130,15 +230,9 @@ void addSupplier(std::vector<Supplier>& suppliers) {
         Supplier supplier;
         std::cin >> supplier;
         
-        if (bulstatExists(suppliers, supplier.getBulstat())) {
-            throw std::invalid_argument("A supplier with this BULSTAT already exists!");
-        }
-        
-        if (phoneNumberExists(suppliers, supplier.getPhoneNumber())) {
-            throw std::invalid_argument("A supplier with this phone number already exists!");
-        }
-        
-        suppliers.push_back(supplier);
+        Transaction transaction(store, "add supplier " + supplier.getName());
+        transaction.addSupplier(supplier);
+        history.record(transaction.commit());
         std::cout << "\n[OK] Supplier added successfully!\n";
     } catch (const std::exception& e) {
         std::cerr << "[ERROR] Error adding supplier: " 
@@ -148,10 +242,10 @@ void addSupplier(std::vector<Supplier>& suppliers) {
     pauseScreen();
 }
 
-void addMaterialToSupplier(std::vector<Supplier>& suppliers) {
+void addMaterialToSupplier(DataStore& store, EditHistory& history) {
     clearScreen();
     
-    if (suppliers.empty()) {
+    if (store.getSupplierCount() == 0) {
         std::cout << "\n[ERROR] No suppliers available! Add a supplier first.\n";
         pauseScreen();
         return;
@@ -159,7 +253,7 @@ void addMaterialToSupplier(std::vector<Supplier>& suppliers) {
     
     std::cout << "\n=== ADD MATERIAL ===\n\n";
     
-    int supplierIndex = selectSupplier(suppliers);
+    int supplierIndex = selectSupplier(store);
     if (supplierIndex == -1) {
         return;
     }
@@ -167,7 +261,9 @@ void addMaterialToSupplier(std::vector<Supplier>& suppliers) {
     try {
         OpticalMaterial material;
         std::cin >> material;
-        suppliers[supplierIndex].addMaterial(material);
+        Transaction transaction(store, "add material " + material.getMaterialName());
+        transaction.addMaterial(supplierIndex, material);
+        history.record(transaction.commit());
         std::cout << "\n[OK] Material added successfully!\n";
     } catch (const std::exception& e) {
         std::cerr << "[ERROR] Error adding material: " 
@@ -177,48 +273,49 @@ void addMaterialToSupplier(std::vector<Supplier>& suppliers) {
     pauseScreen();
 }
 
-void displayAllSuppliers(const std::vector<Supplier>& suppliers) {
+void displayAllSuppliers(const DataStore& store) {
     clearScreen();
     
-    if (suppliers.empty()) {
+    if (store.getSupplierCount() == 0) {
         std::cout << "\n[ERROR] No suppliers available!\n";
         pauseScreen();
         return;
     }
     
     std::cout << "\n=== ALL SUPPLIERS ===\n";
-    for (size_t i = 0; i < suppliers.size(); ++i) {
+    for (int i = 0; i < store.getSupplierCount(); ++i) {
         std::cout << "\n[" << (i + 1) << "] ";
-        std::cout << suppliers[i];
+        std::cout << store.getSupplier(i);
     }
     
     pauseScreen();
 }
 
-void displaySupplierDetails(const std::vector<Supplier>& suppliers) {
+void displaySupplierDetails(const DataStore& store) {
     clearScreen();
     
-    if (suppliers.empty()) {
+    if (store.getSupplierCount() == 0) {
         std::cout << "\n[ERROR] No suppliers available!\n";
         pauseScreen();
         return;
     }
     
-    int supplierIndex = selectSupplier(suppliers);
+    int supplierIndex = selectSupplier(store);
     if (supplierIndex == -1) {
         return;
     }
     
-    std::cout << suppliers[supplierIndex];
-    suppliers[supplierIndex].displayMaterials();
+    const Supplier& supplier = store.getSupplier(supplierIndex);
+    std::cout << supplier;
+    supplier.displayMaterials();
     
     pauseScreen();
 }
 
-void createOrder(const std::vector<Supplier>& suppliers, std::vector<Order>& orders) {
+void createOrder(DataStore& store, EditHistory& history) {
     clearScreen();
     
-    if (suppliers.empty()) {
+    if (store.getSupplierCount() == 0) {
         std::cout << "\n[ERROR] No suppliers available!\n";
         pauseScreen();
         return;
@@ -226,12 +323,12 @@ void createOrder(const std::vector<Supplier>& suppliers, std::vector<Order>& ord
     
     std::cout << "\n=== CREATE ORDER ===\n\n";
     
-    int supplierIndex = selectSupplier(suppliers);
+    int supplierIndex = selectSupplier(store);
     if (supplierIndex == -1) {
         return;
     }
     
-    const Supplier& selectedSupplier = suppliers[supplierIndex];
+    const Supplier selectedSupplier = store.getSupplier(supplierIndex);
     
     if (selectedSupplier.getMaterialCount() == 0) {
         std::cout << "\n[ERROR] This supplier has no available materials!\n";
@@ -258,18 +355,28 @@ void createOrder(const std::vector<Supplier>& suppliers, std::vector<Order>& ord
         int choice = getValidatedInt("\nChoice: ", 0, selectedSupplier.getMaterialCount());
         
         if (choice == 0) {
-            if (!order.isEmpty()) {
-                orders.push_back(order);
-                std::cout << "\n[OK] Order created successfully!\n";
-                std::cout << "Total: " << std::fixed << std::setprecision(2) 
-                          << order.getTotalPrice() << " BGN\n";
-            } else {
-                std::cout << "\n[ERROR] Order is empty and will not be saved.\n";
+            try {
+                Transaction transaction(store, "create order " + order.getOrderId());
+                if (order.isEmpty()) {
+                    std::cout << "\n[ERROR] Order is empty and will not be saved.\n";
+                } else if (!transaction.addOrder(order)) {
+                    std::cout << "\n[ERROR] An identical order was already placed at "
+                              << order.getOrderDate() << "; it was not added again.\n";
+                } else {
+                    history.record(transaction.commit());
+                    std::cout << "\n[OK] Order created successfully!\n";
+                    std::cout << "Order ID: " << order.getOrderId() << "\n";
+                    std::cout << "Total: " << std::fixed << std::setprecision(2) 
+                              << order.getTotalPrice() << " BGN\n";
+                }
+            } catch (const InsufficientStockError& e) {
+                std::cout << "\n[ERROR] " << e.what() << "; the order was not placed.\n";
             }
             addingItems = false;
         } else {
             try {
-                OpticalMaterial material = selectedSupplier.getMaterial(choice - 1);
+                std::shared_ptr<const OpticalMaterial> material = 
+                    store.resolveMaterial(supplierIndex, choice - 1);
                 int quantity = getValidatedInt("Quantity: ", 1, 10000);
                 order.addItem(material, quantity);
                 std::cout << "[OK] Material added to order!\n";
@@ -284,10 +391,12 @@ void createOrder(const std::vector<Supplier>& suppliers, std::vector<Order>& ord
     pauseScreen();
 }
 
-void displayAllOrders(const std::vector<Order>& orders) {
+void displayAllOrders(const DataStore& store) {
     clearScreen();
     
-    if (orders.empty()) {
+    std::vector<std::string> orders = store.renderOrders();
+    size_t archivedCount = store.getArchivedOrderCount();
+    if (orders.empty() && archivedCount == 0) {
         std::cout << "\n[ERROR] No orders available!\n";
         pauseScreen();
         return;
@@ -299,38 +408,195 @@ void displayAllOrders(const std::vector<Order>& orders) {
         std::cout << orders[i];
     }
     
+    if (archivedCount > 0) {
+        std::cout << "\n" << archivedCount 
+                  << " older order(s) are archived. Use 'Browse Order Archive' to view them.\n";
+    }
+    
     pauseScreen();
 }
 
-void saveDataToFile(const std::vector<Supplier>& suppliers, const std::vector<Order>& orders) {
-    try {
-        // Save suppliers
-        std::ofstream suppliersFile("suppliers.dat");
-        if (!suppliersFile) {
-            throw std::runtime_error("Cannot open suppliers file");
+void browseOrderArchive(const DataStore& store) {
+    clearScreen();
+    
+    std::vector<ArchiveSegment> segments = store.getArchiveSegments();
+    if (segments.empty()) {
+        std::cout << "\n[ERROR] The order archive is empty!\n";
+        pauseScreen();
+        return;
+    }
+    
+    std::cout << "\n=== ORDER ARCHIVE ===\n\n";
+    std::cout << std::left << std::setw(6) << "No."
+              << std::setw(10) << "Month"
+              << std::setw(10) << "Orders"
+              << std::setw(14) << "Raw bytes"
+              << std::setw(14) << "Stored bytes" << std::endl;
+    std::cout << std::string(65, '-') << std::endl;
+    for (size_t i = 0; i < segments.size(); ++i) {
+        std::cout << std::left << std::setw(6) << (i + 1)
+                  << std::setw(10) << segments[i].period
+                  << std::setw(10) << segments[i].orderCount
+                  << std::setw(14) << segments[i].rawBytes
+                  << std::setw(14) << segments[i].storedBytes << std::endl;
+    }
+    std::cout << std::string(65, '-') << std::endl;
+    
+    int choice = getValidatedInt("Select month (0 to go back): ", 0, 
+                                 static_cast<int>(segments.size()));
+    if (choice == 0) {
+        return;
+    }
+    
+    std::vector<Order> orders = store.loadArchivedOrders(segments[choice - 1].period);
+    for (size_t i = 0; i < orders.size(); ++i) {
+        std::cout << "\n[Order " << (i + 1) << "]";
+        std::cout << orders[i];
+    }
+    
+    pauseScreen();
+}
+
+void importOrderBatch(DataStore& store, EditHistory& history) {
+    const size_t MAX_ERRORS_SHOWN = 10;
+    
+    clearScreen();
+    std::cout << "\n=== IMPORT ORDER BATCH ===\n";
+    std::cout << "CSV lines: orderRef,bulstat,materialId,quantity\n";
+    std::cout << "Lines sharing an orderRef become one order. An orderRef already\n";
+    std::cout << "imported for the same supplier is skipped, so a batch can be re-run.\n\n";
+    std::cout << "CSV file path: ";
+    
+    std::string path;
+    if (!std::getline(std::cin, path) || path.empty()) {
+        std::cin.clear();
+        std::cout << "[ERROR] No file given!\n";
+        pauseScreen();
+        return;
+    }
+    
+    std::ifstream file(path.c_str());
+    if (!file) {
+        std::cout << "[ERROR] Cannot open " << path << "\n";
+        pauseScreen();
+        return;
+    }
+    
+    std::vector<std::string> errors;
+    std::vector<OrderBatchLine> lines = OrderBatch::parseCsv(file, errors);
+    OrderBatchResult result = OrderBatch::build(store, lines);
+    errors.insert(errors.end(), result.errors.begin(), result.errors.end());
+    
+    std::vector<std::string> stockErrors;
+    Transaction transaction(store, "import order batch " + path);
+    size_t added = transaction.addOrders(result.orders, &stockErrors);
+    errors.insert(errors.end(), stockErrors.begin(), stockErrors.end());
+    
+    std::cout << "\n[OK] Imported " << added << " order(s) from "
+              << result.acceptedLines << " line(s).\n";
+    if (added + stockErrors.size() < result.orders.size()) {
+        std::cout << "[OK] Skipped " << (result.orders.size() - added - stockErrors.size())
+                  << " order(s) that were already imported.\n";
+    }
+    if (!errors.empty()) {
+        std::cout << "[ERROR] " << (result.rejectedOrders + stockErrors.size()) << " order(s) rejected, "
+                  << errors.size() << " problem(s):\n";
+        for (size_t i = 0; i < errors.size() && i < MAX_ERRORS_SHOWN; ++i) {
+            std::cout << "  " << errors[i] << "\n";
         }
-        
-        suppliersFile << suppliers.size() << "\n";
-        for (const auto& supplier : suppliers) {
-            supplier.saveToFile(suppliersFile);
+        if (errors.size() > MAX_ERRORS_SHOWN) {
+            std::cout << "  ... and " << (errors.size() - MAX_ERRORS_SHOWN) << " more\n";
         }
-        suppliersFile.close();
-        
-        // Save orders
-        std::ofstream ordersFile("orders.dat");
-        if (!ordersFile) {
-            throw std::runtime_error("Cannot open orders file");
+    }
+    
+    if (errors.empty() || keepPartialBatch(added, "order(s)")) {
+        history.record(transaction.commit());
+    } else {
+        transaction.rollback();
+        std::cout << "[OK] The batch was rolled back; no orders were imported.\n";
+    }
+    
+    pauseScreen();
+}
+
+void applyPriceListUpdate(DataStore& store, EditHistory& history) {
+    const size_t MAX_ERRORS_SHOWN = 10;
+    
+    clearScreen();
+    std::cout << "\n=== APPLY PRICE LIST UPDATE ===\n";
+    std::cout << "CSV lines: bulstat,price,materialId,newPrice\n";
+    std::cout << "           bulstat,remove,materialId\n";
+    std::cout << "           bulstat,add,type,thickness,diopter,materialName,price\n\n";
+    std::cout << "CSV file path: ";
+    
+    std::string path;
+    if (!std::getline(std::cin, path) || path.empty()) {
+        std::cin.clear();
+        std::cout << "[ERROR] No file given!\n";
+        pauseScreen();
+        return;
+    }
+    
+    std::ifstream file(path.c_str());
+    if (!file) {
+        std::cout << "[ERROR] Cannot open " << path << "\n";
+        pauseScreen();
+        return;
+    }
+    
+    std::vector<std::string> errors;
+    std::vector<CatalogDelta> deltas = CatalogChangeLog::parseCsv(file, errors);
+    
+    size_t appliedChanges = 0;
+    size_t updatedSuppliers = 0;
+    Transaction transaction(store, "price list update " + path);
+    for (size_t i = 0; i < deltas.size(); ++i) {
+        int supplierIndex = store.findSupplier(deltas[i].supplierBulstat);
+        if (supplierIndex == -1) {
+            errors.push_back("unknown supplier BULSTAT " + deltas[i].supplierBulstat);
+            continue;
         }
-        
-        ordersFile << orders.size() << "\n";
-        for (const auto& order : orders) {
-            order.saveToFile(ordersFile);
+        try {
+            CatalogDelta applied = transaction.applyCatalogDelta(supplierIndex, deltas[i].changes);
+            appliedChanges += applied.changes.size();
+            ++updatedSuppliers;
+        } catch (const std::exception& e) {
+            errors.push_back("supplier " + deltas[i].supplierBulstat + ": " + e.what());
         }
-        ordersFile.close();
+    }
+    
+    std::cout << "\n[OK] Applied " << appliedChanges << " change(s) to "
+              << updatedSuppliers << " supplier(s).\n";
+    if (!errors.empty()) {
+        std::cout << "[ERROR] " << errors.size() << " problem(s); rejected suppliers were left unchanged:\n";
+        for (size_t i = 0; i < errors.size() && i < MAX_ERRORS_SHOWN; ++i) {
+            std::cout << "  " << errors[i] << "\n";
+        }
+        if (errors.size() > MAX_ERRORS_SHOWN) {
+            std::cout << "  ... and " << (errors.size() - MAX_ERRORS_SHOWN) << " more\n";
+        }
+    }
+    
+    if (errors.empty() || keepPartialBatch(appliedChanges, "change(s)")) {
+        history.record(transaction.commit());
+    } else {
+        transaction.rollback();
+        std::cout << "[OK] The update was rolled back; no prices were changed.\n";
+    }
+    
+    pauseScreen();
+}
+
+void saveDataToFile(DataStore& store) {
+    try {
+        store.archiveColdOrders();
+        DataPersistence::saveSnapshot(store.snapshot());
+        // Everything the log recorded is now in suppliers.dat
+        store.truncateChangeLogs();
         
         std::cout << "\n[OK] Data saved successfully!\n";
-        std::cout << "  Suppliers: " << suppliers.size() << "\n";
-        std::cout << "  Orders: " << orders.size() << "\n";
+        std::cout << "  Suppliers: " << store.getSupplierCount() << "\n";
+        std::cout << "  Orders: " << store.getOrderCount() << "\n";
     } catch (const std::exception& e) {
         std::cerr << "[ERROR] Error saving: " << e.what() << std::endl;
     }
@@ -338,103 +604,686 @@ void saveDataToFile(const std::vector<Supplier>& suppliers, const std::vector<Or
     pauseScreen();
 }
 
-void loadDataFromFile(std::vector<Supplier>& suppliers, std::vector<Order>& orders) {
+void saveDataInBackground(DataStore& store, std::future<void>& pendingSave) {
+    // Only one writer may touch the data files at a time
+    finishBackgroundSave(pendingSave, true);
+    
     try {
-        // Load suppliers
-        std::ifstream suppliersFile("suppliers.dat");
-        if (suppliersFile) {
-            size_t supplierCount;
-            suppliersFile >> supplierCount;
-            suppliersFile.ignore();
+        store.archiveColdOrders();
+    } catch (const std::exception& e) {
+        std::cerr << "[ERROR] Error archiving orders: " << e.what() << std::endl;
+    }
+    
+    DataSnapshot snapshot = store.snapshot();
+    pendingSave = std::async(std::launch::async, DataPersistence::saveSnapshot, snapshot);
+    
+    std::cout << "\n[OK] Snapshot taken, saving in background.\n";
+    std::cout << "  Suppliers: " << snapshot.supplierCount() << "\n";
+    std::cout << "  Orders: " << snapshot.orderCount() << "\n";
+    pauseScreen();
+}
+
+void finishBackgroundSave(std::future<void>& pendingSave, bool wait) {
+    if (!pendingSave.valid()) {
+        return;
+    }
+    if (!wait && pendingSave.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+        return;
+    }
+    
+    try {
+        pendingSave.get();
+        std::cout << "\n[OK] Background save completed.\n";
+    } catch (const std::exception& e) {
+        std::cerr << "[ERROR] Background save failed: " << e.what() << std::endl;
+    }
+}
+
+void loadDataFromFile(DataStore& store) {
+    try {
+        DataStore loaded(store.getShardCount());
+        bool ordersLoaded;
+        try {
+            ordersLoaded = DataPersistence::readFiles(loaded, false);
+        } catch (const std::exception& e) {
+            std::cerr << "[ERROR] The data files are damaged: " << e.what() << std::endl;
             
-            suppliers.clear();
-            int duplicateCount = 0;
-            for (size_t i = 0; i < supplierCount; ++i) {
-                Supplier supplier;
-                supplier.loadFromFile(suppliersFile);
-                
-                if (bulstatExists(suppliers, supplier.getBulstat())) {
-                    duplicateCount++;
-                    std::cerr << "Warning: Skipping duplicate supplier with BULSTAT: " 
-                              << supplier.getBulstat() << std::endl;
-                    continue;
-                }
-                
-                if (phoneNumberExists(suppliers, supplier.getPhoneNumber())) {
-                    duplicateCount++;
-                    std::cerr << "Warning: Skipping duplicate supplier with phone number: " 
-                              << supplier.getPhoneNumber() << std::endl;
-                    continue;
+            // Move the damaged set aside so the next save cannot rotate it
+            // over the backup we are about to load
+            bool backupExists = false;
+            for (size_t shard = 0; shard < loaded.getShardCount(); ++shard) {
+                std::vector<std::string> names = loaded.getShard(shard).getFiles().dataFiles();
+                for (size_t i = 0; i < names.size(); ++i) {
+                    std::string damaged = names[i] + ".damaged";
+                    std::remove(damaged.c_str());
+                    std::rename(names[i].c_str(), damaged.c_str());
+                    backupExists = backupExists || DataFile::exists(DataPersistence::filePath(names[i], true));
                 }
-                
-                suppliers.push_back(supplier);
             }
-            suppliersFile.close();
+            if (!backupExists) {
+                throw std::runtime_error("no previous save to recover from; "
+                                         "the damaged files were kept as *.dat.damaged");
+            }
             
-            if (duplicateCount > 0) {
-                std::cout << "\n⚠ Skipped " << duplicateCount 
-                          << " duplicate supplier(s) during load.\n";
+            loaded.clear();
+            ordersLoaded = DataPersistence::readFiles(loaded, true);
+            std::cout << "\n[OK] Recovered from the previous save (*.dat.bak); "
+                      << "the damaged files were kept as *.dat.damaged.\n";
+        }
+        
+        // The loaded shards take over as they are, indexes included
+        store.swap(loaded);
+        
+        // Only the hot month stays in memory; older months are sealed
+        store.loadArchiveManifests();
+        size_t recounted = store.rebuildMissingAggregates();
+        store.archiveColdOrders();
+        
+        if (recounted > 0) {
+            std::cout << "\n[OK] Recounted the order totals of " << recounted
+                      << " shard(s) saved without them.\n";
+        }
+        if (ordersLoaded) {
+            std::cout << "\n[OK] Data loaded successfully!\n";
+            std::cout << "  Suppliers: " << store.getSupplierCount() << "\n";
+            std::cout << "  Orders: " << store.getOrderCount() << "\n";
+            pauseScreen();
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "[ERROR] Error loading: " << e.what() << std::endl;
+        pauseScreen();
+    }
+}
+
+int runWorkload(size_t supplierCount) {
+    typedef std::chrono::steady_clock Clock;
+    const int ROUNDS = 3;
+    const int MATERIALS_PER_SUPPLIER = 6;
+    const int ORDERS_PER_SUPPLIER = 3;
+    const char* names[] = { "Optika", "Vision", "Lensa", "Fokus", "Zrenie" };
+    const char* cities[] = { "Sofia", "Plovdiv", "Varna", "Burgas", "Ruse" };
+    const char* types[] = { "Lens", "Contact lens", "Blank" };
+    const char* glasses[] = { "CR39", "Polycarbonate", "Trivex", "Crown glass" };
+    
+    auto elapsedMs = [](Clock::time_point since) {
+        return std::chrono::duration<double, std::milli>(Clock::now() - since).count();
+    };
+    
+    try {
+        if (supplierCount == 0) {
+            throw std::invalid_argument("--workload needs a supplier count above 0");
+        }
+        // It writes a full data set, so never over a real one
+        if (DataFile::exists("shards.idx") || DataFile::exists("suppliers.dat") ||
+            DataFile::exists("suppliers-s0.dat")) {
+            throw std::runtime_error("--workload must run in a directory without data files");
+        }
+        
+        DataStore store;
+        std::mt19937 random(2024);
+        
+        Clock::time_point start = Clock::now();
+        for (size_t i = 0; i < supplierCount; ++i) {
+            char bulstat[32], phone[32];
+            std::snprintf(bulstat, sizeof(bulstat), "%09lu", 100000000UL + static_cast<unsigned long>(i));
+            std::snprintf(phone, sizeof(phone), "08%08lu", static_cast<unsigned long>(i));
+            Supplier supplier(bulstat, std::string(names[i % 5]) + " " + std::to_string(i),
+                              cities[random() % 5], phone);
+            for (int m = 0; m < MATERIALS_PER_SUPPLIER; ++m) {
+                supplier.addMaterial(OpticalMaterial(types[random() % 3], 1.0 + (random() % 30) * 0.1,
+                                                     -6.0 + (random() % 49) * 0.25,
+                                                     glasses[random() % 4], 5.0 + (random() % 2000) * 0.05));
+            }
+            store.addSupplier(supplier);
+        }
+        
+        // Half the orders one line at a time as the menu builds them, the
+        // other half through the batch importer
+        std::vector<OrderBatchLine> lines;
+        for (size_t i = 0; i < supplierCount; ++i) {
+            const Supplier& supplier = store.getSupplier(static_cast<int>(i));
+            for (int o = 0; o < ORDERS_PER_SUPPLIER; ++o) {
+                int lineCount = 1 + static_cast<int>(random() % 4);
+                if (o % 2 == 0) {
+                    Order order(supplier);
+                    for (int l = 0; l < lineCount; ++l) {
+                        order.addItem(store.resolveMaterial(static_cast<int>(i),
+                                                            static_cast<int>(random() % MATERIALS_PER_SUPPLIER)),
+                                      1 + static_cast<int>(random() % 10));
+                    }
+                    store.addOrder(order);
+                } else {
+                    for (int l = 0; l < lineCount; ++l) {
+                        OrderBatchLine line;
+                        line.lineNumber = lines.size() + 1;
+                        line.orderRef = "W" + std::to_string(i) + "-" + std::to_string(o);
+                        line.supplierBulstat = supplier.getBulstat();
+                        line.materialId = supplier.getMaterials()[random() % MATERIALS_PER_SUPPLIER].getId();
+                        line.quantity = 1 + static_cast<int>(random() % 10);
+                        lines.push_back(line);
+                    }
+                }
             }
         }
+        std::vector<Order> batch = OrderBatch::build(store, lines).orders;
+        double buildMs = elapsedMs(start);
         
-        // Load orders
-        std::ifstream ordersFile("orders.dat");
-        if (ordersFile) {
-            size_t orderCount;
-            ordersFile >> orderCount;
-            ordersFile.ignore();
+        // Import the batch once and abort it, as the menu does on request
+        start = Clock::now();
+        int ordersBefore = store.getOrderCount();
+        Transaction rehearsal(store, "workload batch");
+        size_t rehearsed = rehearsal.addOrders(batch);
+        double importMs = elapsedMs(start);
+        start = Clock::now();
+        rehearsal.rollback();
+        double rollbackMs = elapsedMs(start);
+        if (store.getOrderCount() != ordersBefore) {
+            throw std::runtime_error("rolled back batch left orders behind");
+        }
+        
+        start = Clock::now();
+        store.addOrders(batch);
+        buildMs += elapsedMs(start);
+        
+        double saveMs = 0, loadMs = 0, searchMs = 0, renderMs = 0, dashboardMs = 0, scanMs = 0, matrixMs = 0;
+        for (int round = 0; round < ROUNDS; ++round) {
+            start = Clock::now();
+            DataPersistence::saveSnapshot(store.snapshot());
+            saveMs += elapsedMs(start);
             
-            orders.clear();
-            for (size_t i = 0; i < orderCount; ++i) {
-                Order order;
-                order.loadFromFile(ordersFile);
-                orders.push_back(order);
+            start = Clock::now();
+            DataStore loaded(store.getShardCount());
+            DataPersistence::readFiles(loaded, false);
+            loadMs += elapsedMs(start);
+            if (loaded.getSupplierCount() != store.getSupplierCount() ||
+                loaded.getOrderCount() != store.getOrderCount()) {
+                throw std::runtime_error("reloaded data does not match what was saved");
+            }
+            AggregateTotals totals = loaded.orderTotals();
+            if (totals.orderCount != store.orderTotals().orderCount ||
+                totals.amountUnits != store.orderTotals().amountUnits) {
+                throw std::runtime_error("reloaded order totals do not match what was saved");
             }
-            ordersFile.close();
             
-            std::cout << "\n[OK] Data loaded successfully!\n";
-            std::cout << "  Suppliers: " << suppliers.size() << "\n";
-            std::cout << "  Orders: " << orders.size() << "\n";
-            pauseScreen();
+            // The dashboard from the running totals, against counting the
+            // same figures from every order as it would have to otherwise
+            start = Clock::now();
+            loaded.orderTotals();
+            loaded.topSuppliers(10);
+            loaded.topMaterials(10);
+            loaded.recentDays(7);
+            dashboardMs += elapsedMs(start);
+            start = Clock::now();
+            DataSnapshot orders = loaded.snapshot();
+            OrderAggregates recounted;
+            for (size_t shard = 0; shard < orders.shards.size(); ++shard) {
+                for (size_t i = 0; i < orders.shards[shard].orders.size(); ++i) {
+                    if (!orders.shards[shard].orders[i].isCancelled()) {
+                        recounted.add(orders.shards[shard].orders[i]);
+                    }
+                }
+            }
+            recounted.allSupplierSpend();
+            recounted.allMaterialDemand();
+            recounted.recentDays(7);
+            scanMs += elapsedMs(start);
+            if (recounted.getOverall().amountUnits != totals.amountUnits) {
+                throw std::runtime_error("order totals do not match the orders");
+            }
+            
+            start = Clock::now();
+            for (size_t q = 0; q < supplierCount && q < 200; ++q) {
+                std::string query = std::string(names[q % 5]).substr(0, 3 + q % 3) + " " + cities[q % 5];
+                loaded.searchSuppliers(query, 10);
+            }
+            searchMs += elapsedMs(start);
+            
+            start = Clock::now();
+            loaded.renderOrders();
+            renderMs += elapsedMs(start);
+            
+            start = Clock::now();
+            PriceMatrix::exportMatrix(loaded, "price-matrix.csv", MATRIX_WIDE);
+            matrixMs += elapsedMs(start);
         }
+        
+        std::cout << std::fixed << std::setprecision(1);
+        std::cout << "[OK] Workload: " << store.getSupplierCount() << " suppliers, "
+                  << store.getOrderCount() << " orders, " << store.getShardCount() << " shard(s)\n";
+        std::cout << "  Build:  " << buildMs << " ms\n";
+        std::cout << "  Save:   " << saveMs / ROUNDS << " ms per round\n";
+        std::cout << "  Load:   " << loadMs / ROUNDS << " ms per round\n";
+        std::cout << "  Search: " << searchMs / ROUNDS << " ms per round\n";
+        std::cout << "  Render: " << renderMs / ROUNDS << " ms per round\n";
+        std::cout << "  Matrix: " << matrixMs / ROUNDS << " ms per round\n";
+        std::cout << "  Dashboard: " << dashboardMs / ROUNDS << " ms from the totals, "
+                  << scanMs / ROUNDS << " ms counting the orders\n";
+        std::cout << "  Batch of " << rehearsed << " orders: " << importMs << " ms to import, "
+                  << rollbackMs << " ms to roll back\n";
+        std::cout << "\n" << store.memoryUsage().report();
+        return 0;
     } catch (const std::exception& e) {
-        std::cerr << "[ERROR] Error loading: " << e.what() << std::endl;
+        std::cerr << "[ERROR] Workload failed: " << e.what() << std::endl;
+        return 1;
+    }
+}
+
+void findNearestMaterials(const DataStore& store) {
+    clearScreen();
+    std::cout << "\n=== FIND NEAREST MATERIALS ===\n\n";
+    
+    MaterialQuery query;
+    query.diopter = getValidatedDouble("Diopter: ", -30.0, 30.0);
+    query.thickness = getValidatedDouble("Thickness (mm): ", 0.0, 100.0);
+    query.price = getValidatedDouble("Target price in BGN (0 to ignore): ", 0.0);
+    query.usePrice = query.price > 0.0;
+    std::cin.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
+    
+    std::cout << "Type (Enter for any): ";
+    std::getline(std::cin, query.type);
+    std::cout << "Material (Enter for any): ";
+    std::getline(std::cin, query.materialName);
+    query.limit = static_cast<size_t>(getValidatedInt("How many matches: ", 1, 100));
+    
+    std::vector<MaterialMatch> matches = store.nearestMaterials(query);
+    if (matches.empty()) {
+        std::cout << "\n[ERROR] No materials match.\n";
         pauseScreen();
+        return;
     }
+    
+    std::cout << "\nNearest materials:\n";
+    std::cout << std::string(80, '-') << std::endl;
+    for (size_t i = 0; i < matches.size(); ++i) {
+        const Supplier& supplier = store.getSupplier(matches[i].supplierIndex);
+        int position = supplier.findMaterial(matches[i].materialId);
+        if (position == -1) {
+            continue;
+        }
+        std::cout << "[" << (i + 1) << "] " << supplier.getName() << " #" << matches[i].materialId
+                  << " (distance " << std::fixed << std::setprecision(2) << matches[i].distance << ")\n"
+                  << "    " << supplier.getMaterials()[position] << std::endl;
+    }
+    std::cout << std::string(80, '-') << std::endl;
+    
+    pauseScreen();
 }
 
-int selectSupplier(const std::vector<Supplier>& suppliers) {
-    std::cout << "\nAvailable suppliers:\n";
-    std::cout << std::string(65, '-') << std::endl;
+void updateStockLevel(DataStore& store, EditHistory& history) {
+    clearScreen();
+    
+    if (store.getSupplierCount() == 0) {
+        std::cout << "\n[ERROR] No suppliers available!\n";
+        pauseScreen();
+        return;
+    }
+    
+    std::cout << "\n=== UPDATE STOCK LEVEL ===\n";
+    
+    int supplierIndex = selectSupplier(store);
+    if (supplierIndex == -1) {
+        return;
+    }
+    
+    const Supplier supplier = store.getSupplier(supplierIndex);
+    if (supplier.getMaterialCount() == 0) {
+        std::cout << "\n[ERROR] This supplier has no materials!\n";
+        pauseScreen();
+        return;
+    }
+    supplier.displayMaterials();
+    
+    int choice = getValidatedInt("Material (0 to go back): ", 0, supplier.getMaterialCount());
+    if (choice == 0) {
+        return;
+    }
+    unsigned int materialId = supplier.getMaterials()[choice - 1].getId();
+    int onHand = getValidatedInt("Units on hand (-1 to stop counting): ", Supplier::UNTRACKED_STOCK, 1000000);
+    
+    Transaction transaction(store, "stock of material #" + std::to_string(materialId));
+    transaction.setStock(supplierIndex, materialId, onHand);
+    history.record(transaction.commit());
+    if (onHand == Supplier::UNTRACKED_STOCK) {
+        std::cout << "\n[OK] Stock of material #" << materialId << " is no longer counted.\n";
+    } else {
+        std::cout << "\n[OK] Material #" << materialId << " now has " << onHand << " unit(s) in stock.\n";
+    }
+    
+    pauseScreen();
+}
+
+void cancelOrder(DataStore& store, EditHistory& history) {
+    clearScreen();
+    
+    if (store.getSupplierCount() == 0) {
+        std::cout << "\n[ERROR] No suppliers available!\n";
+        pauseScreen();
+        return;
+    }
+    
+    std::cout << "\n=== CANCEL ORDER ===\n";
+    
+    int supplierIndex = selectSupplier(store);
+    if (supplierIndex == -1) {
+        return;
+    }
+    
+    std::cout << "Order ID: ";
+    std::string orderId;
+    if (!std::getline(std::cin, orderId) || orderId.empty()) {
+        std::cin.clear();
+        std::cout << "[ERROR] No order ID given!\n";
+        pauseScreen();
+        return;
+    }
+    
+    std::vector<Order> found = store.findOrders(store.getSupplier(supplierIndex).getBulstat(), orderId);
+    std::vector<Order> open;
+    for (size_t i = 0; i < found.size(); ++i) {
+        if (!found[i].isCancelled()) {
+            open.push_back(found[i]);
+        }
+    }
+    if (open.empty()) {
+        std::cout << "\n[ERROR] No open order " << orderId << " for this supplier"
+                  << (found.empty() ? "" : " (it is already cancelled)") << ".\n";
+        pauseScreen();
+        return;
+    }
+    
+    // Order ids are short, so a busy supplier can have several with the same one
+    size_t chosen = 0;
+    if (open.size() > 1) {
+        std::cout << "\nSeveral open orders have this ID:\n";
+        for (size_t i = 0; i < open.size(); ++i) {
+            std::cout << "[" << (i + 1) << "] " << open[i].getOrderDate() << ", "
+                      << std::fixed << std::setprecision(2) << open[i].getTotalPrice() << " BGN\n";
+        }
+        int choice = getValidatedInt("Select order (0 to go back): ", 0, static_cast<int>(open.size()));
+        if (choice == 0) {
+            return;
+        }
+        chosen = static_cast<size_t>(choice - 1);
+    }
+    
+    open[chosen].displayOrder();
+    int confirm = getValidatedInt("Cancel this order? (1 = yes, 0 = no): ", 0, 1);
+    if (confirm == 1) {
+        Transaction transaction(store, "cancel order " + orderId);
+        transaction.cancelOrder(open[chosen]);
+        history.record(transaction.commit());
+        std::cout << "\n[OK] Order " << orderId << " cancelled; its units are back in stock.\n";
+    }
+    
+    pauseScreen();
+}
+
+void exportOrders(const DataStore& store) {
+    clearScreen();
+    std::cout << "\n=== EXPORT ORDERS ===\n";
+    std::cout << "Archived and current orders, oldest first, one row per order line\n";
+    std::cout << "(JSON: one object per order).\n\n";
+    std::cout << "1. CSV\n";
+    std::cout << "2. Newline-delimited JSON\n";
+    std::cout << "3. Columnar (binary, see README)\n";
+    int choice = getValidatedInt("Format: ", 1, 3);
+    ExportFormat format = choice == 1 ? EXPORT_CSV : (choice == 2 ? EXPORT_NDJSON : EXPORT_COLUMNAR);
+    
+    std::cout << "Output file path: ";
+    std::string path;
+    if (!std::getline(std::cin, path) || path.empty()) {
+        std::cin.clear();
+        std::cout << "[ERROR] No file given!\n";
+        pauseScreen();
+        return;
+    }
+    
+    ExportFilter filter;
+    std::cout << "From date, e.g. 2024-01 or 2024-01-15 (Enter for the first order): ";
+    std::getline(std::cin, filter.from);
+    std::cout << "To date, inclusive (Enter for the last order): ";
+    std::getline(std::cin, filter.to);
+    
+    try {
+        ExportSummary summary = OrderExporter::exportOrders(store, path, format, filter);
+        std::cout << "\n[OK] Exported " << summary.orders << " order(s) with " << summary.lines
+                  << " line(s) to " << path << " (" << summary.bytes << " bytes).\n";
+    } catch (const std::exception& e) {
+        std::cout << "[ERROR] Export failed: " << e.what() << "\n";
+    }
+    
+    pauseScreen();
+}
+
+void displayMemoryUsage(const DataStore& store) {
+    clearScreen();
+    std::cout << "\n=== MEMORY USAGE ===\n";
+    std::cout << "Estimated memory of the data in use; archived months stay on disk.\n\n";
+    std::cout << store.memoryUsage().report();
+    pauseScreen();
+}
+
+void undoLastChange(DataStore& store, EditHistory& history) {
+    clearScreen();
+    std::cout << "\n=== UNDO LAST CHANGE ===\n\n";
+
+    if (!history.canUndo()) {
+        std::cout << "[ERROR] Nothing to undo since the data was loaded.\n";
+        pauseScreen();
+        return;
+    }
+
+    std::cout << "Last change: " << history.nextUndo() << "\n";
+    int confirm = getValidatedInt("Undo it? (1 = yes, 0 = no): ", 0, 1);
+    if (confirm == 1) {
+        try {
+            std::cout << "\n[OK] Undone: " << history.undo(store) << "\n";
+        } catch (const std::exception& e) {
+            std::cout << "\n[ERROR] Cannot undo: " << e.what() << "; nothing was changed.\n";
+        }
+    }
+
+    pauseScreen();
+}
+
+void redoLastChange(DataStore& store, EditHistory& history) {
+    clearScreen();
+    std::cout << "\n=== REDO LAST CHANGE ===\n\n";
+
+    if (!history.canRedo()) {
+        std::cout << "[ERROR] Nothing to redo.\n";
+        pauseScreen();
+        return;
+    }
+
+    try {
+        std::cout << "[OK] Redone: " << history.redo(store) << "\n";
+    } catch (const std::exception& e) {
+        std::cout << "[ERROR] Cannot redo: " << e.what() << "; nothing was changed.\n";
+    }
+
+    pauseScreen();
+}
+
+void displayDashboard(const DataStore& store) {
+    const size_t TOP_COUNT = 10;
+    const size_t RECENT_DAYS = 7;
+    
+    clearScreen();
+    std::cout << "\n=== SPEND & DEMAND DASHBOARD ===\n";
+    std::cout << "Running totals over all orders, archived months included; "
+              << "cancelled orders do not count.\n\n";
+    
+    // The quarter runs from its first month (YYYY-01, -04, -07 or -10)
+    // to the current one
+    std::string month = OrderArchive::currentPeriod();
+    int monthNumber = std::atoi(month.substr(5, 2).c_str());
+    int quarterStart = (monthNumber - 1) / 3 * 3 + 1;
+    std::string quarter = month.substr(0, 5) + (quarterStart < 10 ? "0" : "") + std::to_string(quarterStart);
+    
+    AggregateTotals overall = store.orderTotals();
+    AggregateTotals thisMonth = store.totalsBetween(month + "-01", month + "-31");
+    AggregateTotals thisQuarter = store.totalsBetween(quarter + "-01", month + "-31");
+    std::cout << std::fixed << std::setprecision(2);
+    std::cout << "All orders:   " << std::setw(8) << overall.orderCount << " orders, "
+              << std::setw(14) << overall.amount() << " BGN\n";
+    std::cout << "This month:   " << std::setw(8) << thisMonth.orderCount << " orders, "
+              << std::setw(14) << thisMonth.amount() << " BGN\n";
+    std::cout << "This quarter: " << std::setw(8) << thisQuarter.orderCount << " orders, "
+              << std::setw(14) << thisQuarter.amount() << " BGN\n";
     
+    std::vector<SupplierSpend> suppliers = store.topSuppliers(TOP_COUNT);
+    std::cout << "\nTop suppliers by spend:\n";
+    std::cout << std::string(65, '-') << std::endl;
     for (size_t i = 0; i < suppliers.size(); ++i) {
-        std::cout << "[" << (i + 1) << "] " << suppliers[i].getName() 
-                  << " - " << suppliers[i].getLocation() << std::endl;
+        int index = store.findSupplier(suppliers[i].bulstat);
+        std::string name = index >= 0 ? store.getSupplier(index).getName() : suppliers[i].bulstat;
+        AggregateTotals quarterSpend = store.supplierSpend(suppliers[i].bulstat, quarter, month);
+        std::cout << std::setw(2) << (i + 1) << ". " << name << ": " << suppliers[i].totals.amount()
+                  << " BGN in " << suppliers[i].totals.orderCount << " order(s), "
+                  << quarterSpend.amount() << " BGN this quarter\n";
+    }
+    if (suppliers.empty()) {
+        std::cout << "No orders yet.\n";
+    }
+    
+    std::vector<MaterialDemand> materials = store.topMaterials(TOP_COUNT);
+    std::cout << "\nMost ordered materials:\n";
+    std::cout << std::string(65, '-') << std::endl;
+    for (size_t i = 0; i < materials.size(); ++i) {
+        std::cout << std::setw(2) << (i + 1) << ". " << materials[i].type << " " << materials[i].materialName
+                  << ": " << materials[i].quantity << " unit(s), " << materials[i].amount() << " BGN\n";
+    }
+    if (materials.empty()) {
+        std::cout << "No orders yet.\n";
     }
     
+    std::vector<DayRow> days = store.recentDays(RECENT_DAYS);
+    std::cout << "\nRecent days:\n";
     std::cout << std::string(65, '-') << std::endl;
-    int choice = getValidatedInt("Select supplier: ", 1, 
-                                  static_cast<int>(suppliers.size()));
+    for (size_t i = 0; i < days.size(); ++i) {
+        std::cout << days[i].day << ": " << std::setw(6) << days[i].totals.orderCount << " orders, "
+                  << std::setw(14) << days[i].totals.amount() << " BGN\n";
+    }
+    if (days.empty()) {
+        std::cout << "No orders yet.\n";
+    }
+    
+    pauseScreen();
+}
+
+void exportPriceMatrix(const DataStore& store) {
+    clearScreen();
+    std::cout << "\n=== PRICE COMPARISON MATRIX ===\n";
+    std::cout << "Current prices of every material across all suppliers, with the minimum,\n";
+    std::cout << "median and maximum and the suppliers priced far outside the rest.\n\n";
+    std::cout << "1. Matrix (CSV, one row per material, one column per supplier)\n";
+    std::cout << "2. List (CSV, one row per supplier offer)\n";
+    int choice = getValidatedInt("Layout: ", 1, 2);
+    MatrixLayout layout = choice == 1 ? MATRIX_WIDE : MATRIX_LONG;
     
-    return choice - 1;
+    std::cout << "Output file path: ";
+    std::string path;
+    if (!std::getline(std::cin, path) || path.empty()) {
+        std::cin.clear();
+        std::cout << "[ERROR] No file given!\n";
+        pauseScreen();
+        return;
+    }
+    
+    try {
+        PriceMatrixSummary summary = PriceMatrix::exportMatrix(store, path, layout);
+        std::cout << "\n[OK] Wrote " << summary.rows << " material(s) from " << summary.suppliers
+                  << " supplier(s) to " << path << " (" << summary.bytes << " bytes).\n";
+        std::cout << summary.comparableRows << " material(s) are offered by more than one supplier; "
+                  << summary.outliers << " of " << summary.offers << " price(s) are outliers.\n";
+    } catch (const std::exception& e) {
+        std::cout << "[ERROR] Export failed: " << e.what() << "\n";
+    }
+    
+    pauseScreen();
+}
+
+bool keepPartialBatch(size_t applied, const std::string& what) {
+    if (applied == 0) {
+        return false;
+    }
+    std::cout << "\nKeep the " << applied << " " << what << " that did apply?\n";
+    return getValidatedInt("(1 = keep, 0 = roll back the whole batch): ", 0, 1) == 1;
 }
 
-bool bulstatExists(const std::vector<Supplier>& suppliers, const std::string& bulstat) {
-    for (const auto& supplier : suppliers) {
-        if (supplier.getBulstat() == bulstat) {
-            return true;
+int selectSupplier(const DataStore& store) {
+    const size_t MAX_RESULTS = 10;
+    
+    while (true) {
+        std::cout << "\nSearch supplier by name or location (Enter to list the first " 
+                  << MAX_RESULTS << "): ";
+        std::string query;
+        if (!std::getline(std::cin, query)) {
+            std::cin.clear();
+            return -1;
+        }
+        
+        std::vector<SupplierMatch> matches = store.searchSuppliers(query, MAX_RESULTS);
+        if (matches.empty()) {
+            std::cout << "[ERROR] No suppliers match \"" << query << "\".\n";
+            continue;
+        }
+        
+        std::cout << "\nMatching suppliers:\n";
+        std::cout << std::string(65, '-') << std::endl;
+        for (size_t i = 0; i < matches.size(); ++i) {
+            const Supplier& supplier = store.getSupplier(matches[i].supplierIndex);
+            std::cout << "[" << (i + 1) << "] " << supplier.getName() 
+                      << " - " << supplier.getLocation() << std::endl;
+        }
+        std::cout << std::string(65, '-') << std::endl;
+        
+        int choice = getValidatedInt("Select supplier (0 to search again): ", 0, 
+                                      static_cast<int>(matches.size()));
+        if (choice > 0) {
+            return matches[choice - 1].supplierIndex;
         }
     }
-    return false;
 }
 
-bool phoneNumberExists(const std::vector<Supplier>& suppliers, const std::string& phoneNumber) {
-    for (const auto& supplier : suppliers) {
-        if (supplier.getPhoneNumber() == phoneNumber) {
-            return true;
+void displayMetrics() {
+    clearScreen();
+    std::cout << "\n=== RUNTIME METRICS ===\n\n";
+    
+#if OPTICAL_METRICS
+    if (!Metrics::isEnabled()) {
+        std::cout << "Metrics collection is off (set OPTICAL_METRICS=1 to enable at startup).\n";
+        int enable = getValidatedInt("Enable it now? (1 = yes, 0 = no): ", 0, 1);
+        if (enable == 1) {
+            Metrics::setEnabled(true);
+            std::cout << "[OK] Metrics collection enabled.\n";
         }
+        pauseScreen();
+        return;
+    }
+    
+    std::cout << Metrics::reportText();
+    writeMetricsReport();
+#else
+    std::cout << "This build was compiled without metrics (METRICS=0).\n";
+#endif
+    
+    pauseScreen();
+}
+
+void writeMetricsReport() {
+    if (!Metrics::isEnabled()) {
+        return;
+    }
+    
+    std::ofstream report("metrics.json");
+    if (!report) {
+        std::cerr << "[ERROR] Cannot write metrics.json" << std::endl;
+        return;
     }
-    return false;
+    report << Metrics::reportJson();
+    std::cout << "\n[OK] Metrics written to metrics.json\n";
 }
 
 void clearScreen() {
@@ -0,0 +1,43 @@
+#include <random>
+#include <cstdio>
+#include "TestHarness.h"
+#include "TestData.h"
+
+// Distinct past orders that share an id and a date are all sealed, and
+// sealing them again after an interrupted save adds none of them twice
+TEST_CASE(collidingColdOrdersAreAllSealed) {
+    std::mt19937 random(27);
+    DataStore store(1);
+    store.addSupplier(test::randomSupplier(random, 0, 4));
+    for (int i = 0; i < 3; ++i) {
+        Order order(store.getSupplier(0));
+        order.addItem(store.resolveMaterial(0, i), 1 + i);
+        CHECK(store.addOrder(order));
+    }
+    test::saveStore(store);
+    test::rewriteOrders(store, 0, "2020-01-15 10:00:00", "ORD00001");
+    // The saved totals are for the old dates; loading recounts them
+    std::remove(store.getShard(0).getFiles().aggregates.c_str());
+
+    for (int round = 0; round < 2; ++round) {
+        // The second round finds the orders file as a save that was cut
+        // short after sealing left it
+        if (round == 1) {
+            test::rewriteOrders(store, 0, "2020-01-15 10:00:00", "ORD00001");
+        }
+        DataStore loaded(1);
+        test::loadStore(loaded);
+        CHECK_EQUAL(0, loaded.getOrderCount());
+        CHECK_EQUAL(3u, loaded.getArchivedOrderCount());
+        std::vector<Order> sealed = loaded.loadArchivedOrders("2020-01");
+        CHECK_EQUAL(3u, sealed.size());
+        for (size_t i = 0; i < sealed.size(); ++i) {
+            CHECK_EQUAL(std::string("ORD00001"), sealed[i].getOrderId());
+            for (size_t j = 0; j < i; ++j) {
+                CHECK(!sealed[i].sameContent(sealed[j]));
+            }
+        }
+        test::checkTotalsMatchOrders(loaded);
+        test::saveStore(loaded);
+    }
+}
@@ -0,0 +1,191 @@
+#include <random>
+#include <cstdio>
+#include "TestHarness.h"
+#include "TestData.h"
+#include "DataPersistence.h"
+#include "DataFile.h"
+#include "ModelReflection.h"
+#include "OrderBatch.h"
+
+namespace {
+
+// The same lines, last line moved to the front
+Order withLinesRotated(const Order& order) {
+    Order rotated(order);
+    int count = rotated.getItemCount();
+    for (int i = 0; i + 1 < count; ++i) {
+        OrderItem first = rotated.getItems()[0];
+        rotated.removeItem(0);
+        rotated.addItem(first.material, first.quantity);
+    }
+    return rotated;
+}
+
+}
+
+// Re-adding any stored order, with its lines in any order, adds nothing
+TEST_CASE(storedOrdersAreNeverAddedTwice) {
+    std::mt19937 random(123);
+    test::StoreShape shape;
+    shape.suppliers = 30;
+    shape.trackedStockPercent = 0;
+    DataStore store(3);
+    test::fillStore(store, random, shape);
+
+    std::vector<Order> added;
+    for (int step = 0; step < 400; ++step) {
+        if (added.empty() || random() % 3 != 0) {
+            Order order = test::randomOrder(random, store, static_cast<int>(random() % store.getSupplierCount()));
+            if (store.addOrder(order)) {
+                added.push_back(order);
+            }
+        } else {
+            const Order& earlier = added[random() % added.size()];
+            int ordersBefore = store.getOrderCount();
+            CHECK(!store.addOrder(random() % 2 == 0 ? earlier : withLinesRotated(earlier)));
+            CHECK_EQUAL(ordersBefore, store.getOrderCount());
+        }
+    }
+}
+
+TEST_CASE(idempotencyKeyIsPerSupplier) {
+    std::mt19937 random(8);
+    DataStore store(2);
+    store.addSupplier(test::randomSupplier(random, 0, 4));
+    store.addSupplier(test::randomSupplier(random, 1, 4));
+
+    Order first = test::randomOrder(random, store, 0);
+    first.setIdempotencyKey("PO-1");
+    CHECK(store.addOrder(first));
+
+    // Other lines, same key and supplier: a replay of the same order
+    Order replay(store.getSupplier(0));
+    replay.addItem(store.resolveMaterial(0, 3), 77);
+    replay.setIdempotencyKey("PO-1");
+    CHECK(!store.addOrder(replay));
+
+    // The same key from another supplier is a different order
+    Order other = test::randomOrder(random, store, 1);
+    other.setIdempotencyKey("PO-1");
+    CHECK(store.addOrder(other));
+    CHECK_EQUAL(2, store.getOrderCount());
+}
+
+TEST_CASE(reimportedBatchAddsNothing) {
+    std::mt19937 random(31);
+    test::StoreShape shape;
+    shape.suppliers = 20;
+    shape.ordersPerSupplier = 0;
+    DataStore store(4);
+    test::fillStore(store, random, shape);
+
+    std::vector<OrderBatchLine> lines;
+    for (int i = 0; i < 200; ++i) {
+        const Supplier& supplier = store.getSupplier(static_cast<int>(random() % store.getSupplierCount()));
+        OrderBatchLine line;
+        line.lineNumber = lines.size() + 1;
+        line.orderRef = "B" + std::to_string(random() % 60);
+        line.supplierBulstat = supplier.getBulstat();
+        line.materialId = supplier.getMaterial(static_cast<int>(random() % supplier.getMaterialCount())).getId();
+        line.quantity = 1 + static_cast<int>(random() % 5);
+        lines.push_back(line);
+    }
+
+    size_t imported = store.addOrders(OrderBatch::build(store, lines).orders);
+    CHECK(imported > 0);
+    CHECK_EQUAL(0u, store.addOrders(OrderBatch::build(store, lines).orders));
+    CHECK_EQUAL(static_cast<int>(imported), store.getOrderCount());
+}
+
+// Duplicates that reach the orders file are dropped on load
+TEST_CASE(duplicatesInTheOrdersFileAreSkipped) {
+    std::mt19937 random(64);
+    test::StoreShape shape;
+    shape.suppliers = 15;
+    shape.cancelPercent = 0;
+    DataStore store(1);
+    test::fillStore(store, random, shape);
+    test::saveStore(store);
+
+    DataSnapshot snapshot = store.snapshot();
+    std::vector<Order> orders;
+    for (size_t i = 0; i < snapshot.shards[0].orders.size(); ++i) {
+        orders.push_back(snapshot.shards[0].orders[i]);
+        if (i % 2 == 0) {
+            orders.push_back(withLinesRotated(snapshot.shards[0].orders[i]));
+        }
+    }
+    std::string text;
+    DataFileWriter file(store.getShard(0).getFiles().orders);
+    TextWriter(text, &file).sequence("Orders", orders);
+    file.commit(text);
+
+    DataStore loaded(1);
+    test::loadStore(loaded);
+    CHECK_EQUAL(store.getOrderCount(), loaded.getOrderCount());
+    test::checkSameDump(test::dumpShards(store), test::dumpShards(loaded));
+}
+
+// Keys and contents of orders sealed into the archive still count: a
+// keyed batch replayed after its month was archived adds nothing, also
+// after a restart
+TEST_CASE(batchReplayedAfterArchivingAddsNothing) {
+    std::mt19937 random(39);
+    test::StoreShape shape;
+    shape.suppliers = 12;
+    shape.ordersPerSupplier = 0;
+    shape.trackedStockPercent = 0;
+    DataStore store(2);
+    test::fillStore(store, random, shape);
+
+    std::vector<OrderBatchLine> lines;
+    for (int i = 0; i < 80; ++i) {
+        // An order has one supplier, so each reference keeps to one
+        int reference = static_cast<int>(random() % 30);
+        const Supplier& supplier = store.getSupplier(reference % store.getSupplierCount());
+        OrderBatchLine line;
+        line.lineNumber = lines.size() + 1;
+        line.orderRef = "PO-" + std::to_string(reference);
+        line.supplierBulstat = supplier.getBulstat();
+        line.materialId = supplier.getMaterial(static_cast<int>(random() % supplier.getMaterialCount())).getId();
+        line.quantity = 1 + static_cast<int>(random() % 5);
+        lines.push_back(line);
+    }
+    size_t imported = store.addOrders(OrderBatch::build(store, lines).orders);
+    CHECK(imported > 20);
+
+    // Last year's orders, sealed into their month when loaded
+    test::saveStore(store);
+    for (size_t shard = 0; shard < store.getShardCount(); ++shard) {
+        test::rewriteOrders(store, shard, "2020-03-02 09:30:00");
+        std::remove(store.getShard(shard).getFiles().aggregates.c_str());
+    }
+    DataStore loaded(2);
+    test::loadStore(loaded);
+    CHECK_EQUAL(0, loaded.getOrderCount());
+    CHECK_EQUAL(imported, loaded.getArchivedOrderCount());
+
+    CHECK_EQUAL(0u, loaded.addOrders(OrderBatch::build(loaded, lines).orders));
+    // Without its key, a sealed order is still recognized by its content
+    std::vector<Order> sealed = loaded.loadArchivedOrders("2020-03");
+    CHECK_EQUAL(imported, sealed.size());
+    Order unkeyed(sealed[0]);
+    unkeyed.setIdempotencyKey("");
+    CHECK(!loaded.addOrder(unkeyed));
+    CHECK_EQUAL(0, loaded.getOrderCount());
+
+    // The keys are kept beside the segments, so a restart knows them too,
+    // also when a keys file has to be rebuilt from its segment
+    test::saveStore(loaded);
+    std::string keys = loaded.getShard(0).getFiles().archive + "-2020-03.keys";
+    CHECK(std::remove(keys.c_str()) == 0);
+    DataStore restarted(2);
+    test::loadStore(restarted);
+    CHECK(DataFile::exists(keys));
+    CHECK_EQUAL(0u, restarted.addOrders(OrderBatch::build(restarted, lines).orders));
+    CHECK_EQUAL(0, restarted.getOrderCount());
+
+    // Another key is another order
+    lines[0].orderRef = "PO-new";
+    CHECK(restarted.addOrders(OrderBatch::build(restarted, lines).orders) > 0);
+}
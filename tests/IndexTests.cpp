@@ -0,0 +1,284 @@
+#include <random>
+#include <fstream>
+#include <sstream>
+#include <cstdio>
+#include <cmath>
+#include <map>
+#include <algorithm>
+#include "TestHarness.h"
+#include "TestData.h"
+#include "DataPersistence.h"
+#include "DataFile.h"
+#include "IndexFile.h"
+#include "MaterialIndex.h"
+
+namespace {
+
+const char* QUERIES[] = { "optika", "vision ltd", "lensa 1", "sofia", "plovdv", "fokus 20", "оптика", "" };
+
+// Supplier search, BULSTAT lookups and nearest materials answer the same
+// in both stores, which must number their suppliers alike
+void checkSameLookups(const DataStore& expected, const DataStore& actual) {
+    CHECK_EQUAL(expected.getSupplierCount(), actual.getSupplierCount());
+    for (int i = 0; i < expected.getSupplierCount(); ++i) {
+        const std::string& bulstat = expected.getSupplier(i).getBulstat();
+        CHECK_EQUAL(expected.findSupplier(bulstat), actual.findSupplier(bulstat));
+        CHECK(actual.phoneNumberExists(expected.getSupplier(i).getPhoneNumber()));
+    }
+
+    for (size_t q = 0; q < sizeof(QUERIES) / sizeof(QUERIES[0]); ++q) {
+        std::vector<SupplierMatch> want = expected.searchSuppliers(QUERIES[q], 20);
+        std::vector<SupplierMatch> got = actual.searchSuppliers(QUERIES[q], 20);
+        CHECK_EQUAL(want.size(), got.size());
+        for (size_t i = 0; i < want.size() && i < got.size(); ++i) {
+            CHECK_EQUAL(want[i].supplierIndex, got[i].supplierIndex);
+            CHECK_EQUAL(want[i].score, got[i].score);
+        }
+    }
+
+    std::mt19937 random(99);
+    for (int q = 0; q < 20; ++q) {
+        MaterialQuery query;
+        query.diopter = -6.0 + (random() % 1200) / 100.0;
+        query.thickness = 1.0 + (random() % 300) / 100.0;
+        query.price = random() % 200;
+        query.usePrice = q % 2 == 0;
+        query.type = q % 3 == 0 ? "lens" : "";
+        query.limit = 8;
+        std::vector<MaterialMatch> want = expected.nearestMaterials(query);
+        std::vector<MaterialMatch> got = actual.nearestMaterials(query);
+        CHECK_EQUAL(want.size(), got.size());
+        for (size_t i = 0; i < want.size() && i < got.size(); ++i) {
+            CHECK_EQUAL(want[i].supplierIndex, got[i].supplierIndex);
+            CHECK_EQUAL(want[i].materialId, got[i].materialId);
+            CHECK_EQUAL(want[i].version, got[i].version);
+        }
+    }
+}
+
+bool indexesMatchSuppliers(const DataStore& store, size_t shard) {
+    const ShardFiles& files = store.getShard(shard).getFiles();
+    ShardIndexes indexes;
+    return IndexFile::read(files.index, DataFileReader(files.suppliers).generationStamp(), indexes);
+}
+
+// The reference a load with prebuilt indexes must match: the same files
+// loaded without them
+void loadWithoutIndexes(DataStore& loaded) {
+    for (size_t shard = 0; shard < loaded.getShardCount(); ++shard) {
+        std::remove(loaded.getShard(shard).getFiles().index.c_str());
+    }
+    test::loadStore(loaded);
+}
+
+std::string readBytes(const std::string& path) {
+    std::ifstream in(path.c_str(), std::ios::binary);
+    std::stringstream contents;
+    contents << in.rdbuf();
+    return contents.str();
+}
+
+void writeBytes(const std::string& path, const std::string& bytes) {
+    std::ofstream out(path.c_str(), std::ios::binary | std::ios::trunc);
+    out << bytes;
+}
+
+std::string lowercase(const std::string& text) {
+    std::string result(text);
+    for (size_t i = 0; i < result.size(); ++i) {
+        if (static_cast<unsigned char>(result[i]) < 0x80) {
+            result[i] = static_cast<char>(::tolower(static_cast<unsigned char>(result[i])));
+        }
+    }
+    return result;
+}
+
+// (supplier index, material) of every indexed material
+typedef std::map<std::pair<int, unsigned int>, OpticalMaterial> IndexedMaterials;
+
+// What MaterialIndex::nearest must answer, by measuring every material
+std::vector<MaterialMatch> scanNearest(const IndexedMaterials& materials, const MaterialQuery& query) {
+    std::vector<MaterialMatch> matches;
+    for (IndexedMaterials::const_iterator it = materials.begin(); it != materials.end(); ++it) {
+        const OpticalMaterial& material = it->second;
+        if ((!query.type.empty() && lowercase(material.getType()) != lowercase(query.type)) ||
+            (!query.materialName.empty() && lowercase(material.getMaterialName()) != lowercase(query.materialName))) {
+            continue;
+        }
+        double dx = material.getDiopter() / MaterialIndex::DIOPTER_STEP - query.diopter / MaterialIndex::DIOPTER_STEP;
+        double dy = material.getThickness() / MaterialIndex::THICKNESS_STEP -
+                    query.thickness / MaterialIndex::THICKNESS_STEP;
+        double dp = query.usePrice ? (material.getPrice() - query.price) * (1.0 / MaterialIndex::PRICE_STEP) : 0.0;
+        MaterialMatch match;
+        match.supplierIndex = it->first.first;
+        match.materialId = material.getId();
+        match.version = material.getVersion();
+        match.distance = dx * dx + dy * dy + dp * dp;
+        matches.push_back(match);
+    }
+    std::sort(matches.begin(), matches.end(), MaterialIndex::closer);
+    matches.resize(std::min(matches.size(), query.limit));
+    for (size_t i = 0; i < matches.size(); ++i) {
+        matches[i].distance = std::sqrt(matches[i].distance);
+    }
+    return matches;
+}
+
+}
+
+// A load adopts the indexes saved with the suppliers, and the change log
+// replayed on top updates them like any other change
+TEST_CASE(savedIndexesAreAdopted) {
+    std::mt19937 random(12);
+    test::StoreShape shape;
+    shape.suppliers = 80;
+    DataStore store(3);
+    test::fillStore(store, random, shape);
+    test::saveStore(store);
+    for (size_t shard = 0; shard < store.getShardCount(); ++shard) {
+        CHECK(indexesMatchSuppliers(store, shard));
+    }
+
+    for (int i = 0; i < store.getSupplierCount(); i += 4) {
+        MaterialChange change;
+        change.kind = MaterialChange::UPDATE_PRICE;
+        change.materialId = store.getSupplier(i).getMaterial(2).getId();
+        change.price = 3.5 + i;
+        store.applyCatalogDelta(i, std::vector<MaterialChange>(1, change));
+    }
+
+    DataStore loaded(3);
+    test::loadStore(loaded);
+    DataStore rebuilt(3);
+    loadWithoutIndexes(rebuilt);
+    checkSameLookups(rebuilt, loaded);
+}
+
+// Indexes from another save or damaged on disk are ignored and the load
+// indexes the suppliers itself
+TEST_CASE(staleOrDamagedIndexesAreRebuilt) {
+    std::mt19937 random(21);
+    test::StoreShape shape;
+    shape.suppliers = 40;
+    DataStore store(2);
+    test::fillStore(store, random, shape);
+    test::saveStore(store);
+    std::string staleIndex = readBytes(store.getShard(0).getFiles().index);
+
+    for (size_t i = 0; i < 20; ++i) {
+        store.addSupplier(test::randomSupplier(random, shape.suppliers + i, 5));
+    }
+    test::saveStore(store);
+    writeBytes(store.getShard(0).getFiles().index, staleIndex);
+    std::string damaged = readBytes(store.getShard(1).getFiles().index);
+    damaged[damaged.size() / 2] ^= 0x10;
+    writeBytes(store.getShard(1).getFiles().index, damaged);
+    CHECK(!indexesMatchSuppliers(store, 0));
+    CHECK(!indexesMatchSuppliers(store, 1));
+
+    DataStore loaded(2);
+    test::loadStore(loaded);
+    DataStore rebuilt(2);
+    loadWithoutIndexes(rebuilt);
+    checkSameLookups(rebuilt, loaded);
+}
+
+// A snapshot keeps the indexes as they were when it was taken, however
+// the store changes while it is being saved
+TEST_CASE(snapshotIndexesStayAsTaken) {
+    std::mt19937 random(33);
+    test::StoreShape shape;
+    shape.suppliers = 30;
+    DataStore store(2);
+    test::fillStore(store, random, shape);
+    DataSnapshot snapshot = store.snapshot();
+    for (size_t i = 0; i < 10; ++i) {
+        store.addSupplier(test::randomSupplier(random, shape.suppliers + i, 5));
+    }
+    DataPersistence::saveSnapshot(snapshot);
+    for (size_t shard = 0; shard < store.getShardCount(); ++shard) {
+        CHECK(indexesMatchSuppliers(store, shard));
+    }
+
+    DataStore loaded(2);
+    test::loadStore(loaded);
+    CHECK_EQUAL(static_cast<int>(shape.suppliers), loaded.getSupplierCount());
+    DataStore rebuilt(2);
+    loadWithoutIndexes(rebuilt);
+    checkSameLookups(rebuilt, loaded);
+}
+
+// Nearest-material queries give exactly what a scan of every material
+// gives, after a third of the materials were removed and most of those
+// added again at new prescriptions
+TEST_CASE(nearestMaterialsMatchABruteForceScan) {
+    std::mt19937 random(41);
+    const char* types[] = { "Lens", "lens", "BLANK", "Contact lens" };
+    const char* names[] = { "CR39", "cr39", "Trivex", "Polycarbonate", "Стъкло" };
+    MaterialIndex index;
+    IndexedMaterials materials;
+    auto randomMaterial = [&](unsigned int id, unsigned int version) {
+        // Quantized like real prescriptions, so ties are common
+        OpticalMaterial material(types[random() % 4], 1.0 + random() % 40 * 0.1, -8.0 + random() % 65 * 0.25,
+                                 names[random() % 5], 20.0 + random() % 400 * 0.5);
+        material.setId(id);
+        material.setVersion(version);
+        return material;
+    };
+    for (int supplier = 0; supplier < 200; ++supplier) {
+        for (unsigned int id = 1; id <= 15; ++id) {
+            OpticalMaterial material = randomMaterial(id, 1);
+            index.add(supplier, material);
+            materials[std::make_pair(supplier, id)] = material;
+        }
+    }
+
+    std::vector<std::pair<int, unsigned int> > removed;
+    for (IndexedMaterials::iterator it = materials.begin(); it != materials.end();) {
+        if (random() % 3 == 0) {
+            index.remove(it->first.first, it->first.second);
+            removed.push_back(it->first);
+            materials.erase(it++);
+        } else {
+            ++it;
+        }
+    }
+    CHECK_EQUAL(materials.size(), index.size());
+    for (size_t i = 0; i < removed.size(); ++i) {
+        if (random() % 4 != 0) {
+            OpticalMaterial material = randomMaterial(removed[i].second, 2);
+            index.add(removed[i].first, material);
+            materials[removed[i]] = material;
+        }
+    }
+    // Adding over a live material moves it
+    for (int i = 0; i < 100; ++i) {
+        IndexedMaterials::iterator it = materials.begin();
+        std::advance(it, random() % materials.size());
+        it->second = randomMaterial(it->first.second, it->second.getVersion() + 1);
+        index.add(it->first.first, it->second);
+    }
+    CHECK_EQUAL(materials.size(), index.size());
+
+    for (int q = 0; q < 200; ++q) {
+        MaterialQuery query;
+        // Some queries fall outside every grid or exactly on a cell edge
+        query.diopter = q % 10 == 0 ? -20.0 + random() % 40 : -9.0 + (random() % 1800) / 100.0;
+        query.thickness = q % 7 == 0 ? 1.0 + random() % 8 * 0.5 : 0.5 + (random() % 500) / 100.0;
+        query.usePrice = random() % 2 == 0;
+        query.price = random() % 250;
+        query.type = random() % 3 == 0 ? types[random() % 4] : "";
+        query.materialName = random() % 4 == 0 ? names[random() % 5] : "";
+        query.limit = 1 + random() % 25;
+
+        std::vector<MaterialMatch> want = scanNearest(materials, query);
+        std::vector<MaterialMatch> got = index.nearest(query);
+        CHECK_EQUAL(want.size(), got.size());
+        for (size_t i = 0; i < want.size() && i < got.size(); ++i) {
+            CHECK_EQUAL(want[i].supplierIndex, got[i].supplierIndex);
+            CHECK_EQUAL(want[i].materialId, got[i].materialId);
+            CHECK_EQUAL(want[i].version, got[i].version);
+            CHECK_EQUAL(want[i].distance, got[i].distance);
+        }
+    }
+}
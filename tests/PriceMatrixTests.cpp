@@ -0,0 +1,228 @@
+#include <random>
+#include <fstream>
+#include <map>
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include "TestHarness.h"
+#include "TestData.h"
+#include "PriceMatrix.h"
+
+namespace {
+
+std::vector<std::string> readLines(const std::string& path) {
+    std::ifstream in(path.c_str(), std::ios::binary);
+    std::vector<std::string> lines;
+    std::string line;
+    while (std::getline(in, line)) {
+        lines.push_back(line);
+    }
+    return lines;
+}
+
+// Fields of one CSV line; supplier names may be quoted
+std::vector<std::string> splitCsv(const std::string& line) {
+    std::vector<std::string> fields(1);
+    bool quoted = false;
+    for (size_t i = 0; i < line.size(); ++i) {
+        char c = line[i];
+        if (quoted) {
+            if (c == '"' && i + 1 < line.size() && line[i + 1] == '"') {
+                fields.back() += '"';
+                ++i;
+            } else if (c == '"') {
+                quoted = false;
+            } else {
+                fields.back() += c;
+            }
+        } else if (c == '"') {
+            quoted = true;
+        } else if (c == ',') {
+            fields.push_back(std::string());
+        } else {
+            fields.back() += c;
+        }
+    }
+    return fields;
+}
+
+long long units(double price) {
+    return std::llround(price * 10000.0);
+}
+
+// Kind -> supplier BULSTAT -> its lowest price for the kind
+typedef std::map<std::string, std::map<std::string, long long> > KindPrices;
+
+// The row statistics recounted the plain way, from a map of kinds
+struct Expected {
+    size_t count;
+    long long min, median, max;
+    std::map<std::string, std::string> outliers;
+};
+
+Expected recount(const std::map<std::string, long long>& offers) {
+    std::vector<long long> prices;
+    for (std::map<std::string, long long>::const_iterator it = offers.begin(); it != offers.end(); ++it) {
+        prices.push_back(it->second);
+    }
+    std::sort(prices.begin(), prices.end());
+    size_t n = prices.size();
+    Expected expected;
+    expected.count = n;
+    expected.min = prices.front();
+    expected.max = prices.back();
+    expected.median = n % 2 ? prices[n / 2] : std::llround((prices[n / 2 - 1] + prices[n / 2]) / 2.0);
+    if (n >= PriceMatrix::MIN_OUTLIER_OFFERS) {
+        double q1Position = (n - 1) * 0.25, q3Position = (n - 1) * 0.75;
+        size_t a = static_cast<size_t>(q1Position), b = static_cast<size_t>(q3Position);
+        double q1 = prices[a] + (q1Position - a) * (prices[std::min(a + 1, n - 1)] - prices[a]);
+        double q3 = prices[b] + (q3Position - b) * (prices[std::min(b + 1, n - 1)] - prices[b]);
+        for (std::map<std::string, long long>::const_iterator it = offers.begin(); it != offers.end(); ++it) {
+            if (it->second < q1 - 1.5 * (q3 - q1)) {
+                expected.outliers[it->first] = "low";
+            } else if (it->second > q3 + 1.5 * (q3 - q1)) {
+                expected.outliers[it->first] = "high";
+            }
+        }
+    }
+    return expected;
+}
+
+}
+
+// Spellings that differ only in case and spacing meet on one row; a
+// supplier listing a kind twice counts once, at its lower price
+TEST_CASE(matrixRowsJoinSpellingsOfAKind) {
+    std::mt19937 random(50);
+    DataStore store(2);
+    const char* types[] = { "Lens", "LENS", "  Lens", "lens" };
+    const char* names[] = { "CR39", "Cr39", "CR39 ", "cr39" };
+    const double prices[] = { 10.0, 11.0, 13.0, 40.0 };
+    for (size_t i = 0; i < 4; ++i) {
+        Supplier supplier = test::randomSupplier(random, i, 0);
+        supplier.addMaterial(OpticalMaterial(types[i], i == 1 ? 1.50 : 1.5, -2.0, names[i], prices[i]));
+        if (i == 0) {
+            supplier.addMaterial(OpticalMaterial("lens ", 1.5, -2.0, "cr39", 12.0));
+            supplier.addMaterial(OpticalMaterial("Blank", 2.0, 0.0, "Trivex", 5.25));
+        }
+        store.addSupplier(supplier);
+    }
+
+    PriceMatrixSummary summary = PriceMatrix::exportMatrix(store, "matrix.csv", MATRIX_WIDE);
+    std::vector<std::string> lines = readLines("matrix.csv");
+    CHECK_EQUAL(3u, lines.size());
+    CHECK_EQUAL(std::string("type,material_name,thickness,diopter,suppliers,min_price,median_price,max_price,"
+                            "low_outliers,high_outliers,100000000,100000001,100000002,100000003"), lines[0]);
+    CHECK_EQUAL(std::string("blank,trivex,2,0,1,5.25,5.25,5.25,,,5.25,,,"), lines[1]);
+    CHECK_EQUAL(std::string("lens,cr39,1.5,-2,4,10,12,40,,100000003,10,11,13,40"), lines[2]);
+    CHECK_EQUAL(2u, summary.rows);
+    CHECK_EQUAL(1u, summary.comparableRows);
+    CHECK_EQUAL(5u, summary.offers);
+    CHECK_EQUAL(1u, summary.outliers);
+
+    CHECK_EQUAL(std::string("contact lens"), PriceMatrix::canonicalText(" Contact \t LENS "));
+    // Only ASCII letters are folded, like the material index does
+    CHECK_EQUAL(std::string("Стъкло 1.6"), PriceMatrix::canonicalText("Стъкло  1.6"));
+}
+
+// Every row's statistics and outliers match a plain recount, in both
+// layouts
+TEST_CASE(matrixStatisticsMatchARecount) {
+    std::mt19937 random(7);
+    const char* types[] = { "Lens", "lens", "Blank" };
+    const char* names[] = { "CR39", "Trivex", "trivex " };
+    DataStore store(3);
+    KindPrices kinds;
+    // Three pieces of suppliers, so the sorted runs are merged
+    for (size_t i = 0; i < 150; ++i) {
+        Supplier supplier = test::randomSupplier(random, i, 0);
+        for (int m = 0; m < 8; ++m) {
+            std::string type = types[random() % 3], name = names[random() % 3];
+            double thickness = 1.0 + random() % 3 * 0.5;
+            double diopter = -1.0 + random() % 3 * 0.25;
+            // Mostly close prices, now and then a far one
+            double price = random() % 10 == 0 ? 5.0 + random() % 400 : 50.0 + random() % 2000 * 0.01;
+            supplier.addMaterial(OpticalMaterial(type, thickness, diopter, name, price));
+
+            std::string kind = PriceMatrix::canonicalText(type) + "," + PriceMatrix::canonicalText(name) + "," +
+                               std::to_string(units(thickness)) + "," + std::to_string(units(diopter));
+            std::map<std::string, long long>& offers = kinds[kind];
+            if (!offers.count(supplier.getBulstat()) || offers[supplier.getBulstat()] > units(price)) {
+                offers[supplier.getBulstat()] = units(price);
+            }
+        }
+        store.addSupplier(supplier);
+    }
+
+    PriceMatrixSummary longSummary = PriceMatrix::exportMatrix(store, "offers.csv", MATRIX_LONG);
+    std::vector<std::string> lines = readLines("offers.csv");
+    KindPrices seen;
+    size_t outliers = 0;
+    for (size_t i = 1; i < lines.size(); ++i) {
+        std::vector<std::string> fields = splitCsv(lines[i]);
+        CHECK_EQUAL(12u, fields.size());
+        std::string kind = fields[0] + "," + fields[1] + "," + std::to_string(units(std::atof(fields[2].c_str()))) +
+                           "," + std::to_string(units(std::atof(fields[3].c_str())));
+        CHECK(kinds.count(kind) == 1);
+        Expected expected = recount(kinds[kind]);
+        const std::string& bulstat = fields[4];
+        CHECK_EQUAL(kinds[kind][bulstat], units(std::atof(fields[6].c_str())));
+        CHECK_EQUAL(expected.count, static_cast<size_t>(std::atoi(fields[7].c_str())));
+        CHECK_EQUAL(expected.min, units(std::atof(fields[8].c_str())));
+        CHECK_EQUAL(expected.median, units(std::atof(fields[9].c_str())));
+        CHECK_EQUAL(expected.max, units(std::atof(fields[10].c_str())));
+        std::string outlier = expected.outliers.count(bulstat) ? expected.outliers[bulstat] : "";
+        CHECK_EQUAL(outlier, fields[11]);
+        outliers += outlier.empty() ? 0 : 1;
+        seen[kind][bulstat] = units(std::atof(fields[6].c_str()));
+    }
+    CHECK(seen == kinds);
+    CHECK(outliers > 0);
+    CHECK_EQUAL(outliers, longSummary.outliers);
+
+    // The wide layout has the same rows, a cell per supplier
+    PriceMatrixSummary wideSummary = PriceMatrix::exportMatrix(store, "matrix.csv", MATRIX_WIDE);
+    lines = readLines("matrix.csv");
+    CHECK_EQUAL(kinds.size() + 1, lines.size());
+    CHECK_EQUAL(kinds.size(), wideSummary.rows);
+    CHECK_EQUAL(longSummary.offers, wideSummary.offers);
+    CHECK_EQUAL(longSummary.outliers, wideSummary.outliers);
+    for (size_t i = 0; i < lines.size(); ++i) {
+        CHECK_EQUAL(10u + store.getSupplierCount(), splitCsv(lines[i]).size());
+    }
+}
+
+// A budget too small for the offers spills sorted runs to disk, merges
+// them into the same file and removes them afterwards
+TEST_CASE(matrixSpillsPastItsMemoryBudget) {
+    std::mt19937 random(11);
+    const char* types[] = { "Lens", "Blank", "Frame" };
+    DataStore store(2);
+    for (size_t i = 0; i < 300; ++i) {
+        Supplier supplier = test::randomSupplier(random, i, 0);
+        for (int m = 0; m < 6; ++m) {
+            supplier.addMaterial(OpticalMaterial(types[random() % 3], 1.0 + random() % 4 * 0.5, -1.0 + random() % 5 * 0.5,
+                                                 "CR39", 20.0 + random() % 3000 * 0.01));
+        }
+        store.addSupplier(supplier);
+    }
+
+    for (int layout = MATRIX_WIDE; layout <= MATRIX_LONG; ++layout) {
+        PriceMatrixSummary whole = PriceMatrix::exportMatrix(store, "whole.csv", MatrixLayout(layout));
+        // Room for 100 offers, so every piece of 64 suppliers but the last
+        // is spilled
+        PriceMatrixSummary spilled = PriceMatrix::exportMatrix(store, "spilled.csv", MatrixLayout(layout), 6400);
+        CHECK_EQUAL(0u, whole.spilledRuns);
+        CHECK_EQUAL(4u, spilled.spilledRuns);
+        CHECK(readLines("whole.csv") == readLines("spilled.csv"));
+        CHECK_EQUAL(whole.rows, spilled.rows);
+        CHECK_EQUAL(whole.comparableRows, spilled.comparableRows);
+        CHECK_EQUAL(whole.offers, spilled.offers);
+        CHECK_EQUAL(whole.outliers, spilled.outliers);
+        CHECK_EQUAL(whole.bytes, spilled.bytes);
+        CHECK(whole.outliers > 0);
+        for (int run = 0; run < 4; ++run) {
+            CHECK(!std::ifstream(("spilled.csv.run" + std::to_string(run)).c_str()));
+        }
+    }
+}
@@ -0,0 +1,164 @@
+#include <random>
+#include <sstream>
+#include <fstream>
+#include <cstdio>
+#include <cstring>
+#include <cstdint>
+#include "TestHarness.h"
+#include "TestData.h"
+#include "DataPersistence.h"
+#include "ModelReflection.h"
+#include "LzCodec.h"
+
+// Save then load must give back the same data set, whatever it holds
+TEST_CASE(saveThenLoadGivesTheSameDataSet) {
+    const unsigned int SEEDS[] = { 1, 7, 2024, 31337 };
+    const size_t SHARD_COUNTS[] = { 1, 3, 4 };
+    for (size_t s = 0; s < sizeof(SEEDS) / sizeof(SEEDS[0]); ++s) {
+        for (size_t c = 0; c < sizeof(SHARD_COUNTS) / sizeof(SHARD_COUNTS[0]); ++c) {
+            std::mt19937 random(SEEDS[s]);
+            test::StoreShape shape;
+            shape.suppliers = 20 + random() % 40;
+            DataStore store(SHARD_COUNTS[c]);
+            test::fillStore(store, random, shape);
+            test::saveStore(store);
+
+            DataStore loaded(SHARD_COUNTS[c]);
+            CHECK(test::loadStore(loaded));
+            CHECK_EQUAL(store.getSupplierCount(), loaded.getSupplierCount());
+            CHECK_EQUAL(store.getOrderCount(), loaded.getOrderCount());
+            test::checkSameDump(test::dumpShards(store), test::dumpShards(loaded));
+            // Running totals come back from their own file, not a recount
+            CHECK_EQUAL(store.orderTotals().amountUnits, loaded.orderTotals().amountUnits);
+            CHECK_EQUAL(0u, loaded.rebuildMissingAggregates());
+
+            // Saving what was loaded changes nothing either
+            test::saveStore(loaded);
+            DataStore reloaded(SHARD_COUNTS[c]);
+            test::loadStore(reloaded);
+            test::checkSameDump(test::dumpShards(loaded), test::dumpShards(reloaded));
+        }
+    }
+}
+
+TEST_CASE(changeLogReplaysUnsavedPriceChanges) {
+    std::mt19937 random(11);
+    test::StoreShape shape;
+    shape.suppliers = 30;
+    DataStore store(2);
+    test::fillStore(store, random, shape);
+    test::saveStore(store);
+
+    // Price changes after the save live only in the change logs
+    for (int i = 0; i < store.getSupplierCount(); i += 3) {
+        MaterialChange change;
+        change.kind = MaterialChange::UPDATE_PRICE;
+        change.materialId = store.getSupplier(i).getMaterial(1).getId();
+        // More significant digits than a stream prints by default
+        change.price = 12345.67 + i * 0.0001;
+        store.applyCatalogDelta(i, std::vector<MaterialChange>(1, change));
+    }
+
+    DataStore loaded(2);
+    test::loadStore(loaded);
+    test::checkSameDump(test::dumpShards(store), test::dumpShards(loaded));
+}
+
+TEST_CASE(supplierStreamRoundTrip) {
+    std::mt19937 random(5);
+    for (size_t i = 0; i < 200; ++i) {
+        Supplier supplier = test::randomSupplier(random, i, static_cast<int>(random() % 8));
+        std::stringstream file;
+        supplier.saveToFile(file);
+        Supplier loaded;
+        loaded.loadFromFile(file);
+
+        std::string expected, actual;
+        TextWriter(expected).object("Supplier", supplier);
+        TextWriter(actual).object("Supplier", loaded);
+        test::checkSameDump(expected, actual);
+    }
+}
+
+// A shard whose files predate the totals is recounted once at load
+TEST_CASE(missingTotalsAreRecounted) {
+    std::mt19937 random(3);
+    test::StoreShape shape;
+    shape.suppliers = 40;
+    DataStore store(4);
+    test::fillStore(store, random, shape);
+    test::saveStore(store);
+
+    for (size_t shard = 0; shard < store.getShardCount(); shard += 2) {
+        std::remove(store.getShard(shard).getFiles().aggregates.c_str());
+    }
+    DataStore loaded(4);
+    test::loadStore(loaded);
+    test::checkTotalsMatchOrders(loaded);
+    CHECK_EQUAL(store.orderTotals().amountUnits, loaded.orderTotals().amountUnits);
+}
+
+// A damaged file is reported, not half-loaded, and the previous save
+// still loads
+TEST_CASE(damagedFileFailsTheLoad) {
+    std::mt19937 random(9);
+    DataStore store(1);
+    test::fillStore(store, random, test::StoreShape());
+    test::saveStore(store);
+    test::saveStore(store);
+
+    std::string path = store.getShard(0).getFiles().orders;
+    std::string text;
+    {
+        std::ifstream in(path.c_str(), std::ios::binary);
+        std::stringstream contents;
+        contents << in.rdbuf();
+        text = contents.str();
+    }
+    text[text.size() / 2] ^= 0x20;
+    {
+        std::ofstream out(path.c_str(), std::ios::binary | std::ios::trunc);
+        out << text;
+    }
+
+    DataStore loaded(1);
+    bool threw = false;
+    try {
+        DataPersistence::readFiles(loaded, false);
+    } catch (const std::exception&) {
+        threw = true;
+    }
+    CHECK(threw);
+
+    DataStore fromBackup(1);
+    CHECK(DataPersistence::readFiles(fromBackup, true));
+    test::checkSameDump(test::dumpShards(store), test::dumpShards(fromBackup));
+}
+
+// Compressed blocks round-trip, and a size header the rest of the block
+// cannot stand for is refused before anything is allocated for it
+TEST_CASE(compressedBlocksRejectImpossibleSizes) {
+    std::mt19937 random(27);
+    for (int round = 0; round < 50; ++round) {
+        std::string text;
+        size_t length = random() % 5000;
+        for (size_t i = 0; i < length; ++i) {
+            text += static_cast<char>('a' + random() % (1 + round % 8));
+        }
+        std::string packed = LzCodec::compress(text);
+        CHECK(LzCodec::decompress(packed) == text);
+
+        const uint32_t SIZES[] = { 0xFFFFFFFFu, static_cast<uint32_t>(text.size() + 1) };
+        for (size_t s = 0; s < sizeof(SIZES) / sizeof(SIZES[0]); ++s) {
+            std::string damaged = packed;
+            std::memcpy(&damaged[0], &SIZES[s], sizeof(SIZES[s]));
+            bool threw = false;
+            try {
+                LzCodec::decompress(damaged);
+            } catch (const std::runtime_error&) {
+                threw = true;
+            }
+            CHECK(threw);
+        }
+    }
+}
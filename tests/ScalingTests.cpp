@@ -0,0 +1,156 @@
+#include <random>
+#include <chrono>
+#include <functional>
+#include <sstream>
+#include <memory>
+#include "TestHarness.h"
+#include "TestData.h"
+#include "DataPersistence.h"
+
+// Each operation is timed at a size and at four times that size; a
+// near-linear one takes about four times as long, a quadratic one
+// sixteen. The limits leave room for noise and fixed costs but fail on
+// a complexity regression. Absolute budgets are generous enough for an
+// unoptimized build on a slow machine.
+namespace {
+
+const size_t SMALL = 300;
+const size_t GROWTH = 4;
+const double MAX_TIME_RATIO = 10.0;
+const double MAX_MEMORY_RATIO = GROWTH * 1.25;
+
+// Fastest of a few runs, in milliseconds, to keep scheduler noise out;
+// prepare runs untimed before each one
+double fastestRun(const std::function<void()>& prepare, const std::function<void()>& run) {
+    typedef std::chrono::steady_clock Clock;
+    const int RUNS = 3;
+    double best = 0;
+    for (int i = 0; i < RUNS; ++i) {
+        prepare();
+        Clock::time_point start = Clock::now();
+        run();
+        double ms = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+        if (i == 0 || ms < best) {
+            best = ms;
+        }
+    }
+    return best;
+}
+
+double fastestRun(const std::function<void()>& run) {
+    return fastestRun([]() {}, run);
+}
+
+void checkGrowth(const char* what, double small, double large, double maxRatio) {
+    // Below a millisecond the ratio is mostly noise
+    double ratio = large / (small > 1.0 ? small : 1.0);
+    if (ratio > maxRatio) {
+        std::ostringstream message;
+        message << what << " grew " << ratio << "x for " << GROWTH << "x the data ("
+                << small << " -> " << large << "), limit " << maxRatio << "x";
+        test::fail(__FILE__, __LINE__, message.str());
+    }
+}
+
+test::StoreShape shapeOf(size_t suppliers) {
+    test::StoreShape shape;
+    shape.suppliers = suppliers;
+    shape.trackedStockPercent = 0;
+    shape.cancelPercent = 0;
+    return shape;
+}
+
+double timeSaveAndLoad(size_t suppliers, double& loadMs) {
+    std::mt19937 random(1);
+    DataStore store(4);
+    test::fillStore(store, random, shapeOf(suppliers));
+    double saveMs = fastestRun([&]() { DataPersistence::saveSnapshot(store.snapshot()); });
+    loadMs = fastestRun([&]() {
+        DataStore loaded(4);
+        DataPersistence::readFiles(loaded, false);
+        if (loaded.getOrderCount() != store.getOrderCount()) {
+            test::fail(__FILE__, __LINE__, "reloaded order count differs");
+        }
+    });
+    return saveMs;
+}
+
+}
+
+TEST_CASE(saveAndLoadScaleLinearly) {
+    const double LOAD_BUDGET_MS = 10000;
+    double smallLoad = 0, largeLoad = 0;
+    double smallSave = timeSaveAndLoad(SMALL, smallLoad);
+    double largeSave = timeSaveAndLoad(SMALL * GROWTH, largeLoad);
+    checkGrowth("save", smallSave, largeSave, MAX_TIME_RATIO);
+    checkGrowth("load", smallLoad, largeLoad, MAX_TIME_RATIO);
+    CHECK(largeLoad < LOAD_BUDGET_MS);
+}
+
+// Placing orders checks each against the stored ones for duplicates;
+// that must stay a lookup, not a scan
+TEST_CASE(placingOrdersScalesLinearly) {
+    const int ORDERS_PER_SUPPLIER = 8;
+    double ms[2];
+    for (int run = 0; run < 2; ++run) {
+        size_t suppliers = run == 0 ? SMALL : SMALL * GROWTH;
+        std::unique_ptr<DataStore> store;
+        std::vector<Order> orders;
+        ms[run] = fastestRun([&]() {
+            // A fresh store each time; only the inserts are measured
+            store.reset();
+            store.reset(new DataStore(4));
+            std::mt19937 random(2);
+            test::StoreShape shape = shapeOf(suppliers);
+            shape.ordersPerSupplier = 0;
+            test::fillStore(*store, random, shape);
+            orders.clear();
+            for (size_t i = 0; i < suppliers * ORDERS_PER_SUPPLIER; ++i) {
+                orders.push_back(test::randomOrder(random, *store, static_cast<int>(i % suppliers)));
+            }
+        }, [&]() {
+            for (size_t i = 0; i < orders.size(); ++i) {
+                store->addOrder(orders[i]);
+            }
+        });
+    }
+    checkGrowth("placing orders", ms[0], ms[1], MAX_TIME_RATIO);
+}
+
+TEST_CASE(addingOrderLinesScalesLinearly) {
+    std::mt19937 random(3);
+    DataStore store(1);
+    store.addSupplier(test::randomSupplier(random, 0, static_cast<int>(SMALL * GROWTH * 4)));
+
+    double ms[2];
+    for (int run = 0; run < 2; ++run) {
+        size_t lineCount = (run == 0 ? SMALL : SMALL * GROWTH) * 4;
+        std::vector<std::pair<std::shared_ptr<const OpticalMaterial>, int> > lines;
+        for (size_t i = 0; i < lineCount; ++i) {
+            lines.push_back(std::make_pair(store.resolveMaterial(0, static_cast<int>(i)), 1));
+        }
+        ms[run] = fastestRun([&]() {
+            Order order(store.getSupplier(0));
+            order.addItems(lines);
+        });
+    }
+    checkGrowth("adding order lines", ms[0], ms[1], MAX_TIME_RATIO);
+}
+
+// Memory grows with the records and each kind stays within its budget
+TEST_CASE(memoryPerRecordStaysWithinBudget) {
+    const double MAX_BYTES_PER_SUPPLIER = 1024;
+    const double MAX_BYTES_PER_ORDER = 1024;
+
+    size_t totals[2];
+    for (int run = 0; run < 2; ++run) {
+        std::mt19937 random(4);
+        DataStore store(4);
+        test::fillStore(store, random, shapeOf(run == 0 ? SMALL : SMALL * GROWTH));
+        MemoryUsage usage = store.memoryUsage();
+        CHECK(usage.suppliers.bytesPerRecord() < MAX_BYTES_PER_SUPPLIER);
+        CHECK(usage.orders.bytesPerRecord() < MAX_BYTES_PER_ORDER);
+        totals[run] = usage.totalBytes();
+    }
+    checkGrowth("memory", static_cast<double>(totals[0]), static_cast<double>(totals[1]), MAX_MEMORY_RATIO);
+}
@@ -0,0 +1,125 @@
+#include <atomic>
+#include <random>
+#include <thread>
+#include <map>
+#include "TestHarness.h"
+#include "TestData.h"
+
+// Threads ordering from the same suppliers at once, while price changes
+// keep resetting the stock counters, never take more units than there
+// are: every level ends at what it started with less the units of the
+// stored orders. A reader looks the suppliers up all the while.
+TEST_CASE(concurrentOrdersNeverOversell) {
+    const size_t SUPPLIERS = 12;
+    const int STOCK = 60;
+    const int THREADS = 8;
+    std::mt19937 random(42);
+    DataStore store(2);
+    for (size_t i = 0; i < SUPPLIERS; ++i) {
+        store.addSupplier(test::randomSupplier(random, i, 4));
+        // The last material stays untracked; its price changes below
+        for (int m = 0; m < 3; ++m) {
+            store.setStock(static_cast<int>(i), store.getSupplier(static_cast<int>(i)).getMaterial(m).getId(), STOCK);
+        }
+    }
+
+    // Built up front: the threads only place them
+    std::vector<std::vector<Order> > batches(THREADS);
+    for (int t = 0; t < THREADS; ++t) {
+        for (int o = 0; o < 150; ++o) {
+            batches[t].push_back(test::randomOrder(random, store, static_cast<int>(random() % SUPPLIERS)));
+        }
+    }
+
+    std::vector<std::string> bulstats, names;
+    for (size_t i = 0; i < SUPPLIERS; ++i) {
+        bulstats.push_back(store.getSupplier(static_cast<int>(i)).getBulstat());
+        names.push_back(store.getSupplier(static_cast<int>(i)).getName());
+    }
+
+    std::vector<size_t> placed(THREADS), shortages(THREADS);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < THREADS; ++t) {
+        threads.push_back(std::thread([&, t]() {
+            for (size_t o = 0; o < batches[t].size(); ++o) {
+                try {
+                    // Half the threads go through the batch path
+                    if (t % 2 == 0) {
+                        placed[t] += store.addOrder(batches[t][o]) ? 1 : 0;
+                    } else {
+                        std::vector<std::string> errors;
+                        placed[t] += store.addOrders(std::vector<Order>(1, batches[t][o]), &errors);
+                        shortages[t] += errors.size();
+                    }
+                } catch (const InsufficientStockError&) {
+                    ++shortages[t];
+                }
+            }
+        }));
+    }
+    std::thread repricer([&]() {
+        std::mt19937 local(7);
+        for (int i = 0; i < 200; ++i) {
+            int supplier = static_cast<int>(local() % SUPPLIERS);
+            MaterialChange change;
+            change.kind = MaterialChange::UPDATE_PRICE;
+            change.materialId = 4;
+            change.price = 10.0 + i;
+            store.applyCatalogDelta(supplier, std::vector<MaterialChange>(1, change));
+        }
+    });
+    std::atomic<bool> writing(true);
+    size_t misses = 0;
+    std::thread reader([&]() {
+        while (writing.load()) {
+            for (size_t i = 0; i < SUPPLIERS; ++i) {
+                int found = store.findSupplier(bulstats[i]);
+                if (found == -1 || store.getSupplier(found).getBulstat() != bulstats[i] ||
+                    store.searchSuppliers(names[i], 1).empty()) {
+                    ++misses;
+                }
+            }
+            for (size_t shard = 0; shard < store.getShardCount(); ++shard) {
+                CowVector<Order> orders = store.getShard(shard).getOrders();
+                misses += orders.size() > 0 && orders[orders.size() - 1].getOrderId().empty() ? 1 : 0;
+            }
+        }
+    });
+    for (size_t t = 0; t < threads.size(); ++t) {
+        threads[t].join();
+    }
+    repricer.join();
+    writing.store(false);
+    reader.join();
+    CHECK_EQUAL(0, static_cast<int>(misses));
+
+    size_t placedTotal = 0, shortTotal = 0;
+    for (int t = 0; t < THREADS; ++t) {
+        placedTotal += placed[t];
+        shortTotal += shortages[t];
+    }
+    CHECK_EQUAL(static_cast<int>(placedTotal), store.getOrderCount());
+    // The stock runs out well before the orders do
+    CHECK(shortTotal > 0);
+
+    std::map<std::pair<std::string, unsigned int>, int> ordered;
+    for (size_t shard = 0; shard < store.getShardCount(); ++shard) {
+        const CowVector<Order> orders = store.getShard(shard).getOrders();
+        for (size_t o = 0; o < orders.size(); ++o) {
+            const std::vector<OrderItem>& items = orders[o].getItems();
+            for (size_t i = 0; i < items.size(); ++i) {
+                ordered[std::make_pair(orders[o].getSupplierBulstat(), items[i].material->getId())] +=
+                    items[i].quantity;
+            }
+        }
+    }
+    for (size_t i = 0; i < SUPPLIERS; ++i) {
+        const Supplier supplier = store.getSupplier(static_cast<int>(i));
+        for (int m = 0; m < 3; ++m) {
+            unsigned int id = supplier.getMaterial(m).getId();
+            int onHand = supplier.getStock(id);
+            CHECK(onHand >= 0);
+            CHECK_EQUAL(STOCK, onHand + ordered[std::make_pair(supplier.getBulstat(), id)]);
+        }
+    }
+}
@@ -0,0 +1,207 @@
+#include "TestData.h"
+#include <cstdio>
+#include <limits>
+#include <sstream>
+#include "TestHarness.h"
+#include "DataPersistence.h"
+#include "DataFile.h"
+#include "ModelReflection.h"
+
+namespace {
+
+const char* NAMES[] = { "Optika", "Vision, Ltd.", "\"Lensa\" & Co", "Оптика ООД", "Fokus 2000" };
+const char* CITIES[] = { "Sofia", "Plovdiv", "Varna - port", "Бургас", "Ruse (north)" };
+const char* TYPES[] = { "Lens", "Contact lens", "Blank" };
+const char* GLASSES[] = { "CR39", "Polycarbonate", "Trivex", "Crown glass", "Стъкло 1.6" };
+
+// A value with four decimals, the precision materials are stored with
+double randomDecimal(std::mt19937& random, double from, unsigned int steps) {
+    return from + (random() % steps) / 10000.0;
+}
+
+}
+
+test::StoreShape::StoreShape()
+    : suppliers(50), materialsPerSupplier(6), ordersPerSupplier(4),
+      trackedStockPercent(30), priceChangePercent(30), cancelPercent(10) {}
+
+Supplier test::randomSupplier(std::mt19937& random, size_t number, int materialCount) {
+    char bulstat[32], phone[32];
+    std::snprintf(bulstat, sizeof(bulstat), "%09lu", 100000000UL + static_cast<unsigned long>(number));
+    std::snprintf(phone, sizeof(phone), "08%08lu", static_cast<unsigned long>(number));
+    Supplier supplier(bulstat, std::string(NAMES[random() % 5]) + " " + std::to_string(number),
+                      CITIES[random() % 5], phone);
+    for (int m = 0; m < materialCount; ++m) {
+        supplier.addMaterial(OpticalMaterial(TYPES[random() % 3], randomDecimal(random, 1.0, 30000),
+                                             randomDecimal(random, -6.0, 120001),
+                                             GLASSES[random() % 5], randomDecimal(random, 0.5, 2000000)));
+    }
+    return supplier;
+}
+
+Order test::randomOrder(std::mt19937& random, const DataStore& store, int supplierIndex) {
+    const Supplier& supplier = store.getSupplier(supplierIndex);
+    Order order(supplier);
+    int lineCount = 1 + static_cast<int>(random() % 4);
+    for (int l = 0; l < lineCount; ++l) {
+        int material = static_cast<int>(random() % supplier.getMaterialCount());
+        order.addItem(store.resolveMaterial(supplierIndex, material), 1 + static_cast<int>(random() % 10));
+    }
+    return order;
+}
+
+size_t test::fillStore(DataStore& store, std::mt19937& random, const StoreShape& shape) {
+    size_t placed = 0;
+    for (size_t i = 0; i < shape.suppliers; ++i) {
+        store.addSupplier(randomSupplier(random, i, shape.materialsPerSupplier));
+        int supplierIndex = static_cast<int>(i);
+        const Supplier& supplier = store.getSupplier(supplierIndex);
+        for (int m = 0; m < supplier.getMaterialCount(); ++m) {
+            if (static_cast<int>(random() % 100) < shape.trackedStockPercent) {
+                store.setStock(supplierIndex, supplier.getMaterial(m).getId(), 5 + static_cast<int>(random() % 40));
+            }
+        }
+
+        for (int o = 0; o < shape.ordersPerSupplier; ++o) {
+            // Later orders then point at a newer catalog version
+            if (o == shape.ordersPerSupplier / 2 &&
+                static_cast<int>(random() % 100) < shape.priceChangePercent) {
+                MaterialChange change;
+                change.kind = MaterialChange::UPDATE_PRICE;
+                change.materialId = store.getSupplier(supplierIndex).getMaterial(0).getId();
+                change.price = randomDecimal(random, 0.5, 2000000);
+                store.applyCatalogDelta(supplierIndex, std::vector<MaterialChange>(1, change));
+            }
+
+            Order order = randomOrder(random, store, supplierIndex);
+            try {
+                if (!store.addOrder(order)) {
+                    continue;
+                }
+            } catch (const InsufficientStockError&) {
+                continue;
+            }
+            ++placed;
+            if (static_cast<int>(random() % 100) < shape.cancelPercent) {
+                store.cancelOrder(order);
+            }
+        }
+    }
+    return placed;
+}
+
+void test::rewriteOrders(const DataStore& store, size_t shard, const std::string& orderDate,
+                         const std::string& orderId) {
+    DataSnapshot snapshot = store.snapshot();
+    std::vector<Order> orders(snapshot.shards[shard].orders.begin(), snapshot.shards[shard].orders.end());
+    std::string text;
+    TextWriter(text).sequence("Orders", orders);
+    std::istringstream lines(text);
+    std::string line, rewritten;
+    while (std::getline(lines, line)) {
+        bool isId = line.size() == 8 && line.compare(0, 3, "ORD") == 0 &&
+                    line.find_first_not_of("0123456789", 3) == std::string::npos;
+        bool isDate = line.size() == 19 && line[4] == '-' && line[7] == '-' && line[13] == ':';
+        rewritten += isId && !orderId.empty() ? orderId : (isDate ? orderDate : line);
+        rewritten += '\n';
+    }
+    DataFileWriter file(store.getShard(shard).getFiles().orders);
+    file.commit(rewritten);
+}
+
+void test::saveStore(DataStore& store) {
+    store.archiveColdOrders();
+    DataPersistence::saveSnapshot(store.snapshot());
+    store.truncateChangeLogs();
+}
+
+bool test::loadStore(DataStore& loaded) {
+    bool ordersLoaded = DataPersistence::readFiles(loaded, false);
+    loaded.loadArchiveManifests();
+    loaded.rebuildMissingAggregates();
+    loaded.archiveColdOrders();
+    return ordersLoaded;
+}
+
+std::string test::dumpShards(const DataStore& store) {
+    DataSnapshot snapshot = store.snapshot();
+    std::string text;
+    for (size_t shard = 0; shard < snapshot.shards.size(); ++shard) {
+        const ShardSnapshot& data = snapshot.shards[shard];
+        text += "Shard " + std::to_string(shard) + "\n";
+        TextWriter writer(text);
+        writer.sequence("Suppliers", data.suppliers);
+        writer.sequence("Orders", data.orders);
+        MaterialCatalog::saveEntries(text, data.catalog);
+    }
+    return text;
+}
+
+void test::checkSameDump(const std::string& expected, const std::string& actual) {
+    std::istringstream expectedLines(expected), actualLines(actual);
+    std::string expectedLine, actualLine;
+    for (size_t line = 1; ; ++line) {
+        bool moreExpected = static_cast<bool>(std::getline(expectedLines, expectedLine));
+        bool moreActual = static_cast<bool>(std::getline(actualLines, actualLine));
+        if (!moreExpected && !moreActual) {
+            return;
+        }
+        if (moreExpected != moreActual || expectedLine != actualLine) {
+            fail(__FILE__, __LINE__, "dumps differ at line " + std::to_string(line) + ": \"" +
+                 (moreActual ? actualLine : "<end>") + "\", expected \"" +
+                 (moreExpected ? expectedLine : "<end>") + "\"");
+        }
+    }
+}
+
+void test::checkTotalsMatchOrders(const DataStore& store) {
+    OrderAggregates recounted;
+    DataSnapshot snapshot = store.snapshot();
+    for (size_t shard = 0; shard < snapshot.shards.size(); ++shard) {
+        const CowVector<Order>& orders = snapshot.shards[shard].orders;
+        for (size_t i = 0; i < orders.size(); ++i) {
+            if (!orders[i].isCancelled()) {
+                recounted.add(orders[i]);
+            }
+        }
+    }
+    std::vector<ArchiveSegment> segments = store.getArchiveSegments();
+    for (size_t s = 0; s < segments.size(); ++s) {
+        std::vector<Order> archived = store.loadArchivedOrders(segments[s].period);
+        for (size_t i = 0; i < archived.size(); ++i) {
+            if (!archived[i].isCancelled()) {
+                recounted.add(archived[i]);
+            }
+        }
+    }
+
+    AggregateTotals overall = store.orderTotals();
+    CHECK_EQUAL(recounted.getOverall().orderCount, overall.orderCount);
+    CHECK_EQUAL(recounted.getOverall().amountUnits, overall.amountUnits);
+
+    const size_t ALL = std::numeric_limits<size_t>::max();
+    std::vector<SupplierSpend> suppliers = recounted.allSupplierSpend();
+    CHECK_EQUAL(suppliers.size(), store.topSuppliers(ALL).size());
+    for (size_t i = 0; i < suppliers.size(); ++i) {
+        AggregateTotals spend = store.supplierSpend(suppliers[i].bulstat);
+        CHECK_EQUAL(suppliers[i].totals.orderCount, spend.orderCount);
+        CHECK_EQUAL(suppliers[i].totals.amountUnits, spend.amountUnits);
+    }
+
+    std::vector<MaterialDemand> materials = recounted.allMaterialDemand();
+    CHECK_EQUAL(materials.size(), store.topMaterials(ALL).size());
+    for (size_t i = 0; i < materials.size(); ++i) {
+        MaterialDemand demand = store.materialDemand(materials[i].type, materials[i].materialName);
+        CHECK_EQUAL(materials[i].quantity, demand.quantity);
+        CHECK_EQUAL(materials[i].amountUnits, demand.amountUnits);
+    }
+
+    std::vector<DayRow> days = recounted.recentDays(ALL);
+    std::vector<DayRow> storedDays = store.recentDays(ALL);
+    CHECK_EQUAL(days.size(), storedDays.size());
+    for (size_t i = 0; i < days.size(); ++i) {
+        CHECK_EQUAL(days[i].day, storedDays[i].day);
+        CHECK_EQUAL(days[i].totals.orderCount, storedDays[i].totals.orderCount);
+        CHECK_EQUAL(days[i].totals.amountUnits, storedDays[i].totals.amountUnits);
+    }
+}
@@ -0,0 +1,57 @@
+#ifndef TEST_DATA_H
+#define TEST_DATA_H
+
+#include <string>
+#include <random>
+#include "DataStore.h"
+
+// Random data sets for the property and scaling tests. Every generator
+// takes the random engine, so a failing seed reproduces the same data.
+namespace test {
+
+struct StoreShape {
+    size_t suppliers;
+    int materialsPerSupplier;
+    int ordersPerSupplier;
+    // Chance in percent that a material has tracked stock, that a supplier
+    // gets a price change after its first orders, and that an order is
+    // cancelled again
+    int trackedStockPercent;
+    int priceChangePercent;
+    int cancelPercent;
+
+    StoreShape();
+};
+
+// Supplier number `number` with random materials; names and locations
+// mix spaces, punctuation and Cyrillic to exercise the text codec
+Supplier randomSupplier(std::mt19937& random, size_t number, int materialCount);
+// 1-4 random lines from the supplier's current materials
+Order randomOrder(std::mt19937& random, const DataStore& store, int supplierIndex);
+// Fills an empty store; returns the number of orders placed (duplicates
+// and orders short on stock are not counted)
+size_t fillStore(DataStore& store, std::mt19937& random, const StoreShape& shape);
+
+// Writes the shard's current orders to its orders file with every order
+// dated orderDate and, unless orderId is empty, numbered orderId, as
+// random ids and per-second dates can collide. The saved totals are left
+// as they were.
+void rewriteOrders(const DataStore& store, size_t shard, const std::string& orderDate,
+                   const std::string& orderId = "");
+
+// What the menu's save does: archive, write the snapshot, clear the logs
+void saveStore(DataStore& store);
+// What startup does, into an empty store with the saved shard count
+bool loadStore(DataStore& loaded);
+
+// Canonical text of each shard's suppliers, orders and catalog, in the
+// data file format; equal dumps mean equal data sets
+std::string dumpShards(const DataStore& store);
+// Fails at the first line where two dumps differ
+void checkSameDump(const std::string& expected, const std::string& actual);
+// Fails unless the store's running totals match a recount of its orders
+void checkTotalsMatchOrders(const DataStore& store);
+
+}
+
+#endif
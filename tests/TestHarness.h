@@ -0,0 +1,56 @@
+#ifndef TEST_HARNESS_H
+#define TEST_HARNESS_H
+
+#include <string>
+#include <vector>
+#include <sstream>
+#include <stdexcept>
+#include <functional>
+
+// Self-registering test cases for make test. A case is a function that
+// throws on failure; CHECK and CHECK_EQUAL throw TestFailure with the
+// file, line and what went wrong. Each case runs in a fresh directory of
+// its own, so cases that save data files do not see each other's.
+struct TestFailure : public std::runtime_error {
+    explicit TestFailure(const std::string& message) : std::runtime_error(message) {}
+};
+
+struct TestCase {
+    std::string name;
+    std::function<void()> run;
+};
+
+class TestRegistry {
+public:
+    static std::vector<TestCase>& all();
+    static bool add(const std::string& name, const std::function<void()>& run);
+};
+
+namespace test {
+
+void fail(const char* file, int line, const std::string& message);
+
+template <typename Expected, typename Actual>
+void checkEqual(const Expected& expected, const Actual& actual, const char* what,
+                const char* file, int line) {
+    if (!(expected == actual)) {
+        std::ostringstream message;
+        message << what << " is " << actual << ", expected " << expected;
+        fail(file, line, message.str());
+    }
+}
+
+}
+
+#define TEST_CASE(name) \
+    static void name(); \
+    static const bool name##Registered = TestRegistry::add(#name, name); \
+    static void name()
+
+#define CHECK(condition) \
+    do { if (!(condition)) test::fail(__FILE__, __LINE__, "CHECK(" #condition ") failed"); } while (0)
+
+#define CHECK_EQUAL(expected, actual) \
+    test::checkEqual((expected), (actual), #actual, __FILE__, __LINE__)
+
+#endif
@@ -0,0 +1,108 @@
+#include "TestHarness.h"
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <sys/stat.h>
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <unistd.h>
+#endif
+
+namespace {
+
+bool makeDirectory(const std::string& path) {
+#ifdef _WIN32
+    return _mkdir(path.c_str()) == 0;
+#else
+    return mkdir(path.c_str(), 0755) == 0;
+#endif
+}
+
+bool changeDirectory(const std::string& path) {
+#ifdef _WIN32
+    return _chdir(path.c_str()) == 0;
+#else
+    return chdir(path.c_str()) == 0;
+#endif
+}
+
+bool selected(const std::string& name, int argc, char* argv[]) {
+    if (argc < 2) {
+        return true;
+    }
+    for (int i = 1; i < argc; ++i) {
+        if (name == argv[i]) {
+            return true;
+        }
+    }
+    return false;
+}
+
+}
+
+std::vector<TestCase>& TestRegistry::all() {
+    static std::vector<TestCase> cases;
+    return cases;
+}
+
+bool TestRegistry::add(const std::string& name, const std::function<void()>& run) {
+    TestCase testCase;
+    testCase.name = name;
+    testCase.run = run;
+    all().push_back(testCase);
+    return true;
+}
+
+void test::fail(const char* file, int line, const std::string& message) {
+    std::ostringstream where;
+    where << file << ":" << line << ": " << message;
+    throw TestFailure(where.str());
+}
+
+// Runs every case, or the ones named on the command line, from the
+// current directory; make test starts it in an emptied build/test-data
+int main(int argc, char* argv[]) {
+    typedef std::chrono::steady_clock Clock;
+
+    size_t run = 0;
+    std::vector<std::string> failed;
+    const std::vector<TestCase>& cases = TestRegistry::all();
+    for (size_t i = 0; i < cases.size(); ++i) {
+        if (!selected(cases[i].name, argc, argv)) {
+            continue;
+        }
+        ++run;
+
+        Clock::time_point start = Clock::now();
+        std::string error;
+        if (!makeDirectory(cases[i].name) || !changeDirectory(cases[i].name)) {
+            error = "cannot create the directory " + cases[i].name + " (left over from an earlier run?)";
+        } else {
+            try {
+                cases[i].run();
+            } catch (const std::exception& e) {
+                error = e.what();
+            }
+            if (!changeDirectory("..")) {
+                std::cerr << "[FATAL ERROR] cannot leave the directory " << cases[i].name << std::endl;
+                return 2;
+            }
+        }
+        double ms = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+
+        if (error.empty()) {
+            std::cout << "[OK] " << cases[i].name << " (" << std::fixed << std::setprecision(0)
+                      << ms << " ms)" << std::endl;
+        } else {
+            std::cout << "[FAILED] " << cases[i].name << ": " << error << std::endl;
+            failed.push_back(cases[i].name);
+        }
+    }
+
+    std::cout << "\n" << (run - failed.size()) << " of " << run << " test(s) passed" << std::endl;
+    for (size_t i = 0; i < failed.size(); ++i) {
+        std::cout << "  failed: " << failed[i] << std::endl;
+    }
+    return failed.empty() ? 0 : 1;
+}
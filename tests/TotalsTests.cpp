@@ -0,0 +1,130 @@
+#include <random>
+#include <cmath>
+#include "TestHarness.h"
+#include "TestData.h"
+#include "Transaction.h"
+
+namespace {
+
+double recomputedTotal(const Order& order) {
+    double total = 0.0;
+    const std::vector<OrderItem>& items = order.getItems();
+    for (size_t i = 0; i < items.size(); ++i) {
+        total += items[i].unitPrice * items[i].quantity;
+    }
+    return total;
+}
+
+void checkOrderTotals(const DataStore& store) {
+    DataSnapshot snapshot = store.snapshot();
+    for (size_t shard = 0; shard < snapshot.shards.size(); ++shard) {
+        const CowVector<Order>& orders = snapshot.shards[shard].orders;
+        for (size_t i = 0; i < orders.size(); ++i) {
+            CHECK(std::fabs(orders[i].getTotalPrice() - recomputedTotal(orders[i])) < 1e-6);
+        }
+    }
+}
+
+}
+
+// An order's total is the sum of its lines however the lines were added,
+// merged or removed
+TEST_CASE(orderTotalIsTheSumOfItsLines) {
+    std::mt19937 random(42);
+    DataStore store(1);
+    store.addSupplier(test::randomSupplier(random, 0, 12));
+    for (int round = 0; round < 500; ++round) {
+        Order order(store.getSupplier(0));
+        int steps = 1 + static_cast<int>(random() % 20);
+        for (int step = 0; step < steps; ++step) {
+            if (order.getItemCount() > 0 && random() % 4 == 0) {
+                order.removeItem(static_cast<int>(random() % order.getItemCount()));
+            } else if (random() % 2 == 0) {
+                order.addItem(store.resolveMaterial(0, static_cast<int>(random() % 12)),
+                              1 + static_cast<int>(random() % 50));
+            } else {
+                std::vector<std::pair<std::shared_ptr<const OpticalMaterial>, int> > lines;
+                for (int l = 0; l < 3; ++l) {
+                    lines.push_back(std::make_pair(store.resolveMaterial(0, static_cast<int>(random() % 12)),
+                                                   1 + static_cast<int>(random() % 50)));
+                }
+                order.addItems(lines);
+            }
+            CHECK(std::fabs(order.getTotalPrice() - recomputedTotal(order)) < 1e-6);
+        }
+    }
+}
+
+TEST_CASE(storedTotalsMatchTheOrders) {
+    const unsigned int SEEDS[] = { 3, 17, 99 };
+    for (size_t s = 0; s < sizeof(SEEDS) / sizeof(SEEDS[0]); ++s) {
+        std::mt19937 random(SEEDS[s]);
+        test::StoreShape shape;
+        shape.suppliers = 60;
+        shape.cancelPercent = 25;
+        DataStore store(3);
+        test::fillStore(store, random, shape);
+        checkOrderTotals(store);
+        test::checkTotalsMatchOrders(store);
+
+        test::saveStore(store);
+        DataStore loaded(3);
+        test::loadStore(loaded);
+        checkOrderTotals(loaded);
+        test::checkTotalsMatchOrders(loaded);
+    }
+}
+
+// Random edits, undos and redos keep the running totals equal to a
+// recount, and undoing everything returns to the starting point
+TEST_CASE(totalsSurviveUndoAndRedo) {
+    std::mt19937 random(77);
+    test::StoreShape shape;
+    shape.suppliers = 25;
+    DataStore store(2);
+    test::fillStore(store, random, shape);
+    AggregateTotals before = store.orderTotals();
+    std::string dumpBefore = test::dumpShards(store);
+
+    EditHistory history;
+    for (int step = 0; step < 300; ++step) {
+        int action = static_cast<int>(random() % 10);
+        if (action < 5) {
+            int supplierIndex = static_cast<int>(random() % store.getSupplierCount());
+            Transaction transaction(store, "order");
+            try {
+                transaction.addOrder(test::randomOrder(random, store, supplierIndex));
+            } catch (const InsufficientStockError&) {
+            }
+            history.record(transaction.commit());
+        } else if (action < 7) {
+            int supplierIndex = static_cast<int>(random() % store.getSupplierCount());
+            std::vector<Order> orders;
+            for (int o = 0; o < 5; ++o) {
+                orders.push_back(test::randomOrder(random, store, supplierIndex));
+            }
+            Transaction transaction(store, "batch");
+            transaction.addOrders(orders);
+            if (random() % 2 == 0) {
+                transaction.rollback();
+            } else {
+                history.record(transaction.commit());
+            }
+        } else if (action < 9 && history.canUndo()) {
+            history.undo(store);
+        } else if (history.canRedo()) {
+            history.redo(store);
+        }
+        if (step % 25 == 0) {
+            test::checkTotalsMatchOrders(store);
+        }
+    }
+    test::checkTotalsMatchOrders(store);
+
+    while (history.canUndo()) {
+        history.undo(store);
+    }
+    CHECK_EQUAL(before.orderCount, store.orderTotals().orderCount);
+    CHECK_EQUAL(before.amountUnits, store.orderTotals().amountUnits);
+    test::checkSameDump(dumpBefore, test::dumpShards(store));
+}
@@ -0,0 +1,70 @@
+#include <random>
+#include "TestHarness.h"
+#include "Validation.h"
+
+namespace {
+
+// Strings built from the characters the rules care about plus a few they
+// reject, of lengths that end inside, on and past the SIMD block widths
+std::vector<std::string> randomValues(std::mt19937& random, size_t count) {
+    const char alphabet[] = "0123456789012345678901234567890123456789+-() .x/\t\x80\xff";
+    const size_t alphabetSize = sizeof(alphabet) - 1;
+    std::vector<std::string> values(count);
+    for (size_t i = 0; i < count; ++i) {
+        size_t length = random() % 2 ? random() % 20 : random() % 72;
+        int mostlyDigits = random() % 2;
+        for (size_t c = 0; c < length; ++c) {
+            values[i] += mostlyDigits && random() % 16 ? static_cast<char>('0' + random() % 10)
+                                                      : alphabet[random() % alphabetSize];
+        }
+        if (length > 0 && random() % 64 == 0) {
+            values[i][random() % length] = '\0';
+        }
+    }
+    return values;
+}
+
+}
+
+// Every kernel this CPU runs gives each value the scalar check's error
+TEST_CASE(batchValidationMatchesScalar) {
+    std::mt19937 random(30);
+    std::vector<std::string> values = randomValues(random, 200000);
+    values.push_back("");
+    values.push_back("123456789");
+    values.push_back("+359 (2) 123-45.67");
+
+    const ValidationKernel kernels[] = { VALIDATION_BEST, VALIDATION_SCALAR, VALIDATION_SSE42, VALIDATION_AVX2 };
+    size_t checked = 0;
+    for (size_t k = 0; k < sizeof(kernels) / sizeof(kernels[0]); ++k) {
+        if (!Validation::hasKernel(kernels[k])) {
+            continue;
+        }
+        std::vector<const char*> bulstats = Validation::checkBulstats(values, kernels[k]);
+        std::vector<const char*> phones = Validation::checkPhoneNumbers(values, kernels[k]);
+        CHECK_EQUAL(values.size(), bulstats.size());
+        CHECK_EQUAL(values.size(), phones.size());
+        for (size_t i = 0; i < values.size(); ++i) {
+            if (bulstats[i] != Validation::checkBulstat(values[i]) ||
+                phones[i] != Validation::checkPhoneNumber(values[i])) {
+                test::fail(__FILE__, __LINE__, std::string(Validation::kernelName(kernels[k])) +
+                           " disagrees with the scalar check on \"" + values[i] + "\"");
+            }
+        }
+        ++checked;
+    }
+    CHECK(checked >= 2);
+
+    // Valid values are common enough to matter
+    std::vector<const char*> bulstats = Validation::checkBulstats(values);
+    std::vector<const char*> phones = Validation::checkPhoneNumbers(values);
+    size_t validBulstats = 0, validPhones = 0;
+    for (size_t i = 0; i < values.size(); ++i) {
+        validBulstats += bulstats[i] == 0;
+        validPhones += phones[i] == 0;
+    }
+    CHECK(validBulstats > 1000);
+    CHECK(validPhones > values.size() / 10);
+
+    CHECK(Validation::checkBulstats(std::vector<std::string>()).empty());
+}